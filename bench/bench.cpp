@@ -0,0 +1,913 @@
+// CPU micro-benchmarks for the tile, vegetation, animation, scene, world, loader, LOD, occlusion, uniform and job
+// system hot paths, then checks that jobs run exactly once and in order under contention and that steady-state
+// frames make no heap allocations (exits non-zero when either fails).
+// GL calls go to the stubs in mockGL.cpp, so this runs without a GPU or display.
+// Run from the build directory (assets are loaded from ../assets like main).
+//
+//   bench [--filter <substring>] [--samples <n>] [--json <file>]
+
+#include "mockGL.h"
+
+#include <shader.h>
+#include <tileManager.h>
+#include <vegetation.h>
+#include <gltfModel.h>
+#include <meshLod.h>
+#include <occlusionCuller.h>
+#include <staticBatch.h>
+#include <scene.h>
+#include <worldDatabase.h>
+#include <worldStreamer.h>
+#include <textureStreamer.h>
+#include <profiler.h>
+#include <allocations.h>
+#include <frameArena.h>
+#include <jobSystem.h>
+#include <simulation.h>
+#include <qualityGovernor.h>
+#include <dynamicResolution.h>
+#include <postProcess.h>
+#include <shadowAtlas.h>
+#include <lightShafts.h>
+#include <particleSystem.h>
+#include <light.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define close _close
+static const char* nullDevice = "NUL";
+#else
+#include <fcntl.h>
+#include <unistd.h>
+static const char* nullDevice = "/dev/null";
+#endif
+
+struct BenchResult
+{
+    std::string name;
+    int iterations;    // operations per sample
+    double medianNs;   // per operation
+    double minNs;
+    double p90Ns;
+};
+
+static std::vector<BenchResult> results;
+static const char* filter = nullptr;
+static int samples = 15;
+
+// Shaders report their compiles with printf, which redirecting std::cout
+// does not catch; this sends stdout itself away until restoreStdout
+static int hideStdout()
+{
+    fflush(stdout);
+    int saved = dup(1);
+    FILE* null = fopen(nullDevice, "w");
+    if (null) {
+        dup2(fileno(null), 1);
+        fclose(null);
+    }
+    return saved;
+}
+
+static void restoreStdout(int saved)
+{
+    if (saved < 0) return;
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+}
+
+// Times `iterations` calls of op per sample and keeps per-op statistics over
+// all samples. One extra sample is run first and discarded as warmup.
+static void runBench(const char* name, int iterations, const std::function<void()>& op)
+{
+    if (filter && !strstr(name, filter)) return;
+
+    std::vector<double> perOp;
+    for (int s = 0; s <= samples; ++s)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) op();
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        if (s > 0) perOp.push_back(elapsed.count() / iterations);
+    }
+
+    std::sort(perOp.begin(), perOp.end());
+    BenchResult r;
+    r.name = name;
+    r.iterations = iterations;
+    r.medianNs = perOp[perOp.size() / 2];
+    r.minNs = perOp.front();
+    r.p90Ns = perOp[(perOp.size() * 9) / 10];
+    results.push_back(r);
+
+    printf("%-36s %8d %14.1f %14.1f %14.1f\n", name, iterations, r.medianNs, r.minNs, r.p90Ns);
+    fflush(stdout);
+}
+
+static void benchTiles()
+{
+    // Every call crosses a tile boundary: spawns a column of tiles and
+    // periodically unloads the ones left behind
+    {
+        TileManager manager;
+        manager.initialise();
+        manager.texture_path = ""; // untextured, measures bookkeeping only
+        float x = 0.0f;
+        runBench("tiles/crossing", 200, [&]() {
+            x += manager.tileSize;
+            manager.updateTiles(glm::vec3(x, 0.0f, 0.0f));
+        });
+        manager.cleanup();
+    }
+
+    // Same with the terrain texture, loaded once and then shared through the texture cache
+    {
+        TileManager manager;
+        manager.initialise();
+        float x = 0.0f;
+        runBench("tiles/crossing_textured", 200, [&]() {
+            x += manager.tileSize;
+            manager.updateTiles(glm::vec3(x, 0.0f, 0.0f));
+        });
+        manager.cleanup();
+    }
+
+    // Frames that stay inside the current tile
+    {
+        TileManager manager;
+        manager.initialise();
+        manager.texture_path = "";
+        manager.updateTiles(glm::vec3(0.0f));
+        runBench("tiles/no_crossing", 100000, [&]() {
+            manager.updateTiles(glm::vec3(1.0f, 0.0f, 1.0f));
+        });
+        manager.cleanup();
+    }
+}
+
+static void benchVegetation()
+{
+    // placement of one tile with main's rules, as the vegetation worker runs it
+    TileManager terrain;
+    terrain.initialise();
+    std::vector<VegetationAsset> assets(2);
+    std::vector<ScatterRule> rules = {{0, 0.0001f, 0.9f, 1.1f, 0.3f, 0.0f, 14.0f}, {1, 0.006f, 1.5f, 3.5f, 0.6f, 0.7f, 0.0f}};
+    std::vector<ExclusionZone> exclusions = {{glm::vec2(0, -40), 16.0f}, {glm::vec2(0, 0), 30.0f}};
+    Vegetation::TileInstances instances;
+    int x = 0;
+    runBench("vegetation/scatter_tile", 200, [&]() {
+        Vegetation::scatter(x++, 3, rules, exclusions, assets, 0x5eed, 1.0f, terrain, instances);
+    });
+    runBench("vegetation/scatter_tile_dense", 20, [&]() {
+        Vegetation::scatter(x++, 3, rules, exclusions, assets, 0x5eed, 10.0f, terrain, instances);
+    });
+    terrain.cleanup();
+}
+
+static void benchAnimation()
+{
+    GLTFModel alien("../assets/green_alien/scene.gltf");
+    alien.isAnimated = true;
+    runBench("animation/alien_update", 2000, [&]() {
+        GetFrameArena().reset();  // its temporaries live in the frame arena, as in a frame
+        alien.updateAnimation(1.0f / 60.0f);
+    });
+}
+
+// The scene's systems over 100k entities: a field of transformed, bounded
+// pines, a thousand of which are animated aliens
+static void benchScene()
+{
+    static const char* names[] = {"scene/transforms_100k_serial", "scene/bounds_100k_serial", "scene/animate_1k_serial"};
+    if (filter && std::none_of(std::begin(names), std::end(names), [](const char* name) { return strstr(name, filter); })) return;
+
+    GLTFModel pine("../assets/pine_tree_-_ps1_low_poly/scene1.gltf");
+    pine.isAnimated = false;
+    GLTFModel alien("../assets/green_alien/scene.gltf");
+    alien.isAnimated = true;
+
+    const int count = 100000;
+    const int animated = 1000;
+    Scene scene;
+    scene.transforms.reserve(count);
+    scene.meshes.reserve(count);
+    scene.bounds.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        Entity e = scene.create();
+        float angle = i * 0.37f;
+        scene.addTransform(e, glm::vec3((i % 316) * 3.0f, 0.0f, (i / 316) * 3.0f), glm::angleAxis(angle, glm::vec3(0, 1, 0)), glm::vec3(1.0f + (i % 7) * 0.1f));
+        scene.addModel(e, i % (count / animated) == 0 ? alien : pine);
+    }
+
+    runBench("scene/transforms_100k", 5, [&]() {
+        // something moves every frame, so every world matrix is rebuilt
+        for (Transform& t : scene.transforms.values) t.position.y += 0.001f;
+        scene.updateTransforms();
+    });
+    runBench("scene/bounds_100k", 5, [&]() { scene.updateBounds(); });
+    runBench("scene/animate_1k", 5, [&]() { scene.animate(1.0f / 60.0f); });
+
+    // the same with every system on this thread
+    scene.parallelThreshold = SIZE_MAX;
+    runBench("scene/transforms_100k_serial", 5, [&]() { scene.updateTransforms(); });
+    runBench("scene/bounds_100k_serial", 5, [&]() { scene.updateBounds(); });
+    runBench("scene/animate_1k_serial", 5, [&]() {
+        GetFrameArena().reset();
+        scene.animate(1.0f / 60.0f);
+    });
+
+    pine.cleanup();
+    alien.cleanup();
+}
+
+// A 64x64-tile world, 25 pines and a lamp per tile, baked to .lwld: opening
+// it and streaming one tile should cost the same however big the world is
+static void benchWorld()
+{
+    static const char* names[] = {"world/open_4096_tiles", "world/find_tile", "world/stream_tile"};
+    if (filter && std::none_of(std::begin(names), std::end(names), [](const char* name) { return strstr(name, filter); })) return;
+
+    const char* sourcePath = "bench_world.txt";
+    {
+        std::ofstream source(sourcePath);
+        source << "tile-size 32\nmodel pine ../assets/pine_tree_-_ps1_low_poly/scene1.gltf static 1\n";
+        for (int x = 0; x < 64; ++x)
+            for (int z = 0; z < 64; ++z) {
+                for (int i = 0; i < 25; ++i)
+                    source << "instance pine " << x * 32 + (i % 5) * 6 - 12 << " 0 " << z * 32 + (i / 5) * 6 - 12 << " " << i * 14 << " -90 0 2\n";
+                source << "light point " << x * 32 << " 4 " << z * 32 << " 1 0.8 0.5 1 0.09 0.032\n";
+            }
+    }
+    std::vector<unsigned char> baked;
+    std::string bakedPath = bakedWorldPath(sourcePath);
+    if (!bakeWorld(sourcePath, baked)) return;
+    {
+        std::ofstream out(bakedPath, std::ios::binary);
+        out.write((const char*)baked.data(), baked.size());
+    }
+
+    WorldDatabase world;
+    runBench("world/open_4096_tiles", 200, [&]() {
+        world.close();
+        world.open(sourcePath);
+    });
+
+    int tile = 0;
+    runBench("world/find_tile", 100000, [&]() {
+        tile++;
+        if (!world.findTile(tile & 63, (tile >> 6) & 63)) abort();
+    });
+
+    GLTFModel pine("../assets/pine_tree_-_ps1_low_poly/scene1.gltf");
+    pine.isAnimated = false;
+    Scene scene;
+    WorldStreamer streamer;
+    streamer.models.resize(world.header->modelCount);
+    streamer.models[0].model = &pine;
+    streamer.initialise(world, scene);
+    runBench("world/stream_tile", 1000, [&]() {
+        tile++;
+        streamer.tileLoaded(tile & 63, (tile >> 6) & 63);
+        streamer.tileUnloaded(tile & 63, (tile >> 6) & 63);
+        // taken each frame by main
+        streamer.created.clear();
+        streamer.destroyed.clear();
+    });
+    streamer.cleanup();
+    world.close();
+    pine.cleanup();
+    std::remove(sourcePath);
+    std::remove(bakedPath.c_str());
+}
+
+static void benchAssembly(const char* name, const char* path, int iterations)
+{
+    if (filter && !strstr(name, filter)) return;
+
+    tinygltf::TinyGLTF loader;
+    tinygltf::Model model;
+    std::string err, warn;
+    if (!loader.LoadASCIIFromFile(&model, &err, &warn, path)) {
+        std::cerr << "Failed to load glTF: " << err << std::endl;
+        return;
+    }
+
+    std::vector<GLTFModel::Vertex> vertices;
+    std::vector<unsigned int> indices;
+    runBench(name, iterations, [&]() {
+        for (const auto& mesh : model.meshes)
+            for (const auto& primitive : mesh.primitives)
+                GLTFModel::assemblePrimitive(model, primitive, vertices, indices);
+    });
+}
+
+// One LOD step of every primitive, as GLTFModel's import runs it
+static void benchSimplify(const char* name, const char* path, int iterations)
+{
+    if (filter && !strstr(name, filter)) return;
+
+    tinygltf::TinyGLTF loader;
+    tinygltf::Model model;
+    std::string err, warn;
+    if (!loader.LoadASCIIFromFile(&model, &err, &warn, path)) {
+        std::cerr << "Failed to load glTF: " << err << std::endl;
+        return;
+    }
+
+    std::vector<std::vector<GLTFModel::Vertex>> vertices;
+    std::vector<std::vector<unsigned int>> indices;
+    for (const auto& mesh : model.meshes)
+        for (const auto& primitive : mesh.primitives) {
+            vertices.emplace_back();
+            indices.emplace_back();
+            GLTFModel::assemblePrimitive(model, primitive, vertices.back(), indices.back());
+        }
+
+    std::vector<unsigned int> level;
+    runBench(name, iterations, [&]() {
+        for (size_t i = 0; i < vertices.size(); ++i)
+            SimplifyMesh(vertices[i], indices[i], indices[i].size() / 6 * 3, level);
+    });
+}
+
+// The occlusion buffer of main's opening view: the active terrain tiles and
+// the cabin, then box tests against it
+static void benchOcclusion()
+{
+    if (filter && !strstr("occlusion/raster", filter) && !strstr("occlusion/test_boxes", filter)) return;
+
+    TileManager terrain;
+    terrain.initialise();
+    terrain.texture_path = "";
+    terrain.updateTiles(glm::vec3(0.0f));
+
+    GLTFModel cabin("../assets/rustic-cabin/scene.gltf");
+    glm::mat4 cabinTransform = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0, 8, -40)), glm::vec3(10.0f));
+
+    OcclusionCuller occlusion;
+    int terrainOccluder = occlusion.addTerrain(terrain, 8);
+    int cabinOccluder = occlusion.addModel(cabin);
+    occlusion.initialise();
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 10, 0), glm::vec3(0, 10, -1), glm::vec3(0, 1, 0));
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 1024.0f / 768.0f, 0.1f, 1000.0f);
+    auto frame = [&]() {
+        occlusion.clearOccluders();
+        terrain.addOccluders(occlusion, terrainOccluder);
+        occlusion.addOccluder(cabinOccluder, cabinTransform);
+        occlusion.begin(view, projection, 1024, 768);
+        occlusion.finish();
+    };
+    runBench("occlusion/raster", 200, frame);
+
+    // a field of tree-sized boxes behind and around the cabin
+    frame();
+    runBench("occlusion/test_boxes", 20, [&]() {
+        for (int z = 0; z < 32; ++z)
+            for (int x = 0; x < 32; ++x) {
+                glm::vec3 centre((x - 16) * 4.0f, 2.0f, -45.0f - z * 4.0f);
+                occlusion.isVisible(centre - glm::vec3(1.0f, 2.0f, 1.0f), centre + glm::vec3(1.0f, 2.0f, 1.0f));
+            }
+    });
+
+    occlusion.cleanup();
+    terrain.cleanup();
+}
+
+static void benchUniforms()
+{
+    Shader program;
+    program.ID = GlProgram(1);
+
+    // the per-light uniform block upload from main()
+    runBench("uniforms/light_array", 20000, [&]() {
+        for (int i = 0; i < 2; ++i)
+        {
+            std::string base = "lights[" + std::to_string(i) + "]";
+            program.setInt((base + ".type"), 2);
+            program.setVec3((base + ".position"), glm::vec3(0.0f));
+            program.setVec3((base + ".direction"), glm::vec3(0.0f, -1.0f, 0.0f));
+            program.setVec3((base + ".colour"), glm::vec3(1.0f));
+            program.setFloat((base + ".constant"), 1.0f);
+            program.setFloat((base + ".linear"), 0.014f);
+            program.setFloat((base + ".quadratic"), 0.0007f);
+            program.setFloat((base + ".cutoff"), 0.9f);
+            program.setFloat((base + ".outerCutoff"), 0.8f);
+        }
+    });
+
+    // the per-draw uniforms set for every model and tile
+    glm::mat4 model(1.0f);
+    runBench("uniforms/per_draw", 100000, [&]() {
+        program.setFloat("diffuseStrength", 1.0f);
+        program.setMatrix("model", &model[0][0]);
+        program.setBool("useSkinning", false);
+        program.setBool("useTexture", true);
+        program.setInt("textureSampler", 0);
+    });
+}
+
+// The same parallelFor with 1, 2, 4... threads (workers and the caller), up
+// to one per core and at least two, then the round trip of jobs that do
+// nothing. Leaves the job system as main() starts it.
+static void benchJobs()
+{
+    JobSystem& jobs = GetJobSystem();
+    const size_t count = 1 << 16;
+    std::vector<float> out(count);
+    float* values = out.data();
+    auto work = [values](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            float x = i * 0.001f, sum = 0.0f;
+            for (int k = 0; k < 64; ++k) sum += std::sin(x * k);
+            values[i] = sum;
+        }
+    };
+
+    int cores = std::max(2, (int)std::thread::hardware_concurrency());
+    char name[64];
+    for (int threads = 1; threads <= cores && threads <= JobSystem::maxWorkers + 1; threads *= 2) {
+        snprintf(name, sizeof(name), "jobs/parallel_for_%d_thread%s", threads, threads > 1 ? "s" : "");
+        if (filter && !strstr(name, filter)) continue;
+        jobs.shutdown();
+        jobs.initialise(threads - 1);
+        runBench(name, 5, [&]() { jobs.parallelFor(count, 256, work); });
+    }
+    jobs.shutdown();
+    jobs.initialise();
+
+    // per 256 jobs, submitted from this thread and waited on
+    runBench("jobs/empty_256", 100, [&]() {
+        JobCounter counter;
+        Job job;
+        job.function = [](void*, size_t, size_t) {};
+        job.counter = &counter;
+        for (int i = 0; i < 256; ++i) jobs.submit(job);
+        jobs.wait(counter);
+    });
+}
+
+// The job system with more workers than cores, so they are preempted in the
+// middle of a push or a steal: four threads submitting into the shared deque
+// at once (past its capacity), chains of jobs that depend on the stage
+// before, and jobs running parallelFors of their own. Returns false when a
+// job ran twice, never ran, or ran before what it depended on.
+static bool checkJobSystem()
+{
+    const char* name = "jobs/contention";
+    if (filter && !strstr(name, filter)) return true;
+
+    JobSystem& jobs = GetJobSystem();
+    jobs.shutdown();
+    jobs.initialise(std::max(3, (int)std::thread::hardware_concurrency() + 1));
+
+    const int rounds = 10;
+    int failures = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        // every slot bumped exactly once
+        const int submitters = 4;
+        const int perSubmitter = 20000;
+        std::vector<std::atomic<int>> runs(submitters * perSubmitter);
+        auto submitAll = [&](int submitter) {
+            JobCounter counter;
+            Job job;
+            job.function = [](void* data, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) static_cast<std::atomic<int>*>(data)[i].fetch_add(1);
+            };
+            job.data = runs.data();
+            job.counter = &counter;
+            for (int i = 0; i < perSubmitter; ++i) {
+                job.begin = (size_t)submitter * perSubmitter + i;
+                job.end = job.begin + 1;
+                jobs.submit(job);
+            }
+            jobs.wait(counter);
+        };
+        std::thread others[submitters - 1];
+        for (int t = 1; t < submitters; ++t) others[t - 1] = std::thread(submitAll, t);
+        submitAll(0);
+        for (std::thread& other : others) other.join();
+        int wrong = 0;
+        for (const std::atomic<int>& r : runs) wrong += r.load() != 1;
+
+        // each stage's jobs only once the whole stage before has finished
+        const int stages = 8;
+        const int width = 8;
+        struct Stages {
+            std::atomic<int> completed[stages];
+            std::atomic<int> early;
+        } chain;
+        for (std::atomic<int>& c : chain.completed) c = 0;
+        chain.early = 0;
+        JobCounter counters[stages];
+        Job job;
+        job.function = [](void* data, size_t stage, size_t) {
+            Stages& chain = *static_cast<Stages*>(data);
+            if (stage > 0 && chain.completed[stage - 1].load() != width) chain.early.fetch_add(1);
+            chain.completed[stage].fetch_add(1);
+        };
+        job.data = &chain;
+        for (int stage = 0; stage < stages; ++stage) {
+            job.begin = stage;
+            job.counter = &counters[stage];
+            for (int i = 0; i < width; ++i) {
+                if (stage == 0) jobs.submit(job);
+                else jobs.submitAfter(job, counters[stage - 1]);
+            }
+        }
+        for (JobCounter& counter : counters) jobs.wait(counter);
+        wrong += chain.early.load() + (chain.completed[stages - 1].load() != width);
+
+        // jobs waiting on jobs of their own
+        const int outer = 64;
+        const size_t inner = 10000;
+        std::vector<std::atomic<long long>> sums(outer);
+        jobs.parallelFor(outer, 1, [&](size_t begin, size_t end) {
+            for (size_t o = begin; o < end; ++o) {
+                std::atomic<long long>& sum = sums[o];
+                jobs.parallelFor(inner, 100, [&sum](size_t b, size_t e) {
+                    long long part = 0;
+                    for (size_t i = b; i < e; ++i) part += (long long)i;
+                    sum.fetch_add(part);
+                });
+            }
+        });
+        for (const std::atomic<long long>& sum : sums) wrong += sum.load() != (long long)(inner * (inner - 1) / 2);
+
+        failures += wrong > 0;
+    }
+
+    printf("%-36s %8d rounds %7d failed, %d workers, %llu stolen\n", name, rounds, failures, jobs.workerCount(), jobs.jobsStolen());
+    fflush(stdout);
+
+    jobs.shutdown();
+    jobs.initialise();
+    return failures == 0;
+}
+
+// main's frame, minus the window, against a scene of terrain, vegetation, the
+// batched cabin, the animated alien posed by the simulation thread, the ufo's
+// spot light and a lamp in the shadow atlas, and the particles, light shafts
+// and post chain, with the quality governor and dynamic resolution taking
+// samples. Once the vegetation of the loaded tiles is placed, frames whose
+// camera stays inside one tile must not touch the heap on any thread. Returns false when they do
+// (or the camera left its tile, which would make the check meaningless),
+// listing the profiler scopes the allocations were made in.
+static bool checkSteadyStateAllocations()
+{
+    const char* name = "steady_state/allocations";
+    if (filter && !strstr(name, filter)) return true;
+
+    Shader program;
+    program.ID = GlProgram(1);
+    Shader depth;
+    depth.ID = GlProgram(2);
+
+    int savedStdout = hideStdout();
+    TileManager terrain;
+    terrain.initialise();
+    terrain.texture_path = "";
+
+    GLTFModel cabin("../assets/rustic-cabin/scene.gltf");
+    glm::mat4 cabinTransform = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0, 8, -40)), glm::vec3(10.0f));
+    cabin.setTransform(cabinTransform);
+    GLTFModel alien("../assets/green_alien/scene.gltf");
+    alien.isAnimated = true;
+    Scene scene;
+    Entity alienEntity = scene.create();
+    scene.addTransform(alienEntity, glm::vec3(0, 0, -30), glm::quat(1, 0, 0, 0), glm::vec3(0.0035f));
+    scene.addModel(alienEntity, alien);
+    StaticBatch staticBatch;
+    staticBatch.add(cabin);
+    staticBatch.build();
+
+    // impostors are left out: baking them needs pixels back from the GPU
+    Vegetation vegetation;
+    VegetationAsset cabinAsset;
+    cabinAsset.model = &cabin;
+    cabinAsset.base = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0, 8, 0)), glm::vec3(10.0f));
+    vegetation.assets.push_back(cabinAsset);
+    vegetation.rules.push_back({0, 0.0001f, 0.9f, 1.1f, 0.3f, 0.0f, 14.0f});
+    vegetation.exclusions.push_back({glm::vec2(0, -40), 16.0f});
+    terrain.vegetation = &vegetation;
+    vegetation.initialise(terrain, program);
+
+    OcclusionCuller occlusion;
+    int terrainOccluder = occlusion.addTerrain(terrain, 8);
+    int cabinOccluder = occlusion.addModel(cabin);
+    vegetation.assets[0].occluder = cabinOccluder;
+    occlusion.initialise();
+
+    // the ufo's beam and the cabin's lamp, as in assets/world.txt
+    std::vector<Light> lights(2);
+    lights[0].type = (int)LightType::Spot;
+    lights[0].position = glm::vec3(0, 60, -40);
+    lights[0].direction = glm::vec3(0, -1, 0);
+    lights[0].colour = glm::vec3(2.25f, 18.75f, 1.5f);
+    lights[0].constant = 1.0f;
+    lights[0].linear = 0.014f;
+    lights[0].quadratic = 0.0007f;
+    lights[0].cutoff = std::cos(glm::radians(15.0f));
+    lights[0].outerCutoff = std::cos(glm::radians(20.0f));
+    lights[1].type = (int)LightType::Point;
+    lights[1].position = glm::vec3(6, 3, -26);
+    lights[1].direction = glm::vec3(0.0f);
+    lights[1].colour = glm::vec3(4.0f, 2.4f, 1.0f);
+    lights[1].constant = 1.0f;
+    lights[1].linear = 0.09f;
+    lights[1].quadratic = 0.032f;
+    lights[1].cutoff = 0.0f;
+    lights[1].outerCutoff = 0.0f;
+    ShadowAtlas shadowAtlas;
+    shadowAtlas.initialise();
+
+    PostProcess post;
+    post.initialise(1024, 768);
+    LightShafts lightShafts;
+    lightShafts.initialise(1024, 768);
+    ParticleSystem particles;
+    particles.capacity = 1024;
+    particles.lightCount = 2;
+    ParticleEmitter fireflies;
+    fireflies.centre = glm::vec3(0.0f, 2.0f, -25.0f);
+    fireflies.extent = glm::vec3(28.0f, 1.5f, 20.0f);
+    fireflies.wander = 0.6f;
+    fireflies.flicker = 1.0f;
+    fireflies.rate = 50.0f;
+    particles.emitters.push_back(fireflies);
+    particles.initialise();
+
+    // a budget no frame here misses, so both take their samples and decide
+    // every frame without changing a level (which re-streams the terrain)
+    QualityGovernor governor;
+    governor.enabled = true;
+    governor.targetMs = 1000.0f;
+    governor.highest = {terrain.renderDistance, 1.0f, 8, 1.0f};
+    governor.lowest = {1, 0.25f, 1, 4.0f};
+    governor.level = governor.levels;
+    DynamicResolution dynamicResolution;
+    dynamicResolution.enabled = true;
+    dynamicResolution.targetGpuMs = governor.targetMs;
+    dynamicResolution.initialise(1024, 768);
+    GpuTimer gpuTimer;
+    gpuTimer.initialise();
+    GetGpuPassTimer().initialise();
+
+    Simulation simulation;
+    simulation.animated.push_back(&alien);
+    FrameSnapshot snapshot;
+    simulation.initialise(snapshot);
+    restoreStdout(savedStdout);
+
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 1024.0f / 768.0f, 0.1f, 1000.0f);
+    glm::mat4 lightSpace = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 0.1f, 100.0f)
+                         * glm::lookAt(glm::vec3(0, 60, 0), glm::vec3(0, 8, -40), glm::vec3(0, 1, 0));
+    int frameIndex = 0;
+    auto frame = [&]() {
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        // wanders a few units around the start, never leaving its tile
+        float angle = frameIndex * 0.05f;
+        glm::vec3 eye(std::sin(angle) * 4.0f, 10.0f, std::cos(angle) * 4.0f);
+        glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(std::sin(angle), 0.0f, -1.0f), glm::vec3(0, 1, 0));
+        double renderTime = ++frameIndex / 60.0;
+        int renderWidth = dynamicResolution.renderWidth();
+        int renderHeight = dynamicResolution.renderHeight();
+
+        GetFrameArena().reset();
+        Profiler::beginFrame();
+        gpuTimer.begin();
+        simulation.snapshotAt(renderTime, snapshot);
+        simulation.advanceTo(renderTime + 1.0 / 60.0);
+        scene.setPose(&alien, snapshot.poses[0]);
+        scene.updateTransforms();
+        scene.updateBounds();
+
+        occlusion.clearOccluders();
+        terrain.addOccluders(occlusion, terrainOccluder);
+        vegetation.addOccluders(occlusion);
+        occlusion.addOccluder(cabinOccluder, cabinTransform);
+        occlusion.begin(view, projection, 1024, 768);
+        {
+            PROFILE_SCOPE("shadow");
+            depth.setMatrix("lightSpaceMatrix", &lightSpace[0][0]);
+            scene.renderDepth(depth);
+            staticBatch.renderDepth(depth);
+            vegetation.renderDepth(depth);
+        }
+        {
+            PROFILE_SCOPE("shadow_atlas");
+            FrameVector<glm::vec4> movers;
+            for (uint32_t owner : scene.animators.owners)
+                if (const Bounds* bounds = scene.bounds.get(owner))
+                    movers.push_back(glm::vec4(bounds->centre, bounds->radius));
+            shadowAtlas.update(lights.data(), (int)lights.size(), view, projection, renderHeight, movers.data(), movers.size());
+            for (const ShadowAtlas::View& atlasView : shadowAtlas.pending()) {
+                depth.setMatrix("lightSpaceMatrix", &atlasView.lightSpace[0][0]);
+                if (atlasView.drawStatic) {
+                    shadowAtlas.bindStatic(atlasView);
+                    staticBatch.renderDepth(depth);
+                    vegetation.renderDepth(depth);
+                }
+                shadowAtlas.bind(atlasView);
+                if (atlasView.drawMoving) scene.renderDepth(depth);
+            }
+            shadowAtlas.finish();
+        }
+
+        post.bind(renderWidth, renderHeight);
+        {
+            PROFILE_SCOPE("particles");
+            GPU_PASS_SCOPE("particle_update");
+            particles.update(1.0f / 60.0f);
+        }
+
+        program.setVec3("cameraPos", eye);
+        program.setMatrix("view", &view[0][0]);
+        program.setMatrix("projection", &projection[0][0]);
+        program.setMatrix("lightSpaceMatrix", &lightSpace[0][0]);
+        shadowAtlas.apply(program, 4);
+        particles.applyLights(program, (int)lights.size(), 8);
+        {
+            PROFILE_SCOPE("models");
+            occlusion.finish();
+            GetLodSelector().viewportHeight = renderHeight;
+            scene.render(view, projection, program, 0, 150.0f, &occlusion);
+            staticBatch.selectLods(view, projection, &occlusion);
+            staticBatch.render(view, projection, program, 0);
+        }
+        {
+            PROFILE_SCOPE("tiles");
+            terrain.updateTiles(eye);
+            terrain.renderTiles(view, projection, program);
+        }
+        {
+            PROFILE_SCOPE("vegetation");
+            vegetation.update();
+            vegetation.selectLods(view, projection, &occlusion);
+            vegetation.render(view, projection, program, 0);
+        }
+        {
+            PROFILE_SCOPE("particle_draw");
+            GPU_PASS_SCOPE("particle_draw");
+            particles.render(view, projection);
+        }
+        {
+            PROFILE_SCOPE("light_shafts");
+            GPU_PASS_SCOPE("light_shafts");
+            lightShafts.render(post.fbo, renderWidth, renderHeight, view, projection, lights.data(), (int)lights.size(),
+                               shadowAtlas);
+        }
+        {
+            PROFILE_SCOPE("post");
+            post.resolve(0, renderWidth, renderHeight);
+        }
+        GetTextureStreamer().viewportHeight = renderHeight;
+        GetTextureStreamer().update();
+
+        gpuTimer.end();
+        GetGpuPassTimer().endFrame();
+        Profiler::endFrame();
+        std::chrono::duration<float, std::milli> cpuTime = std::chrono::high_resolution_clock::now() - frameStart;
+        governor.addCpuSample(cpuTime.count());
+        float gpuMs;
+        while (gpuTimer.poll(gpuMs)) {
+            if (dynamicResolution.saturated(gpuMs))
+                governor.addGpuSample(gpuMs);
+            dynamicResolution.addGpuSample(gpuMs);
+        }
+        governor.update();
+    };
+
+    // until the worker has placed the vegetation of every loaded tile, then
+    // long enough for every per-frame buffer to reach its working size
+    for (int i = 0; i < 2000 && vegetation.tiles.size() < terrain.tiles.size(); ++i) {
+        frame();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (int i = 0; i < 2 * terrain.cleanupInterval; ++i) frame();
+
+    const int frames = 300;
+    int crossingsBefore = terrain.boundaryCrossings;
+    Profiler::reset();
+    AllocationCount before = totalAllocations();
+    for (int i = 0; i < frames; ++i) frame();
+    AllocationCount after = totalAllocations();
+    bool crossed = terrain.boundaryCrossings != crossingsBefore;
+
+    unsigned long long count = after.count - before.count;
+    printf("%-36s %8d frames %7llu allocations, %llu bytes%s\n", name, frames, count, after.bytes - before.bytes,
+           crossed ? " (crossed a tile)" : "");
+    for (int i = 0; i < Profiler::sampleCount(); ++i) {
+        const ProfileSample& s = Profiler::sample(i);
+        if (s.totalAllocations > 0) printf("  %-34s %lld allocations\n", s.name, s.totalAllocations);
+    }
+    fflush(stdout);
+
+    simulation.cleanup();
+    gpuTimer.cleanup();
+    GetGpuPassTimer().cleanup();
+    particles.cleanup();
+    lightShafts.cleanup();
+    post.cleanup();
+    shadowAtlas.cleanup();
+    occlusion.cleanup();
+    vegetation.cleanup();
+    staticBatch.cleanup();
+    terrain.cleanup();
+    alien.cleanup();
+    cabin.cleanup();
+    return count == 0 && !crossed;
+}
+
+static bool writeJson(const char* path)
+{
+    std::ofstream out(path);
+    if (!out.is_open()) return false;
+    out << "{\n  \"samples\": " << samples << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+            << ", \"median_ns\": " << r.medianNs << ", \"min_ns\": " << r.minNs
+            << ", \"p90_ns\": " << r.p90Ns << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const char* jsonPath = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) filter = argv[++i];
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) samples = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) jsonPath = argv[++i];
+    }
+
+    if (gladLoadGL(mockGetProcAddress) == 0) {
+        std::cerr << "Failed to load mock OpenGL." << std::endl;
+        return -1;
+    }
+    GetJobSystem().initialise();
+
+    // keep the loaders' progress output out of the table
+    std::streambuf* coutBuffer = std::cout.rdbuf();
+    std::ofstream devNull;
+    std::cout.rdbuf(devNull.rdbuf());
+
+    printf("%-36s %8s %14s %14s %14s\n", "benchmark", "iters", "median ns/op", "min ns/op", "p90 ns/op");
+    benchTiles();
+    benchVegetation();
+    benchAnimation();
+    benchScene();
+    benchWorld();
+    benchAssembly("gltf/assemble_cabin", "../assets/rustic-cabin/scene.gltf", 5);
+    benchAssembly("gltf/assemble_alien", "../assets/green_alien/scene.gltf", 20);
+    benchAssembly("gltf/assemble_pine", "../assets/pine_tree_-_ps1_low_poly/scene1.gltf", 200);
+    benchSimplify("lod/simplify_cabin", "../assets/rustic-cabin/scene.gltf", 1);
+    benchSimplify("lod/simplify_alien", "../assets/green_alien/scene.gltf", 2);
+    benchOcclusion();
+    benchUniforms();
+    benchJobs();
+    bool jobsCorrect = checkJobSystem();
+    bool steadyState = checkSteadyStateAllocations();
+
+    std::cout.rdbuf(coutBuffer);
+
+    if (jsonPath) {
+        if (!writeJson(jsonPath)) {
+            std::cerr << "Failed to write " << jsonPath << std::endl;
+            return -1;
+        }
+        std::cout << "Results written to " << jsonPath << std::endl;
+    }
+    if (!jobsCorrect) {
+        std::cerr << "Jobs were lost, repeated or run out of order under contention." << std::endl;
+        return 1;
+    }
+    if (!steadyState) {
+        std::cerr << "Steady-state frames allocated on the heap." << std::endl;
+        return 1;
+    }
+    return 0;
+}
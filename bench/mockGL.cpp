@@ -0,0 +1,127 @@
+#include "mockGL.h"
+
+#include <cstdint>
+#include <cstring>
+
+static GLuint nextName = 1;
+static long long drawCalls = 0;
+static unsigned char mappedScratch[1 << 20]; // backing store for glMapBuffer*
+
+static void GLAD_API_PTR mockNoop() {}
+
+static void GLAD_API_PTR mockGen(GLsizei n, GLuint* names)
+{
+	for (GLsizei i = 0; i < n; ++i) names[i] = nextName++;
+}
+
+static GLuint GLAD_API_PTR mockCreate(GLenum) { return nextName++; }
+static GLuint GLAD_API_PTR mockCreateProgram() { return nextName++; }
+static GLboolean GLAD_API_PTR mockIsObject(GLuint name) { return name != 0 ? GL_TRUE : GL_FALSE; }
+static GLenum GLAD_API_PTR mockGetError() { return GL_NO_ERROR; }
+static GLenum GLAD_API_PTR mockCheckFramebufferStatus(GLenum) { return GL_FRAMEBUFFER_COMPLETE; }
+static GLint GLAD_API_PTR mockGetLocation(GLuint, const GLchar*) { return 0; }
+static void* GLAD_API_PTR mockMapBuffer(GLenum) { return mappedScratch; }
+static void* GLAD_API_PTR mockMapBufferRange(GLenum, GLintptr, GLsizeiptr, GLbitfield) { return mappedScratch; }
+static GLboolean GLAD_API_PTR mockUnmapBuffer(GLenum) { return GL_TRUE; }
+static GLsync GLAD_API_PTR mockFenceSync(GLenum, GLbitfield) { return reinterpret_cast<GLsync>(static_cast<uintptr_t>(nextName++)); }
+static GLenum GLAD_API_PTR mockClientWaitSync(GLsync, GLbitfield, GLuint64) { return GL_ALREADY_SIGNALED; }
+
+static void GLAD_API_PTR mockDrawElements(GLenum, GLsizei, GLenum, const void*) { drawCalls++; }
+static void GLAD_API_PTR mockDrawArrays(GLenum, GLint, GLsizei) { drawCalls++; }
+static void GLAD_API_PTR mockDrawInstanced(GLenum, GLsizei, GLenum, const void*, GLsizei) { drawCalls++; }
+static void GLAD_API_PTR mockMultiDrawElementsBaseVertex(GLenum, const GLsizei*, GLenum, const void* const*, GLsizei, const GLint*) { drawCalls++; }
+
+static const GLubyte* GLAD_API_PTR mockGetString(GLenum name)
+{
+	switch (name) {
+		case GL_VERSION: return reinterpret_cast<const GLubyte*>("3.3.0 Mock");
+		case GL_RENDERER: return reinterpret_cast<const GLubyte*>("Mock renderer");
+		case GL_VENDOR: return reinterpret_cast<const GLubyte*>("Mock");
+		case GL_SHADING_LANGUAGE_VERSION: return reinterpret_cast<const GLubyte*>("3.30");
+		default: return reinterpret_cast<const GLubyte*>("");
+	}
+}
+
+static const GLubyte* GLAD_API_PTR mockGetStringi(GLenum, GLuint) { return reinterpret_cast<const GLubyte*>(""); }
+
+static void GLAD_API_PTR mockGetIntegerv(GLenum name, GLint* data)
+{
+	switch (name) {
+		case GL_MAJOR_VERSION: *data = 3; break;
+		case GL_MINOR_VERSION: *data = 3; break;
+		default: *data = 0; break; // includes GL_NUM_EXTENSIONS
+	}
+}
+
+// compile and link status succeed, info logs are empty
+static void GLAD_API_PTR mockGetObjectiv(GLuint, GLenum name, GLint* params)
+{
+	*params = (name == GL_COMPILE_STATUS || name == GL_LINK_STATUS) ? GL_TRUE : 0;
+}
+
+static void GLAD_API_PTR mockGetQueryObjectiv(GLuint, GLenum, GLint* params) { *params = GL_TRUE; }
+static void GLAD_API_PTR mockGetQueryObjectui64v(GLuint, GLenum, GLuint64* params) { *params = 0; }
+
+struct MockEntry
+{
+	const char* name;
+	GLADapiproc proc;
+};
+
+#define MOCK(glName, fn) {glName, reinterpret_cast<GLADapiproc>(fn)}
+
+static const MockEntry entries[] = {
+	MOCK("glGenBuffers", mockGen),
+	MOCK("glGenVertexArrays", mockGen),
+	MOCK("glGenTextures", mockGen),
+	MOCK("glGenFramebuffers", mockGen),
+	MOCK("glGenRenderbuffers", mockGen),
+	MOCK("glGenQueries", mockGen),
+	MOCK("glGenTransformFeedbacks", mockGen),
+	MOCK("glGenSamplers", mockGen),
+	MOCK("glCreateShader", mockCreate),
+	MOCK("glCreateProgram", mockCreateProgram),
+	MOCK("glIsTexture", mockIsObject),
+	MOCK("glIsBuffer", mockIsObject),
+	MOCK("glIsProgram", mockIsObject),
+	MOCK("glGetError", mockGetError),
+	MOCK("glCheckFramebufferStatus", mockCheckFramebufferStatus),
+	MOCK("glGetUniformLocation", mockGetLocation),
+	MOCK("glGetAttribLocation", mockGetLocation),
+	MOCK("glGetUniformBlockIndex", mockGetLocation),
+	MOCK("glMapBuffer", mockMapBuffer),
+	MOCK("glMapBufferRange", mockMapBufferRange),
+	MOCK("glUnmapBuffer", mockUnmapBuffer),
+	MOCK("glFenceSync", mockFenceSync),
+	MOCK("glClientWaitSync", mockClientWaitSync),
+	MOCK("glDrawElements", mockDrawElements),
+	MOCK("glDrawArrays", mockDrawArrays),
+	MOCK("glDrawElementsInstanced", mockDrawInstanced),
+	MOCK("glMultiDrawElementsBaseVertex", mockMultiDrawElementsBaseVertex),
+	MOCK("glGetString", mockGetString),
+	MOCK("glGetStringi", mockGetStringi),
+	MOCK("glGetIntegerv", mockGetIntegerv),
+	MOCK("glGetShaderiv", mockGetObjectiv),
+	MOCK("glGetProgramiv", mockGetObjectiv),
+	MOCK("glGetQueryObjectiv", mockGetQueryObjectiv),
+	MOCK("glGetQueryObjectui64v", mockGetQueryObjectui64v),
+};
+
+GLADapiproc mockGetProcAddress(const char* name)
+{
+	for (const MockEntry& entry : entries)
+		if (strcmp(entry.name, name) == 0) return entry.proc;
+
+	// everything else has no return value we depend on
+	return reinterpret_cast<GLADapiproc>(mockNoop);
+}
+
+long long mockDrawCalls()
+{
+	return drawCalls;
+}
+
+void mockResetCounters()
+{
+	drawCalls = 0;
+}
@@ -0,0 +1,17 @@
+#ifndef _MOCK_GL_H_
+#define _MOCK_GL_H_
+
+#include <glad/gl.h>
+
+// Loader for gladLoadGL that resolves every entry point to a stub, so the
+// engine code can run without a GPU or a display. Object names are handed
+// out from a counter, compile/link/framebuffer checks succeed and queries
+// report zero. Nothing is drawn.
+GLADapiproc mockGetProcAddress(const char* name);
+
+// Number of glDraw* calls since the last reset
+long long mockDrawCalls();
+
+void mockResetCounters();
+
+#endif
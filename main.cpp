@@ -17,21 +17,41 @@
 #include <tileManager.h>
 #include <light.h>
 #include <gltfModel.h>
+#include <profiler.h>
+#include <benchmark.h>
+#include <headlessContext.h>
+#include <frameCapture.h>
+#include <textureStreamer.h>
+#include <staticBatch.h>
+#include <vegetation.h>
+#include <meshLod.h>
+#include <occlusionCuller.h>
+#include <qualityGovernor.h>
+#include <dynamicResolution.h>
+#include <postProcess.h>
+#include <particleSystem.h>
+#include <simulation.h>
+#include <gpuResources.h>
+#include <jobSystem.h>
+#include <frameArena.h>
+#include <scene.h>
+#include <shadowAtlas.h>
+#include <lightShafts.h>
+#include <worldDatabase.h>
+#include <worldStreamer.h>
 #include <vector>
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <iostream>
 #include <random>
+#include <chrono>
+#include <cstring>
 
 
-// GLTF model loader
-#define TINYGLTF_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <tiny_gltf.h>
-
 static GLFWwindow *window;
 void processInput(GLFWwindow *window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+static void updateFront();
 
 // OpenGL camera view parameters
 static glm::vec3 eye_center(0, 10 , 0);
@@ -40,42 +60,47 @@ static glm::vec3 lookat;
 static glm::vec3 front(0,0,-1);
 static glm::vec3 up(0, 1, 0);
 
+static int screenWidth = 1024;
+static int screenHeight = 768;
+
 float deltaTime = 0.0f;	// Time between current frame and last frame
 float lastFrame = 0.0f; // Time of last frame
 
-// for shadow
-static int shadowMapWidth = 1024;
-static int shadowMapHeight = 768;
+// camera movement and animation run here at a fixed timestep; the loop in
+// main renders blended snapshots of it
+static Simulation simulation;
+
+// for shadow; the quality governor scales the map down from its full size
+static const int shadowMapFullWidth = 1024;
+static const int shadowMapFullHeight = 768;
+static int shadowMapWidth = shadowMapFullWidth;
+static int shadowMapHeight = shadowMapFullHeight;
 
 static float depthFoV = 80.0f;
 static float depthNear = 30.0f;
 static float depthFar = 600.0f;
 
-// Helper flag and function to save depth maps for debugging
+// Helper flag to save the shadow depth map for debugging
 static bool saveDepth = true;
 
-// This function retrieves and stores the depth map of the default frame buffer
-// or a particular frame buffer (indicated by FBO ID) to a PNG image.
-static void saveDepthTexture(GLuint fbo, std::string filename) {
-	int width = shadowMapWidth;
-	int height = shadowMapHeight;
-	if (shadowMapWidth == 0 || shadowMapHeight == 0) {
-		width = 1024;
-		height = 768;
-	}
-	int channels = 3;
-
-	std::vector<float> depth(width * height);
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glReadBuffer(GL_DEPTH_COMPONENT);
-	glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, depth.data());
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	std::vector<unsigned char> img(width * height * 3);
-	for (int i = 0; i < width * height; ++i) img[3*i] = img[3*i+1] = img[3*i+2] = depth[i] * 255;
-
-	stbi_write_png(filename.c_str(), width, height, channels, img.data(), width * channels);
-}
+// Colour frame sequences (timelapses, regression images): every Nth frame while
+// recording. P toggles recording; --capture-every N starts with it on.
+static int captureEvery = 1;
+static bool captureFrames = false;
+static int capturedFrames = 0;
+
+static float vegetationDensity = 1.0f;
+static float impostorDistanceScale = 1.0f;
+static bool occlusionCulling = true;
+static float frameBudgetMs = -1.0f; // quality governor target; negative picks the default
+static float resolutionTargetMs = -1.0f; // dynamic resolution GPU target; negative follows the governor
+static float fixedRenderScale = 0.0f; // 0 leaves the scale to the GPU target
+static int lightShaftDownscale = 4; // 0 turns the spotlight's shafts off
+static int lightShaftSteps = 16;
+static int bloomLevels = 5; // 0 turns bloom off
+static int particleCapacity = 4096; // 0 turns the fireflies and beam dust off
+static int particleLights = 0; // brightest particles that light the scene
+static int jobWorkers = -1; // job system threads besides this one; negative takes one per core, less this one
 
 // for rotation
 bool firstMouse = true;
@@ -84,6 +109,12 @@ float pitch =  0.0f;
 float lastX =  800.0f / 2.0;
 float lastY =  600.0 / 2.0;
 
+// F9 toggles recording the camera into a path that --camera-path can replay
+static bool recordingPath = false;
+static CameraPath recordedPath;
+static float recordTime = 0.0f;
+static float recordTimer = 0.0f;
+
 float randomFloat(float min, float max) {
 	static std::random_device rd;
 	static std::mt19937 gen(rd());
@@ -91,42 +122,114 @@ float randomFloat(float min, float max) {
 	return dist(gen);
 }
 
-int main(void) {
-    // Initialise GLFW
-	if (!glfwInit())
-	{
-		std::cerr << "Failed to initialize GLFW." << std::endl;
+int main(int argc, char** argv) {
+	BenchmarkConfig benchmark;
+	if (!parseBenchmarkArgs(argc, argv, benchmark))
 		return -1;
-	}
+	for (int i = 1; i + 1 < argc; ++i)
+		if (strcmp(argv[i], "--capture-every") == 0) {
+			captureEvery = std::max(1, atoi(argv[i + 1]));
+			captureFrames = true;
+		}
+		else if (strcmp(argv[i], "--texture-budget") == 0) {
+			GetTextureStreamer().budgetBytes = (size_t)std::max(1, atoi(argv[i + 1])) * 1024 * 1024; // MiB
+		}
+		else if (strcmp(argv[i], "--lod-error") == 0) {
+			GetLodSelector().maxPixelError = std::max(0.0f, (float)atof(argv[i + 1])); // pixels
+		}
+		else if (strcmp(argv[i], "--vegetation-density") == 0) {
+			vegetationDensity = std::max(0.0f, (float)atof(argv[i + 1])); // multiplier on every scatter rule
+		}
+		else if (strcmp(argv[i], "--impostor-distance") == 0) {
+			impostorDistanceScale = std::max(0.0f, (float)atof(argv[i + 1])); // multiplier, 0 keeps every mesh
+		}
+		else if (strcmp(argv[i], "--occlusion-culling") == 0) {
+			occlusionCulling = atoi(argv[i + 1]) != 0;
+		}
+		else if (strcmp(argv[i], "--frame-budget") == 0) {
+			frameBudgetMs = std::max(0.0f, (float)atof(argv[i + 1])); // milliseconds, 0 keeps full quality
+		}
+		else if (strcmp(argv[i], "--dynamic-resolution") == 0) {
+			resolutionTargetMs = std::max(0.0f, (float)atof(argv[i + 1])); // GPU milliseconds, 0 renders at full size
+		}
+		else if (strcmp(argv[i], "--render-scale") == 0) {
+			fixedRenderScale = glm::clamp((float)atof(argv[i + 1]), 0.25f, 1.0f);
+		}
+		else if (strcmp(argv[i], "--light-shafts") == 0) {
+			lightShaftDownscale = glm::clamp(atoi(argv[i + 1]), 0, 8); // 2 half resolution, 4 quarter, 0 off
+		}
+		else if (strcmp(argv[i], "--shaft-steps") == 0) {
+			lightShaftSteps = glm::clamp(atoi(argv[i + 1]), 1, 64); // samples per shaft pixel
+		}
+		else if (strcmp(argv[i], "--bloom-levels") == 0) {
+			bloomLevels = glm::clamp(atoi(argv[i + 1]), 0, PostProcess::maxBloomLevels); // halvings from half resolution
+		}
+		else if (strcmp(argv[i], "--particles") == 0) {
+			particleCapacity = std::max(0, atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--particle-lights") == 0) {
+			particleLights = glm::clamp(atoi(argv[i + 1]), 0, ParticleSystem::maxLights); // brightest particles lit
+		}
+		else if (strcmp(argv[i], "--gpu-budget") == 0) {
+			GetGpuResources().budgetBytes = (size_t)std::max(0, atoi(argv[i + 1])) * 1024 * 1024; // MiB, 0 never warns
+		}
+		else if (strcmp(argv[i], "--job-workers") == 0) {
+			jobWorkers = atoi(argv[i + 1]); // at most JobSystem::maxWorkers
+		}
 
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // For MacOS
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	// before anything loads, as the loaders hand their work to it
+	GetJobSystem().initialise(jobWorkers);
 
-	// Open a window and create its OpenGL context
-	window = glfwCreateWindow(1024, 768, "hi", NULL, NULL);
-	if (window == NULL)
-	{
-		std::cerr << "Failed to open a GLFW window." << std::endl;
-		glfwTerminate();
-		return -1;
+	// Benchmark runs prefer a windowless context so they work without a display
+	bool headless = benchmark.enabled && createHeadlessContext();
+	if (benchmark.enabled) {
+		screenWidth = benchmark.width;
+		screenHeight = benchmark.height;
 	}
-	glfwMakeContextCurrent(window);
 
-	// Ensure we can capture the escape key being pressed below
-	//glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+	if (!headless)
+	{
+		// Initialise GLFW
+		if (!glfwInit())
+		{
+			std::cerr << "Failed to initialize GLFW." << std::endl;
+			return -1;
+		}
+
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // For MacOS
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		if (benchmark.enabled)
+			glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+
+		// Open a window and create its OpenGL context
+		window = glfwCreateWindow(screenWidth, screenHeight, "hi", NULL, NULL);
+		if (window == NULL)
+		{
+			std::cerr << "Failed to open a GLFW window." << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
 
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-	glfwSetCursorPosCallback(window, mouse_callback);
+		// Ensure we can capture the escape key being pressed below
+		//glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+
+		if (!benchmark.enabled) {
+			glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+			glfwSetCursorPosCallback(window, mouse_callback);
+		}
+	}
 
 	// Load OpenGL functions, gladLoadGL returns the loaded version, 0 on error.
-	int version = gladLoadGL(glfwGetProcAddress);
+	int version = gladLoadGL(headless ? headlessGetProcAddress : glfwGetProcAddress);
 	if (version == 0)
 	{
 		std::cerr << "Failed to initialize OpenGL context." << std::endl;
 		return -1;
 	}
+	GetProgramCache().initialise(headless ? headlessGetProcAddress : glfwGetProcAddress);
 
 	// Background
 	glClearColor(0.003f, 0.0025f, 0.05f, 1.0f);
@@ -138,121 +241,180 @@ int main(void) {
 	glm::float32 FoV = 60;
 	glm::float32 zNear = 0.1f;
 	glm::float32 zFar = 1000.0f;
-	glm::mat4 projectionMatrix = glm::perspective(glm::radians(FoV), 4.0f / 3.0f, zNear, zFar);
+	glm::mat4 projectionMatrix = glm::perspective(glm::radians(FoV), (float)screenWidth / screenHeight, zNear, zFar);
 
+	// programs are only started here; the terrain and models load while
+	// uncached ones compile, and each is finished just before its first use
 	Shader objectShader;
-	objectShader.initialise("../shaders/object.vert", "../shaders/object.frag");
+	objectShader.begin("../shaders/object.vert", "../shaders/object.frag");
 
 	Shader depthShader;
-	depthShader.initialise("../shaders/depth.vert","../shaders/depth.frag");
-
-	// making lights
-	Light dirLight;
-	dirLight.type = 0;
-	dirLight.direction = glm::vec3(-0.5, -1.0, -0.3);
-	dirLight.colour = glm::vec3(0.05f, 0.05f,0.1f);
-	dirLight.constant = 1.0;
-	dirLight.linear = 0.007;
-	dirLight.quadratic = 0.0002;
-
-	// for lighting - spotlight
-	Light spotlight;
-	spotlight.type = 2;
-	spotlight.direction = glm::vec3(0, -1, 0);
-	spotlight.position = glm::vec3(0,60,-40);//(0,100,-100);
-	spotlight.colour = glm::vec3(0.75f, 6.25f, 0.5f)*glm::vec3(3.0f);//(0.3f, 2.5f, 0.2f);
-	spotlight.constant = 1.0;
-	spotlight.linear = 0.014;
-	spotlight.quadratic = 0.0007;
-	spotlight.cutoff = glm::cos(glm::radians(15.0f));
-	spotlight.outerCutoff = glm::cos(glm::radians(20.0f));
-
-	std::vector<Light> lights = {dirLight, spotlight};
+	depthShader.begin("../shaders/depth.vert","../shaders/depth.frag");
 
-	objectShader.use();
-	objectShader.setInt("numLights", lights.size());
-	for (int i = 0; i < lights.size(); ++i)
-	{
-		std::string base = "lights[" + std::to_string(i) + "]";
-		objectShader.setInt((base + ".type"), lights[i].type);
-		objectShader.setVec3((base + ".position"), lights[i].position);
-		objectShader.setVec3((base + ".direction"), lights[i].direction);
-		objectShader.setVec3((base + ".colour"), lights[i].colour);
-		objectShader.setFloat((base + ".constant"), lights[i].constant);
-		objectShader.setFloat((base + ".linear"), lights[i].linear);
-		objectShader.setFloat((base + ".quadratic"), lights[i].quadratic);
-		objectShader.setFloat((base + ".cutoff"), lights[i].cutoff);
-		objectShader.setFloat((base + ".outerCutoff"), lights[i].outerCutoff);
-	}
-
-	//fog to fade out the horizon; based on cam pos
-	glm::vec3 fogColour = glm::vec3(0.03f, 0.04f, 0.01f);
-	objectShader.setVec3("fogColour", fogColour);
-	objectShader.setFloat("fogStart", 50.0f);
-	objectShader.setFloat("fogEnd", 150.0f);
+	Shader impostorBakeShader;
+	impostorBakeShader.begin("../shaders/impostorBake.vert", "../shaders/impostorBake.frag");
 
 	TileManager t;
 	t.initialise();
 
-	std::vector<GLTFModel> models;
-	glm::mat4 transformMatrix(1.0f);
-	transformMatrix = glm::mat4(1.0f);
-	GLTFModel ufo("../assets/ufo-low-poly/scene.gltf");
-	ufo.isAnimated = false;
-	transformMatrix = glm::translate(transformMatrix, spotlight.position);
-	transformMatrix = glm::scale(transformMatrix, glm::vec3(40.0f));
-	//transformMatrix = glm::rotate(transformMatrix, glm::radians(-90.0f),glm::vec3(1,0,0));
-	ufo.setTransform(transformMatrix);
-	models.push_back(ufo);
-	//}
-
-	GLTFModel cabin("../assets/rustic-cabin/scene.gltf");
-	transformMatrix = glm::mat4(1.0f);
-	cabin.isAnimated = false;
-	transformMatrix = glm::translate(transformMatrix, glm::vec3(0,8,-40));
-	transformMatrix = glm::scale(transformMatrix, glm::vec3(10.0f));
-	//transformMatrix = glm::rotate(transformMatrix, glm::radians(90.0f),glm::vec3(1,0,0));
-	cabin.setTransform(transformMatrix);
-	models.push_back(cabin);
+	// authored placements come from the world file, a tile's worth at a time as
+	// the terrain streams; models own their buffers and stay where they are,
+	// and the scene's entities only point at them, so several can show the same model
+	const char* worldPath = "../assets/world.txt";
+	WorldDatabase world;
+	if (!world.open(worldPath)) {
+		std::cerr << "Failed to open world " << worldPath << std::endl;
+		return -1;
+	}
+	if (world.header->tileSize != t.tileSize)
+		std::cerr << "Warning: " << worldPath << " was bucketed for tiles of " << world.header->tileSize << ", not " << t.tileSize << std::endl;
+
+	Scene scene;
+	WorldStreamer worldStreamer;
+	worldStreamer.models.resize(world.header->modelCount);
+	std::vector<GLTFModel> worldModels;
+	worldModels.reserve(world.header->modelCount); // the streamer and scene keep pointers to them
+	for (uint32_t i = 0; i < world.header->modelCount; ++i) {
+		const WorldModel& source = world.models[i];
+		GLTFModel& model = worldModels.emplace_back(source.path);
+		model.isAnimated = (source.flags & WorldModelAnimated) != 0;
+		model.diffuseStrength = source.diffuseStrength;
+		worldStreamer.models[i].model = &model;
+	}
+	worldStreamer.initialise(world, scene);
+	t.world = &worldStreamer;
+
+	int cabinModel = world.findModel("cabin");
+	if (cabinModel < 0) {
+		std::cerr << worldPath << " has no cabin model for the vegetation" << std::endl;
+		return -1;
+	}
+	GLTFModel& cabin = worldModels[cabinModel];
 
+	// pines are scattered over the terrain instead of placed by hand
 	GLTFModel tree("../assets/pine_tree_-_ps1_low_poly/scene1.gltf");
-	transformMatrix = glm::mat4(1.0f);
 	tree.isAnimated = false;
-	transformMatrix = glm::translate(transformMatrix, glm::vec3(20,0, -40));
-	transformMatrix = glm::scale(transformMatrix, glm::vec3(2.0f));
-	transformMatrix = glm::rotate(transformMatrix, glm::radians(-90.0f),glm::vec3(1,0,0));
-	tree.setTransform(transformMatrix);
-	models.push_back(tree);
-
-	GLTFModel tree2("../assets/pine_tree_-_ps1_low_poly/scene1.gltf");
-	transformMatrix = glm::mat4(1.0f);
-	tree2.isAnimated = false;
-	transformMatrix = glm::translate(transformMatrix, glm::vec3(-40,0, -60));
-	transformMatrix = glm::scale(transformMatrix, glm::vec3(3.0f));
-	transformMatrix = glm::rotate(transformMatrix, glm::radians(-90.0f),glm::vec3(1,0,0));
-	tree2.setTransform(transformMatrix);
-	models.push_back(tree2);
-
-	float diffStrength = 0.1f;
-	GLTFModel alien("../assets/green_alien/scene.gltf");
-	alien.diffuseStrength = diffStrength;
-	alien.isAnimated = true;
-	transformMatrix = glm::mat4(1.0f);
-	transformMatrix = glm::translate(transformMatrix, glm::vec3(0,0, -30));
-	transformMatrix = glm::scale(transformMatrix, glm::vec3(0.0035f));
-	alien.setTransform(transformMatrix);
-	models.push_back(alien);
+
+	// the shadow map follows the first directional light
+	glm::vec3 sunDirection(0.0f, -1.0f, 0.0f);
+	for (uint32_t i = 0; i < world.header->globalLightCount; ++i)
+		if (world.globalLights[i].type == (int)LightType::Directional) {
+			sunDirection = glm::vec3(world.globalLights[i].direction[0], world.globalLights[i].direction[1], world.globalLights[i].direction[2]);
+			break;
+		}
+
+	objectShader.finish();
+	depthShader.finish();
+
+	// re-sent whenever tiles bring lights in or take them away, only the
+	// entries that changed: a tile's lights come and go at the end of the
+	// list, apart from the ones moved down into the slots they leave. object.frag
+	// has room for maxLights, and the governor's budget may use fewer
+	const int maxLights = 8; // MAX_LIGHTS in object.frag
+	int lightBudget = maxLights;
+	std::vector<Light> lights;   // as sent
+	std::vector<Light> gathered;
+	auto uploadLights = [&]() {
+		scene.gatherLights(gathered);
+		if ((int)gathered.size() > maxLights) gathered.resize(maxLights);
+		lights.swap(gathered);
+		objectShader.use();
+		objectShader.setInt("numLights", std::min(lightBudget, (int)lights.size()));
+		for (int i = 0; i < lights.size(); ++i)
+		{
+			if (i < gathered.size() && sameLight(gathered[i], lights[i])) continue;
+			std::string base = "lights[" + std::to_string(i) + "]";
+			objectShader.setInt((base + ".type"), lights[i].type);
+			objectShader.setVec3((base + ".position"), lights[i].position);
+			objectShader.setVec3((base + ".direction"), lights[i].direction);
+			objectShader.setVec3((base + ".colour"), lights[i].colour);
+			objectShader.setFloat((base + ".constant"), lights[i].constant);
+			objectShader.setFloat((base + ".linear"), lights[i].linear);
+			objectShader.setFloat((base + ".quadratic"), lights[i].quadratic);
+			objectShader.setFloat((base + ".cutoff"), lights[i].cutoff);
+			objectShader.setFloat((base + ".outerCutoff"), lights[i].outerCutoff);
+		}
+	};
+
+	objectShader.use();
+	//fog to fade out the horizon; based on cam pos
+	glm::vec3 fogColour = glm::vec3(0.03f, 0.04f, 0.01f);
+	objectShader.setVec3("fogColour", fogColour);
+	const float fogStart = 50.0f;
+	const float fogEnd = 150.0f;
+	objectShader.setFloat("fogStart", fogStart);
+	objectShader.setFloat("fogEnd", fogEnd);
+
+	// unskinned scenery is drawn from one shared arena, a multi-draw per texture
+	// array; entities baked into it keep their transform and bounds but are no
+	// longer drawn one by one. Entities tiles bring in are added to it and the
+	// ones they take away removed, each under its entity index.
+	StaticBatch staticBatch;
+	auto batchWorld = [&]() {
+		// removals first, as what came in since may be using their indices
+		for (Entity entity : worldStreamer.destroyed)
+			staticBatch.remove(entity.index);
+		for (Entity entity : worldStreamer.created) {
+			MeshRef* mesh = scene.alive(entity) ? scene.meshes.get(entity.index) : nullptr;
+			if (!mesh || mesh->model->isAnimated) continue;
+			mesh->model->setTransform(scene.transforms.get(entity.index)->world);
+			mesh->batched = staticBatch.add(*mesh->model, entity.index);
+		}
+		worldStreamer.created.clear();
+		worldStreamer.destroyed.clear();
+		staticBatch.build();
+	};
+	int worldChanges = -1;
+	objectShader.use();
+	objectShader.setInt("textureArraySampler", 2);
+
+	// the simulation thread plays the animations, one pose per animated model
+	// that all of its instances share; their poses are copied into the scene each frame
+	for (const GLTFModel& model : worldModels)
+		if (model.isAnimated) simulation.animated.push_back(&model);
+
+	// the odd abandoned cabin first, so the pines keep clear of it
+	Vegetation vegetation;
+	vegetation.densityScale = vegetationDensity;
+	VegetationAsset cabinAsset;
+	cabinAsset.model = &cabin;
+	cabinAsset.base = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0, 8, 0)), glm::vec3(10.0f));
+	cabinAsset.impostorDistance = 100.0f * impostorDistanceScale;
+	vegetation.assets.push_back(cabinAsset);
+	VegetationAsset treeAsset;
+	treeAsset.model = &tree;
+	treeAsset.base = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1, 0, 0));
+	treeAsset.impostorDistance = 60.0f * impostorDistanceScale; // well into the fog
+	vegetation.assets.push_back(treeAsset);
+	vegetation.rules.push_back({0, 0.0001f, 0.9f, 1.1f, 0.3f, 0.0f, 14.0f});
+	vegetation.rules.push_back({1, 0.006f, 1.5f, 3.5f, 0.6f, 0.7f, 0.0f});
+	vegetation.exclusions.push_back({glm::vec2(0, -40), 16.0f}); // the cabin
+	vegetation.exclusions.push_back({glm::vec2(0, 0), 30.0f}); // the clearing around the start and the alien
+	t.vegetation = &vegetation;
+	impostorBakeShader.finish();
+	vegetation.initialise(t, impostorBakeShader);
+	impostorBakeShader.remove();
+	objectShader.use();
+
+	// the ground and the cabins hide what is behind them; coarse stand-ins are
+	// rasterised on the CPU while the GPU draws the shadow map
+	OcclusionCuller occlusion;
+	occlusion.enabled = occlusionCulling;
+	int terrainOccluder = occlusion.addTerrain(t, 8);
+	int cabinOccluder = occlusion.addModel(cabin);
+	vegetation.assets[0].occluder = cabinOccluder;
+	worldStreamer.models[cabinModel].occluder = cabinOccluder;
+	occlusion.initialise();
 
 	//shadow fbo
-	GLuint shadowFBO;
-	glGenFramebuffers(1, &shadowFBO);
+	GLuint shadowFBO = gpuCreateFramebuffer(GpuOwner::Shadows, GPU_SITE);
 	glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
 
 	// shadow map
-	GLuint depthMap;
-	glGenTextures(1, &depthMap);
+	GLuint depthMap = gpuCreateTexture(GpuOwner::Shadows, GPU_SITE);
 	glBindTexture(GL_TEXTURE_2D, depthMap);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, shadowMapWidth, shadowMapHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	GetGpuResources().setBytes(GpuKind::Texture, depthMap, (size_t)shadowMapWidth * shadowMapHeight * 4);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
@@ -270,49 +432,278 @@ int main(void) {
 	}
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-	float prevDeltaTime = 0.016f; // 60 fpsshader.use();
+	// spot and point lights share one atlas; the sun keeps its own map above
+	ShadowAtlas shadowAtlas;
+	shadowAtlas.maxDistance = fogEnd;
+	shadowAtlas.initialise();
+	int shadowCasterBuilds = -1;
+
+	// past fogEnd everything is fog colour, so nothing wholly out there is drawn
+	t.cullDistance = fogEnd;
+	staticBatch.cullDistance = fogEnd;
+	vegetation.cullDistance = fogEnd;
+
+	// Trades render distance, shadow resolution, lights and LOD detail for
+	// frame time. Interactive runs aim for 60 fps; benchmark runs keep full
+	// quality unless given a --frame-budget, so their reports stay comparable.
+	QualityGovernor governor;
+	governor.targetMs = frameBudgetMs > 0.0f ? frameBudgetMs : 16.7f;
+	governor.enabled = frameBudgetMs > 0.0f || (frameBudgetMs < 0.0f && !benchmark.enabled);
+	governor.highest = {t.renderDistance, 1.0f, maxLights, 1.0f};
+	governor.lowest = {1, 0.25f, 1, 4.0f};
+	governor.level = governor.levels;
+	const float fullLodError = GetLodSelector().maxPixelError;
+	auto applyQuality = [&](const QualitySettings& quality) {
+		t.setRenderDistance(quality.renderDistance);
+		GetLodSelector().maxPixelError = fullLodError * quality.lodBias;
+		shadowAtlas.detailScale = quality.shadowScale;
+
+		lightBudget = quality.lightBudget;
+		objectShader.use();
+		objectShader.setInt("numLights", std::min(lightBudget, (int)lights.size()));
+
+		int width = std::max(1, (int)(shadowMapFullWidth * quality.shadowScale));
+		int height = std::max(1, (int)(shadowMapFullHeight * quality.shadowScale));
+		if (width != shadowMapWidth || height != shadowMapHeight) {
+			shadowMapWidth = width;
+			shadowMapHeight = height;
+			glBindTexture(GL_TEXTURE_2D, depthMap);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, shadowMapWidth, shadowMapHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+			GetGpuResources().setBytes(GpuKind::Texture, depthMap, (size_t)shadowMapWidth * shadowMapHeight * 4);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+	};
+
+	// The main pass renders into an HDR target that is bloomed and tone mapped
+	// into the output; only a corner of it when the GPU has a time target (by
+	// default the governor's) or a fixed scale is asked for. The scale answers
+	// GPU time first: the governor is only shown the GPU times the scale
+	// cannot take up, pinned at its smallest or its largest
+	PostProcess post;
+	post.bloomLevels = bloomLevels;
+	post.initialise(screenWidth, screenHeight);
+	DynamicResolution dynamicResolution;
+	dynamicResolution.targetGpuMs = resolutionTargetMs >= 0.0f ? resolutionTargetMs : (governor.enabled ? governor.targetMs : 0.0f);
+	dynamicResolution.enabled = dynamicResolution.targetGpuMs > 0.0f || fixedRenderScale > 0.0f;
+	if (fixedRenderScale > 0.0f) {
+		dynamicResolution.scale = fixedRenderScale;
+		dynamicResolution.targetGpuMs = 0.0f;
+	}
+	dynamicResolution.initialise(screenWidth, screenHeight);
+	double renderScaleSum = 0.0;
+
+	// A headless context has no default framebuffer, so benchmark frames go to an offscreen one
+	GLuint mainFramebuffer = 0;
+	GLuint benchmarkColour = 0;
+	if (benchmark.enabled)
+	{
+		benchmarkColour = gpuCreateRenderbuffer(GpuOwner::Targets, GPU_SITE);
+		glBindRenderbuffer(GL_RENDERBUFFER, benchmarkColour);
+		gpuRenderbufferStorage(benchmarkColour, GL_RGBA8, screenWidth, screenHeight, 4);
+
+		mainFramebuffer = gpuCreateFramebuffer(GpuOwner::Targets, GPU_SITE);
+		glBindFramebuffer(GL_FRAMEBUFFER, mainFramebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, benchmarkColour);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cerr << "Error: Benchmark framebuffer is not complete!" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// the ufo's beam through the air, marched at a fraction of the resolution
+	LightShafts lightShafts;
+	lightShafts.enabled = lightShaftDownscale > 0;
+	lightShafts.downscale = lightShaftDownscale;
+	lightShafts.steps = lightShaftSteps;
+	lightShafts.fogStart = fogStart;
+	lightShafts.fogEnd = fogEnd;
+	if (lightShafts.enabled)
+		lightShafts.initialise(screenWidth, screenHeight);
+
+	// fireflies over the clearing, and dust rising up the ufo's beam
+	ParticleSystem particles;
+	particles.capacity = particleCapacity;
+	particles.lightCount = particleLights;
+	particles.fogStart = fogStart;
+	particles.fogEnd = fogEnd;
+	{
+		ParticleEmitter fireflies;
+		fireflies.centre = glm::vec3(0.0f, 2.0f, -25.0f);
+		fireflies.extent = glm::vec3(28.0f, 1.5f, 20.0f);
+		fireflies.colour = glm::vec3(2.4f, 3.0f, 0.6f);
+		fireflies.wander = 0.6f;
+		fireflies.flicker = 1.0f;
+		fireflies.size = 0.06f;
+		fireflies.lifetime = 8.0f;
+		fireflies.rate = 50.0f;
+		particles.emitters.push_back(fireflies);
+
+		ParticleEmitter dust;
+		dust.centre = glm::vec3(0.0f, 10.0f, -40.0f);
+		dust.extent = glm::vec3(10.0f, 10.0f, 10.0f);
+		dust.velocity = glm::vec3(0.0f, 0.4f, 0.0f);
+		dust.colour = glm::vec3(0.12f, 1.0f, 0.08f);
+		dust.wander = 0.15f;
+		dust.size = 0.04f;
+		dust.lifetime = 10.0f;
+		dust.rate = 150.0f;
+		particles.emitters.push_back(dust);
+	}
+	if (particles.capacity > 0)
+		particles.initialise();
+
+	CameraPath cameraPath;
+	if (benchmark.enabled && (benchmark.pathFile.empty() || !cameraPath.load(benchmark.pathFile)))
+		cameraPath.makeDefault(t.tileSize);
+
+	FrameCapture capture;
+	capture.initialise();
+	int frameNumber = 0;
+
+	FrameSnapshot frame;
+	frame.eyeCentre = eye_center;
+	frame.cameraTarget = camera_target;
+	frame.yaw = yaw;
+	frame.pitch = pitch;
+	if (benchmark.enabled)
+		simulation.path = &cameraPath;
+	simulation.initialise(frame);
+
+	BenchmarkStats stats;
+	if (benchmark.enabled)
+		stats.reserve(benchmark.frames);  // so recording them does not count against the frames
+	GpuTimer gpuTimer;
+	gpuTimer.initialise();
+	GetGpuPassTimer().initialise();
+	int frameIndex = 0;
+	int gpuResults = 0;
+	int crossingsAtWarmup = 0;
+	GLsync frameFences[2] = {nullptr, nullptr}; // keep at most two benchmark frames in flight, like a swap chain
+
 	float fps = 0.0f;
 	float fpsTimer = 0.0f;
 	int fpsFrames = 0;
 
 	do
 	{
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+		auto frameStart = std::chrono::high_resolution_clock::now();
+		GetFrameArena().reset();
+		Profiler::beginFrame();
+		gpuTimer.begin();
+
+		// benchmark frames step a fixed time along the scripted path, so every
+		// run renders the same frames; interactive ones show the simulation one
+		// tick behind the clock, blending the ticks either side
+		double renderTime;
+		if (benchmark.enabled)
+		{
+			deltaTime = benchmark.timestep;
+			renderTime = (frameIndex + 1) * (double)benchmark.timestep;
+		}
+		else
+		{
+			float currentFrame = glfwGetTime();
+			deltaTime = currentFrame - lastFrame;
+			lastFrame = currentFrame;
+			renderTime = std::max(0.0, (double)currentFrame - simulation.timestep);
+			processInput(window);
+		}
 
-		if (deltaTime > 0.05f)
-			deltaTime = 0.05f;
+		{
+			PROFILE_SCOPE("simulation_wait");
+			simulation.snapshotAt(renderTime, frame);
+		}
+		// the ticks of the next frame run while this one is submitted
+		simulation.advanceTo(renderTime + deltaTime);
+
+		eye_center = frame.eyeCentre;
+		camera_target = frame.cameraTarget;
+		yaw = frame.yaw;
+		pitch = frame.pitch;
+		updateFront();
+
+		// tiles (and the world entities on them) stream before anything is
+		// drawn, so what they bring in shows from this frame on
+		{
+			PROFILE_SCOPE("tile_streaming");
+			glm::vec3 forwardLook = glm::normalize(front) * t.tileSize * 0.5f; // to ensure tiles in distancee are created when we get there
+			glm::vec3 updatePos = camera_target + forwardLook;
+			t.updateTiles(updatePos);
+		}
+		if (worldStreamer.changes != worldChanges) {
+			PROFILE_SCOPE("world_streaming");
+			worldChanges = worldStreamer.changes;
+			batchWorld();
+			uploadLights();
+			// only the regions that can see what came or went draw their static casters again
+			for (const glm::vec4& sphere : staticBatch.changed)
+				shadowAtlas.invalidate(sphere);
+			staticBatch.changed.clear();
+		}
+		for (size_t i = 0; i < simulation.animated.size(); ++i)
+			scene.setPose(simulation.animated[i], frame.poses[i]);
+		scene.updateTransforms();
+		scene.updateBounds();
 
-		deltaTime = glm::mix(prevDeltaTime, deltaTime, 0.1f);
-		prevDeltaTime = deltaTime;
+		// calculate viewMatrix and vp
+		glm::mat4 viewMatrix = glm::lookAt(eye_center, eye_center + front, up);
 
-		//========= SHADOW RENDER ===============================
-		glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
-		glClear(GL_DEPTH_BUFFER_BIT);
+		occlusion.clearOccluders();
+		t.addOccluders(occlusion, terrainOccluder);
+		vegetation.addOccluders(occlusion);
+		scene.addOccluders(occlusion);
+		occlusion.begin(viewMatrix, projectionMatrix, screenWidth, screenHeight);
 
+		//========= SHADOW RENDER ===============================
 		glm::mat4 lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 0.1f, 100.0f);//perspective(glm::radians(depthFoV), (float)(shadowMapWidth/shadowMapHeight), depthNear, depthFar);
-		glm::mat4 lightView = glm::lookAt(glm::vec3(0,8,-40) - dirLight.direction * 100.0f, glm::vec3(0,8,-40), glm::vec3(0.0, 1.0, 0.0));
+		glm::mat4 lightView = glm::lookAt(glm::vec3(0,8,-40) - sunDirection * 100.0f, glm::vec3(0,8,-40), glm::vec3(0.0, 1.0, 0.0));
 		glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-
-		depthShader.use();
-		depthShader.setMatrix("lightSpaceMatrix", &lightSpaceMatrix[0][0]);
-
-		for (GLTFModel& m : models)
-			m.renderDepth(lightSpaceMatrix, depthShader);
+		{
+			PROFILE_SCOPE("shadow");
+			glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
+			glViewport(0, 0, shadowMapWidth, shadowMapHeight);
+			glClear(GL_DEPTH_BUFFER_BIT);
+
+			depthShader.use();
+			depthShader.setMatrix("lightSpaceMatrix", &lightSpaceMatrix[0][0]);
+
+			scene.renderDepth(depthShader);
+			staticBatch.renderDepth(depthShader);
+			vegetation.renderDepth(depthShader);
+		}
+		{
+			PROFILE_SCOPE("shadow_atlas");
+			if (vegetation.builds != shadowCasterBuilds) {
+				shadowCasterBuilds = vegetation.builds;
+				shadowAtlas.invalidate();
+			}
+			// only the animated entities move
+			FrameVector<glm::vec4> movers;
+			for (uint32_t owner : scene.animators.owners)
+				if (const Bounds* bounds = scene.bounds.get(owner))
+					movers.push_back(glm::vec4(bounds->centre, bounds->radius));
+			shadowAtlas.update(lights.data(), std::min(lightBudget, (int)lights.size()), viewMatrix, projectionMatrix,
+			                   dynamicResolution.renderHeight(), movers.data(), movers.size());
+			for (const ShadowAtlas::View& view : shadowAtlas.pending()) {
+				depthShader.setMatrix("lightSpaceMatrix", &view.lightSpace[0][0]);
+				if (view.drawStatic) {
+					shadowAtlas.bindStatic(view);
+					staticBatch.renderDepth(depthShader);
+					vegetation.renderDepth(depthShader);
+				}
+				shadowAtlas.bind(view);
+				if (view.drawMoving) scene.renderDepth(depthShader);
+			}
+			shadowAtlas.finish();
+		}
 
 		//========= MAIN RENDER =============
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		post.bind(dynamicResolution.renderWidth(), dynamicResolution.renderHeight());
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		processInput(window);
-		float lerpSpeed = 5.0f;
-		eye_center = glm::mix(eye_center, camera_target, lerpSpeed * deltaTime);
-
-		// calculate viewMatrix and vp
-		glm::mat4 viewMatrix = glm::lookAt(eye_center, eye_center + front, up);
-
-		glm::vec3 forwardLook = glm::normalize(front) * t.tileSize * 0.5f; // to ensure tiles in distancee are created when we get there
-		glm::vec3 updatePos = camera_target + forwardLook;
+		{
+			PROFILE_SCOPE("particles");
+			GPU_PASS_SCOPE("particle_update");
+			particles.update(deltaTime);
+		}
 
 		// render stuff here
 		objectShader.use();
@@ -320,90 +711,280 @@ int main(void) {
 		objectShader.setMatrix("view", &viewMatrix[0][0]);
 		objectShader.setMatrix("projection", &projectionMatrix[0][0]);
 		objectShader.setMatrix("lightSpaceMatrix", &lightSpaceMatrix[0][0]);
-		alien.updateAnimation(deltaTime);
+		shadowAtlas.apply(objectShader, 4);
+		if (particles.lightCount > 0)
+			particles.applyLights(objectShader, (int)lights.size(), lightBudget);
+		{
+			PROFILE_SCOPE("models");
+			occlusion.finish();
+			GetLodSelector().viewportHeight = dynamicResolution.renderHeight();
+			scene.render(viewMatrix, projectionMatrix, objectShader, depthMap, fogEnd, &occlusion);
+			staticBatch.selectLods(viewMatrix, projectionMatrix, &occlusion);
+			staticBatch.render(viewMatrix, projectionMatrix, objectShader, depthMap);
+		}
+		{
+			PROFILE_SCOPE("tiles");
+			t.renderTiles(viewMatrix, projectionMatrix, objectShader);
+		}
+		{
+			PROFILE_SCOPE("vegetation");
+			vegetation.update();
+			vegetation.selectLods(viewMatrix, projectionMatrix, &occlusion);
+			vegetation.render(viewMatrix, projectionMatrix, objectShader, depthMap);
+		}
 
-		for (GLTFModel& m : models)
-			m.render(objectShader, depthMap);
-		t.updateTiles(updatePos, objectShader);
-		t.renderTiles(viewMatrix, projectionMatrix, objectShader);
+		{
+			PROFILE_SCOPE("particle_draw");
+			GPU_PASS_SCOPE("particle_draw");
+			particles.render(viewMatrix, projectionMatrix);
+		}
+
+		if (lightShafts.enabled) {
+			PROFILE_SCOPE("light_shafts");
+			GPU_PASS_SCOPE("light_shafts");
+			lightShafts.render(post.fbo, dynamicResolution.renderWidth(), dynamicResolution.renderHeight(), viewMatrix, projectionMatrix, lights.data(),
+			                   std::min(lightBudget, (int)lights.size()), shadowAtlas);
+		}
+
+		{
+			PROFILE_SCOPE("post");
+			post.resolve(mainFramebuffer, dynamicResolution.renderWidth(), dynamicResolution.renderHeight());
+		}
+
+		// stream in the mips this frame's requests asked for; they are used from the next frame
+		GetTextureStreamer().viewportHeight = dynamicResolution.renderHeight();
+		GetTextureStreamer().update();
 
 		if (saveDepth) {
 			std::string filename = "depth_camera.png";
-			saveDepthTexture(shadowFBO, filename);
-			std::cout << "Depth texture saved to " << filename << std::endl;
+			capture.request(shadowFBO, shadowMapWidth, shadowMapHeight, CaptureFormat::Depth, filename);
+			std::cout << "Depth texture will be saved to " << filename << std::endl;
 			saveDepth = false;
 		}
 
-		fpsFrames++;
-		fpsTimer += deltaTime;
-
-		if (fpsTimer >= 1.0f) {
-			fps = fpsFrames / fpsTimer;
-			std::stringstream stream;
-			stream << std::fixed << std::setprecision(2) << "CSU44052 Supplemental DA | Frames per second (FPS): " << fps;
-			glfwSetWindowTitle(window, stream.str().c_str());
+		if (captureFrames && frameNumber % captureEvery == 0) {
+			char filename[64];
+			snprintf(filename, sizeof(filename), "frame_%05d.png", capturedFrames++);
+			capture.request(mainFramebuffer, screenWidth, screenHeight, CaptureFormat::Colour, filename);
+		}
+		capture.update();
+		frameNumber++;
+
+		if (recordingPath) {
+			recordTime += deltaTime;
+			recordTimer += deltaTime;
+			if (recordTimer >= 0.25f) {
+				recordedPath.add(recordTime, camera_target, yaw, pitch);
+				recordTimer = 0.0f;
+			}
+		}
 
-			fpsFrames = 0;
-			fpsTimer = 0.0f;
+		gpuTimer.end();
+		GetGpuPassTimer().endFrame();
+		Profiler::endFrame();
+		GetGpuResources().endFrame();
+		std::chrono::duration<float, std::milli> cpuTime = std::chrono::high_resolution_clock::now() - frameStart;
+		governor.addCpuSample(cpuTime.count());
+
+		if (benchmark.enabled)
+		{
+
+			// stand-in for the swap chain throttle: wait until the frame before last has finished
+			GLsync& fence = frameFences[frameIndex % 2];
+			if (fence) {
+				glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+				glDeleteSync(fence);
+			}
+			fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+
+			std::chrono::duration<float, std::milli> frameTime = std::chrono::high_resolution_clock::now() - frameStart;
+			if (frameIndex >= benchmark.warmupFrames) {
+				stats.cpuMs.push_back(cpuTime.count());
+				stats.frameMs.push_back(frameTime.count());
+				stats.allocations.push_back((float)Profiler::frameAllocations());
+				renderScaleSum += dynamicResolution.enabled ? dynamicResolution.scale : 1.0f;
+			}
+
+			float gpuMs;
+			while (gpuTimer.poll(gpuMs)) {
+				if (dynamicResolution.saturated(gpuMs))
+					governor.addGpuSample(gpuMs);
+				dynamicResolution.addGpuSample(gpuMs);
+				if (gpuResults++ >= benchmark.warmupFrames) stats.gpuMs.push_back(gpuMs);
+			}
+
+			frameIndex++;
+			if (frameIndex == benchmark.warmupFrames) {
+				Profiler::reset();
+				GetGpuPassTimer().reset();
+				GetLodSelector().resetHistogram();
+				occlusion.resetTotals();
+				shadowAtlas.updatesTotal = 0;
+				crossingsAtWarmup = t.boundaryCrossings;
+			}
+		}
+		else
+		{
+			float gpuMs;
+			while (gpuTimer.poll(gpuMs)) {
+				if (dynamicResolution.saturated(gpuMs))
+					governor.addGpuSample(gpuMs);
+				dynamicResolution.addGpuSample(gpuMs);
+			}
+
+			fpsFrames++;
+			fpsTimer += deltaTime;
+
+			if (fpsTimer >= 1.0f) {
+				fps = fpsFrames / fpsTimer;
+				char owners[256];
+				char title[384];
+				GetGpuResources().summary(owners, sizeof(owners));
+				snprintf(title, sizeof(title), "CSU44052 Supplemental DA | Frames per second (FPS): %.2f | GPU %.1f MiB (%s)",
+						 fps, GetGpuResources().total.bytes / 1048576.0, owners);
+				glfwSetWindowTitle(window, title);
+
+				fpsFrames = 0;
+				fpsTimer = 0.0f;
+			}
+
+			// Swap buffers
+			glfwSwapBuffers(window);
+			glfwPollEvents();
 		}
 
-		// Swap buffers
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		// the new settings take effect from the next frame
+		if (governor.update())
+			applyQuality(governor.current());
 
 	} // Check if the ESC key was pressed or the window was closed
-	while (!glfwWindowShouldClose(window));
+	while (benchmark.enabled ? frameIndex < benchmark.warmupFrames + benchmark.frames : !glfwWindowShouldClose(window));
+
+	if (benchmark.enabled)
+	{
+		glFinish();
+		float gpuMs;
+		while (gpuTimer.poll(gpuMs, true))
+			if (gpuResults++ >= benchmark.warmupFrames) stats.gpuMs.push_back(gpuMs);
+		GetGpuPassTimer().flush();
+		for (GLsync fence : frameFences)
+			if (fence) glDeleteSync(fence);
+
+		stats.tileCrossings = t.boundaryCrossings - crossingsAtWarmup;
+		stats.textureResidentPeak = GetTextureStreamer().peakResidentBytes;
+		const LodSelector& lods = GetLodSelector();
+		stats.lodHistogram.assign(std::begin(lods.histogram), std::end(lods.histogram));
+		stats.occlusionTests = occlusion.testsTotal;
+		stats.occlusionCulled = occlusion.culledTotal;
+		stats.shadowAtlasUpdates = shadowAtlas.updatesTotal;
+		stats.qualityLevel = governor.level;
+		stats.qualityChanges = governor.changes;
+		stats.renderScaleMean = stats.frameMs.empty() ? 1.0f : (float)(renderScaleSum / stats.frameMs.size());
+		stats.writeReport(benchmark, (const char*)glGetString(GL_RENDERER));
+
+		gpuDeleteFramebuffer(mainFramebuffer);
+		gpuDeleteRenderbuffer(benchmarkColour);
+	}
 
 	// Clean up
+	capture.cleanup();
+	if (capture.stalls > 0)
+		std::cout << "Frame capture waited on the GPU " << capture.stalls << " times." << std::endl;
+	gpuTimer.cleanup();
+	GetGpuPassTimer().cleanup();
+	simulation.cleanup();
+	GetJobSystem().shutdown();
+	occlusion.cleanup();
+	post.cleanup();
+	lightShafts.cleanup();
+	particles.cleanup();
+	vegetation.cleanup();
 	t.cleanup();
+	staticBatch.cleanup();
+	GetTextureStreamer().cleanup();
+	worldStreamer.cleanup();
+	for (GLTFModel& model : worldModels)
+		model.cleanup();
+	world.close();
+	tree.cleanup();
+	gpuDeleteFramebuffer(shadowFBO);
+	gpuDeleteTexture(depthMap);
+	shadowAtlas.cleanup();
 	objectShader.remove();
 	depthShader.remove();
+	GetGpuResources().reportLeaks();
 	// Close OpenGL window and terminate GLFW
-	glfwTerminate();
+	if (headless)
+		destroyHeadlessContext();
+	else
+		glfwTerminate();
     return 0;
 }
 
 // Is called whenever a key is pressed/released via GLFW
 void processInput(GLFWwindow *window)
 {
-	float cameraSpeed = 15.0f * deltaTime;
+	// held keys go to the simulation, which moves the camera every tick
 	glm::vec3 move(0.0f);
-	glm::vec3 flatFront = glm::normalize(glm::vec3(front.x, 0.0f, front.z));
 
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_W) == GLFW_REPEAT)
 	{
-		move += flatFront;
+		move.z += 1.0f;
 	}
 
 	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_S) == GLFW_REPEAT)
 	{
-		move -= flatFront;
+		move.z -= 1.0f;
 	}
 
 	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_A) == GLFW_REPEAT)
 	{
-		move -= glm::normalize(glm::cross(flatFront, up));
+		move.x -= 1.0f;
 	}
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_D) == GLFW_REPEAT)
 	{
-		move += glm::normalize(glm::cross(flatFront, up));
+		move.x += 1.0f;
 	}
-	if ((glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_Q) == GLFW_REPEAT)
-		&& eye_center.y < 40.0f/*+ cameraSpeed <= 20.0f*/)
+	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_Q) == GLFW_REPEAT)
 	{
-		move += glm::vec3(0.0f, 1.0f, 0.0f);
+		move.y += 1.0f;
 	}
-	if ((glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_E) == GLFW_REPEAT)
-		&& eye_center.y > 5.0f/*- cameraSpeed >= 0.0f*/)
+	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_E) == GLFW_REPEAT)
 	{
-		move -= glm::vec3(0.0f, 1.0f, 0.0f);
+		move.y -= 1.0f;
 	}
+	simulation.setMove(move);
 
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
 
-	if (glm::length(move) > 0.0f)
-		camera_target += glm::normalize(move) * cameraSpeed;
+	static bool recordKeyDown = false;
+	bool recordKey = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+	if (recordKey && !recordKeyDown)
+	{
+		recordingPath = !recordingPath;
+		if (recordingPath) {
+			recordedPath.keys.clear();
+			recordTime = recordTimer = 0.0f;
+			recordedPath.add(0.0f, camera_target, yaw, pitch);
+			std::cout << "Recording camera path..." << std::endl;
+		} else {
+			recordedPath.add(recordTime, camera_target, yaw, pitch);
+			if (recordedPath.save("camera_path.txt"))
+				std::cout << "Camera path saved to camera_path.txt" << std::endl;
+		}
+	}
+	recordKeyDown = recordKey;
+
+	static bool captureKeyDown = false;
+	bool captureKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+	if (captureKey && !captureKeyDown)
+	{
+		captureFrames = !captureFrames;
+		std::cout << (captureFrames ? "Capturing frames..." : "Stopped capturing frames.") << std::endl;
+	}
+	captureKeyDown = captureKey;
 }
 
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
@@ -427,15 +1008,12 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     xoffset *= sensitivity;
     yoffset *= sensitivity;
 
-    yaw += xoffset;
-    pitch += yoffset;
-
-    // make sure that when pitch is out of bounds, screen doesn't get flipped
-    if (pitch > 89.0f)
-        pitch = 89.0f;
-    if (pitch < -89.0f)
-        pitch = -89.0f;
+    // the simulation turns the camera and keeps pitch short of flipping the screen
+    simulation.addLook(xoffset, yoffset);
+}
 
+static void updateFront()
+{
     front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
     front.y = sin(glm::radians(pitch));
     front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
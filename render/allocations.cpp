@@ -0,0 +1,88 @@
+#include "allocations.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replacing the global operator new (and with it every delete, so memory is
+// always released the way it was obtained) counts each allocation once per
+// thread and once overall. The per-thread counters are plain thread_locals,
+// so counting costs a couple of adds on the allocating path.
+
+static thread_local unsigned long long threadCount = 0;
+static thread_local unsigned long long threadBytes = 0;
+static std::atomic<unsigned long long> allCount{0};
+static std::atomic<unsigned long long> allBytes{0};
+
+AllocationCount threadAllocations()
+{
+    return {threadCount, threadBytes};
+}
+
+AllocationCount totalAllocations()
+{
+    return {allCount.load(std::memory_order_relaxed), allBytes.load(std::memory_order_relaxed)};
+}
+
+static void count(std::size_t size)
+{
+    threadCount++;
+    threadBytes += size;
+    allCount.fetch_add(1, std::memory_order_relaxed);
+    allBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+static void* allocate(std::size_t size)
+{
+    count(size);
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+static void* allocateAligned(std::size_t size, std::align_val_t alignment)
+{
+    count(size);
+    std::size_t align = (std::size_t)alignment;
+#ifdef _WIN32
+    void* p = _aligned_malloc(size ? size : 1, align);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, align < sizeof(void*) ? sizeof(void*) : align, size ? size : 1) != 0) p = nullptr;
+#endif
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+static void releaseAligned(void* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return allocate(size); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return allocate(size); } catch (...) { return nullptr; }
+}
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { releaseAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { releaseAligned(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { releaseAligned(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { releaseAligned(p); }
@@ -0,0 +1,20 @@
+#ifndef _ALLOCATIONS_H_
+#define _ALLOCATIONS_H_
+
+#include <cstddef>
+
+// Heap allocations seen by the replaced global operator new. Counts only go
+// up; take the difference of two readings to measure a stretch of code.
+struct AllocationCount
+{
+    unsigned long long count = 0;
+    unsigned long long bytes = 0;
+};
+
+// Made by the calling thread since it started
+AllocationCount threadAllocations();
+
+// Made by every thread since the program started
+AllocationCount totalAllocations();
+
+#endif
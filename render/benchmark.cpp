@@ -0,0 +1,295 @@
+#include "benchmark.h"
+#include "profiler.h"
+#include "gpuResources.h"
+#include "jobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+bool parseBenchmarkArgs(int argc, char** argv, BenchmarkConfig& config)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (strcmp(arg, "--benchmark") == 0) {
+			config.enabled = true;
+			// optional frame count straight after the flag
+			if (hasValue && argv[i + 1][0] != '-')
+				config.frames = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--frames") == 0 && hasValue) config.frames = atoi(argv[++i]);
+		else if (strcmp(arg, "--warmup") == 0 && hasValue) config.warmupFrames = atoi(argv[++i]);
+		else if (strcmp(arg, "--timestep") == 0 && hasValue) config.timestep = static_cast<float>(atof(argv[++i]));
+		else if (strcmp(arg, "--camera-path") == 0 && hasValue) config.pathFile = argv[++i];
+		else if (strcmp(arg, "--report") == 0 && hasValue) config.reportFile = argv[++i];
+		else if (strcmp(arg, "--size") == 0 && hasValue) {
+			if (sscanf(argv[++i], "%dx%d", &config.width, &config.height) != 2) return false;
+		}
+	}
+
+	if (config.frames <= 0 || config.warmupFrames < 0 || config.timestep <= 0.0f ||
+		config.width <= 0 || config.height <= 0) {
+		std::cerr << "Invalid benchmark arguments." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool CameraPath::load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		std::cerr << "Camera path not found " << path << std::endl;
+		return false;
+	}
+
+	keys.clear();
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#') continue;
+		std::istringstream stream(line);
+		CameraKeyframe key;
+		if (stream >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch)
+			keys.push_back(key);
+	}
+
+	std::sort(keys.begin(), keys.end(), [](const CameraKeyframe& a, const CameraKeyframe& b) { return a.time < b.time; });
+	return !keys.empty();
+}
+
+bool CameraPath::save(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file.is_open()) return false;
+
+	file << "# time x y z yaw pitch\n";
+	for (const CameraKeyframe& key : keys)
+		file << key.time << " " << key.position.x << " " << key.position.y << " " << key.position.z << " "
+			 << key.yaw << " " << key.pitch << "\n";
+	return true;
+}
+
+void CameraPath::makeDefault(float tileSize)
+{
+	keys.clear();
+	// out along -z, across in +x, back along +z and home; yaw keeps increasing so the wrap is seamless
+	add(0.0f, glm::vec3(0.0f, 10.0f, 0.0f), -90.0f, 0.0f);
+	add(8.0f, glm::vec3(0.0f, 10.0f, -8.0f * tileSize), -90.0f, -10.0f);
+	add(12.0f, glm::vec3(4.0f * tileSize, 15.0f, -8.0f * tileSize), 0.0f, 0.0f);
+	add(20.0f, glm::vec3(4.0f * tileSize, 15.0f, 0.0f), 90.0f, -5.0f);
+	add(24.0f, glm::vec3(0.0f, 10.0f, 0.0f), 180.0f, 0.0f);
+	add(26.0f, glm::vec3(0.0f, 10.0f, 0.0f), 270.0f, 0.0f);
+}
+
+void CameraPath::add(float time, glm::vec3 position, float yaw, float pitch)
+{
+	keys.push_back({time, position, yaw, pitch});
+}
+
+float CameraPath::duration() const
+{
+	return keys.empty() ? 0.0f : keys.back().time;
+}
+
+void CameraPath::sample(float time, glm::vec3& position, float& yaw, float& pitch) const
+{
+	if (keys.empty()) return;
+	if (keys.size() == 1 || duration() <= 0.0f) {
+		position = keys[0].position;
+		yaw = keys[0].yaw;
+		pitch = keys[0].pitch;
+		return;
+	}
+
+	time = std::fmod(time, duration());
+	size_t next = 1;
+	while (next < keys.size() - 1 && keys[next].time < time) ++next;
+	const CameraKeyframe& a = keys[next - 1];
+	const CameraKeyframe& b = keys[next];
+
+	float factor = (b.time > a.time) ? glm::clamp((time - a.time) / (b.time - a.time), 0.0f, 1.0f) : 0.0f;
+	position = glm::mix(a.position, b.position, factor);
+	yaw = glm::mix(a.yaw, b.yaw, factor);
+	pitch = glm::mix(a.pitch, b.pitch, factor);
+}
+
+float percentile(std::vector<float> values, float p)
+{
+	if (values.empty()) return 0.0f;
+	std::sort(values.begin(), values.end());
+	// nearest-rank
+	size_t rank = static_cast<size_t>(std::ceil(p / 100.0f * values.size()));
+	if (rank > 0) rank--;
+	return values[std::min(rank, values.size() - 1)];
+}
+
+size_t peakResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return static_cast<size_t>(usage.ru_maxrss); // bytes on macOS
+#else
+	return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes on Linux
+#endif
+#endif
+}
+
+// A JSON string literal: quotes, backslashes and control characters escaped
+static void writeString(std::ostream& out, const std::string& text)
+{
+	out << '"';
+	for (unsigned char c : text)
+	{
+		switch (c) {
+		case '"': out << "\\\""; break;
+		case '\\': out << "\\\\"; break;
+		case '\n': out << "\\n"; break;
+		case '\r': out << "\\r"; break;
+		case '\t': out << "\\t"; break;
+		default:
+			if (c < 0x20) {
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+				out << escaped;
+			}
+			else out << c;
+		}
+	}
+	out << '"';
+}
+
+static void writeDistribution(std::ostream& out, const char* name, const std::vector<float>& values)
+{
+	double sum = 0.0;
+	for (float v : values) sum += v;
+	float mean = values.empty() ? 0.0f : static_cast<float>(sum / values.size());
+	float maxValue = values.empty() ? 0.0f : *std::max_element(values.begin(), values.end());
+
+	out << "  \"" << name << "\": {"
+		<< "\"samples\": " << values.size()
+		<< ", \"mean\": " << mean
+		<< ", \"p50\": " << percentile(values, 50.0f)
+		<< ", \"p95\": " << percentile(values, 95.0f)
+		<< ", \"p99\": " << percentile(values, 99.0f)
+		<< ", \"max\": " << maxValue << "},\n";
+}
+
+void BenchmarkStats::reserve(int frames)
+{
+	frameMs.reserve(frames);
+	cpuMs.reserve(frames);
+	gpuMs.reserve(frames);
+	allocations.reserve(frames);
+}
+
+bool BenchmarkStats::writeReport(const BenchmarkConfig& config, const char* renderer) const
+{
+	std::ofstream out(config.reportFile);
+	if (!out.is_open()) {
+		std::cerr << "Failed to write benchmark report " << config.reportFile << std::endl;
+		return false;
+	}
+
+	float cpuMedian = percentile(cpuMs, 50.0f);
+	float gpuMedian = percentile(gpuMs, 50.0f);
+
+	out << "{\n";
+	out << "  \"renderer\": ";
+	writeString(out, renderer ? renderer : "unknown");
+	out << ",\n";
+	out << "  \"frames\": " << frameMs.size() << ",\n";
+	out << "  \"warmup_frames\": " << config.warmupFrames << ",\n";
+	out << "  \"timestep\": " << config.timestep << ",\n";
+	out << "  \"resolution\": [" << config.width << ", " << config.height << "],\n";
+	out << "  \"camera_path\": ";
+	writeString(out, config.pathFile.empty() ? "default" : config.pathFile);
+	out << ",\n";
+	writeDistribution(out, "frame_ms", frameMs);
+	writeDistribution(out, "cpu_ms", cpuMs);
+	writeDistribution(out, "gpu_ms", gpuMs);
+	writeDistribution(out, "allocations_per_frame", allocations);
+	out << "  \"bound\": \"" << (gpuMedian > cpuMedian ? "gpu" : "cpu") << "\",\n";
+	out << "  \"tile_crossings\": " << tileCrossings << ",\n";
+	out << "  \"peak_rss_bytes\": " << peakResidentBytes() << ",\n";
+	out << "  \"texture_resident_peak_bytes\": " << textureResidentPeak << ",\n";
+	out << "  \"lod_histogram\": [";
+	for (size_t i = 0; i < lodHistogram.size(); ++i)
+		out << (i ? ", " : "") << lodHistogram[i];
+	out << "],\n";
+	out << "  \"occlusion\": {\"tests\": " << occlusionTests << ", \"culled\": " << occlusionCulled << "},\n";
+	out << "  \"shadow_atlas_updates\": " << shadowAtlasUpdates << ",\n";
+	out << "  \"quality\": {\"level\": " << qualityLevel << ", \"changes\": " << qualityChanges << "},\n";
+	out << "  \"render_scale_mean\": " << renderScaleMean << ",\n";
+
+	// highest live GPU bytes of each subsystem at the end of any frame
+	const GpuResourceTracker& gpu = GetGpuResources();
+	out << "  \"gpu_memory_peak_bytes\": {\"total\": " << gpu.total.peakBytes;
+	for (int i = 0; i < (int)GpuOwner::Count; ++i)
+		out << ", \"" << gpuOwnerName((GpuOwner)i) << "\": " << gpu.owners[i].peakBytes;
+	out << "},\n";
+
+	// mean per-frame CPU time of each profiler scope
+	out << "  \"scopes\": {";
+	int frames = std::max(Profiler::frameCount(), 1);
+	for (int i = 0; i < Profiler::sampleCount(); ++i)
+	{
+		const ProfileSample& s = Profiler::sample(i);
+		out << (i ? ", " : "") << "\"" << s.name << "\": " << s.totalMs / frames;
+	}
+	out << "},\n";
+
+	// mean per-frame heap allocations made inside each profiler scope
+	out << "  \"scope_allocations\": {";
+	for (int i = 0; i < Profiler::sampleCount(); ++i)
+	{
+		const ProfileSample& s = Profiler::sample(i);
+		out << (i ? ", " : "") << "\"" << s.name << "\": " << (double)s.totalAllocations / frames;
+	}
+	out << "},\n";
+
+	// mean GPU time of each timed pass over the frames it was read back for
+	const GpuPassTimer& passes = GetGpuPassTimer();
+	out << "  \"gpu_passes\": {";
+	for (int i = 0; i < passes.passCount; ++i)
+	{
+		const GpuPassTimer::Pass& p = passes.passes[i];
+		out << (i ? ", " : "") << "\"" << p.name << "\": " << p.totalMs / std::max(p.frames, 1);
+	}
+	out << "},\n";
+
+	// job system use over the whole run, warmup and loading included
+	const JobSystem& jobs = GetJobSystem();
+	out << "  \"jobs\": {\"workers\": " << jobs.workerCount() << ", \"executed\": " << jobs.jobsExecuted()
+		<< ", \"stolen\": " << jobs.jobsStolen() << "}\n";
+	out << "}\n";
+
+	std::cout << "Benchmark: " << frameMs.size() << " frames, frame p50/p95/p99 "
+			  << percentile(frameMs, 50.0f) << "/" << percentile(frameMs, 95.0f) << "/" << percentile(frameMs, 99.0f)
+			  << " ms, cpu p50 " << cpuMedian << " ms, gpu p50 " << gpuMedian << " ms, allocations/frame max "
+			  << (allocations.empty() ? 0.0f : *std::max_element(allocations.begin(), allocations.end())) << std::endl;
+	std::cout << "Benchmark report written to " << config.reportFile << std::endl;
+	return true;
+}
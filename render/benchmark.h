@@ -0,0 +1,78 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Options for --benchmark runs. Everything has a default so "--benchmark"
+// on its own is a complete, repeatable run.
+struct BenchmarkConfig
+{
+    bool enabled = false;
+    int frames = 1000;
+    int warmupFrames = 60;          // not included in the report
+    float timestep = 1.0f / 60.0f;  // fixed simulation step per frame
+    int width = 1024;
+    int height = 768;
+    std::string pathFile;           // empty = built-in path
+    std::string reportFile = "benchmark_report.json";
+};
+
+// Returns false if the arguments are malformed. Unknown arguments are ignored.
+bool parseBenchmarkArgs(int argc, char** argv, BenchmarkConfig& config);
+
+struct CameraKeyframe
+{
+    float time;
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+};
+
+// Camera path played back by the benchmark, or recorded from an interactive
+// session. Stored as one "time x y z yaw pitch" line per keyframe.
+struct CameraPath
+{
+    std::vector<CameraKeyframe> keys;
+
+    bool load(const std::string& path);
+
+    bool save(const std::string& path) const;
+
+    // A loop that crosses tile boundaries in both axes and turns the camera.
+    void makeDefault(float tileSize);
+
+    void add(float time, glm::vec3 position, float yaw, float pitch);
+
+    float duration() const;
+
+    // Linear interpolation between keyframes, wrapping past the end.
+    void sample(float time, glm::vec3& position, float& yaw, float& pitch) const;
+};
+
+struct BenchmarkStats
+{
+    std::vector<float> frameMs; // wall time per frame
+    std::vector<float> cpuMs;   // CPU submission time per frame
+    std::vector<float> gpuMs;   // GL_TIME_ELAPSED per frame
+    std::vector<float> allocations; // heap allocations made by the main thread per frame
+    int tileCrossings = 0;
+    size_t textureResidentPeak = 0; // bytes of streamed mip levels
+    std::vector<long long> lodHistogram; // model LOD selections per level
+    long long occlusionTests = 0;   // boxes tested against the occluders
+    long long occlusionCulled = 0;  // of which were hidden
+    long long shadowAtlasUpdates = 0; // shadow atlas regions drawn
+    int qualityLevel = 0;           // quality governor level at the end of the run
+    int qualityChanges = 0;
+    float renderScaleMean = 1.0f;   // dynamic resolution scale over the measured frames
+
+    void reserve(int frames);
+    bool writeReport(const BenchmarkConfig& config, const char* renderer) const;
+};
+
+float percentile(std::vector<float> values, float p);
+
+size_t peakResidentBytes();
+
+#endif
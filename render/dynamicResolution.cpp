@@ -0,0 +1,45 @@
+#include "dynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+void DynamicResolution::initialise(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+}
+
+int DynamicResolution::renderWidth() const
+{
+    if (!enabled) return width;
+    return std::clamp((int)std::lround(width * scale), 1, width);
+}
+
+int DynamicResolution::renderHeight() const
+{
+    if (!enabled) return height;
+    return std::clamp((int)std::lround(height * scale), 1, height);
+}
+
+void DynamicResolution::addGpuSample(float ms)
+{
+    if (!enabled || targetGpuMs <= 0.0f || ms <= 0.0f) return;
+    if (std::abs(ms - targetGpuMs) < deadband * targetGpuMs) return;
+
+    // cost ~ scale^2, so the scale that would have hit the target
+    float estimate = scale * std::sqrt(targetGpuMs / ms);
+    float next = scale + (estimate - scale) * response;
+
+    // in whole steps, and at least one towards the estimate, so being a
+    // little off the target still moves the scale rather than rounding back
+    float current = std::round(scale / step);
+    float steps = ms > targetGpuMs ? std::min(std::floor(next / step + 1e-3f), current - 1.0f)
+                                   : std::max(std::ceil(next / step - 1e-3f), current + 1.0f);
+    scale = std::clamp(steps * step, minScale, maxScale);
+}
+
+bool DynamicResolution::saturated(float ms) const
+{
+    if (!enabled || targetGpuMs <= 0.0f) return true;
+    return ms > targetGpuMs ? scale <= minScale : scale >= maxScale;
+}
@@ -0,0 +1,39 @@
+#ifndef _DYNAMIC_RESOLUTION_H_
+#define _DYNAMIC_RESOLUTION_H_
+
+// How much of PostProcess's scene target the main pass renders: its lower
+// left corner, scale times the output's width and height, which tone mapping
+// stretches over the output. The target is only allocated once, so the scale
+// can change every frame. With a GPU time target the scale follows the
+// measured frame times: pixel count, and so roughly the fill-bound cost, goes
+// with the square of the scale.
+struct DynamicResolution
+{
+    bool enabled = false;
+    float scale = 1.0f;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    float step = 0.025f;        // the scale moves in multiples of this
+    float targetGpuMs = 0.0f;   // 0 keeps the scale where it is put
+    float deadband = 0.05f;     // fraction of the target left alone
+    float response = 0.3f;      // share of the way to the estimate taken per sample
+
+    int width = 0, height = 0;  // output size
+
+    void initialise(int width, int height);
+
+    // Size of the rendered corner at the current scale; the whole output
+    // while disabled
+    int renderWidth() const;
+    int renderHeight() const;
+
+    // A GPU frame time in milliseconds, as GpuTimer reports them
+    void addGpuSample(float ms);
+
+    // True when the scale cannot answer a GPU time of ms: over the target at
+    // minScale, under it at maxScale, or there is no target. The quality
+    // governor takes only these, so the two do not chase the same target
+    bool saturated(float ms) const;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "frameArena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+FrameArena& GetFrameArena()
+{
+    static thread_local FrameArena arena;
+    return arena;
+}
+
+FrameArena::~FrameArena()
+{
+    for (Block& block : blocks)
+        ::operator delete(block.data);
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    for (;;) {
+        if (current < blocks.size()) {
+            Block& block = blocks[current];
+            uintptr_t base = (uintptr_t)block.data;
+            uintptr_t start = (base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+            size_t end = (size_t)(start - base) + bytes;
+            if (end <= block.size) {
+                if (startCount == maxStarts) {
+                    std::copy(starts + 1, starts + maxStarts, starts);
+                    startCount--;
+                }
+                starts[startCount++] = offset;
+                used += end - offset;
+                offset = end;
+                peak = std::max(peak, used);
+                return (void*)start;
+            }
+            if (current + 1 < blocks.size()) {
+                current++;
+                offset = 0;
+                startCount = 0;
+                continue;
+            }
+        }
+
+        // out of room: a new block at least big enough for this allocation
+        size_t size = std::max(blockBytes, bytes + alignment);
+        // through operator new, so growing shows up in the allocation counts
+        unsigned char* data = (unsigned char*)::operator new(size);
+        blocks.push_back({data, size});
+        current = blocks.size() - 1;
+        offset = 0;
+        startCount = 0;
+    }
+}
+
+void FrameArena::deallocate(void* p, size_t bytes)
+{
+    if (current >= blocks.size()) return;
+    unsigned char* end = blocks[current].data + offset;
+    if ((unsigned char*)p + bytes != end) return;
+    // back to where it was allocated from, padding and all, when that is
+    // still known; otherwise to its first byte
+    size_t start = startCount > 0 ? starts[--startCount] : offset - bytes;
+    used -= offset - start;
+    offset = start;
+}
+
+void FrameArena::rewind(const Marker& marker)
+{
+    current = marker.block;
+    offset = marker.offset;
+    used = marker.used;
+    startCount = 0;
+}
+
+void FrameArena::reset()
+{
+    if (blocks.size() > 1) {
+        // the next frame will likely need as much again; fit it in one block
+        size_t total = 0;
+        for (Block& block : blocks) {
+            total += block.size;
+            ::operator delete(block.data);
+        }
+        blocks.clear();
+        unsigned char* data = (unsigned char*)::operator new(total);
+        blocks.push_back({data, total});
+    }
+    current = 0;
+    offset = 0;
+    used = 0;
+    startCount = 0;
+}
+
+size_t FrameArena::capacity() const
+{
+    size_t total = 0;
+    for (const Block& block : blocks)
+        total += block.size;
+    return total;
+}
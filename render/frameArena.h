@@ -0,0 +1,93 @@
+#ifndef _FRAME_ARENA_H_
+#define _FRAME_ARENA_H_
+
+#include <cstddef>
+#include <vector>
+
+// Linear allocator for temporaries that live no longer than a frame.
+// Allocating bumps an offset and nothing is freed until reset, which the
+// owning thread calls at the top of each frame (the simulation thread at the
+// top of each tick), when none of its temporaries are alive. Blocks are kept
+// across frames; after a frame that spilled past the first block they are
+// merged into one big enough for it, so steady-state frames stay off the heap.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t blockBytes = 256 * 1024) : blockBytes(blockBytes) {}
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    // Only gives the space back when p is the latest allocation, along with
+    // the padding allocate put before it for the last few still in the block
+    void deallocate(void* p, size_t bytes);
+
+    void reset();
+
+    // Where the arena is now; rewinding to it frees everything allocated
+    // since, so a loop can reuse the same space for each iteration's scratch
+    struct Marker {
+        size_t block;
+        size_t offset;
+        size_t used;
+    };
+    Marker mark() const { return {current, offset, used}; }
+    void rewind(const Marker& marker);
+
+    size_t capacity() const;
+    size_t usedBytes() const { return used; }
+    size_t peakBytes() const { return peak; } // most used by a single frame
+
+private:
+    struct Block {
+        unsigned char* data;
+        size_t size;
+    };
+
+    size_t blockBytes;
+    std::vector<Block> blocks;
+    size_t current = 0;     // block being allocated from
+    size_t offset = 0;      // into blocks[current]
+    size_t used = 0;
+    size_t peak = 0;
+
+    // offsets before the padding of the latest allocations in blocks[current],
+    // newest at starts[startCount - 1]; the oldest drop off when it is full
+    static const int maxStarts = 16;
+    size_t starts[maxStarts];
+    int startCount = 0;
+};
+
+// The calling thread's arena
+FrameArena& GetFrameArena();
+
+// Standard allocator over a frame arena, for containers that are built and
+// thrown away within one frame
+template <typename T>
+struct FrameAllocator
+{
+    using value_type = T;
+
+    FrameArena* arena;
+
+    FrameAllocator() : arena(&GetFrameArena()) {}
+    explicit FrameAllocator(FrameArena& arena) : arena(&arena) {}
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T* p, size_t n) { arena->deallocate(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const FrameAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const FrameAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+#endif
@@ -0,0 +1,162 @@
+#include "frameCapture.h"
+#include "gpuResources.h"
+
+#include <stb_image_write.h>
+#include <cstring>
+#include <iostream>
+
+void FrameCapture::initialise()
+{
+	for (Slot& slot : slots)
+		slot.pbo = gpuCreateBuffer(GpuOwner::Targets, GPU_SITE);
+	head = tail = 0;
+	stopping = false;
+	worker = std::thread(&FrameCapture::encodeLoop, this);
+}
+
+void FrameCapture::request(GLuint fbo, int width, int height, CaptureFormat format, const std::string& filename)
+{
+	// every slot still in flight: finish the oldest rather than drop a frame of a sequence
+	if (head - tail == ringSize) {
+		retire(true);
+		stalls++;
+	}
+
+	Slot& slot = slots[head % ringSize];
+	size_t bytes = (size_t)width * height * 4; // RGBA8 or one float per pixel
+	slot.width = width;
+	slot.height = height;
+	slot.format = format;
+	slot.filename = filename;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	if (bytes > slot.capacity) {
+		gpuBufferData(GL_PIXEL_PACK_BUFFER, slot.pbo, bytes, nullptr, GL_STREAM_READ);
+		slot.capacity = bytes;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	if (format == CaptureFormat::Colour) {
+		glReadBuffer(fbo == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	} else {
+		glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	head++;
+}
+
+void FrameCapture::update()
+{
+	while (head != tail)
+	{
+		GLenum status = glClientWaitSync(slots[tail % ringSize].fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+		retire(false);
+	}
+}
+
+void FrameCapture::retire(bool wait)
+{
+	Slot& slot = slots[tail % ringSize];
+	if (wait)
+		glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+
+	EncodeJob job;
+	job.width = slot.width;
+	job.height = slot.height;
+	job.format = slot.format;
+	job.filename = slot.filename;
+	job.pixels.resize((size_t)slot.width * slot.height * 4);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, job.pixels.size(), GL_MAP_READ_BIT);
+	if (data) {
+		memcpy(job.pixels.data(), data, job.pixels.size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	tail++;
+
+	if (!data) {
+		std::cerr << "Failed to map capture buffer for " << job.filename << std::endl;
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	wake.notify_one();
+}
+
+void FrameCapture::flush()
+{
+	while (head != tail)
+		retire(true);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	wake.wait(lock, [this]() { return jobs.empty(); });
+}
+
+void FrameCapture::cleanup()
+{
+	flush();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	if (worker.joinable()) worker.join();
+
+	for (Slot& slot : slots) {
+		gpuDeleteBuffer(slot.pbo);
+		slot.capacity = 0;
+	}
+}
+
+void FrameCapture::encodeLoop()
+{
+	std::vector<unsigned char> image;
+	for (;;)
+	{
+		EncodeJob job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (jobs.empty()) return;
+			job = std::move(jobs.front());
+		}
+
+		// GL rows start at the bottom; PNG rows start at the top
+		int channels = job.format == CaptureFormat::Colour ? 4 : 3;
+		image.resize((size_t)job.width * job.height * channels);
+		for (int y = 0; y < job.height; ++y)
+		{
+			unsigned char* dst = &image[(size_t)(job.height - 1 - y) * job.width * channels];
+			if (job.format == CaptureFormat::Colour) {
+				memcpy(dst, &job.pixels[(size_t)y * job.width * 4], (size_t)job.width * 4);
+			} else {
+				const float* depth = reinterpret_cast<const float*>(job.pixels.data()) + (size_t)y * job.width;
+				for (int x = 0; x < job.width; ++x)
+					dst[3*x] = dst[3*x+1] = dst[3*x+2] = (unsigned char)(depth[x] * 255);
+			}
+		}
+
+		if (!stbi_write_png(job.filename.c_str(), job.width, job.height, channels, image.data(), job.width * channels))
+			std::cerr << "Failed to write capture " << job.filename << std::endl;
+
+		// only drop the job once it is written, so flush() waits for the file
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.pop_front();
+		}
+		wake.notify_all();
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef _FRAME_CAPTURE_H_
+#define _FRAME_CAPTURE_H_
+
+#include <glad/gl.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class CaptureFormat {Colour = 0, Depth = 1};
+
+// Asynchronous framebuffer captures. glReadPixels goes into a ring of pixel
+// buffer objects and is only mapped once its fence has signalled a few frames
+// later; PNG encoding then happens on a worker thread, so continuous capture
+// does not stall the GPU or the render thread.
+struct FrameCapture
+{
+    static const int ringSize = 3;
+
+    struct Slot {
+        GLuint pbo = 0;
+        GLsync fence = nullptr;
+        size_t capacity = 0;
+        int width, height;
+        CaptureFormat format;
+        std::string filename;
+    };
+
+    struct EncodeJob {
+        std::vector<unsigned char> pixels; // raw readback, bottom row first
+        int width, height;
+        CaptureFormat format;
+        std::string filename;
+    };
+
+    Slot slots[ringSize];
+    int head = 0;  // next slot to issue
+    int tail = 0;  // oldest slot in flight
+    int stalls = 0; // requests that had to wait for a full ring
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<EncodeJob> jobs;
+    bool stopping = false;
+
+    void initialise();
+
+    // Starts an asynchronous read of the colour or depth buffer of fbo
+    // (0 = default framebuffer, read from the back buffer).
+    void request(GLuint fbo, int width, int height, CaptureFormat format, const std::string& filename);
+
+    // Hands finished readbacks to the encoder; call once per frame.
+    void update();
+
+    // Waits for all outstanding captures to be written.
+    void flush();
+
+    void cleanup();
+
+private:
+    void retire(bool wait);
+    void encodeLoop();
+};
+
+#endif
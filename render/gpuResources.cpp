@@ -0,0 +1,256 @@
+#include "gpuResources.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+static const char* kindNames[(int)GpuKind::Count] = {"buffer", "texture", "vertex array", "framebuffer", "renderbuffer", "program"};
+
+const char* gpuOwnerName(GpuOwner owner)
+{
+    static const char* names[(int)GpuOwner::Count] = {"tiles", "models", "vegetation", "textures", "shadows", "targets", "shaders", "particles"};
+    return names[(int)owner];
+}
+
+GpuResourceTracker& GetGpuResources()
+{
+    static GpuResourceTracker tracker;
+    return tracker;
+}
+
+// GL names are only unique per kind
+static unsigned long long recordKey(GpuKind kind, GLuint name)
+{
+    return ((unsigned long long)kind << 32) | name;
+}
+
+void GpuResourceTracker::add(GpuKind kind, GLuint name, GpuOwner owner, const char* site)
+{
+    if (name == 0) return;
+    auto [it, inserted] = records.emplace(recordKey(kind, name), Record{owner, site, 0});
+    if (!inserted) {
+        // the name was deleted behind the tracker's back and handed out again
+        fprintf(stderr, "GPU %s %u from %s was never released through the tracker\n", kindNames[(int)kind], name, it->second.site);
+        remove(kind, name);
+        records.emplace(recordKey(kind, name), Record{owner, site, 0});
+    }
+    owners[(int)owner].count++;
+    total.count++;
+}
+
+void GpuResourceTracker::remove(GpuKind kind, GLuint name)
+{
+    auto it = records.find(recordKey(kind, name));
+    if (it == records.end()) return;
+    Totals& owner = owners[(int)it->second.owner];
+    owner.count--;
+    owner.bytes -= it->second.bytes;
+    total.count--;
+    total.bytes -= it->second.bytes;
+    records.erase(it);
+}
+
+void GpuResourceTracker::setBytes(GpuKind kind, GLuint name, size_t bytes)
+{
+    auto it = records.find(recordKey(kind, name));
+    if (it == records.end()) return;
+    addBytes(kind, name, (ptrdiff_t)bytes - (ptrdiff_t)it->second.bytes);
+}
+
+void GpuResourceTracker::addBytes(GpuKind kind, GLuint name, ptrdiff_t bytes)
+{
+    auto it = records.find(recordKey(kind, name));
+    if (it == records.end()) return;
+    it->second.bytes += bytes;
+    owners[(int)it->second.owner].bytes += bytes;
+    total.bytes += bytes;
+}
+
+void GpuResourceTracker::endFrame()
+{
+    for (Totals& owner : owners)
+        owner.peakBytes = std::max(owner.peakBytes, owner.bytes);
+    total.peakBytes = std::max(total.peakBytes, total.bytes);
+
+    bool over = budgetBytes > 0 && total.bytes > budgetBytes;
+    if (over && !overBudget) {
+        char owners[256];
+        summary(owners, sizeof(owners));
+        fprintf(stderr, "GPU memory over budget: %.1f of %.1f MiB (%s)\n",
+                total.bytes / 1048576.0, budgetBytes / 1048576.0, owners);
+    }
+    overBudget = over;
+}
+
+void GpuResourceTracker::summary(char* text, size_t size) const
+{
+    if (size == 0) return;
+    text[0] = '\0';
+    size_t length = 0;
+    for (int i = 0; i < (int)GpuOwner::Count && length < size; ++i) {
+        if (owners[i].count == 0) continue;
+        int written = snprintf(text + length, size - length, "%s%s %.1f MiB", length == 0 ? "" : ", ",
+                               gpuOwnerName((GpuOwner)i), owners[i].bytes / 1048576.0);
+        if (written < 0) break;
+        length += (size_t)written;
+    }
+}
+
+int GpuResourceTracker::reportLeaks() const
+{
+    if (records.empty()) return 0;
+
+    struct Leak {
+        GpuKind kind;
+        GpuOwner owner;
+        int count = 0;
+        size_t bytes = 0;
+    };
+    std::map<std::string, Leak> bySite;
+    for (const auto& [key, record] : records) {
+        GpuKind kind = (GpuKind)(key >> 32);
+        Leak& leak = bySite[std::string(record.site) + " " + kindNames[(int)kind]];
+        leak.kind = kind;
+        leak.owner = record.owner;
+        leak.count++;
+        leak.bytes += record.bytes;
+    }
+
+    fprintf(stderr, "GPU resources still alive at shutdown: %d (%.1f MiB)\n", total.count, total.bytes / 1048576.0);
+    for (const auto& [site, leak] : bySite)
+        fprintf(stderr, "  %-10s %d x %s, %.1f KiB\n", gpuOwnerName(leak.owner), leak.count, site.c_str(), leak.bytes / 1024.0);
+    return (int)records.size();
+}
+
+GLuint gpuCreateBuffer(GpuOwner owner, const char* site)
+{
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    GetGpuResources().add(GpuKind::Buffer, buffer, owner, site);
+    return buffer;
+}
+
+GLuint gpuCreateTexture(GpuOwner owner, const char* site)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    GetGpuResources().add(GpuKind::Texture, texture, owner, site);
+    return texture;
+}
+
+GLuint gpuCreateVertexArray(GpuOwner owner, const char* site)
+{
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    GetGpuResources().add(GpuKind::VertexArray, vao, owner, site);
+    return vao;
+}
+
+GLuint gpuCreateFramebuffer(GpuOwner owner, const char* site)
+{
+    GLuint fbo;
+    glGenFramebuffers(1, &fbo);
+    GetGpuResources().add(GpuKind::Framebuffer, fbo, owner, site);
+    return fbo;
+}
+
+GLuint gpuCreateRenderbuffer(GpuOwner owner, const char* site)
+{
+    GLuint renderbuffer;
+    glGenRenderbuffers(1, &renderbuffer);
+    GetGpuResources().add(GpuKind::Renderbuffer, renderbuffer, owner, site);
+    return renderbuffer;
+}
+
+GLuint gpuCreateProgram(GpuOwner owner, const char* site)
+{
+    GLuint program = glCreateProgram();
+    GetGpuResources().add(GpuKind::Program, program, owner, site);
+    return program;
+}
+
+void gpuBufferData(GLenum target, GLuint buffer, GLsizeiptr size, const void* data, GLenum usage)
+{
+    glBufferData(target, size, data, usage);
+    GetGpuResources().setBytes(GpuKind::Buffer, buffer, (size_t)size);
+}
+
+void gpuRenderbufferStorage(GLuint renderbuffer, GLenum internalFormat, int width, int height, int bytesPerPixel)
+{
+    glRenderbufferStorage(GL_RENDERBUFFER, internalFormat, width, height);
+    GetGpuResources().setBytes(GpuKind::Renderbuffer, renderbuffer, (size_t)width * height * bytesPerPixel);
+}
+
+void gpuDeleteBuffer(GLuint& buffer)
+{
+    if (buffer == 0) return;
+    GetGpuResources().remove(GpuKind::Buffer, buffer);
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+}
+
+void gpuDeleteTexture(GLuint& texture)
+{
+    if (texture == 0) return;
+    GetGpuResources().remove(GpuKind::Texture, texture);
+    glDeleteTextures(1, &texture);
+    texture = 0;
+}
+
+void gpuDeleteVertexArray(GLuint& vao)
+{
+    if (vao == 0) return;
+    GetGpuResources().remove(GpuKind::VertexArray, vao);
+    glDeleteVertexArrays(1, &vao);
+    vao = 0;
+}
+
+void gpuDeleteFramebuffer(GLuint& fbo)
+{
+    if (fbo == 0) return;
+    GetGpuResources().remove(GpuKind::Framebuffer, fbo);
+    glDeleteFramebuffers(1, &fbo);
+    fbo = 0;
+}
+
+void gpuDeleteRenderbuffer(GLuint& renderbuffer)
+{
+    if (renderbuffer == 0) return;
+    GetGpuResources().remove(GpuKind::Renderbuffer, renderbuffer);
+    glDeleteRenderbuffers(1, &renderbuffer);
+    renderbuffer = 0;
+}
+
+void gpuDeleteProgram(GLuint program)
+{
+    if (program == 0) return;
+    GetGpuResources().remove(GpuKind::Program, program);
+    glDeleteProgram(program);
+}
+
+GLuint gpuCreate(GpuKind kind, GpuOwner owner, const char* site)
+{
+    switch (kind) {
+        case GpuKind::Buffer: return gpuCreateBuffer(owner, site);
+        case GpuKind::Texture: return gpuCreateTexture(owner, site);
+        case GpuKind::VertexArray: return gpuCreateVertexArray(owner, site);
+        case GpuKind::Framebuffer: return gpuCreateFramebuffer(owner, site);
+        case GpuKind::Renderbuffer: return gpuCreateRenderbuffer(owner, site);
+        case GpuKind::Program: return gpuCreateProgram(owner, site);
+        default: return 0;
+    }
+}
+
+void gpuDelete(GpuKind kind, GLuint& name)
+{
+    switch (kind) {
+        case GpuKind::Buffer: gpuDeleteBuffer(name); break;
+        case GpuKind::Texture: gpuDeleteTexture(name); break;
+        case GpuKind::VertexArray: gpuDeleteVertexArray(name); break;
+        case GpuKind::Framebuffer: gpuDeleteFramebuffer(name); break;
+        case GpuKind::Renderbuffer: gpuDeleteRenderbuffer(name); break;
+        case GpuKind::Program: gpuDeleteProgram(name); name = 0; break;
+        default: break;
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef _GPU_RESOURCES_H_
+#define _GPU_RESOURCES_H_
+
+#include <glad/gl.h>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+
+// Subsystems GPU memory is charged to
+enum class GpuOwner {Tiles, Models, Vegetation, Textures, Shadows, Targets, Shaders, Particles, Count};
+
+enum class GpuKind {Buffer, Texture, VertexArray, Framebuffer, Renderbuffer, Program, Count};
+
+const char* gpuOwnerName(GpuOwner owner);
+
+// Every buffer, texture, vertex array, framebuffer, renderbuffer and program
+// is created and deleted through the gpu* helpers below, which record its
+// owner, the file and line that created it and, once storage is given, its
+// size. Sizes are what the application asked for, not what the driver spent.
+// GL objects only live on the main thread, so neither is this locked.
+struct GpuResourceTracker
+{
+    struct Totals {
+        int count = 0;
+        size_t bytes = 0;
+        size_t peakBytes = 0;   // highest bytes seen at the end of a frame
+    };
+
+    size_t budgetBytes = 0;     // warn when the live total goes over; 0 never warns
+
+    Totals owners[(int)GpuOwner::Count];
+    Totals total;
+
+    void add(GpuKind kind, GLuint name, GpuOwner owner, const char* site);
+    void remove(GpuKind kind, GLuint name);
+    void setBytes(GpuKind kind, GLuint name, size_t bytes);
+    void addBytes(GpuKind kind, GLuint name, ptrdiff_t bytes);
+
+    // Takes the peaks and warns once each time the budget is crossed
+    void endFrame();
+
+    // "tiles 12.3 MiB, models ..." for the live totals, truncated to fit
+    // size; written in place so the per-second window title does not allocate
+    void summary(char* text, size_t size) const;
+
+    // Lists whatever is still alive, grouped by creation site; returns how many
+    int reportLeaks() const;
+
+private:
+    struct Record {
+        GpuOwner owner;
+        const char* site;
+        size_t bytes;
+    };
+    std::unordered_map<unsigned long long, Record> records;
+    bool overBudget = false;
+};
+
+GpuResourceTracker& GetGpuResources();
+
+#define GPU_STRINGIFY_INNER(x) #x
+#define GPU_STRINGIFY(x) GPU_STRINGIFY_INNER(x)
+#define GPU_SITE __FILE__ ":" GPU_STRINGIFY(__LINE__)
+
+GLuint gpuCreateBuffer(GpuOwner owner, const char* site);
+GLuint gpuCreateTexture(GpuOwner owner, const char* site);
+GLuint gpuCreateVertexArray(GpuOwner owner, const char* site);
+GLuint gpuCreateFramebuffer(GpuOwner owner, const char* site);
+GLuint gpuCreateRenderbuffer(GpuOwner owner, const char* site);
+GLuint gpuCreateProgram(GpuOwner owner, const char* site);
+
+// glBufferData on the buffer bound to target, recording its new size
+void gpuBufferData(GLenum target, GLuint buffer, GLsizeiptr size, const void* data, GLenum usage);
+
+// glRenderbufferStorage on the bound renderbuffer, recording its size
+void gpuRenderbufferStorage(GLuint renderbuffer, GLenum internalFormat, int width, int height, int bytesPerPixel);
+
+// Deleting 0 does nothing; the name is zeroed afterwards
+void gpuDeleteBuffer(GLuint& buffer);
+void gpuDeleteTexture(GLuint& texture);
+void gpuDeleteVertexArray(GLuint& vao);
+void gpuDeleteFramebuffer(GLuint& fbo);
+void gpuDeleteRenderbuffer(GLuint& renderbuffer);
+void gpuDeleteProgram(GLuint program);
+
+GLuint gpuCreate(GpuKind kind, GpuOwner owner, const char* site);
+void gpuDelete(GpuKind kind, GLuint& name);
+
+// Sole owner of one GL object, deleted through the tracker when the handle is
+// reset, reassigned or destroyed. Handles move but never copy, so a struct
+// holding one cannot be copied by accident and free the object twice. The GL
+// context must still be current when a live handle goes away, which is why
+// the owners keep their explicit cleanup.
+template <GpuKind Kind>
+class GlHandle
+{
+public:
+    GlHandle() = default;
+    explicit GlHandle(GLuint name) : name(name) {}  // takes over an existing object
+
+    GlHandle(const GlHandle&) = delete;
+    GlHandle& operator=(const GlHandle&) = delete;
+
+    GlHandle(GlHandle&& other) noexcept : name(other.name) { other.name = 0; }
+    GlHandle& operator=(GlHandle&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            name = other.name;
+            other.name = 0;
+        }
+        return *this;
+    }
+
+    ~GlHandle() { reset(); }
+
+    static GlHandle create(GpuOwner owner, const char* site) { return GlHandle(gpuCreate(Kind, owner, site)); }
+
+    // the name, for passing to GL; it stays owned by the handle
+    operator GLuint() const { return name; }
+
+    void reset() { gpuDelete(Kind, name); }
+
+private:
+    GLuint name = 0;
+};
+
+using GlBuffer = GlHandle<GpuKind::Buffer>;
+using GlTexture = GlHandle<GpuKind::Texture>;
+using GlVertexArray = GlHandle<GpuKind::VertexArray>;
+using GlFramebuffer = GlHandle<GpuKind::Framebuffer>;
+using GlRenderbuffer = GlHandle<GpuKind::Renderbuffer>;
+using GlProgram = GlHandle<GpuKind::Program>;
+
+#endif
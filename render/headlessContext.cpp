@@ -0,0 +1,98 @@
+#include "headlessContext.h"
+
+#include <iostream>
+
+#ifdef LUMINOUS_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+
+bool createHeadlessContext()
+{
+	// Prefer the surfaceless platform so no X/Wayland server is needed
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		std::cerr << "Failed to initialise EGL display." << std::endl;
+		return false;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		std::cerr << "EGL implementation has no desktop OpenGL." << std::endl;
+		eglTerminate(display);
+		return false;
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config = nullptr;
+	EGLint numConfigs = 0;
+	eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	// configless contexts are fine as we never create a surface
+	context = eglCreateContext(display, numConfigs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttribs);
+	if (context == EGL_NO_CONTEXT) {
+		std::cerr << "Failed to create EGL context (0x" << std::hex << eglGetError() << std::dec << ")." << std::endl;
+		eglTerminate(display);
+		return false;
+	}
+
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		std::cerr << "Failed to make surfaceless EGL context current." << std::endl;
+		destroyHeadlessContext();
+		return false;
+	}
+
+	std::cout << "Created headless EGL " << major << "." << minor << " context." << std::endl;
+	return true;
+}
+
+GLADapiproc headlessGetProcAddress(const char* name)
+{
+	return (GLADapiproc)eglGetProcAddress(name);
+}
+
+void destroyHeadlessContext()
+{
+	if (display == EGL_NO_DISPLAY) return;
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+	eglTerminate(display);
+	context = EGL_NO_CONTEXT;
+	display = EGL_NO_DISPLAY;
+}
+
+#else
+
+bool createHeadlessContext()
+{
+	return false;
+}
+
+GLADapiproc headlessGetProcAddress(const char* name)
+{
+	(void)name;
+	return nullptr;
+}
+
+void destroyHeadlessContext()
+{
+}
+
+#endif
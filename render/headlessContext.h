@@ -0,0 +1,16 @@
+#ifndef _HEADLESS_CONTEXT_H_
+#define _HEADLESS_CONTEXT_H_
+
+#include <glad/gl.h>
+
+// OpenGL 3.3 core context with no window, through surfaceless EGL. Works on
+// machines without a display or GPU (Mesa llvmpipe). Only available when the
+// build found EGL (LUMINOUS_HAS_EGL); otherwise creation always fails and the
+// caller falls back to a hidden GLFW window.
+bool createHeadlessContext();
+
+GLADapiproc headlessGetProcAddress(const char* name);
+
+void destroyHeadlessContext();
+
+#endif
@@ -0,0 +1,176 @@
+#include "jobSystem.h"
+
+// the deque this thread pushes to: its own for a worker, the shared one otherwise
+static thread_local int queueIndex = 0;
+
+void JobSystem::initialise(int workers)
+{
+    if (workers < 0) workers = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+    if (workers > maxWorkers) workers = maxWorkers;
+
+    stopping = false;
+    executed = 0;
+    stolen = 0;
+    this->workers = workers;
+    for (int i = 0; i < workers; ++i)
+        threads[i] = std::thread(&JobSystem::workerLoop, this, i + 1);
+}
+
+void JobSystem::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (int i = 0; i < workers; ++i)
+        if (threads[i].joinable()) threads[i].join();
+
+    // whatever was still queued runs here
+    Job job;
+    while (take(job)) run(job);
+    workers = 0;
+}
+
+void JobSystem::submit(const Job& job)
+{
+    if (job.counter) job.counter->pending.fetch_add(1);
+    push(job);
+}
+
+void JobSystem::submitAfter(const Job& job, JobCounter& after)
+{
+    if (job.counter) job.counter->pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(after.mutex);
+        if (after.pending.load() > 0 && after.continuationCount < JobCounter::maxContinuations) {
+            after.continuations[after.continuationCount++] = job;
+            return;
+        }
+    }
+    // no room to park it: its dependencies have to finish first
+    wait(after);
+    push(job);
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    Job job;
+    while (!counter.done()) {
+        if (take(job)) run(job);
+        else std::this_thread::yield();
+    }
+    // the last job to finish counts down under the lock; once it has let go
+    // nothing touches the counter again, so the caller may free it
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::push(const Job& job)
+{
+    if (workers == 0) {
+        run(job);
+        return;
+    }
+
+    Queue& queue = queues[queueIndex];
+    bool pushed;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        pushed = queue.tail - queue.head < (size_t)queueCapacity;
+        if (pushed) queue.jobs[queue.tail++ % queueCapacity] = job;
+    }
+    if (!pushed) {
+        run(job);
+        return;
+    }
+
+    // a worker going to sleep counts itself sleeping before it looks at
+    // queued, and this looks at sleeping after counting the job, so either it
+    // sees the job or it is woken here
+    queued.fetch_add(1);
+    if (sleeping.load() == 0) return;
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    wake.notify_one();
+}
+
+bool JobSystem::take(Job& job)
+{
+    if (queued.load() <= 0) return false;
+
+    // newest of our own first
+    {
+        Queue& own = queues[queueIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.tail != own.head) {
+            job = own.jobs[--own.tail % queueCapacity];
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    // then the oldest of anyone else's, starting from the next along
+    for (int i = 1; i <= workers; ++i) {
+        Queue& victim = queues[(queueIndex + i) % (workers + 1)];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tail != victim.head) {
+            job = victim.jobs[victim.head++ % queueCapacity];
+            queued.fetch_sub(1);
+            stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::run(const Job& job)
+{
+    if (job.name) {
+        ProfileScope scope(job.name);
+        job.function(job.data, job.begin, job.end);
+    }
+    else job.function(job.data, job.begin, job.end);
+    executed.fetch_add(1, std::memory_order_relaxed);
+    finish(job);
+}
+
+void JobSystem::finish(const Job& job)
+{
+    if (!job.counter) return;
+
+    JobCounter& counter = *job.counter;
+    Job ready[JobCounter::maxContinuations];
+    int readyCount = 0;
+    {
+        std::lock_guard<std::mutex> lock(counter.mutex);
+        if (counter.pending.fetch_sub(1) == 1) {
+            readyCount = counter.continuationCount;
+            std::copy(counter.continuations, counter.continuations + readyCount, ready);
+            counter.continuationCount = 0;
+        }
+    }
+    // counted when they were submitted
+    for (int i = 0; i < readyCount; ++i)
+        push(ready[i]);
+}
+
+void JobSystem::workerLoop(int index)
+{
+    queueIndex = index;
+    Job job;
+    for (;;) {
+        if (take(job)) {
+            run(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        if (stopping) return;
+        sleeping.fetch_add(1);
+        wake.wait(lock, [this]() { return stopping || queued.load() > 0; });
+        sleeping.fetch_sub(1);
+    }
+}
+
+JobSystem& GetJobSystem()
+{
+    static JobSystem jobs;
+    return jobs;
+}
@@ -0,0 +1,156 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include "profiler.h"
+
+struct JobCounter;
+
+// One piece of work, function(data, begin, end). A plain function and data
+// pointer rather than a std::function, so submitting never allocates; data
+// must outlive the job.
+struct Job
+{
+    void (*function)(void* data, size_t begin, size_t end) = nullptr;
+    void* data = nullptr;
+    size_t begin = 0, end = 0;
+    const char* name = nullptr;     // timed as a profiler scope when set; a string literal
+    JobCounter* counter = nullptr;  // counted down once the job has run
+};
+
+// Jobs submitted against it and not yet finished, and the jobs waiting for
+// them to finish. Lives wherever its jobs are waited on, usually the stack.
+struct JobCounter
+{
+    static const int maxContinuations = 16;
+
+    std::atomic<int> pending{0};
+
+    bool done() const { return pending.load() == 0; }
+
+private:
+    friend struct JobSystem;
+
+    std::mutex mutex;   // held while pending drops, and while continuations change
+    Job continuations[maxContinuations];
+    int continuationCount = 0;
+};
+
+// A fixed pool of worker threads sharing out jobs by work stealing. Every
+// worker has its own deque: it pushes and pops the newest end, so the jobs it
+// spawns run while their data is still in its cache, and when it runs dry it
+// steals the oldest job from another's, which is usually the biggest piece
+// left. Threads that are not workers (the GL thread, the simulation) share
+// one more deque. Deques are fixed rings behind a mutex each, taken only for
+// a push or pop, so contention is per deque; a job pushed to a full deque is
+// run there and then.
+//
+// wait() does not block while its jobs are outstanding: the waiting thread
+// runs queued jobs itself, so jobs may wait on jobs they spawn, and with no
+// workers (one core, or initialise(0)) everything runs on the caller in order.
+struct JobSystem
+{
+    static const int maxWorkers = 16;
+    static const int queueCapacity = 1024;  // jobs per deque
+
+    // Starts that many worker threads; below 0 takes one per core but the caller's
+    void initialise(int workers = -1);
+
+    // Runs whatever is still queued, then stops the workers
+    void shutdown();
+    ~JobSystem() { shutdown(); }
+
+    int workerCount() const { return workers; }
+
+    // Counts job against its counter and queues it
+    void submit(const Job& job);
+
+    // As submit, but the job is only queued once after has no jobs pending
+    void submitAfter(const Job& job, JobCounter& after);
+
+    // Returns once counter has nothing pending, running queued jobs meanwhile
+    void wait(JobCounter& counter);
+
+    // Runs work(begin, end) over [0, count) in chunks of at least grain,
+    // spread over the workers and the caller, and returns when all are done.
+    // Each chunk is timed as name when set.
+    template <typename Work>
+    void parallelFor(size_t count, size_t grain, const Work& work, const char* name = nullptr);
+
+    // Since initialise
+    unsigned long long jobsExecuted() const { return executed.load(std::memory_order_relaxed); }
+    unsigned long long jobsStolen() const { return stolen.load(std::memory_order_relaxed); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        Job jobs[queueCapacity];
+        size_t head = 0;    // oldest, where thieves take from
+        size_t tail = 0;    // newest, where the owner pushes and pops
+    };
+
+    Queue queues[maxWorkers + 1];   // 0 is shared by every thread that is not a worker
+    std::thread threads[maxWorkers];
+    int workers = 0;
+
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::atomic<int> queued{0};     // jobs sitting in any deque
+    std::atomic<int> sleeping{0};   // workers waiting on wake
+    std::atomic<bool> stopping{false};
+
+    std::atomic<unsigned long long> executed{0};
+    std::atomic<unsigned long long> stolen{0};
+
+    void workerLoop(int index);
+    void push(const Job& job);
+    bool take(Job& job);
+    void run(const Job& job);
+    void finish(const Job& job);
+};
+
+JobSystem& GetJobSystem();
+
+template <typename Work>
+void JobSystem::parallelFor(size_t count, size_t grain, const Work& work, const char* name)
+{
+    grain = std::max(grain, (size_t)1);
+    if (workers == 0 || count <= grain) {
+        if (name) {
+            ProfileScope scope(name);
+            work((size_t)0, count);
+        }
+        else work((size_t)0, count);
+        return;
+    }
+
+    // a few chunks per thread, so a thread that finishes early has some to steal
+    size_t chunks = std::min((count + grain - 1) / grain, (size_t)(workers + 1) * 4);
+    size_t chunk = (count + chunks - 1) / chunks;
+
+    JobCounter counter;
+    Job job;
+    job.function = [](void* data, size_t begin, size_t end) { (*static_cast<const Work*>(data))(begin, end); };
+    job.data = const_cast<Work*>(&work);
+    job.name = name;
+    job.counter = &counter;
+    for (size_t begin = chunk; begin < count; begin += chunk) {
+        job.begin = begin;
+        job.end = std::min(count, begin + chunk);
+        submit(job);
+    }
+
+    // the first chunk is the caller's
+    job.begin = 0;
+    job.end = chunk;
+    job.counter = nullptr;
+    run(job);
+    wait(counter);
+}
+
+#endif
@@ -0,0 +1,174 @@
+#include "lightShafts.h"
+#include "shadowAtlas.h"
+#include "gpuResources.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+void LightShafts::initialise(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    downscale = std::max(1, downscale);
+    lowWidth = (width + downscale - 1) / downscale;
+    lowHeight = (height + downscale - 1) / downscale;
+
+    depth = gpuCreateTexture(GpuOwner::Targets, GPU_SITE);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+    GetGpuResources().setBytes(GpuKind::Texture, depth, (size_t)width * height * 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    depthFbo = gpuCreateFramebuffer(GpuOwner::Targets, GPU_SITE);
+    glBindFramebuffer(GL_FRAMEBUFFER, depthFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "Error: Light shaft depth framebuffer is not complete!" << std::endl;
+
+    for (int i = 0; i < 2; ++i) {
+        history[i] = gpuCreateTexture(GpuOwner::Targets, GPU_SITE);
+        glBindTexture(GL_TEXTURE_2D, history[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, lowWidth, lowHeight, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        GetGpuResources().setBytes(GpuKind::Texture, history[i], (size_t)lowWidth * lowHeight * 8);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        historyFbo[i] = gpuCreateFramebuffer(GpuOwner::Targets, GPU_SITE);
+        glBindFramebuffer(GL_FRAMEBUFFER, historyFbo[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, history[i], 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Error: Light shaft framebuffer is not complete!" << std::endl;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // the same full screen triangle as the post passes
+    march.initialise("../shaders/fullscreen.vert", "../shaders/lightShafts.frag");
+    composite.initialise("../shaders/fullscreen.vert", "../shaders/lightShaftsComposite.frag");
+    emptyVAO = gpuCreateVertexArray(GpuOwner::Targets, GPU_SITE);
+    hasHistory = false;
+}
+
+void LightShafts::render(GLuint target, int renderWidth, int renderHeight, const glm::mat4& viewMatrix,
+                         const glm::mat4& projectionMatrix, const Light* lights, int count, const ShadowAtlas& atlas)
+{
+    marchedLastFrame = 0;
+    const Light* spot = nullptr;
+    glm::mat4 lightSpace;
+    glm::vec4 shadowRect;
+    glm::vec2 shadowRange;
+    for (int i = 0; i < count && !spot; ++i)
+        if (lights[i].type == (int)LightType::Spot && atlas.spotRegion(i, lightSpace, shadowRect, shadowRange))
+            spot = &lights[i];
+    if (!enabled || !spot) {
+        hasHistory = false;
+        return;
+    }
+
+    int w = std::min(renderWidth, width), h = std::min(renderHeight, height);
+    int marchWidth = std::max(1, (w + downscale - 1) / downscale);
+    int marchHeight = std::max(1, (h + downscale - 1) / downscale);
+    glm::vec2 depthScale((float)w / width, (float)h / height);
+    glm::vec2 marchScale((float)marchWidth / lowWidth, (float)marchHeight / lowHeight);
+    glm::mat4 viewProjection = projectionMatrix * viewMatrix;
+    glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+    glm::vec3 cameraPos = glm::vec3(glm::inverse(viewMatrix)[3]);
+    glm::vec2 depthTerms(projectionMatrix[2][2], projectionMatrix[3][2]);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, target);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFbo);
+    glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    glDisable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(emptyVAO);
+
+    // march into the history not read this frame
+    int read = current, write = 1 - current;
+    glBindFramebuffer(GL_FRAMEBUFFER, historyFbo[write]);
+    glViewport(0, 0, marchWidth, marchHeight);
+    march.use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    march.setInt("depthSampler", 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, history[read]);
+    march.setInt("historySampler", 1);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, atlas.texture);
+    march.setInt("shadowAtlas", 2);
+    march.setVec4("depthRect", glm::vec4(depthScale, 0.0f, 0.0f));
+    march.setVec4("historyRect", glm::vec4(previousScale, previousScale - 0.5f / glm::vec2(lowWidth, lowHeight)));
+    march.setFloat("historyWeight", hasHistory ? historyWeight : 0.0f);
+    march.setMatrix("inverseViewProjection", &inverseViewProjection[0][0]);
+    march.setMatrix("previousViewProjection", &previousViewProjection[0][0]);
+    march.setVec3("cameraPos", cameraPos);
+    march.setVec4("depthTerms", glm::vec4(depthTerms, 0.0f, 0.0f));
+    march.setVec3("lightPosition", spot->position);
+    march.setVec3("lightDirection", glm::normalize(spot->direction));
+    march.setVec3("lightColour", spot->colour);
+    march.setVec3("lightAttenuation", glm::vec3(spot->constant, spot->linear, spot->quadratic));
+    march.setVec4("lightCone", glm::vec4(spot->cutoff, spot->outerCutoff, 0.0f, 0.0f));
+    march.setMatrix("lightSpaceMatrix", &lightSpace[0][0]);
+    march.setVec4("shadowRect", shadowRect);
+    march.setVec4("shadowRange", glm::vec4(shadowRange, 0.0f, 0.0f));
+    march.setInt("steps", std::max(1, steps));
+    march.setFloat("density", density);
+    march.setFloat("anisotropy", anisotropy);
+    march.setFloat("fogStart", fogStart);
+    march.setFloat("fogEnd", fogEnd);
+    // golden ratio steps spread each pixel's start evenly over frames
+    march.setFloat("jitter", std::fmod(frame * 0.618034f, 1.0f));
+    frame = (frame + 1) % 1024;
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    // added over the target
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    glViewport(0, 0, w, h);
+    composite.use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, history[write]);
+    composite.setInt("shaftsSampler", 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    composite.setInt("depthSampler", 1);
+    composite.setVec4("shaftsSize", glm::vec4(marchWidth, marchHeight, 0.0f, 0.0f));
+    composite.setVec4("depthRect", glm::vec4(depthScale, 0.0f, 0.0f));
+    composite.setVec4("depthTerms", glm::vec4(depthTerms, fogEnd, 0.0f));
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glDisable(GL_BLEND);
+
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_DEPTH_TEST);
+
+    current = write;
+    hasHistory = true;
+    previousScale = marchScale;
+    previousViewProjection = viewProjection;
+    marchedLastFrame = marchWidth * marchHeight;
+}
+
+void LightShafts::cleanup()
+{
+    gpuDeleteFramebuffer(depthFbo);
+    gpuDeleteTexture(depth);
+    for (int i = 0; i < 2; ++i) {
+        gpuDeleteFramebuffer(historyFbo[i]);
+        gpuDeleteTexture(history[i]);
+    }
+    gpuDeleteVertexArray(emptyVAO);
+    march.remove();
+    composite.remove();
+}
@@ -0,0 +1,66 @@
+#ifndef _LIGHT_SHAFTS_H_
+#define _LIGHT_SHAFTS_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "light.h"
+#include "shader.h"
+
+struct ShadowAtlas;
+
+// Light scattered towards the camera inside the first shadowed spot light's
+// cone. The cone is raymarched at 1/downscale of the rendered size against
+// the light's shadow atlas region, steps samples per pixel starting at a
+// per-pixel, per-frame offset, so the cost is bounded by pixels / downscale^2
+// * steps whatever the scene. Each result is blended with last frame's,
+// reprojected through the surface behind it, which turns the jitter into
+// more samples over time; history whose depth no longer matches is dropped.
+// The low resolution result is added to the target with a bilateral
+// upsample that only takes samples of about the pixel's own depth, so the
+// shafts stay behind the edges in front of them.
+//
+// The scene's depth is copied out of the target first. Blits only copy
+// depth between matching formats, so the target's depth is 24 bit with 8 bit
+// stencil, as PostProcess's scene target has.
+struct LightShafts
+{
+    bool enabled = true;
+    int downscale = 4;          // 2 for half resolution, 4 for quarter; fixed once initialised
+    int steps = 16;             // samples per low resolution pixel
+    float density = 0.02f;      // fraction of the light scattered per unit of distance
+    float anisotropy = 0.5f;    // Henyey-Greenstein g; towards 1 scatters more forwards
+    float historyWeight = 0.85f;
+    float fogStart = 50.0f;     // the shafts fade with the scene's fog
+    float fogEnd = 150.0f;      // and are not marched past it
+
+    int width = 0, height = 0;  // output size
+
+    GLuint depth = 0;           // the target's depth, 24/8
+    GLuint depthFbo = 0;
+    GLuint history[2] = {};     // RGBA16F: scattered light, linear depth it was marched to
+    GLuint historyFbo[2] = {};
+
+    int marchedLastFrame = 0;   // low resolution pixels, 0 when there was nothing to march
+
+    void initialise(int width, int height);
+
+    // After the main pass, with target bound and its viewport on the rendered
+    // renderWidth x renderHeight corner; leaves both as they were
+    void render(GLuint target, int renderWidth, int renderHeight, const glm::mat4& viewMatrix,
+                const glm::mat4& projectionMatrix, const Light* lights, int count, const ShadowAtlas& atlas);
+
+    void cleanup();
+
+private:
+    Shader march = {};
+    Shader composite = {};
+    GLuint emptyVAO = 0;
+    int lowWidth = 0, lowHeight = 0;    // texture size
+    int current = 0;                    // history written last
+    bool hasHistory = false;
+    glm::vec2 previousScale = glm::vec2(1.0f);  // uv of the corner marched last
+    glm::mat4 previousViewProjection = glm::mat4(1.0f);
+    int frame = 0;
+};
+
+#endif
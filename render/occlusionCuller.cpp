@@ -0,0 +1,414 @@
+#include "occlusionCuller.h"
+#include "gltfModel.h"
+#include "tileManager.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2 1
+#endif
+
+int OcclusionCuller::addModel(const GLTFModel& model)
+{
+    OccluderMesh mesh;
+    int level = model.lodCount - 1;
+    for (const auto& prim : model.primitives)
+    {
+        unsigned int base = (unsigned int)mesh.positions.size();
+        for (const auto& vertex : prim.vertices)
+            mesh.positions.push_back(vertex.pos);
+        for (GLsizei i = 0; i < prim.lodIndexCount[level]; ++i)
+            mesh.indices.push_back(base + prim.indices[prim.lodFirstIndex[level] + i]);
+    }
+    meshes.push_back(std::move(mesh));
+    return (int)meshes.size() - 1;
+}
+
+int OcclusionCuller::addTerrain(const TileManager& terrain, int quads)
+{
+    // same sampling as Tile::buildVertices, at its full resolution
+    const int grid = Tile::gridSize;
+    std::vector<float> heights((grid + 1) * (grid + 1));
+    for (int iz = 0; iz <= grid; ++iz)
+        for (int ix = 0; ix <= grid; ++ix)
+            heights[iz * (grid + 1) + ix] = terrain.heights.sample(ix / (float)grid, 1.0f - iz / (float)grid);
+
+    // a coarse corner takes the lowest sample of the cells around it, so the
+    // coarse surface never rises above the tile mesh
+    OccluderMesh mesh;
+    int step = std::max(1, grid / quads);
+    quads = grid / step;
+    for (int cz = 0; cz <= quads; ++cz)
+        for (int cx = 0; cx <= quads; ++cx)
+        {
+            float lowest = FLT_MAX;
+            for (int iz = std::max(0, (cz - 1) * step); iz <= std::min(grid, (cz + 1) * step); ++iz)
+                for (int ix = std::max(0, (cx - 1) * step); ix <= std::min(grid, (cx + 1) * step); ++ix)
+                    lowest = std::min(lowest, heights[iz * (grid + 1) + ix]);
+            mesh.positions.push_back(glm::vec3((cx * step - 0.5f * grid) * terrain.tileSize / grid, lowest,
+                                               (cz * step - 0.5f * grid) * terrain.tileSize / grid));
+        }
+    for (int cz = 0; cz < quads; ++cz)
+        for (int cx = 0; cx < quads; ++cx)
+        {
+            unsigned int a = cz * (quads + 1) + cx, b = a + 1, d = a + quads + 1, c = d + 1;
+            mesh.indices.insert(mesh.indices.end(), {a, d, c, a, c, b});
+        }
+    meshes.push_back(std::move(mesh));
+    return (int)meshes.size() - 1;
+}
+
+void OcclusionCuller::initialise()
+{
+    int count = std::clamp((int)std::thread::hardware_concurrency() - 1, 1, 4);
+    stopping = false;
+    for (int strip = 0; strip < count; ++strip)
+        workers.emplace_back(&OcclusionCuller::workerLoop, this, strip);
+}
+
+void OcclusionCuller::clearOccluders()
+{
+    placements.clear();
+}
+
+void OcclusionCuller::addOccluder(int mesh, const glm::mat4& transform)
+{
+    placements.push_back({mesh, transform});
+}
+
+void OcclusionCuller::begin(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, int viewportWidth, int viewportHeight)
+{
+    ready = false;
+    if (!enabled || workers.empty()) return;
+    {
+        // a frame that never tested still has its workers running
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return busy == 0; });
+    }
+
+    PROFILE_SCOPE("occlusion_setup");
+    width = std::max(4, width & ~3); // rows are filled four pixels at a time
+    height = std::max(1, (int)std::lround((float)width * viewportHeight / viewportWidth));
+    if (levels.empty() || levelSize[0] != glm::ivec2(width, height))
+    {
+        levels.clear();
+        levelSize.clear();
+        glm::ivec2 size(width, height);
+        for (;;) {
+            levels.emplace_back(size.x * size.y);
+            levelSize.push_back(size);
+            if (size.x == 1 && size.y == 1) break;
+            size = glm::max((size + 1) / 2, glm::ivec2(1));
+        }
+    }
+
+    viewProjection = projectionMatrix * viewMatrix;
+    screen.clear();
+    triangles.clear();
+    for (const Placement& placement : placements)
+    {
+        const OccluderMesh& mesh = meshes[placement.mesh];
+        unsigned int base = (unsigned int)screen.size();
+        glm::mat4 transform = viewProjection * placement.transform;
+        for (const glm::vec3& p : mesh.positions)
+        {
+            glm::vec4 clip = transform * glm::vec4(p, 1.0f);
+            if (clip.w < nearClip) {
+                screen.push_back(glm::vec4(0.0f, 0.0f, 0.0f, -1.0f)); // marks the vertex unusable
+                continue;
+            }
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            screen.push_back(glm::vec4((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f, clip.w));
+        }
+        for (unsigned int index : mesh.indices)
+            triangles.push_back(base + index);
+    }
+    trianglesLastFrame = (int)triangles.size() / 3;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+        busy = (int)workers.size();
+    }
+    wake.notify_all();
+}
+
+void OcclusionCuller::finish()
+{
+    if (!enabled || workers.empty() || ready) return;
+    PROFILE_SCOPE("occlusion_wait");
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return busy == 0; });
+    }
+    buildPyramid();
+    ready = true;
+    testsLastFrame = culledLastFrame = 0;
+}
+
+void OcclusionCuller::workerLoop(int strip)
+{
+    unsigned long long seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+
+        int rows = (height + (int)workers.size() - 1) / (int)workers.size();
+        rasterise(std::min(height, strip * rows), std::min(height, (strip + 1) * rows));
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy--;
+        }
+        done.notify_one();
+    }
+}
+
+namespace {
+
+// One triangle after setup: inside where all three edge functions are >= 0,
+// depth a plane over the screen
+struct SetupTriangle {
+    float edgeA[3], edgeB[3], edgeC[3];
+    float depthA, depthB, depthC;
+    int minX, maxX, minY, maxY;
+};
+
+}
+
+// Sets up triangles [first, first + 4) of the list, returning how many of them are drawable
+static int setupTriangles(const std::vector<glm::vec4>& screen, const std::vector<unsigned int>& triangles, size_t first,
+                          int width, int height, SetupTriangle* out)
+{
+    size_t count = std::min<size_t>(4, triangles.size() / 3 - first);
+    float x[3][4], y[3][4], z[3][4];
+    bool usable[4];
+    for (size_t t = 0; t < 4; ++t)
+    {
+        usable[t] = t < count;
+        for (int v = 0; v < 3; ++v)
+        {
+            const glm::vec4& p = usable[t] ? screen[triangles[(first + t) * 3 + v]] : glm::vec4(0.0f);
+            x[v][t] = p.x; y[v][t] = p.y; z[v][t] = p.z;
+            usable[t] = usable[t] && p.w > 0.0f;
+        }
+    }
+
+    float area[4], edgeA[3][4], edgeB[3][4], edgeC[3][4];
+#ifdef OCCLUSION_SSE2
+    // edge i runs from vertex i + 1 to vertex i + 2, so it is zero on the side opposite vertex i
+    __m128 vx[3], vy[3];
+    for (int v = 0; v < 3; ++v) {
+        vx[v] = _mm_loadu_ps(x[v]);
+        vy[v] = _mm_loadu_ps(y[v]);
+    }
+    for (int e = 0; e < 3; ++e)
+    {
+        int a = (e + 1) % 3, b = (e + 2) % 3;
+        _mm_storeu_ps(edgeA[e], _mm_sub_ps(vy[a], vy[b]));
+        _mm_storeu_ps(edgeB[e], _mm_sub_ps(vx[b], vx[a]));
+        _mm_storeu_ps(edgeC[e], _mm_sub_ps(_mm_mul_ps(vx[a], vy[b]), _mm_mul_ps(vy[a], vx[b])));
+    }
+    __m128 areas = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(vx[1], vx[0]), _mm_sub_ps(vy[2], vy[0])),
+                              _mm_mul_ps(_mm_sub_ps(vy[1], vy[0]), _mm_sub_ps(vx[2], vx[0])));
+    _mm_storeu_ps(area, areas);
+#else
+    for (int t = 0; t < 4; ++t)
+    {
+        for (int e = 0; e < 3; ++e)
+        {
+            int a = (e + 1) % 3, b = (e + 2) % 3;
+            edgeA[e][t] = y[a][t] - y[b][t];
+            edgeB[e][t] = x[b][t] - x[a][t];
+            edgeC[e][t] = x[a][t] * y[b][t] - y[a][t] * x[b][t];
+        }
+        area[t] = (x[1][t] - x[0][t]) * (y[2][t] - y[0][t]) - (y[1][t] - y[0][t]) * (x[2][t] - x[0][t]);
+    }
+#endif
+
+    int drawable = 0;
+    for (int t = 0; t < 4; ++t)
+    {
+        if (!usable[t] || std::fabs(area[t]) < 1e-6f) continue;
+
+        SetupTriangle& tri = out[drawable];
+        float minX = std::min(x[0][t], std::min(x[1][t], x[2][t])), maxX = std::max(x[0][t], std::max(x[1][t], x[2][t]));
+        float minY = std::min(y[0][t], std::min(y[1][t], y[2][t])), maxY = std::max(y[0][t], std::max(y[1][t], y[2][t]));
+        tri.minX = std::max(0, (int)std::floor(minX)) & ~3;
+        tri.maxX = std::min(width - 1, (int)std::ceil(maxX));
+        tri.minY = std::max(0, (int)std::floor(minY));
+        tri.maxY = std::min(height - 1, (int)std::ceil(maxY));
+        if (tri.minX > tri.maxX || tri.minY > tri.maxY) continue;
+
+        // both windings are occluders; flip clockwise ones so inside is positive
+        float sign = area[t] > 0.0f ? 1.0f : -1.0f;
+        float inverseArea = 1.0f / std::fabs(area[t]);
+        tri.depthA = tri.depthB = tri.depthC = 0.0f;
+        for (int e = 0; e < 3; ++e)
+        {
+            tri.edgeA[e] = edgeA[e][t] * sign;
+            tri.edgeB[e] = edgeB[e][t] * sign;
+            tri.edgeC[e] = edgeC[e][t] * sign;
+            // the edge opposite vertex e is its barycentric weight times the area
+            tri.depthA += tri.edgeA[e] * inverseArea * z[e][t];
+            tri.depthB += tri.edgeB[e] * inverseArea * z[e][t];
+            tri.depthC += tri.edgeC[e] * inverseArea * z[e][t];
+        }
+        drawable++;
+    }
+    return drawable;
+}
+
+void OcclusionCuller::rasterise(int rowBegin, int rowEnd)
+{
+    std::vector<float>& depth = levels[0];
+    std::fill(depth.begin() + rowBegin * width, depth.begin() + rowEnd * width, 1.0f);
+
+    SetupTriangle setup[4];
+    size_t triangleCount = triangles.size() / 3;
+    for (size_t first = 0; first < triangleCount; first += 4)
+    {
+        int drawable = setupTriangles(screen, triangles, first, width, height, setup);
+        for (int t = 0; t < drawable; ++t)
+        {
+            const SetupTriangle& tri = setup[t];
+            int y0 = std::max(tri.minY, rowBegin), y1 = std::min(tri.maxY, rowEnd - 1);
+            for (int y = y0; y <= y1; ++y)
+            {
+                float py = y + 0.5f;
+                float* row = &depth[y * width];
+#ifdef OCCLUSION_SSE2
+                const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                const __m128 zero = _mm_setzero_ps();
+                __m128 a[3], rowE[3];
+                for (int e = 0; e < 3; ++e) {
+                    a[e] = _mm_set1_ps(tri.edgeA[e]);
+                    rowE[e] = _mm_set1_ps(tri.edgeB[e] * py + tri.edgeC[e]);
+                }
+                __m128 depthA = _mm_set1_ps(tri.depthA), depthRow = _mm_set1_ps(tri.depthB * py + tri.depthC);
+                for (int x = tri.minX; x <= tri.maxX; x += 4)
+                {
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                    __m128 inside = _mm_and_ps(_mm_and_ps(
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[0], px), rowE[0]), zero),
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[1], px), rowE[1]), zero)),
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[2], px), rowE[2]), zero));
+                    if (_mm_movemask_ps(inside) == 0) continue;
+                    __m128 z = _mm_add_ps(_mm_mul_ps(depthA, px), depthRow);
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(old, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                }
+#else
+                for (int x = tri.minX; x <= tri.maxX; ++x)
+                {
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for (int e = 0; e < 3; ++e)
+                        inside = inside && tri.edgeA[e] * px + tri.edgeB[e] * py + tri.edgeC[e] >= 0.0f;
+                    if (inside)
+                        row[x] = std::min(row[x], tri.depthA * px + tri.depthB * py + tri.depthC);
+                }
+#endif
+            }
+        }
+    }
+}
+
+void OcclusionCuller::buildPyramid()
+{
+    // each texel keeps the farthest occluder depth under it
+    for (size_t level = 1; level < levels.size(); ++level)
+    {
+        const std::vector<float>& fine = levels[level - 1];
+        glm::ivec2 fineSize = levelSize[level - 1], size = levelSize[level];
+        std::vector<float>& coarse = levels[level];
+        for (int y = 0; y < size.y; ++y)
+            for (int x = 0; x < size.x; ++x)
+            {
+                int fx = x * 2, fy = y * 2;
+                int fx1 = std::min(fx + 1, fineSize.x - 1), fy1 = std::min(fy + 1, fineSize.y - 1);
+                coarse[y * size.x + x] = std::max(std::max(fine[fy * fineSize.x + fx], fine[fy * fineSize.x + fx1]),
+                                                  std::max(fine[fy1 * fineSize.x + fx], fine[fy1 * fineSize.x + fx1]));
+            }
+    }
+}
+
+bool OcclusionCuller::isVisible(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::mat4& transform)
+{
+    if (!ready) return true;
+    testsLastFrame++;
+    testsTotal++;
+
+    glm::mat4 toClip = viewProjection * transform;
+    float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        glm::vec4 clip = toClip * glm::vec4((corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y,
+                                            (corner & 4) ? boxMax.z : boxMin.z, 1.0f);
+        if (clip.w < nearClip) return true; // reaches past the near plane
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        minX = std::min(minX, ndc.x); maxX = std::max(maxX, ndc.x);
+        minY = std::min(minY, ndc.y); maxY = std::max(maxY, ndc.y);
+        nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+    }
+
+    int x0 = std::max(0, (int)std::floor((minX * 0.5f + 0.5f) * width));
+    int x1 = std::min(width - 1, (int)std::floor((maxX * 0.5f + 0.5f) * width));
+    int y0 = std::max(0, (int)std::floor((minY * 0.5f + 0.5f) * height));
+    int y1 = std::min(height - 1, (int)std::floor((maxY * 0.5f + 0.5f) * height));
+    if (x0 > x1 || y0 > y1) return true; // off screen, left to frustum culling
+
+    // the level where the rectangle spans at most a few texels
+    int level = 0;
+    while (level + 1 < (int)levels.size() && std::max(x1 - x0, y1 - y0) >= 4) {
+        level++;
+        x0 >>= 1; x1 >>= 1; y0 >>= 1; y1 >>= 1;
+    }
+
+    const std::vector<float>& depth = levels[level];
+    int stride = levelSize[level].x;
+    for (int y = y0; y <= y1; ++y)
+        for (int x = x0; x <= x1; ++x)
+            if (depth[y * stride + x] >= nearest) return true;
+
+    culledLastFrame++;
+    culledTotal++;
+    return false;
+}
+
+bool OcclusionCuller::isVisible(const GLTFModel& model)
+{
+    return isVisible(model.boundsMin, model.boundsMax, model.modelMatrix);
+}
+
+void OcclusionCuller::resetTotals()
+{
+    testsTotal = culledTotal = 0;
+}
+
+void OcclusionCuller::cleanup()
+{
+    finish();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+    meshes.clear();
+    placements.clear();
+    levels.clear();
+    levelSize.clear();
+}
@@ -0,0 +1,100 @@
+#ifndef _OCCLUSION_CULLER_H_
+#define _OCCLUSION_CULLER_H_
+
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct GLTFModel;
+struct TileManager;
+
+// Software occlusion culling. Designated occluders (simplified meshes, one
+// per kind, placed by transform) are rasterised on the CPU into a small depth
+// buffer holding the nearest occluder depth per pixel; a max-depth pyramid
+// over it then answers whether a bounding box is hidden behind them. The
+// buffer is split into row strips, one per worker thread, so rasterisation
+// runs while the main thread submits the shadow pass; triangles are set up
+// four at a time and pixels filled four at a time with SSE2.
+struct OcclusionCuller
+{
+    struct OccluderMesh {
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+    };
+
+    bool enabled = true;
+    int width = 256;            // buffer size; height follows the viewport's aspect
+    int height = 0;
+    float nearClip = 0.1f;      // triangles and boxes reaching closer than this are not used
+
+    std::vector<OccluderMesh> meshes;
+
+    int trianglesLastFrame = 0; // occluder triangles rasterised
+    int testsLastFrame = 0;
+    int culledLastFrame = 0;
+    long long testsTotal = 0;
+    long long culledTotal = 0;
+
+    // Coarsest level of every primitive of model, in model space
+    int addModel(const GLTFModel& model);
+
+    // One terrain tile as a quads x quads grid lying on or under the real
+    // surface everywhere, relative to the tile's position
+    int addTerrain(const TileManager& terrain, int quads);
+
+    void initialise();
+
+    // Occluders drawn by the next begin
+    void clearOccluders();
+    void addOccluder(int mesh, const glm::mat4& transform);
+
+    // Transforms the occluders and starts the workers on them
+    void begin(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, int viewportWidth, int viewportHeight);
+
+    // Waits for the workers and builds the pyramid; tests need this first
+    void finish();
+
+    // False when the box (in model space under transform) is certainly hidden
+    bool isVisible(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::mat4& transform = glm::mat4(1.0f));
+
+    bool isVisible(const GLTFModel& model);
+
+    void resetTotals();
+
+    void cleanup();
+
+    // Rows [rowBegin, rowEnd) of the depth buffer from the current occluders
+    void rasterise(int rowBegin, int rowEnd);
+
+private:
+    struct Placement {
+        int mesh;
+        glm::mat4 transform;
+    };
+
+    std::vector<Placement> placements;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    bool ready = false;         // the pyramid matches the last begin
+
+    // screen-space vertices (x, y in pixels, z depth in [0, 1], w clip w)
+    // and the triangles over them, rebuilt by begin
+    std::vector<glm::vec4> screen;
+    std::vector<unsigned int> triangles;
+
+    std::vector<std::vector<float>> levels; // level 0 is the depth buffer, row 0 at the bottom
+    std::vector<glm::ivec2> levelSize;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    unsigned long long generation = 0;
+    int busy = 0;
+    bool stopping = false;
+
+    void workerLoop(int strip);
+    void buildPyramid();
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "particleSystem.h"
+#include "gpuResources.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+
+// the varyings particleUpdate.vert writes, laid out as Particle
+static const char* feedbackVaryings[] = {"outPosition", "outVelocity", "outColour", "outMotion"};
+
+static void particleAttributes(GLuint buffer, GLuint divisor)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    const size_t offsets[4] = {offsetof(Particle, position), offsetof(Particle, velocity),
+                               offsetof(Particle, colour), offsetof(Particle, motion)};
+    for (int i = 0; i < 4; ++i) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)offsets[i]);
+        glVertexAttribDivisor(i, divisor);
+    }
+}
+
+float particleBrightness(const Particle& particle, float age)
+{
+    float lifetime = particle.velocity.w;
+    if (age >= lifetime) return 0.0f;
+    float fade = std::min(std::min(age, lifetime - age) / std::min(0.2f * lifetime, 1.0f), 1.0f);
+    float pulse = 0.5f + 0.5f * std::sin(age * 2.5f + particle.motion.z * 6.2831853f);
+    return fade * (1.0f + (pulse * pulse * pulse - 1.0f) * particle.motion.y);
+}
+
+void ParticleSystem::initialise()
+{
+    capacity = std::max(capacity, 1);
+    lightCount = std::clamp(lightCount, 0, maxLights);
+
+    // every slot starts unused: a lifetime of 0 is already over
+    std::vector<Particle> empty(capacity, Particle{});
+    for (int i = 0; i < 2; ++i) {
+        buffers[i] = gpuCreateBuffer(GpuOwner::Particles, GPU_SITE);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+        gpuBufferData(GL_ARRAY_BUFFER, buffers[i], sizeof(Particle) * capacity, empty.data(), GL_DYNAMIC_COPY);
+    }
+    for (int i = 0; i < 2; ++i) {
+        updateVAO[i] = gpuCreateVertexArray(GpuOwner::Particles, GPU_SITE);
+        glBindVertexArray(updateVAO[i]);
+        particleAttributes(buffers[i], 0);
+        drawVAO[i] = gpuCreateVertexArray(GpuOwner::Particles, GPU_SITE);
+        glBindVertexArray(drawVAO[i]);
+        particleAttributes(buffers[i], 1);
+    }
+    glBindVertexArray(0);
+
+    if (lightCount > 0) {
+        readback = gpuCreateBuffer(GpuOwner::Particles, GPU_SITE);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readback);
+        gpuBufferData(GL_COPY_WRITE_BUFFER, readback, sizeof(Particle) * capacity, nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    simulate.initialise("../shaders/particleUpdate.vert", nullptr, feedbackVaryings, 4);
+    draw.initialise("../shaders/particle.vert", "../shaders/particle.frag");
+}
+
+void ParticleSystem::emit(const ParticleEmitter& emitter, int count, bool prewarm)
+{
+    count = std::min(count, capacity);
+    if (count <= 0) return;
+    if (burstCount == maxBursts) {
+        burstsDropped++;
+        return;
+    }
+    int i = burstCount++;
+    burstRange[i] = glm::vec4((float)next, (float)count, emitter.lifetime, prewarm ? 1.0f : 0.0f);
+    burstCentre[i] = glm::vec4(emitter.centre, emitter.wander);
+    burstExtent[i] = glm::vec4(emitter.extent, emitter.flicker);
+    burstVelocity[i] = glm::vec4(emitter.velocity, emitter.size);
+    burstColour[i] = glm::vec4(emitter.colour, 0.0f);
+    next = (next + count) % capacity;
+}
+
+void ParticleSystem::update(float deltaTime)
+{
+    if (buffers[0] == 0) return;
+
+    burstCount = 0;
+    for (ParticleEmitter& emitter : emitters) {
+        if (!emitter.prewarmed) {
+            // as many as live at once: lifetimes average 1.25 times the emitter's
+            emit(emitter, (int)(emitter.rate * emitter.lifetime * 1.25f), true);
+            emitter.prewarmed = true;
+            continue;
+        }
+        emitter.timer += deltaTime;
+        while (emitter.timer >= emitter.burstInterval) {
+            emitter.timer -= emitter.burstInterval;
+            emit(emitter, (int)std::lround(emitter.rate * emitter.burstInterval), false);
+        }
+    }
+
+    simulate.use();
+    simulate.setInt("capacity", capacity);
+    simulate.setFloat("deltaTime", deltaTime);
+    simulate.setInt("seed", (int)(frame++ & 0x7fffffff));
+    simulate.setInt("burstCount", burstCount);
+    if (burstCount > 0) {
+        simulate.setVec4Array("burstRange", burstRange, burstCount);
+        simulate.setVec4Array("burstCentre", burstCentre, burstCount);
+        simulate.setVec4Array("burstExtent", burstExtent, burstCount);
+        simulate.setVec4Array("burstVelocity", burstVelocity, burstCount);
+        simulate.setVec4Array("burstColour", burstColour, burstCount);
+    }
+
+    int write = 1 - current;
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(updateVAO[current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[write]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, capacity);
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+    current = write;
+
+    if (lightCount > 0) {
+        litAge += deltaTime;
+        readbackAge += deltaTime;
+        readBack();
+    }
+}
+
+void ParticleSystem::readBack()
+{
+    if (readbackFence) {
+        // never waited on: until the copy has landed the lights keep moving on their own
+        GLenum state = glClientWaitSync(readbackFence, 0, 0);
+        if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) return;
+        glDeleteSync(readbackFence);
+        readbackFence = nullptr;
+
+        glBindBuffer(GL_COPY_READ_BUFFER, readback);
+        const Particle* particles = (const Particle*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, sizeof(Particle) * capacity, GL_MAP_READ_BIT);
+        if (particles) {
+            // the brightest lightCount, brightest first, as they are by now
+            float brightest[maxLights];
+            litCount = 0;
+            for (int i = 0; i < capacity; ++i) {
+                const Particle& particle = particles[i];
+                const glm::vec4& c = particle.colour;
+                float brightness = particleBrightness(particle, particle.position.w + readbackAge) * std::max(c.r, std::max(c.g, c.b));
+                if (brightness <= 0.0f || (litCount == lightCount && brightness <= brightest[litCount - 1])) continue;
+                int at = litCount < lightCount ? litCount++ : litCount - 1;
+                for (; at > 0 && brightest[at - 1] < brightness; --at) {
+                    brightest[at] = brightest[at - 1];
+                    lit[at] = lit[at - 1];
+                }
+                brightest[at] = brightness;
+                lit[at] = particle;
+            }
+            litAge = readbackAge;
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        framesSinceReadback = 0;
+    }
+
+    if (++framesSinceReadback < readbackInterval) return;
+    glBindBuffer(GL_COPY_READ_BUFFER, buffers[current]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, readback);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(Particle) * capacity);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readbackAge = 0.0f;
+}
+
+void ParticleSystem::render(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) const
+{
+    if (buffers[0] == 0) return;
+
+    draw.use();
+    draw.setMatrix("view", &viewMatrix[0][0]);
+    draw.setMatrix("projection", &projectionMatrix[0][0]);
+    draw.setFloat("fogStart", fogStart);
+    draw.setFloat("fogEnd", fogEnd);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(drawVAO[current]);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, capacity);
+    glBindVertexArray(0);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
+
+int ParticleSystem::applyLights(Shader& program, int sceneLights, int budget) const
+{
+    int count = std::clamp(budget - sceneLights, 0, litCount);
+    char name[48];
+    for (int i = 0; i < count; ++i) {
+        const Particle& particle = lit[i];
+        float brightness = particleBrightness(particle, particle.position.w + litAge);
+        int index = sceneLights + i;
+        // names built on the stack, so the lights can change every frame without allocating
+        snprintf(name, sizeof(name), "lights[%d].type", index);
+        program.setInt(name, (int)LightType::Point);
+        snprintf(name, sizeof(name), "lights[%d].position", index);
+        program.setVec3(name, glm::vec3(particle.position) + glm::vec3(particle.velocity) * litAge);
+        snprintf(name, sizeof(name), "lights[%d].colour", index);
+        program.setVec3(name, glm::vec3(particle.colour) * (brightness * lightScale));
+        snprintf(name, sizeof(name), "lights[%d].constant", index);
+        program.setFloat(name, lightAttenuation.x);
+        snprintf(name, sizeof(name), "lights[%d].linear", index);
+        program.setFloat(name, lightAttenuation.y);
+        snprintf(name, sizeof(name), "lights[%d].quadratic", index);
+        program.setFloat(name, lightAttenuation.z);
+    }
+    program.setInt("numLights", std::min(budget, sceneLights + count));
+    return count;
+}
+
+void ParticleSystem::cleanup()
+{
+    if (readbackFence) glDeleteSync(readbackFence);
+    readbackFence = nullptr;
+    gpuDeleteBuffer(readback);
+    for (int i = 0; i < 2; ++i) {
+        gpuDeleteVertexArray(updateVAO[i]);
+        gpuDeleteVertexArray(drawVAO[i]);
+        gpuDeleteBuffer(buffers[i]);
+    }
+    simulate.remove();
+    draw.remove();
+}
@@ -0,0 +1,117 @@
+#ifndef _PARTICLE_SYSTEM_H_
+#define _PARTICLE_SYSTEM_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "light.h"
+#include "shader.h"
+
+// A box particles are emitted into, in bursts of rate * burstInterval
+struct ParticleEmitter
+{
+    glm::vec3 centre = glm::vec3(0.0f);
+    glm::vec3 extent = glm::vec3(1.0f);     // half size of the box
+    glm::vec3 velocity = glm::vec3(0.0f);   // every particle starts with it
+    glm::vec3 colour = glm::vec3(1.0f);     // above 1 blooms
+    float wander = 0.0f;        // strength of the drift each particle follows, units per second squared
+    float flicker = 0.0f;       // 0 glows steadily, 1 pulses fully on and off
+    float size = 0.05f;         // half width of the quad
+    float lifetime = 5.0f;      // seconds; each particle lives up to half as long again
+    float rate = 100.0f;        // particles per second
+    float burstInterval = 0.25f;
+
+    float timer = 0.0f;
+    bool prewarmed = false;     // the first burst fills the box as if it had been emitting all along
+};
+
+// One particle as the update pass reads and writes it
+struct Particle
+{
+    glm::vec4 position;         // xyz, age in seconds
+    glm::vec4 velocity;         // xyz, lifetime in seconds (0 for a slot never used)
+    glm::vec4 colour;
+    glm::vec4 motion;           // wander, flicker, seed 0 to 1, size
+};
+
+// Glowing particles simulated entirely on the GPU. The pool is capacity
+// particles in each of two buffers: every frame a vertex shader reads each
+// particle from one, moves it, and transform feedback writes it to the other
+// with rasterisation off, so the CPU neither touches nor uploads them.
+// Emitters hand out bursts of consecutive slots from a ring, and the update
+// pass respawns whatever is in a burst's slots, so when the pool is full the
+// oldest make way and nothing has to count the living. Dead particles stay in
+// the pool and are dropped when drawn: the pool is drawn whole, as camera
+// facing quads instanced over its particles, added to the scene without
+// writing depth.
+//
+// With lightCount above 0 the pool is copied to a buffer every
+// readbackInterval frames, mapped once its fence has passed, and the
+// brightest particles in it become unshadowed point lights. They are moved on
+// by their velocity in between, so they trail the particles only where they
+// wander.
+struct ParticleSystem
+{
+    static const int maxBursts = 8;     // per frame; MAX_BURSTS in particleUpdate.vert
+    static const int maxLights = 4;
+
+    int capacity = 4096;                // fixed once initialised
+    int lightCount = 0;                 // brightest particles lit; fixed once initialised
+    float lightScale = 2.0f;            // a light's colour against its particle's
+    glm::vec3 lightAttenuation = glm::vec3(1.0f, 0.35f, 0.44f);  // constant, linear, quadratic
+    int readbackInterval = 4;           // frames
+    float fogStart = 50.0f;
+    float fogEnd = 150.0f;
+
+    std::vector<ParticleEmitter> emitters;
+
+    int burstsDropped = 0;              // since initialised, when more than maxBursts were due in a frame
+
+    void initialise();
+
+    // Emits what is due and moves every particle on by deltaTime. Nothing is
+    // drawn, but a draw needs a complete framebuffer bound all the same
+    void update(float deltaTime);
+
+    // After the opaque passes, with the scene's target bound
+    void render(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) const;
+
+    // Puts the particle lights after the scene's sceneLights in program's
+    // lights, keeping numLights within budget; returns how many were set
+    int applyLights(Shader& program, int sceneLights, int budget) const;
+
+    void cleanup();
+
+private:
+    Shader simulate = {};
+    Shader draw = {};
+    GLuint buffers[2] = {};
+    GLuint updateVAO[2] = {};           // reads buffers[i] a particle per vertex
+    GLuint drawVAO[2] = {};             // reads buffers[i] a particle per instance
+    int current = 0;                    // buffer written last
+    int next = 0;                       // first slot of the next burst
+    unsigned int frame = 0;
+
+    int burstCount = 0;
+    glm::vec4 burstRange[maxBursts];    // first slot, count, lifetime, prewarm
+    glm::vec4 burstCentre[maxBursts];   // xyz, wander
+    glm::vec4 burstExtent[maxBursts];   // xyz, flicker
+    glm::vec4 burstVelocity[maxBursts]; // xyz, size
+    glm::vec4 burstColour[maxBursts];
+
+    GLuint readback = 0;
+    GLsync readbackFence = nullptr;
+    int framesSinceReadback = 0;
+    float readbackAge = 0.0f;           // seconds since the copy being read was taken
+    Particle lit[maxLights];            // as read back
+    int litCount = 0;
+    float litAge = 0.0f;                // seconds since lit was copied
+
+    void emit(const ParticleEmitter& emitter, int count, bool prewarm);
+    void readBack();
+};
+
+// How bright a particle is at its age, as particle.vert draws it
+float particleBrightness(const Particle& particle, float age);
+
+#endif
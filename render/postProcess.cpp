@@ -0,0 +1,141 @@
+#include "postProcess.h"
+#include "gpuResources.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+static GLuint createColourTarget(int width, int height, GLuint& fbo)
+{
+    GLuint texture = gpuCreateTexture(GpuOwner::Targets, GPU_SITE);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+    GetGpuResources().setBytes(GpuKind::Texture, texture, (size_t)width * height * 8);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    fbo = gpuCreateFramebuffer(GpuOwner::Targets, GPU_SITE);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    return texture;
+}
+
+void PostProcess::initialise(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+
+    colour = createColourTarget(width, height, fbo);
+    depth = gpuCreateRenderbuffer(GpuOwner::Targets, GPU_SITE);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    gpuRenderbufferStorage(depth, GL_DEPTH24_STENCIL8, width, height, 4);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "Error: Scene framebuffer is not complete!" << std::endl;
+
+    bloomLevels = std::clamp(bloomLevels, 0, maxBloomLevels);
+    glm::ivec2 size(width, height);
+    for (int i = 0; i < bloomLevels; ++i) {
+        size = glm::max(size / 2, glm::ivec2(1));
+        bloomSize[i] = size;
+        bloom[i] = createColourTarget(size.x, size.y, bloomFbo[i]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Error: Bloom framebuffer is not complete!" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    downsample.initialise("../shaders/fullscreen.vert", "../shaders/bloomDownsample.frag");
+    upsample.initialise("../shaders/fullscreen.vert", "../shaders/bloomUpsample.frag");
+    tonemap.initialise("../shaders/fullscreen.vert", "../shaders/tonemap.frag");
+    emptyVAO = gpuCreateVertexArray(GpuOwner::Targets, GPU_SITE);
+}
+
+void PostProcess::bind(int renderWidth, int renderHeight) const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, renderWidth, renderHeight);
+}
+
+void PostProcess::resolve(GLuint framebuffer, int renderWidth, int renderHeight)
+{
+    int w = std::min(renderWidth, width), h = std::min(renderHeight, height);
+    // the rendered corner's uv scale, and the last uv inside it for bilinear reads
+    glm::vec4 sceneRect((float)w / width, (float)h / height, (w - 0.5f) / width, (h - 0.5f) / height);
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(emptyVAO);
+    glActiveTexture(GL_TEXTURE0);
+
+    if (bloomLevels > 0) {
+        GPU_PASS_SCOPE("bloom_downsample");
+        downsample.use();
+        downsample.setInt("source", 0);
+        downsample.setVec4("threshold", glm::vec4(bloomThreshold, bloomKnee, 0.0f, 0.0f));
+        for (int i = 0; i < bloomLevels; ++i) {
+            glBindFramebuffer(GL_FRAMEBUFFER, bloomFbo[i]);
+            glViewport(0, 0, bloomSize[i].x, bloomSize[i].y);
+            if (i == 0) {
+                glBindTexture(GL_TEXTURE_2D, colour);
+                downsample.setVec4("sourceRect", sceneRect);
+                downsample.setVec4("sourceTexel", glm::vec4(1.0f / width, 1.0f / height, 0.0f, 0.0f));
+            } else {
+                glm::vec2 texel = 1.0f / glm::vec2(bloomSize[i - 1]);
+                glBindTexture(GL_TEXTURE_2D, bloom[i - 1]);
+                downsample.setVec4("sourceRect", glm::vec4(1.0f, 1.0f, 1.0f - texel.x * 0.5f, 1.0f - texel.y * 0.5f));
+                downsample.setVec4("sourceTexel", glm::vec4(texel, 0.0f, 0.0f));
+            }
+            downsample.setBool("prefilter", i == 0);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    }
+    if (bloomLevels > 1) {
+        GPU_PASS_SCOPE("bloom_upsample");
+        upsample.use();
+        upsample.setInt("source", 0);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        for (int i = bloomLevels - 1; i > 0; --i) {
+            glBindFramebuffer(GL_FRAMEBUFFER, bloomFbo[i - 1]);
+            glViewport(0, 0, bloomSize[i - 1].x, bloomSize[i - 1].y);
+            glBindTexture(GL_TEXTURE_2D, bloom[i]);
+            upsample.setVec4("sourceTexel", glm::vec4(1.0f / glm::vec2(bloomSize[i]), 0.0f, 0.0f));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glDisable(GL_BLEND);
+    }
+    {
+        GPU_PASS_SCOPE("tonemap");
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+        tonemap.use();
+        glBindTexture(GL_TEXTURE_2D, colour);
+        tonemap.setInt("sceneSampler", 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, bloomLevels > 0 ? bloom[0] : 0);
+        tonemap.setInt("bloomSampler", 1);
+        tonemap.setVec4("sourceRect", sceneRect);
+        tonemap.setVec4("grading", glm::vec4(exposure, shoulder, bloomLevels > 0 ? bloomIntensity : 0.0f, 0.0f));
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void PostProcess::cleanup()
+{
+    gpuDeleteFramebuffer(fbo);
+    gpuDeleteTexture(colour);
+    gpuDeleteRenderbuffer(depth);
+    for (int i = 0; i < maxBloomLevels; ++i) {
+        gpuDeleteFramebuffer(bloomFbo[i]);
+        gpuDeleteTexture(bloom[i]);
+    }
+    gpuDeleteVertexArray(emptyVAO);
+    downsample.remove();
+    upsample.remove();
+    tonemap.remove();
+}
@@ -0,0 +1,56 @@
+#ifndef _POST_PROCESS_H_
+#define _POST_PROCESS_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "shader.h"
+
+// The main pass renders into the lower left corner of an RGBA16F scene
+// target, renderWidth x renderHeight of it, so lights brighter than 1 keep
+// their value. resolve() blooms whatever is over the threshold and tone maps
+// the two into the output, stretching the corner over all of it.
+//
+// Bloom is a chain of half-size levels starting at half the output's size:
+// each is a 13-tap downsample of the one above (the first also thresholds),
+// then each is added back into the one above through a tent filter, so the
+// wide blurs only ever touch a few pixels. Tone mapping leaves colours under
+// the shoulder as they were and rolls the rest off towards 1 instead of
+// clipping them.
+struct PostProcess
+{
+    static const int maxBloomLevels = 8;
+
+    float exposure = 1.0f;
+    float shoulder = 0.8f;          // brightest channel where the roll-off starts
+    int bloomLevels = 5;            // 0 turns bloom off; fixed once initialised
+    float bloomThreshold = 1.0f;    // what used to clip
+    float bloomKnee = 0.5f;         // soft ramp either side of the threshold
+    float bloomIntensity = 0.15f;
+
+    int width = 0, height = 0;      // output size
+
+    GLuint fbo = 0;
+    GLuint colour = 0;              // RGBA16F
+    GLuint depth = 0;               // 24 bit depth, 8 bit stencil
+
+    void initialise(int width, int height);
+
+    // Binds the scene target with the viewport on its rendered corner
+    void bind(int renderWidth, int renderHeight) const;
+
+    // Blooms and tone maps the rendered corner into framebuffer, which is width x height
+    void resolve(GLuint framebuffer, int renderWidth, int renderHeight);
+
+    void cleanup();
+
+private:
+    Shader downsample = {};
+    Shader upsample = {};
+    Shader tonemap = {};
+    GLuint emptyVAO = 0;            // core profile needs one bound for the attribute-less draws
+    GLuint bloom[maxBloomLevels] = {};
+    GLuint bloomFbo[maxBloomLevels] = {};
+    glm::ivec2 bloomSize[maxBloomLevels];
+};
+
+#endif
@@ -0,0 +1,248 @@
+#include "profiler.h"
+#include "allocations.h"
+
+#include <cstring>
+#include <mutex>
+
+static ProfileSample scopes[MAX_PROFILE_SCOPES];
+static double scopeFrameMs[MAX_PROFILE_SCOPES]; // running totals for the frame in progress
+static int scopeFrameCalls[MAX_PROFILE_SCOPES];
+static long long scopeFrameAllocations[MAX_PROFILE_SCOPES];
+static int numScopes = 0;
+static int numFrames = 0;
+static AllocationCount frameStartAllocations;
+static long long lastFrameAllocations = 0;
+static long long lastFrameAllocatedBytes = 0;
+static std::mutex scopesMutex; // scopes are recorded from job system workers too
+
+static int findScope(const char* name)
+{
+	for (int i = 0; i < numScopes; ++i)
+		if (scopes[i].name == name) return i;
+	for (int i = 0; i < numScopes; ++i)
+		if (strcmp(scopes[i].name, name) == 0) return i;
+
+	if (numScopes == MAX_PROFILE_SCOPES) return -1;
+	scopes[numScopes] = {name, 0.0, 0.0, 0, 0, 0};
+	scopeFrameMs[numScopes] = 0.0;
+	scopeFrameCalls[numScopes] = 0;
+	scopeFrameAllocations[numScopes] = 0;
+	return numScopes++;
+}
+
+void Profiler::beginFrame()
+{
+	std::lock_guard<std::mutex> lock(scopesMutex);
+	for (int i = 0; i < numScopes; ++i)
+	{
+		scopeFrameMs[i] = 0.0;
+		scopeFrameCalls[i] = 0;
+		scopeFrameAllocations[i] = 0;
+	}
+	frameStartAllocations = threadAllocations();
+}
+
+void Profiler::endFrame()
+{
+	std::lock_guard<std::mutex> lock(scopesMutex);
+	for (int i = 0; i < numScopes; ++i)
+	{
+		scopes[i].frameMs = scopeFrameMs[i];
+		scopes[i].calls = scopeFrameCalls[i];
+		scopes[i].totalMs += scopeFrameMs[i];
+		scopes[i].frameAllocations = scopeFrameAllocations[i];
+		scopes[i].totalAllocations += scopeFrameAllocations[i];
+	}
+	AllocationCount now = threadAllocations();
+	lastFrameAllocations = (long long)(now.count - frameStartAllocations.count);
+	lastFrameAllocatedBytes = (long long)(now.bytes - frameStartAllocations.bytes);
+	numFrames++;
+}
+
+void Profiler::record(const char* name, double ms, long long allocations)
+{
+	std::lock_guard<std::mutex> lock(scopesMutex);
+	int index = findScope(name);
+	if (index < 0) return;
+	scopeFrameMs[index] += ms;
+	scopeFrameCalls[index]++;
+	scopeFrameAllocations[index] += allocations;
+}
+
+void Profiler::reset()
+{
+	std::lock_guard<std::mutex> lock(scopesMutex);
+	for (int i = 0; i < numScopes; ++i) {
+		scopes[i].totalMs = 0.0;
+		scopes[i].totalAllocations = 0;
+	}
+	numFrames = 0;
+}
+
+long long Profiler::frameAllocations()
+{
+	return lastFrameAllocations;
+}
+
+long long Profiler::frameAllocatedBytes()
+{
+	return lastFrameAllocatedBytes;
+}
+
+int Profiler::sampleCount()
+{
+	return numScopes;
+}
+
+const ProfileSample& Profiler::sample(int index)
+{
+	return scopes[index];
+}
+
+int Profiler::frameCount()
+{
+	return numFrames;
+}
+
+ProfileScope::ProfileScope(const char* name)
+	: name(name), start(std::chrono::high_resolution_clock::now()), allocationsAtStart(threadAllocations().count)
+{
+}
+
+ProfileScope::~ProfileScope()
+{
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	Profiler::record(name, elapsed.count(), (long long)(threadAllocations().count - allocationsAtStart));
+}
+
+void GpuTimer::initialise()
+{
+	glGenQueries(queryCount, queries);
+	head = tail = 0;
+}
+
+void GpuTimer::begin()
+{
+	// ring full: the oldest result has to be consumed before its query is reused
+	if (head - tail == queryCount) {
+		float discarded;
+		poll(discarded, true);
+	}
+	glBeginQuery(GL_TIME_ELAPSED, queries[head % queryCount]);
+}
+
+void GpuTimer::end()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	head++;
+}
+
+bool GpuTimer::poll(float& ms, bool wait)
+{
+	if (head == tail) return false;
+
+	GLuint query = queries[tail % queryCount];
+	GLint available = GL_FALSE;
+	glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available && !wait) return false;
+
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+	ms = static_cast<float>(elapsed / 1.0e6);
+	tail++;
+	return true;
+}
+
+void GpuTimer::cleanup()
+{
+	glDeleteQueries(queryCount, queries);
+}
+
+void GpuPassTimer::initialise()
+{
+	glGenQueries(frameLatency * maxPasses * 2, &queries[0][0][0]);
+	memset(issued, 0, sizeof(issued));
+	head = tail = 0;
+	open = -1;
+}
+
+void GpuPassTimer::begin(const char* name)
+{
+	if (queries[0][0][0] == 0) return;
+	int index = -1;
+	for (int i = 0; i < passCount && index < 0; ++i)
+		if (passes[i].name == name || strcmp(passes[i].name, name) == 0) index = i;
+	if (index < 0) {
+		if (passCount == maxPasses) return;
+		index = passCount++;
+		passes[index] = Pass();
+		passes[index].name = name;
+	}
+	glQueryCounter(queries[head % frameLatency][index][0], GL_TIMESTAMP);
+	open = index;
+}
+
+void GpuPassTimer::end()
+{
+	if (open < 0) return;
+	glQueryCounter(queries[head % frameLatency][open][1], GL_TIMESTAMP);
+	issued[head % frameLatency][open] = true;
+	open = -1;
+}
+
+void GpuPassTimer::endFrame()
+{
+	if (queries[0][0][0] == 0) return;
+	head++;
+	// the next frame reuses the oldest frame's queries once the ring is full
+	while (tail < head && readBack(tail % frameLatency, head - tail >= frameLatency))
+		tail++;
+}
+
+void GpuPassTimer::flush()
+{
+	while (tail < head && readBack(tail % frameLatency, true))
+		tail++;
+}
+
+bool GpuPassTimer::readBack(int slot, bool wait)
+{
+	for (int i = 0; i < passCount && !wait; ++i) {
+		if (!issued[slot][i]) continue;
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(queries[slot][i][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return false;
+	}
+	for (int i = 0; i < passCount; ++i) {
+		if (!issued[slot][i]) continue;
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(queries[slot][i][0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(queries[slot][i][1], GL_QUERY_RESULT, &end);
+		passes[i].lastMs = end > start ? (end - start) / 1.0e6 : 0.0;
+		passes[i].totalMs += passes[i].lastMs;
+		passes[i].frames++;
+		issued[slot][i] = false;
+	}
+	return true;
+}
+
+void GpuPassTimer::reset()
+{
+	for (int i = 0; i < passCount; ++i) {
+		passes[i].totalMs = 0.0;
+		passes[i].frames = 0;
+	}
+}
+
+void GpuPassTimer::cleanup()
+{
+	if (queries[0][0][0] == 0) return;
+	glDeleteQueries(frameLatency * maxPasses * 2, &queries[0][0][0]);
+	memset(queries, 0, sizeof(queries));
+}
+
+GpuPassTimer& GetGpuPassTimer()
+{
+	static GpuPassTimer timer;
+	return timer;
+}
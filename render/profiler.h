@@ -0,0 +1,133 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <glad/gl.h>
+#include <chrono>
+
+#define MAX_PROFILE_SCOPES 64
+
+// CPU scope timings and heap allocations, accumulated per frame and over the
+// whole run. Scope names must be string literals (compared by pointer first).
+// Scopes may be recorded from any thread; those run as jobs on several
+// threads at once add up to more than the wall time they took.
+struct ProfileSample
+{
+    const char* name;
+    double frameMs;  // time spent in this scope during the last finished frame
+    double totalMs;  // time spent over all frames since reset
+    int calls;       // calls during the last finished frame
+    long long frameAllocations; // made on the scope's thread during the last finished frame
+    long long totalAllocations; // since reset
+};
+
+struct Profiler
+{
+    static void beginFrame();
+    static void endFrame();
+    static void record(const char* name, double ms, long long allocations = 0);
+    static void reset();
+
+    static int sampleCount();
+    static const ProfileSample& sample(int index);
+    static int frameCount();
+
+    // Heap allocations and bytes the thread calling beginFrame and endFrame
+    // made between them, for the last finished frame
+    static long long frameAllocations();
+    static long long frameAllocatedBytes();
+};
+
+struct ProfileScope
+{
+    const char* name;
+    std::chrono::high_resolution_clock::time_point start;
+    unsigned long long allocationsAtStart;
+
+    ProfileScope(const char* name);
+    ~ProfileScope();
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name)
+
+// GL_TIME_ELAPSED queries in a small ring so results are read back a few
+// frames late instead of stalling on the frame that issued them.
+struct GpuTimer
+{
+    static const int queryCount = 4;
+
+    GLuint queries[queryCount];
+    int head = 0; // next query to issue
+    int tail = 0; // oldest query still in flight
+
+    void initialise();
+
+    void begin();
+
+    void end();
+
+    // Returns true and the elapsed milliseconds of the oldest finished query.
+    // With wait set, blocks until the oldest in-flight query has finished.
+    bool poll(float& ms, bool wait = false);
+
+    bool pending() const { return head != tail; }
+
+    void cleanup();
+};
+
+// GPU time of named passes within a frame, from GL_TIMESTAMP queries at each
+// pass's start and end, as GL_TIME_ELAPSED queries cannot sit inside
+// GpuTimer's. A frame's queries are read back up to frameLatency frames late
+// and only waited on when the ring comes round. Each name is timed at most
+// once a frame and must be a string literal, as with PROFILE_SCOPE.
+struct GpuPassTimer
+{
+    static const int maxPasses = 16;
+    static const int frameLatency = 4;
+
+    struct Pass {
+        const char* name = nullptr;
+        double lastMs = 0.0;    // latest frame read back
+        double totalMs = 0.0;   // since reset
+        int frames = 0;         // read back since reset
+    };
+
+    Pass passes[maxPasses];
+    int passCount = 0;
+
+    void initialise();
+
+    void begin(const char* name);
+    void end();
+
+    // After the frame's last pass; reads back whichever frames have finished
+    void endFrame();
+
+    // Reads back every frame still in flight, waiting for them
+    void flush();
+
+    void reset();
+    void cleanup();
+
+private:
+    GLuint queries[frameLatency][maxPasses][2] = {};
+    bool issued[frameLatency][maxPasses] = {};
+    int head = 0;   // frame being issued
+    int tail = 0;   // oldest frame not read back
+    int open = -1;  // pass begun and not yet ended
+
+    bool readBack(int slot, bool wait);
+};
+
+GpuPassTimer& GetGpuPassTimer();
+
+struct GpuPassScope
+{
+    GpuPassScope(const char* name) { GetGpuPassTimer().begin(name); }
+    ~GpuPassScope() { GetGpuPassTimer().end(); }
+};
+
+#define GPU_PASS_SCOPE(name) GpuPassScope PROFILE_CONCAT(gpuPassScope_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,58 @@
+#include "qualityGovernor.h"
+
+#include <algorithm>
+#include <cmath>
+
+QualitySettings QualityGovernor::current() const
+{
+    float f = levels > 0 ? (float)level / levels : 1.0f;
+    auto mix = [f](float a, float b) { return a + (b - a) * f; };
+    auto mixGeometric = [f](float a, float b) { return a * std::pow(b / a, f); };
+
+    QualitySettings settings;
+    settings.renderDistance = (int)std::lround(mix((float)lowest.renderDistance, (float)highest.renderDistance));
+    settings.shadowScale = std::exp2(std::round(std::log2(mixGeometric(lowest.shadowScale, highest.shadowScale))));
+    settings.lightBudget = (int)std::lround(mix((float)lowest.lightBudget, (float)highest.lightBudget));
+    settings.lodBias = mixGeometric(lowest.lodBias, highest.lodBias);
+    return settings;
+}
+
+void QualityGovernor::addCpuSample(float ms)
+{
+    if (settling > 0) return;
+    cpuSum += ms;
+    cpuCount++;
+}
+
+void QualityGovernor::addGpuSample(float ms)
+{
+    if (settling > 0) return;
+    gpuSum += ms;
+    gpuCount++;
+}
+
+bool QualityGovernor::update()
+{
+    if (!enabled) return false;
+    if (settling > 0) {
+        settling--;
+        return false;
+    }
+    if (cpuCount < windowFrames) return false;
+
+    float frameMs = std::max(cpuSum / cpuCount, gpuCount > 0 ? gpuSum / gpuCount : 0.0f);
+    cpuSum = gpuSum = 0.0f;
+    cpuCount = gpuCount = 0;
+
+    int next = level;
+    if (frameMs > targetMs * 1.5f) next = level - 2;
+    else if (frameMs > targetMs * (1.0f + tolerance)) next = level - 1;
+    else if (frameMs < targetMs * headroom) next = level + 1;
+    next = std::clamp(next, 0, levels);
+    if (next == level) return false;
+
+    level = next;
+    changes++;
+    settling = 4; // GpuTimer::queryCount frames still measure the old level
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef _QUALITY_GOVERNOR_H_
+#define _QUALITY_GOVERNOR_H_
+
+// What the governor trades for frame time
+struct QualitySettings
+{
+    int renderDistance;     // tiles drawn either side of the camera's tile
+    float shadowScale;      // shadow map size relative to the configured one, a power of two
+    int lightBudget;        // lights shaded, the first ones of the light list
+    float lodBias;          // multiplies LodSelector::maxPixelError
+};
+
+// Holds the frame time near a target by stepping through quality levels
+// between `lowest` and `highest`. Each window of frames is judged by the
+// larger of its mean CPU and GPU time, so a frame waiting on vsync or on the
+// other side does not count as headroom. Over the target by more than the
+// tolerance drops a level (two when far over); under it by the headroom
+// margin raises one. After a change the next window starts fresh, since GPU
+// times arrive a few frames late.
+struct QualityGovernor
+{
+    bool enabled = false;
+    float targetMs = 16.7f;
+    float tolerance = 0.1f;     // fraction over target that drops a level
+    float headroom = 0.75f;     // fraction of target below which a level is raised
+    int windowFrames = 30;
+    int levels = 8;             // steps from lowest (0) to highest (levels)
+
+    QualitySettings lowest = {1, 0.25f, 1, 4.0f};
+    QualitySettings highest = {3, 1.0f, 2, 1.0f};
+
+    int level = 8;
+    int changes = 0;            // level changes since start, for benchmark reports
+
+    // Settings of the current level
+    QualitySettings current() const;
+
+    void addCpuSample(float ms);
+    void addGpuSample(float ms);
+
+    // Once per frame; true when the level changed and current() needs applying
+    bool update();
+
+private:
+    float cpuSum = 0.0f, gpuSum = 0.0f;
+    int cpuCount = 0, gpuCount = 0;
+    int settling = 0;           // frames of samples still ignored after a change
+};
+
+#endif
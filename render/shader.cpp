@@ -1,11 +1,41 @@
 #include "shader.h"
+#include "gpuResources.h"
 
+#include <cstdio>
+#include <cstring>
 #include <string> 
 #include <iostream> 
 #include <fstream>
+#include <filesystem>
 #include <sstream> 
 #include <vector>
 
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach-o/dyld.h>
+#endif
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void (GLAD_API_PTR *GetProgramBinaryFunc)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (GLAD_API_PTR *ProgramBinaryFunc)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (GLAD_API_PTR *ProgramParameteriFunc)(GLuint program, GLenum pname, GLint value);
+typedef void (GLAD_API_PTR *MaxShaderCompilerThreadsFunc)(GLuint count);
+
+static GetProgramBinaryFunc getProgramBinary = nullptr;
+static ProgramBinaryFunc programBinary = nullptr;
+static ProgramParameteriFunc programParameteri = nullptr;
+static MaxShaderCompilerThreadsFunc maxShaderCompilerThreads = nullptr;
+
 GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path)
 {
 	// Create the shaders
@@ -88,7 +118,7 @@ GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_fi
 
 	// Link the program
 	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
+	GLuint ProgramID = gpuCreateProgram(GpuOwner::Shaders, GPU_SITE);
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
 	glLinkProgram(ProgramID);
@@ -166,7 +196,7 @@ GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentS
 
 	// Link the program
 	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
+	GLuint ProgramID = gpuCreateProgram(GpuOwner::Shaders, GPU_SITE);
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
 	glLinkProgram(ProgramID);
@@ -194,15 +224,137 @@ GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentS
 	return ProgramID;
 }
 
-void Shader::initialise(const char *vertex_file_path, const char *fragment_file_path)
+static bool readSource(const char *path, std::string &code)
+{
+	std::ifstream stream(path, std::ios::in);
+	if (!stream.is_open()) return false;
+	std::stringstream sstr;
+	sstr << stream.rdbuf();
+	code = sstr.str();
+	return true;
+}
+
+// Prints the log of a shader that failed to compile; true if it compiled
+static bool checkCompiled(GLuint shader, const char *stage, const std::string &path)
+{
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &Result);
+	if (Result) return true;
+
+	printf("Error compiling %s shader : %s\n", stage, path.c_str());
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if (InfoLogLength > 0) {
+		std::vector<char> ErrorMessage(InfoLogLength + 1);
+		glGetShaderInfoLog(shader, InfoLogLength, NULL, &ErrorMessage[0]);
+		printf("%s\n", &ErrorMessage[0]);
+	}
+	return false;
+}
+
+void Shader::begin(const char *vertex_file_path, const char *fragment_file_path,
+				   const char *const *feedbackVaryings, int feedbackCount)
+{
+	ID.reset();
+	pendingVertex = 0;
+	pendingFragment = 0;
+	pendingPath = vertex_file_path;
+
+	std::string VertexShaderCode;
+	if (!readSource(vertex_file_path, VertexShaderCode)) {
+		printf("Vertex shader not found %s.\n", vertex_file_path);
+		return;
+	}
+	std::string FragmentShaderCode;
+	if (fragment_file_path && !readSource(fragment_file_path, FragmentShaderCode)) {
+		printf("Fragment shader not found %s.\n", fragment_file_path);
+		return;
+	}
+	// the captured outputs are part of the link, so part of the key
+	for (int i = 0; i < feedbackCount; ++i)
+		(FragmentShaderCode += "\n// feedback ") += feedbackVaryings[i];
+
+	ProgramCache &cache = GetProgramCache();
+	pendingKey = cache.key(VertexShaderCode, FragmentShaderCode);
+	ID = GlProgram(cache.load(pendingKey));
+	if (ID) {
+		printf("Loaded cached program : %s\n", vertex_file_path);
+		return;
+	}
+
+	// nothing is checked until finish: with parallel compilation the driver
+	// works on these in the background, and asking for a status would wait
+	printf("Compiling vertex shader : %s\n", vertex_file_path);
+	char const *VertexSourcePointer = VertexShaderCode.c_str();
+	pendingVertex = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(pendingVertex, 1, &VertexSourcePointer, NULL);
+	glCompileShader(pendingVertex);
+
+	if (fragment_file_path) {
+		printf("Compiling fragment shader : %s\n", fragment_file_path);
+		char const *FragmentSourcePointer = FragmentShaderCode.c_str();
+		pendingFragment = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(pendingFragment, 1, &FragmentSourcePointer, NULL);
+		glCompileShader(pendingFragment);
+	}
+
+	printf("Linking program\n");
+	ID = GlProgram::create(GpuOwner::Shaders, GPU_SITE);
+	glAttachShader(ID, pendingVertex);
+	if (pendingFragment) glAttachShader(ID, pendingFragment);
+	if (feedbackCount > 0) glTransformFeedbackVaryings(ID, feedbackCount, feedbackVaryings, GL_INTERLEAVED_ATTRIBS);
+	cache.markRetrievable(ID);
+	glLinkProgram(ID);
+}
+
+bool Shader::finish()
 {
-	ID = LoadShadersFromFile(vertex_file_path, fragment_file_path);
-	if (ID == 0) std::cerr << "Failed to load shader. Vertex file path: " << vertex_file_path << std::endl;
+	if (pendingVertex == 0) {
+		// loaded from the cache, or begin could not read the sources
+		if (ID == 0) std::cerr << "Failed to load shader. Vertex file path: " << pendingPath << std::endl;
+		return ID != 0;
+	}
+
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+	glGetProgramiv(ID, GL_LINK_STATUS, &Result);
+	if (!Result) {
+		if (checkCompiled(pendingVertex, "vertex", pendingPath) && (!pendingFragment || checkCompiled(pendingFragment, "fragment", pendingPath))) {
+			printf("Error linking program\n");
+			glGetProgramiv(ID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+			if (InfoLogLength > 0)
+			{
+				std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
+				glGetProgramInfoLog(ID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+				printf("%s\n", &ProgramErrorMessage[0]);
+			}
+		}
+		ID.reset();
+	} else {
+		glDetachShader(ID, pendingVertex);
+		if (pendingFragment) glDetachShader(ID, pendingFragment);
+		GetProgramCache().store(pendingKey, ID);
+	}
+
+	glDeleteShader(pendingVertex);
+	if (pendingFragment) glDeleteShader(pendingFragment);
+	pendingVertex = 0;
+	pendingFragment = 0;
+
+	if (ID == 0) std::cerr << "Failed to load shader. Vertex file path: " << pendingPath << std::endl;
+	return ID != 0;
+}
+
+void Shader::initialise(const char *vertex_file_path, const char *fragment_file_path,
+						const char *const *feedbackVaryings, int feedbackCount)
+{
+	begin(vertex_file_path, fragment_file_path, feedbackVaryings, feedbackCount);
+	finish();
 }
 
-void Shader::setBool(const std::string &name, bool value) const
+void Shader::setBool(const char *name, bool value) const
 {
-	GLint loc = glGetUniformLocation(ID, name.c_str());
+	GLint loc = glGetUniformLocation(ID, name);
 	if (loc < 0) {
 		std::cerr << "Uniform " << name << " not found in shader!" << std::endl;
 		return;
@@ -210,9 +362,9 @@ void Shader::setBool(const std::string &name, bool value) const
 	glUniform1i(loc, static_cast<int>(value));
 }
 
-void Shader::setInt(const std::string &name, int value) const
+void Shader::setInt(const char *name, int value) const
 {
-	GLint loc = glGetUniformLocation(ID, name.c_str());
+	GLint loc = glGetUniformLocation(ID, name);
 	if (loc < 0) {
 		std::cerr << "Uniform " << name << " not found in shader!" << std::endl;
 		return;
@@ -220,9 +372,9 @@ void Shader::setInt(const std::string &name, int value) const
 	glUniform1i(loc, static_cast<int>(value));
 }
 
-void Shader::setFloat(const std::string &name, float value) const
+void Shader::setFloat(const char *name, float value) const
 {
-	GLint loc = glGetUniformLocation(ID, name.c_str());
+	GLint loc = glGetUniformLocation(ID, name);
 	if (loc < 0) {
 		std::cerr << "Uniform " << name << " not found in shader!" << std::endl;
 		return;
@@ -231,9 +383,9 @@ void Shader::setFloat(const std::string &name, float value) const
 }
 
 
-void Shader::setVec3(const std::string &name, glm::vec3 value) const
+void Shader::setVec3(const char *name, glm::vec3 value) const
 {
-	GLint loc = glGetUniformLocation(ID, name.c_str());
+	GLint loc = glGetUniformLocation(ID, name);
 	if (loc < 0) {
 		std::cerr << "Uniform " << name << " not found in shader!" << std::endl;
 		return;
@@ -241,9 +393,9 @@ void Shader::setVec3(const std::string &name, glm::vec3 value) const
 	glUniform3fv(loc, 1, &value[0]);
 }
 
-void Shader::setVec4(const std::string &name, glm::vec4 value) const
+void Shader::setVec4(const char *name, glm::vec4 value) const
 {
-	GLint loc = glGetUniformLocation(ID, name.c_str());
+	GLint loc = glGetUniformLocation(ID, name);
 	if (loc < 0) {
 		std::cerr << "Uniform " << name << " not found in shader!" << std::endl;
 		return;
@@ -251,9 +403,9 @@ void Shader::setVec4(const std::string &name, glm::vec4 value) const
 	glUniform4fv(loc, 1, &value[0]);
 }
 
-void Shader::setMatrix(const std::string &name, const float *value) const
+void Shader::setMatrix(const char *name, const float *value) const
 {
-	GLint loc = glGetUniformLocation(ID, name.c_str());
+	GLint loc = glGetUniformLocation(ID, name);
 	if (loc < 0) {
 		std::cerr << "Uniform " << name << " not found in shader!" << std::endl;
 		return;
@@ -261,14 +413,29 @@ void Shader::setMatrix(const std::string &name, const float *value) const
 	glUniformMatrix4fv(loc, 1, GL_FALSE, value);
 }
 
-void Shader::setMatrixArray(const std::string& name, const std::vector<glm::mat4>& matrices) const
+void Shader::setMatrixArray(const char *name, const std::vector<glm::mat4>& matrices) const
+{
+	setMatrixArray(name, matrices.data(), (int)matrices.size());
+}
+
+void Shader::setMatrixArray(const char *name, const glm::mat4 *matrices, int count) const
 {
-	GLint loc = glGetUniformLocation(ID, name.c_str());
+	GLint loc = glGetUniformLocation(ID, name);
 	if (loc < 0) {
 		std::cerr << "Uniform " << name << " not found in shader!" << std::endl;
 		return;
 	}
-	glUniformMatrix4fv(loc, (GLsizei)matrices.size(), GL_FALSE, &matrices[0][0][0]);
+	glUniformMatrix4fv(loc, (GLsizei)count, GL_FALSE, (const float*)matrices);
+}
+
+void Shader::setVec4Array(const char *name, const glm::vec4 *values, int count) const
+{
+	GLint loc = glGetUniformLocation(ID, name);
+	if (loc < 0) {
+		std::cerr << "Uniform " << name << " not found in shader!" << std::endl;
+		return;
+	}
+	glUniform4fv(loc, (GLsizei)count, (const float*)values);
 }
 
 
@@ -277,6 +444,182 @@ void Shader::use() const
 	glUseProgram(ID);
 }
 
-void Shader::remove() const {
-	glDeleteProgram(ID);
-}
\ No newline at end of file
+void Shader::remove() {
+	ID.reset();
+}
+
+ProgramCache& GetProgramCache()
+{
+	static ProgramCache cache;
+	return cache;
+}
+
+static bool hasExtension(const char *name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i) {
+		const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+		if (extension && strcmp(extension, name) == 0) return true;
+	}
+	return false;
+}
+
+// Empty when the platform will not say
+static std::filesystem::path executablePath()
+{
+#ifdef _WIN32
+	char buffer[MAX_PATH];
+	DWORD length = GetModuleFileNameA(nullptr, buffer, MAX_PATH);
+	return length > 0 && length < MAX_PATH ? std::filesystem::path(buffer) : std::filesystem::path();
+#elif defined(__APPLE__)
+	char buffer[4096];
+	uint32_t size = sizeof(buffer);
+	return _NSGetExecutablePath(buffer, &size) == 0 ? std::filesystem::path(buffer) : std::filesystem::path();
+#else
+	std::error_code error;
+	std::filesystem::path path = std::filesystem::read_symlink("/proc/self/exe", error);
+	return error ? std::filesystem::path() : path;
+#endif
+}
+
+void ProgramCache::initialise(GLADloadfunc load)
+{
+	// a relative directory is taken from the executable's, so every working
+	// directory finds the same cache
+	std::filesystem::path executable = executablePath();
+	if (std::filesystem::path(directory).is_relative() && !executable.empty())
+		directory = (executable.parent_path() / directory).string();
+
+	const char *vendor = (const char *)glGetString(GL_VENDOR);
+	const char *renderer = (const char *)glGetString(GL_RENDERER);
+	const char *version = (const char *)glGetString(GL_VERSION);
+	driver = std::string(vendor ? vendor : "") + "\n" + (renderer ? renderer : "") + "\n" + (version ? version : "");
+
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+	// a loader may hand back a pointer for any name, so the version or the
+	// extension decides whether the entry points can be used
+	if (major > 4 || (major == 4 && minor >= 1) || hasExtension("GL_ARB_get_program_binary")) {
+		getProgramBinary = (GetProgramBinaryFunc)load("glGetProgramBinary");
+		programBinary = (ProgramBinaryFunc)load("glProgramBinary");
+		programParameteri = (ProgramParameteriFunc)load("glProgramParameteri");
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		binariesSupported = getProgramBinary && programBinary && programParameteri && formats > 0;
+	}
+
+	if (hasExtension("GL_KHR_parallel_shader_compile"))
+		maxShaderCompilerThreads = (MaxShaderCompilerThreadsFunc)load("glMaxShaderCompilerThreadsKHR");
+	else if (hasExtension("GL_ARB_parallel_shader_compile"))
+		maxShaderCompilerThreads = (MaxShaderCompilerThreadsFunc)load("glMaxShaderCompilerThreadsARB");
+	if (maxShaderCompilerThreads) {
+		maxShaderCompilerThreads(0xFFFFFFFFu); // as many as the driver likes
+		parallelCompile = true;
+	}
+
+	printf("Program cache : %s, parallel compilation : %s\n",
+		binariesSupported && enabled ? "on" : "off", parallelCompile ? "on" : "off");
+}
+
+uint64_t ProgramCache::key(const std::string &vertexCode, const std::string &fragmentCode) const
+{
+	// FNV-1a over both sources and the driver, with a separator between them
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&](const std::string &text) {
+		for (unsigned char c : text) {
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+		hash ^= 0xFF;
+		hash *= 1099511628211ull;
+	};
+	add(vertexCode);
+	add(fragmentCode);
+	add(driver);
+	return hash;
+}
+
+std::string ProgramCache::path(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.lprg", (unsigned long long)key);
+	return directory + "/" + name;
+}
+
+GLuint ProgramCache::load(uint64_t key)
+{
+	if (!enabled || !binariesSupported) return 0;
+
+	std::ifstream file(path(key), std::ios::binary);
+	ProgramBinaryHeader header;
+	if (!file.read((char *)&header, sizeof(header)) || memcmp(header.magic, "LPRG", 4) != 0 ||
+		header.version != programBinaryVersion || header.key != key || header.driverLength != driver.size()) {
+		++misses;
+		return 0;
+	}
+
+	std::string storedDriver(header.driverLength, '\0');
+	std::vector<char> binary(header.binaryLength);
+	if (!file.read(&storedDriver[0], header.driverLength) || storedDriver != driver ||
+		!file.read(binary.data(), binary.size())) {
+		++misses;
+		return 0;
+	}
+
+	// the driver may still refuse it, after an update that kept its version string
+	GLuint program = gpuCreateProgram(GpuOwner::Shaders, GPU_SITE);
+	programBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+	GLint Result = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &Result);
+	if (!Result) {
+		gpuDeleteProgram(program);
+		++misses;
+		return 0;
+	}
+	++hits;
+	return program;
+}
+
+void ProgramCache::markRetrievable(GLuint program) const
+{
+	if (enabled && binariesSupported) programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramCache::store(uint64_t key, GLuint program) const
+{
+	if (!enabled || !binariesSupported) return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	getProgramBinary(program, length, &length, &format, binary.data());
+
+	ProgramBinaryHeader header;
+	memcpy(header.magic, "LPRG", 4);
+	header.version = programBinaryVersion;
+	header.key = key;
+	header.format = format;
+	header.driverLength = (uint32_t)driver.size();
+	header.binaryLength = (uint32_t)length;
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	// written aside and renamed, so another instance never reads half a file
+	std::string target = path(key);
+	std::string temporary = target + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file) return;
+		file.write((const char *)&header, sizeof(header));
+		file.write(driver.data(), driver.size());
+		file.write(binary.data(), length);
+		if (!file) return;
+	}
+	std::filesystem::rename(temporary, target, error);
+}
@@ -3,25 +3,114 @@
 
 #include <glad/gl.h>
 #include <glm/glm.hpp>
+#include <gpuResources.h>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 struct Shader {
-    GLuint ID;
+    GlProgram ID;
 
-    void initialise(const char *vertex_file_path, const char *fragment_file_path);
+    // Loads the program from the program cache when it holds one for the same
+    // sources and driver, otherwise compiles and links it; both are only
+    // started here, so loading can carry on while the driver compiles
+    // With feedbackVaryings, those vertex outputs are captured interleaved, in
+    // that order, by transform feedback; fragment_file_path may then be null
+    // for a program that only ever runs with GL_RASTERIZER_DISCARD
+    void begin(const char *vertex_file_path, const char *fragment_file_path,
+               const char *const *feedbackVaryings = nullptr, int feedbackCount = 0);
+
+    // Waits for the program begun last, reports any errors and stores a newly
+    // linked program in the cache; ID is 0 on failure
+    bool finish();
+
+    void initialise(const char *vertex_file_path, const char *fragment_file_path,
+                    const char *const *feedbackVaryings = nullptr, int feedbackCount = 0);
     void use() const;
-    void setBool(const std::string &name, bool value) const;
-    void setInt(const std::string &name, int value) const;
-    void setFloat(const std::string &name, float value) const;
-    void setVec3(const std::string &name, glm::vec3 value) const;
-    void setVec4(const std::string &name, glm::vec4 value) const;
-    void setMatrix(const std::string &name, const float *value) const;
-    void setMatrixArray(const std::string& name, const std::vector<glm::mat4>& matrices) const;
-    void remove() const;
+
+    // Take the name as a C string, so setting uniforms every frame does not
+    // build a std::string per call; the std::string overloads forward
+    void setBool(const char *name, bool value) const;
+    void setInt(const char *name, int value) const;
+    void setFloat(const char *name, float value) const;
+    void setVec3(const char *name, glm::vec3 value) const;
+    void setVec4(const char *name, glm::vec4 value) const;
+    void setMatrix(const char *name, const float *value) const;
+    void setMatrixArray(const char *name, const std::vector<glm::mat4>& matrices) const;
+    void setMatrixArray(const char *name, const glm::mat4 *matrices, int count) const;
+    void setVec4Array(const char *name, const glm::vec4 *values, int count) const;
+    void setBool(const std::string &name, bool value) const { setBool(name.c_str(), value); }
+    void setInt(const std::string &name, int value) const { setInt(name.c_str(), value); }
+    void setFloat(const std::string &name, float value) const { setFloat(name.c_str(), value); }
+    void setVec3(const std::string &name, glm::vec3 value) const { setVec3(name.c_str(), value); }
+    void setVec4(const std::string &name, glm::vec4 value) const { setVec4(name.c_str(), value); }
+    void setMatrix(const std::string &name, const float *value) const { setMatrix(name.c_str(), value); }
+    void setMatrixArray(const std::string& name, const std::vector<glm::mat4>& matrices) const { setMatrixArray(name.c_str(), matrices); }
+    void remove();
+
+    // between begin and finish
+    GLuint pendingVertex = 0;
+    GLuint pendingFragment = 0;
+    uint64_t pendingKey = 0;
+    std::string pendingPath;
 };
 GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path);
 
 GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode);
 
+// .lprg: a linked program as returned by glGetProgramBinary, one file per
+// program under ProgramCache::directory, named by its key. The key hashes the
+// sources together with the driver's vendor, renderer and version strings, and
+// the driver string is stored too, so a driver update just misses the cache.
+//
+//   ProgramBinaryHeader
+//   driver string
+//   binary
+
+struct ProgramBinaryHeader
+{
+    char magic[4];      // "LPRG"
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;    // as reported by glGetProgramBinary
+    uint32_t driverLength;
+    uint32_t binaryLength;
+};
+
+static const uint32_t programBinaryVersion = 1;
+
+// Program binaries (GL 4.1 or ARB_get_program_binary) and background
+// compilation (KHR/ARB_parallel_shader_compile) are not part of the 3.3 core
+// profile glad was generated for, so their entry points are looked up here
+struct ProgramCache
+{
+    std::string directory = "shader_cache";    // relative to the executable's directory
+    bool enabled = true;
+
+    bool binariesSupported = false;
+    bool parallelCompile = false;
+    std::string driver;
+
+    int hits = 0;
+    int misses = 0;
+
+    // After gladLoadGL, with the same loader
+    void initialise(GLADloadfunc load);
+
+    uint64_t key(const std::string& vertexCode, const std::string& fragmentCode) const;
+
+    // Creates a program from the cached binary for key, 0 when there is none
+    // or the driver rejects it
+    GLuint load(uint64_t key);
+
+    // Asks the driver to keep the binary of a program about to be linked
+    void markRetrievable(GLuint program) const;
+
+    void store(uint64_t key, GLuint program) const;
+
+    std::string path(uint64_t key) const;
+};
+
+ProgramCache& GetProgramCache();
+
 #endif
@@ -0,0 +1,401 @@
+#include "shadowAtlas.h"
+#include "gpuResources.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+const glm::vec3 ShadowAtlas::faceForward[6] = {
+    glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)};
+const glm::vec3 ShadowAtlas::faceUp[6] = {
+    glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0)};
+
+// Distance at which the light's brightest channel has fallen to a fiftieth
+static float reach(const Light& light, float maxDistance)
+{
+    float brightest = std::max(light.colour.r, std::max(light.colour.g, light.colour.b));
+    float k = brightest / 0.02f - light.constant;
+    if (k <= 0.0f) return 0.0f;
+    float distance = maxDistance;
+    if (light.quadratic > 0.0f)
+        distance = (-light.linear + std::sqrt(light.linear * light.linear + 4.0f * light.quadratic * k)) / (2.0f * light.quadratic);
+    else if (light.linear > 0.0f)
+        distance = k / light.linear;
+    return std::min(distance, maxDistance);
+}
+
+// Sphere around what the light reaches: all of it for a point light, the cone for a spot
+static glm::vec4 reachSphere(const Light& light, float range)
+{
+    if (light.type == (int)LightType::Spot) {
+        float outer = std::acos(glm::clamp(light.outerCutoff, -1.0f, 1.0f));
+        if (outer < glm::radians(45.0f)) {
+            float spread = std::tan(outer);
+            return glm::vec4(light.position + glm::normalize(light.direction) * range * 0.5f, range * std::sqrt(0.25f + spread * spread));
+        }
+    }
+    return glm::vec4(light.position, range);
+}
+
+static void createDepthTarget(int size, GLuint& texture, GLuint& framebuffer)
+{
+    texture = gpuCreateTexture(GpuOwner::Shadows, GPU_SITE);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    GetGpuResources().setBytes(GpuKind::Texture, texture, (size_t)size * size * 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    framebuffer = gpuCreateFramebuffer(GpuOwner::Shadows, GPU_SITE);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "Error: Shadow atlas framebuffer is not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowAtlas::initialise()
+{
+    createDepthTarget(size, texture, framebuffer);
+    createDepthTarget(size, staticTexture, staticFramebuffer);
+
+    // nothing below grows after this, so frames with the same lights do not allocate
+    slots.assign(maxRegions, Slot());
+    views.reserve(maxRegions);
+    freeSquares.assign(levelOf(minRegion) + 1, {});
+    for (std::vector<glm::ivec2>& level : freeSquares)
+        level.reserve(maxRegions * 3 + 1);
+    freeSquares[0].push_back(glm::ivec2(0));
+    uploaded = false;
+}
+
+int ShadowAtlas::levelOf(int regionSize) const
+{
+    int level = 0;
+    while ((size >> level) > regionSize) level++;
+    return level;
+}
+
+bool ShadowAtlas::allocate(int regionSize, Region& out)
+{
+    int level = levelOf(regionSize);
+    int from = level;
+    while (from >= 0 && freeSquares[from].empty()) from--;
+    if (from < 0) return false;
+
+    glm::ivec2 at = freeSquares[from].back();
+    freeSquares[from].pop_back();
+    // split down to the size asked for, keeping the first quarter each time
+    while (from < level) {
+        from++;
+        int side = size >> from;
+        freeSquares[from].push_back(at + glm::ivec2(side, 0));
+        freeSquares[from].push_back(at + glm::ivec2(0, side));
+        freeSquares[from].push_back(at + glm::ivec2(side, side));
+    }
+    out.x = at.x;
+    out.y = at.y;
+    out.size = regionSize;
+    return true;
+}
+
+void ShadowAtlas::release(const Region& region)
+{
+    int level = levelOf(region.size);
+    glm::ivec2 at(region.x, region.y);
+    // merge back into the parent square while its other three quarters are free
+    while (level > 0) {
+        int mask = ~(2 * (size >> level) - 1);
+        glm::ivec2 parent(at.x & mask, at.y & mask);
+        auto sibling = [&](const glm::ivec2& square) { return (square.x & mask) == parent.x && (square.y & mask) == parent.y; };
+        std::vector<glm::ivec2>& free = freeSquares[level];
+        if (std::count_if(free.begin(), free.end(), sibling) < 3) break;
+        free.erase(std::remove_if(free.begin(), free.end(), sibling), free.end());
+        at = parent;
+        level--;
+    }
+    freeSquares[level].push_back(at);
+}
+
+bool ShadowAtlas::covers(const Slot& slot, const glm::vec4& sphere)
+{
+    glm::vec4 reached = reachSphere(slot.light, slot.range);
+    if (glm::length(glm::vec3(sphere) - glm::vec3(reached)) > reached.w + sphere.w) return false;
+    if (slot.face < 0) return true;
+
+    // within the face's 90 degree frustum, give or take the sphere's radius
+    glm::vec3 d = glm::vec3(sphere) - slot.light.position;
+    glm::vec3 forward = faceForward[slot.face];
+    glm::vec3 side = glm::cross(forward, faceUp[slot.face]);
+    float across = std::max(std::abs(glm::dot(side, d)), std::abs(glm::dot(faceUp[slot.face], d)));
+    return glm::dot(forward, d) + sphere.w * 1.5f >= across - sphere.w * 1.5f;
+}
+
+void ShadowAtlas::update(const Light* lights, int count, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                         int viewportHeight, const glm::vec4* movers, size_t moverCount)
+{
+    frame++;
+    views.clear();
+    count = std::min(count, maxLights);
+    glm::vec3 cameraPos = glm::vec3(glm::inverse(viewMatrix)[3]);
+
+    // the shadowed lights, most important (largest reach on screen) first
+    int order[maxLights];
+    float importance[maxLights];
+    float ranges[maxLights];
+    int shadowed = 0;
+    for (int i = 0; i < count; ++i) {
+        const Light& light = lights[i];
+        if (light.type != (int)LightType::Spot && light.type != (int)LightType::Point) continue;
+        ranges[i] = reach(light, maxDistance);
+        if (ranges[i] <= nearPlane * 2.0f) continue;
+
+        glm::vec4 sphere = reachSphere(light, ranges[i]);
+        float distance = glm::length(glm::vec3(sphere) - cameraPos);
+        importance[i] = distance <= sphere.w ? (float)viewportHeight
+                      : sphere.w / std::sqrt(distance * distance - sphere.w * sphere.w) * projectionMatrix[1][1] * viewportHeight;
+        order[shadowed++] = i;
+    }
+    std::sort(order, order + shadowed, [&](int a, int b) { return importance[a] > importance[b]; });
+
+    // regions still holding depth drawn for one of this frame's lights are
+    // claimed by it; the rest go back to the allocator
+    for (Slot& slot : slots) slot.used = false;
+    for (int k = 0; k < shadowed; ++k) {
+        int i = order[k];
+        int faces = lights[i].type == (int)LightType::Point ? 6 : 1;
+        for (int f = 0; f < faces; ++f)
+            for (Slot& slot : slots)
+                if (slot.active && !slot.used && slot.face == (faces == 6 ? f : -1) && sameLight(slot.light, lights[i])) {
+                    slot.used = true;
+                    slot.lightIndex = i;
+                    slot.importance = importance[i];
+                    break;
+                }
+    }
+    for (Slot& slot : slots)
+        if (slot.active && !slot.used) {
+            release(slot.region);
+            slot.active = false;
+        }
+
+    // resize what has drifted a factor of two from its size on screen and
+    // place the lights that are new, most important first
+    for (int k = 0; k < shadowed; ++k) {
+        int i = order[k];
+        const Light& light = lights[i];
+        bool point = light.type == (int)LightType::Point;
+        int faces = point ? 6 : 1;
+        float target = importance[i] * detailScale * (point ? 0.5f : 1.0f);
+        int limit = std::max(minRegion, (int)(maxRegion * detailScale * (point ? 0.5f : 1.0f)));
+        int wanted = minRegion;
+        while (wanted * 2 <= target && wanted * 2 <= limit) wanted *= 2;
+
+        for (int f = 0; f < faces; ++f) {
+            int face = point ? f : -1;
+            Slot* slot = nullptr;
+            for (Slot& s : slots)
+                if (s.used && s.lightIndex == i && s.face == face) slot = &s;
+
+            if (slot) {
+                int current = slot->region.size;
+                if (current == wanted || (current <= limit && current * 2 > target && current < target * 2)) continue;
+                release(slot->region);
+            } else {
+                for (Slot& s : slots)
+                    if (!s.active) { slot = &s; break; }
+                if (!slot) break;
+            }
+
+            // a full atlas hands out smaller regions
+            Region region;
+            int regionSize = wanted;
+            bool placed = allocate(regionSize, region);
+            while (!placed && regionSize > minRegion) {
+                regionSize /= 2;
+                placed = allocate(regionSize, region);
+            }
+            if (!placed) {
+                slot->active = slot->used = false;
+                continue;
+            }
+            slot->region = region;
+            slot->active = slot->used = true;
+            slot->light = light;
+            slot->face = face;
+            slot->lightIndex = i;
+            slot->importance = importance[i];
+            slot->range = ranges[i];
+            slot->rendered = false;
+            slot->stale = false;
+            slot->moving = false;
+
+            glm::mat4 projection;
+            glm::mat4 view;
+            if (point) {
+                projection = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, ranges[i]);
+                view = glm::lookAt(light.position, light.position + faceForward[f], faceUp[f]);
+            } else {
+                glm::vec3 direction = glm::normalize(light.direction);
+                glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+                float fov = std::min(2.0f * std::acos(glm::clamp(light.outerCutoff, -1.0f, 1.0f)) + glm::radians(2.0f), glm::radians(170.0f));
+                projection = glm::perspective(fov, 1.0f, nearPlane, ranges[i]);
+                view = glm::lookAt(light.position, light.position + direction, up);
+            }
+            slot->lightSpace = projection * view;
+        }
+    }
+
+    // which regions have something moving in them
+    for (Slot& slot : slots) {
+        if (!slot.used) continue;
+        slot.moving = false;
+        for (size_t m = 0; m < moverCount && !slot.moving; ++m)
+            slot.moving = covers(slot, movers[m]);
+    }
+
+    // this frame's static redraws: regions never drawn, then those the
+    // static casters changed under, most important first
+    updatesLastFrame = 0;
+    refreshesLastFrame = 0;
+    for (int pass = 0; pass < 2; ++pass)
+        for (int k = 0; k < shadowed; ++k)
+            for (Slot& slot : slots) {
+                if (!slot.used || slot.lightIndex != order[k] || (pass == 0 ? slot.rendered : !slot.stale)) continue;
+                if (updatesLastFrame == updatesPerFrame) break;
+                views.push_back({slot.region, slot.lightSpace, true, slot.moving});
+                slot.rendered = true;
+                slot.stale = false;
+                slot.lastRendered = frame;
+                updatesLastFrame++;
+            }
+    // then the moving casters over the static depth, the longest stale first
+    while (refreshesLastFrame < refreshesPerFrame) {
+        Slot* oldest = nullptr;
+        for (Slot& slot : slots)
+            if (slot.used && slot.rendered && slot.moving && slot.lastRendered != frame && (!oldest || slot.lastRendered < oldest->lastRendered))
+                oldest = &slot;
+        if (!oldest) break;
+        views.push_back({oldest->region, oldest->lightSpace, false, true});
+        oldest->lastRendered = frame;
+        refreshesLastFrame++;
+    }
+    updatesTotal += updatesLastFrame;
+    regionsInUse = 0;
+    cachedLastFrame = 0;
+    for (const Slot& slot : slots)
+        if (slot.used) {
+            regionsInUse++;
+            if (slot.rendered && slot.lastRendered != frame) cachedLastFrame++;
+        }
+
+    // uniforms: each shadowed light's regions are consecutive in shadowRects,
+    // a region not drawn yet has size 0 and leaves its part of the light unshadowed
+    for (int l = 0; l < maxLights; ++l) {
+        lightData[l] = glm::vec4(-1.0f, 0.0f, 0.0f, 0.0f);
+        lightMatrices[l] = glm::mat4(1.0f);
+    }
+    for (int r = 0; r < maxRegions; ++r) rects[r] = glm::vec4(0.0f);
+    int next = 0;
+    for (int k = 0; k < shadowed; ++k) {
+        int i = order[k];
+        int faces = lights[i].type == (int)LightType::Point ? 6 : 1;
+        if (next + faces > maxRegions) break;
+        bool any = false;
+        for (const Slot& slot : slots) {
+            if (!slot.used || slot.lightIndex != i) continue;
+            any = true;
+            if (slot.face < 0) lightMatrices[i] = slot.lightSpace;
+            if (slot.rendered)
+                rects[next + std::max(slot.face, 0)] = glm::vec4(slot.region.x, slot.region.y, slot.region.size, slot.region.size) / (float)size;
+        }
+        if (!any) continue;
+        lightData[i] = glm::vec4((float)next, nearPlane, ranges[i], 0.0f);
+        next += faces;
+    }
+}
+
+void ShadowAtlas::bindStatic(const View& view) const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, staticFramebuffer);
+    glViewport(view.region.x, view.region.y, view.region.size, view.region.size);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(view.region.x, view.region.y, view.region.size, view.region.size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void ShadowAtlas::bind(const View& view) const
+{
+    const Region& r = view.region;
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(r.x, r.y, r.size, r.size);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    glBlitFramebuffer(r.x, r.y, r.x + r.size, r.y + r.size, r.x, r.y, r.x + r.size, r.y + r.size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(r.x, r.y, r.size, r.size);
+}
+
+void ShadowAtlas::finish() const
+{
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowAtlas::invalidate()
+{
+    for (Slot& slot : slots)
+        if (slot.active) slot.stale = true;
+}
+
+void ShadowAtlas::invalidate(const glm::vec4& sphere)
+{
+    for (Slot& slot : slots)
+        if (slot.active && covers(slot, sphere)) slot.stale = true;
+}
+
+void ShadowAtlas::apply(Shader& program, int unit)
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    program.setInt("shadowAtlas", unit);
+
+    if (uploaded && memcmp(sentLightData, lightData, sizeof(lightData)) == 0 && memcmp(sentRects, rects, sizeof(rects)) == 0 &&
+        memcmp(sentMatrices, lightMatrices, sizeof(lightMatrices)) == 0)
+        return;
+    program.setVec4Array("lightShadow", lightData, maxLights);
+    program.setMatrixArray("lightShadowMatrix", lightMatrices, maxLights);
+    program.setVec4Array("shadowRects", rects, maxRegions);
+    memcpy(sentLightData, lightData, sizeof(lightData));
+    memcpy(sentRects, rects, sizeof(rects));
+    memcpy(sentMatrices, lightMatrices, sizeof(lightMatrices));
+    uploaded = true;
+}
+
+bool ShadowAtlas::spotRegion(int light, glm::mat4& lightSpace, glm::vec4& rect, glm::vec2& range) const
+{
+    if (light < 0 || light >= maxLights || lightData[light].x < 0.0f) return false;
+    rect = rects[(int)lightData[light].x];
+    if (rect.z == 0.0f) return false;
+    lightSpace = lightMatrices[light];
+    range = glm::vec2(lightData[light].y, lightData[light].z);
+    return true;
+}
+
+void ShadowAtlas::cleanup()
+{
+    gpuDeleteFramebuffer(framebuffer);
+    gpuDeleteTexture(texture);
+    gpuDeleteFramebuffer(staticFramebuffer);
+    gpuDeleteTexture(staticTexture);
+    slots.clear();
+    views.clear();
+    freeSquares.clear();
+}
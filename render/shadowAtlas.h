@@ -0,0 +1,141 @@
+#ifndef _SHADOW_ATLAS_H_
+#define _SHADOW_ATLAS_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "light.h"
+#include "shader.h"
+
+// One depth texture holding the shadows of every spot light and of each
+// face of every point light, so more shadowed lights cost regions rather
+// than framebuffers. Regions are squares from a quadtree (buddy) allocator,
+// sized by how large the light's reach is on screen. The static casters'
+// depth is kept in a second atlas for as long as the light is unchanged and
+// only drawn again when the static casters change, at most updatesPerFrame
+// regions a frame, new ones first and most important first. A region with
+// something moving in reach copies its static depth across and draws just
+// the moving casters over it, at most refreshesPerFrame a frame, the
+// longest stale first.
+//
+// object.frag samples spot regions through lightShadowMatrix and works the
+// point-light faces out itself from faceForward/faceUp, which must match.
+struct ShadowAtlas
+{
+    static const int maxLights = 8;     // MAX_LIGHTS in object.frag
+    static const int maxRegions = 24;   // MAX_SHADOW_RECTS in object.frag
+
+    struct Region {
+        int x = 0, y = 0;   // texels
+        int size = 0;
+    };
+
+    // A region due a render this frame
+    struct View {
+        Region region;
+        glm::mat4 lightSpace;
+        bool drawStatic;    // into the static atlas, after bindStatic
+        bool drawMoving;    // over the copied static depth, after bind
+    };
+
+    int size = 2048;
+    int maxRegion = 1024;       // a spot light up close; point-light faces get half
+    int minRegion = 64;
+    float detailScale = 1.0f;   // region sizes are scaled by this (the governor's shadow scale)
+    float maxDistance = 150.0f; // no light's far plane goes past this
+    float nearPlane = 0.5f;
+    int updatesPerFrame = 2;    // static redraws
+    int refreshesPerFrame = 8;  // moving-caster redraws
+
+    GLuint texture = 0;         // GL_DEPTH_COMPONENT24, sampled
+    GLuint framebuffer = 0;
+    GLuint staticTexture = 0;   // the static casters alone
+    GLuint staticFramebuffer = 0;
+
+    int updatesLastFrame = 0;   // static redraws
+    int refreshesLastFrame = 0;
+    int cachedLastFrame = 0;    // regions in use that kept last frame's depth
+    int regionsInUse = 0;
+    long long updatesTotal = 0;
+
+    void initialise();
+
+    // Gives the spot and point lights among the first count their regions
+    // and picks this frame's renders. movers are the bounding spheres
+    // (centre, radius) of casters that move.
+    void update(const Light* lights, int count, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                int viewportHeight, const glm::vec4* movers, size_t moverCount);
+
+    const std::vector<View>& pending() const { return views; }
+
+    // Targets one pending region of the static atlas (viewport and scissor)
+    // and clears it; draw the static casters with view.lightSpace afterwards
+    void bindStatic(const View& view) const;
+
+    // Copies the region's static depth into the sampled atlas and targets it
+    // there; draw the moving casters afterwards when view.drawMoving
+    void bind(const View& view) const;
+
+    // Back to the default framebuffer with the scissor off
+    void finish() const;
+
+    // The static casters changed: every region is drawn again, within the budget
+    void invalidate();
+
+    // Static casters within sphere (centre, radius) came or went: the regions
+    // that can see it are drawn again
+    void invalidate(const glm::vec4& sphere);
+
+    // Binds the atlas to unit and sends the shadow uniforms when they changed
+    void apply(Shader& program, int unit);
+
+    // The drawn region of spot light index light, as passed to update: its
+    // uv rect in the atlas, light-space matrix and near and far planes. False
+    // while it has none.
+    bool spotRegion(int light, glm::mat4& lightSpace, glm::vec4& rect, glm::vec2& range) const;
+
+    void cleanup();
+
+    // Cube face directions, as lookAt forward and up
+    static const glm::vec3 faceForward[6];
+    static const glm::vec3 faceUp[6];
+
+private:
+    struct Slot {
+        bool active = false;
+        bool used = false;      // claimed by a light this frame
+        Light light;            // what the depth was drawn for
+        int face = -1;          // -1 for a spot light, else the cube face
+        int lightIndex = 0;
+        Region region;
+        bool rendered = false;
+        bool stale = false;     // drawn, but the static casters have changed since
+        int lastRendered = -1;
+        bool moving = false;    // a mover is within its reach
+        float importance = 0.0f;
+        float range = 0.0f;     // far plane
+        glm::mat4 lightSpace;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<View> views;
+    std::vector<std::vector<glm::ivec2>> freeSquares; // per level, 0 being the whole atlas
+    int frame = 0;
+
+    glm::vec4 lightData[maxLights];             // first region (-1 none), near, far
+    glm::mat4 lightMatrices[maxLights];
+    glm::vec4 rects[maxRegions];                // uv offset and size; 0 size until drawn
+    bool uploaded = false;
+    glm::vec4 sentLightData[maxLights];
+    glm::vec4 sentRects[maxRegions];
+    glm::mat4 sentMatrices[maxLights];
+
+    // Whether sphere (centre, radius) is within what the slot's region sees
+    static bool covers(const Slot& slot, const glm::vec4& sphere);
+
+    bool allocate(int regionSize, Region& out);
+    void release(const Region& region);
+    int levelOf(int regionSize) const;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#version 330 core
+
+in vec2 uv;
+
+out vec4 result;
+
+uniform sampler2D source;
+uniform vec4 sourceRect;    // xy: uv scale of the part read, zw: last uv inside it
+uniform vec4 sourceTexel;   // xy: one texel of source, in uv
+uniform bool prefilter;     // the first level keeps only what is over the threshold
+uniform vec4 threshold;     // threshold, knee
+
+vec3 tap(vec2 offset)
+{
+    return texture(source, min(uv * sourceRect.xy + offset * sourceTexel.xy, sourceRect.zw)).rgb;
+}
+
+void main() {
+    // 13 taps: a 4x4 box inside four overlapping 2x2 ones, which keeps the
+    // blocky flicker of a plain 2x2 average out of the wide levels
+    vec3 a = tap(vec2(-2.0, 2.0)), b = tap(vec2(0.0, 2.0)), c = tap(vec2(2.0, 2.0));
+    vec3 d = tap(vec2(-1.0, 1.0)), e = tap(vec2(1.0, 1.0));
+    vec3 f = tap(vec2(-2.0, 0.0)), g = tap(vec2(0.0, 0.0)), h = tap(vec2(2.0, 0.0));
+    vec3 i = tap(vec2(-1.0, -1.0)), j = tap(vec2(1.0, -1.0));
+    vec3 k = tap(vec2(-2.0, -2.0)), l = tap(vec2(0.0, -2.0)), m = tap(vec2(2.0, -2.0));
+    vec3 colour = (d + e + i + j) * 0.125 + (a + c + k + m) * 0.03125 + (b + f + h + l) * 0.0625 + g * 0.125;
+
+    if (prefilter) {
+        float brightness = max(colour.r, max(colour.g, colour.b));
+        float knee = threshold.y;
+        float soft = clamp(brightness - threshold.x + knee, 0.0, 2.0 * knee);
+        soft = soft * soft / (4.0 * knee + 1e-4);
+        colour *= max(soft, brightness - threshold.x) / max(brightness, 1e-4);
+    }
+    result = vec4(colour, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+
+in vec2 uv;
+
+out vec4 result; // added to the level above
+
+uniform sampler2D source;   // the level below, read whole
+uniform vec4 sourceTexel;   // xy: one texel of source, in uv
+
+void main() {
+    // 3x3 tent
+    vec2 t = sourceTexel.xy;
+    vec3 colour = texture(source, uv).rgb * 4.0;
+    colour += (texture(source, uv + vec2(t.x, 0.0)).rgb + texture(source, uv - vec2(t.x, 0.0)).rgb +
+               texture(source, uv + vec2(0.0, t.y)).rgb + texture(source, uv - vec2(0.0, t.y)).rgb) * 2.0;
+    colour += texture(source, uv + t).rgb + texture(source, uv - t).rgb +
+              texture(source, uv + vec2(t.x, -t.y)).rgb + texture(source, uv + vec2(-t.x, t.y)).rgb;
+    result = vec4(colour / 16.0, 1.0);
+}
@@ -1,10 +1,12 @@
 #version 330 core
 layout (location = 0) in vec3 vertexPos;
+layout (location = 6) in mat4 instanceMatrix;
 
 uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
+uniform bool useInstancing;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(vertexPos, 1.0);
+    gl_Position = lightSpaceMatrix * (useInstancing ? instanceMatrix : model) * vec4(vertexPos, 1.0);
 }
\ No newline at end of file
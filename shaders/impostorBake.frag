@@ -0,0 +1,16 @@
+#version 330 core
+
+in vec3 normal;
+in vec2 uv;
+
+layout (location = 0) out vec4 colour;       // colour atlas, alpha = coverage
+layout (location = 1) out vec4 packedNormal; // normal atlas
+
+uniform bool useTexture;
+uniform sampler2D textureSampler;
+
+void main() {
+    // unlit, matching the base colour object.frag would light
+    colour = vec4(useTexture ? texture(textureSampler, uv).rgb : vec3(1.0), 1.0);
+    packedNormal = vec4(normalize(normal) * 0.5 + 0.5, 1.0);
+}
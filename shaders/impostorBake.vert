@@ -0,0 +1,17 @@
+#version 330 core
+
+layout (location = 0) in vec3 vertexPos;
+layout (location = 1) in vec3 vertexNorm;
+layout (location = 3) in vec2 vertexUV;
+
+out vec3 normal;
+out vec2 uv;
+
+uniform mat4 model; // the asset's base transform without its translation
+uniform mat4 viewProjection;
+
+void main() {
+    gl_Position = viewProjection * model * vec4(vertexPos, 1.0);
+    normal = mat3(transpose(inverse(model))) * vertexNorm;
+    uv = vertexUV;
+}
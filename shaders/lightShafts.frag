@@ -0,0 +1,107 @@
+#version 330 core
+
+in vec2 uv;
+
+out vec4 result; // light scattered towards the camera, linear depth it was marched to
+
+uniform sampler2D depthSampler;     // the scene's depth
+uniform sampler2D historySampler;   // last frame's result
+uniform sampler2D shadowAtlas;
+uniform vec4 depthRect;             // xy: uv scale of the rendered corner
+uniform vec4 historyRect;           // xy: uv scale of last frame's corner, zw: last uv inside it
+uniform float historyWeight;        // 0 without history
+uniform mat4 inverseViewProjection;
+uniform mat4 previousViewProjection;
+uniform vec3 cameraPos;
+uniform vec4 depthTerms;            // projection[2][2], projection[3][2]
+
+uniform vec3 lightPosition;
+uniform vec3 lightDirection;
+uniform vec3 lightColour;
+uniform vec3 lightAttenuation;      // constant, linear, quadratic
+uniform vec4 lightCone;             // cutoff, outer cutoff
+uniform mat4 lightSpaceMatrix;
+uniform vec4 shadowRect;            // the light's region of shadowAtlas, in uv
+uniform vec4 shadowRange;           // its near and far planes
+
+uniform int steps;
+uniform float density;
+uniform float anisotropy;
+uniform float fogStart;
+uniform float fogEnd;
+uniform float jitter;               // this frame's offset, 0 to 1
+
+const float PI = 3.14159265;
+
+// 0 in the light's shadow; the same compare as object.frag's atlasShadow
+float visibility(vec3 position, vec2 halfTexel)
+{
+    vec4 clip = lightSpaceMatrix * vec4(position, 1.0);
+    if (clip.w <= shadowRange.x || clip.w >= shadowRange.y) return 1.0;
+    vec2 at = clip.xy / clip.w * 0.5 + 0.5;
+    if (any(lessThan(at, vec2(0.0))) || any(greaterThan(at, vec2(1.0)))) return 1.0;
+    at = clamp(shadowRect.xy + at * shadowRect.zw, shadowRect.xy + halfTexel, shadowRect.xy + shadowRect.zw - halfTexel);
+    float stored = texture(shadowAtlas, at).r * 2.0 - 1.0;
+    float closest = 2.0 * shadowRange.x * shadowRange.y / (shadowRange.y + shadowRange.x - stored * (shadowRange.y - shadowRange.x));
+    return clip.w > closest + 0.05 + 0.01 * clip.w ? 0.0 : 1.0;
+}
+
+// Henyey-Greenstein, with cosAngle between the light's travel and the view ray
+float phase(float cosAngle)
+{
+    float g = anisotropy;
+    return (1.0 - g * g) / (4.0 * PI * pow(1.0 + g * g - 2.0 * g * cosAngle, 1.5));
+}
+
+void main() {
+    float ndcZ = texture(depthSampler, uv * depthRect.xy).r * 2.0 - 1.0;
+    float linearDepth = min(depthTerms.y / (ndcZ + depthTerms.x), fogEnd);
+    vec4 world = inverseViewProjection * vec4(uv * 2.0 - 1.0, ndcZ, 1.0);
+    world /= world.w;
+    vec3 ray = world.xyz - cameraPos;
+    float rayLength = length(ray);
+    vec3 rayDir = ray / rayLength;
+    rayLength = min(rayLength, fogEnd);
+
+    // only the stretch of the ray inside the light's reach is marched
+    vec3 scattered = vec3(0.0);
+    vec3 fromLight = cameraPos - lightPosition;
+    float b = dot(fromLight, rayDir);
+    float disc = b * b - dot(fromLight, fromLight) + shadowRange.y * shadowRange.y;
+    if (disc > 0.0) {
+        float root = sqrt(disc);
+        float t0 = max(-b - root, 0.0);
+        float t1 = min(-b + root, rayLength);
+        if (t1 > t0) {
+            vec2 halfTexel = 0.5 / vec2(textureSize(shadowAtlas, 0));
+            float stepLength = (t1 - t0) / float(steps);
+            // interleaved gradient noise, moved on every frame
+            float offset = fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))) + jitter);
+            for (int i = 0; i < steps; ++i) {
+                float t = t0 + (float(i) + offset) * stepLength;
+                vec3 position = cameraPos + rayDir * t;
+                vec3 toLight = lightPosition - position;
+                float distance = length(toLight);
+                toLight /= distance;
+                float cone = clamp((dot(toLight, -lightDirection) - lightCone.y) / (lightCone.x - lightCone.y), 0.0, 1.0);
+                if (cone <= 0.0) continue;
+                float attenuation = cone / (lightAttenuation.x + lightAttenuation.y * distance + lightAttenuation.z * distance * distance);
+                float fog = clamp((fogEnd - t) / (fogEnd - fogStart), 0.0, 1.0);
+                scattered += attenuation * fog * phase(dot(toLight, rayDir)) * visibility(position, halfTexel);
+            }
+            scattered *= lightColour * density * stepLength;
+        }
+    }
+
+    // last frame's result for the same surface, unless it has come out from
+    // behind something since
+    vec4 previous = previousViewProjection * vec4(world.xyz, 1.0);
+    vec2 previousUv = previous.xy / previous.w * 0.5 + 0.5;
+    if (historyWeight > 0.0 && previous.w > 0.0 && all(greaterThanEqual(previousUv, vec2(0.0))) && all(lessThanEqual(previousUv, vec2(1.0)))) {
+        vec4 history = texture(historySampler, min(previousUv * historyRect.xy, historyRect.zw));
+        float previousDepth = min(previous.w, fogEnd);
+        if (abs(history.a - previousDepth) < 0.1 * previousDepth)
+            scattered = mix(scattered, history.rgb, historyWeight);
+    }
+    result = vec4(scattered, linearDepth);
+}
@@ -0,0 +1,41 @@
+#version 330 core
+
+in vec2 uv;
+
+out vec4 finalColour; // added to the target
+
+uniform sampler2D shaftsSampler;    // scattered light, linear depth
+uniform sampler2D depthSampler;     // the scene's depth
+uniform vec4 shaftsSize;            // xy: marched texels
+uniform vec4 depthRect;             // xy: uv scale of the rendered corner
+uniform vec4 depthTerms;            // projection[2][2], projection[3][2], furthest depth marched
+
+void main() {
+    float ndcZ = texture(depthSampler, uv * depthRect.xy).r * 2.0 - 1.0;
+    float depth = min(depthTerms.y / (ndcZ + depthTerms.x), depthTerms.z);
+
+    // the four marched texels around the pixel, bilinear weights cut down by
+    // how far their depth is from the pixel's; when none is close, the closest
+    vec2 at = uv * shaftsSize.xy - 0.5;
+    ivec2 base = ivec2(floor(at));
+    vec2 f = at - vec2(base);
+    ivec2 last = ivec2(shaftsSize.xy) - 1;
+    vec3 sum = vec3(0.0);
+    float total = 0.0;
+    vec3 closest = vec3(0.0);
+    float closestDifference = 1e20;
+    for (int y = 0; y < 2; ++y)
+        for (int x = 0; x < 2; ++x) {
+            vec4 texel = texelFetch(shaftsSampler, clamp(base + ivec2(x, y), ivec2(0), last), 0);
+            float difference = abs(texel.a - depth);
+            float weight = (x == 1 ? f.x : 1.0 - f.x) * (y == 1 ? f.y : 1.0 - f.y);
+            weight *= max(0.0, 1.0 - difference / (0.1 * depth));
+            sum += texel.rgb * weight;
+            total += weight;
+            if (difference < closestDifference) {
+                closestDifference = difference;
+                closest = texel.rgb;
+            }
+        }
+    finalColour = vec4(total > 1e-4 ? sum / total : closest, 0.0);
+}
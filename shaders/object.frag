@@ -1,6 +1,7 @@
 #version 330 core
 
 #define MAX_LIGHTS 8
+#define MAX_SHADOW_RECTS 24
 struct Light
 {
     int type;
@@ -19,6 +20,11 @@ in vec3 normal;
 //in vec3 surfaceColour;
 in vec3 fragPos;
 in vec4 fragPosLightSpace;
+flat in vec2 material;
+in vec2 impostorUV;
+flat in float impostorBlend;
+flat in vec2 impostorRotation;
+flat in float fadeDistance;
 
 out vec4 finalColour;
 
@@ -27,7 +33,18 @@ uniform Light lights[MAX_LIGHTS];
 
 uniform bool useTexture;
 uniform sampler2D textureSampler;
+uniform bool useTextureArray; // static batch: material comes from the vertex
+uniform sampler2DArray textureArraySampler;
 uniform sampler2D shadowMap;
+uniform sampler2D shadowAtlas;                  // spot lights and point-light faces (ShadowAtlas)
+uniform vec4 lightShadow[MAX_LIGHTS];           // first region in shadowRects (-1 for none), near, far
+uniform mat4 lightShadowMatrix[MAX_LIGHTS];     // spot lights
+uniform vec4 shadowRects[MAX_SHADOW_RECTS];     // atlas uv offset and size; size 0 until drawn
+uniform bool useImpostor;      // textureSampler holds the colour atlas
+uniform sampler2D impostorNormals;
+uniform int crossFade;         // 0 off, 1 fading out with distance (mesh), 2 fading in (impostor)
+uniform float crossFadeStart;
+uniform float crossFadeEnd;
 uniform vec3 cameraPos;
 uniform float fogStart;
 uniform float fogEnd;
@@ -54,9 +71,89 @@ float calculateShadow()
     return shadow;
 }
 
+// depth is the fragment's distance along the region's view axis
+float atlasShadow(int region, vec2 uv, float depth, vec2 range)
+{
+    vec4 rect = shadowRects[region];
+    if (rect.z == 0.0) return 1.0;
+
+    // clamped inside the region, so filtering never reads a neighbour
+    vec2 halfTexel = 0.5 / vec2(textureSize(shadowAtlas, 0));
+    vec2 at = clamp(rect.xy + uv * rect.zw, rect.xy + halfTexel, rect.xy + rect.zw - halfTexel);
+    float stored = texture(shadowAtlas, at).r * 2.0 - 1.0;
+    float closest = 2.0 * range.x * range.y / (range.y + range.x - stored * (range.y - range.x));
+
+    return depth > closest + 0.05 + 0.01 * depth ? 0.2 : 1.0;
+}
+
+float spotShadow(int light)
+{
+    vec4 info = lightShadow[light];
+    if (info.x < 0.0) return 1.0;
+    vec4 clip = lightShadowMatrix[light] * vec4(fragPos, 1.0);
+    if (clip.w <= 0.0 || clip.w >= info.z) return 1.0;
+    vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) return 1.0;
+    return atlasShadow(int(info.x), uv, clip.w, info.yz);
+}
+
+// The face is the major axis. x and y are the fragment in that face's view,
+// the lookAt of ShadowAtlas::faceForward and faceUp written out per axis
+// (a table indexed per fragment is much slower on some drivers).
+float pointShadow(int light, vec3 position)
+{
+    vec4 info = lightShadow[light];
+    if (info.x < 0.0) return 1.0;
+    vec3 d = fragPos - position;
+    vec3 a = abs(d);
+    int face;
+    vec3 view; // x, y, depth
+    if (a.x >= a.y && a.x >= a.z) {
+        face = d.x > 0.0 ? 0 : 1;
+        view = vec3(-sign(d.x) * d.z, -d.y, a.x);
+    } else if (a.y >= a.z) {
+        face = d.y > 0.0 ? 2 : 3;
+        view = vec3(d.x, sign(d.y) * d.z, a.y);
+    } else {
+        face = d.z > 0.0 ? 4 : 5;
+        view = vec3(sign(d.z) * d.x, -d.y, a.z);
+    }
+    if (view.z >= info.z) return 1.0;
+    vec2 uv = view.xy / view.z * 0.5 + 0.5;
+    return atlasShadow(int(info.x) + face, uv, view.z, info.yz);
+}
+
+// 4x4 ordered dither: the mesh and the impostor of one instance keep
+// complementary pixels while they cross-fade, so neither needs sorting
+float ditherThreshold()
+{
+    const float bayer[16] = float[](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 cell = ivec2(gl_FragCoord.xy) % 4;
+    return (bayer[cell.y * 4 + cell.x] + 0.5) / 16.0;
+}
+
 void main() {
+    if (crossFade != 0) {
+        float progress = clamp((fadeDistance - crossFadeStart) / (crossFadeEnd - crossFadeStart), 0.0, 1.0);
+        if ((progress > ditherThreshold()) == (crossFade == 1)) discard;
+    }
+
     vec3 baseColour = vec3(1.0);
-    if (useTexture) baseColour = texture(textureSampler, uv).rgb;
+    float diffuse = diffuseStrength;
+    vec3 surfaceNormal = normal;
+    if (useImpostor) {
+        vec4 colour = mix(texture(textureSampler, uv), texture(textureSampler, impostorUV), impostorBlend);
+        if (colour.a < 0.5) discard;
+        baseColour = colour.rgb;
+        vec3 n = mix(texture(impostorNormals, uv).xyz, texture(impostorNormals, impostorUV).xyz, impostorBlend) * 2.0 - 1.0;
+        surfaceNormal = normalize(vec3(impostorRotation.x * n.x + impostorRotation.y * n.z, n.y,
+                                       -impostorRotation.y * n.x + impostorRotation.x * n.z));
+    }
+    else if (useTextureArray) {
+        diffuse = material.y;
+        if (material.x >= 0.0) baseColour = texture(textureArraySampler, vec3(uv, material.x)).rgb;
+    }
+    else if (useTexture) baseColour = texture(textureSampler, uv).rgb;
     //else baseColour = surfaceColour;
 
     vec3 result = vec3(0.0);
@@ -69,14 +166,15 @@ void main() {
         if (light.type == 0) {
             // Directional
             lightDir = normalize(-light.direction);
-            diff = max(dot(normal, lightDir), 0.0);
+            diff = max(dot(surfaceNormal, lightDir), 0.0);
             shadow = calculateShadow();
         } else if (light.type == 1) {
             // Point
             lightDir = normalize(light.position - fragPos);
             float distance = length(light.position - fragPos);
             attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-            diff = max(dot(normal, lightDir), 0.0);
+            diff = max(dot(surfaceNormal, lightDir), 0.0);
+            if (attenuation * diff > 0.0) shadow = pointShadow(i, light.position);
 
         } else if (light.type == 2) {
             // Spotlight
@@ -87,10 +185,11 @@ void main() {
 
             float distance = length(light.position - fragPos);
             attenuation = intensity / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-            diff = max(dot(normal, lightDir), 0.0);
+            diff = max(dot(surfaceNormal, lightDir), 0.0);
+            if (attenuation * diff > 0.0) shadow = spotShadow(i);
         }
 
-        vec3 lighting = diffuseStrength * diff * light.colour * baseColour * shadow;
+        vec3 lighting = diffuse * diff * light.colour * baseColour * shadow;
         result += attenuation * lighting;
     }
     float ambientStrength = 0.2;
@@ -3,9 +3,13 @@
 layout (location = 0) in vec3 vertexPos;
 layout (location = 1) in vec3 vertexNorm;
 //layout (location = 2) in vec3 vertexCol;
+layout (location = 2) in vec2 vertexMaterial; // static batch: texture array layer, diffuse strength
 layout (location = 3) in vec2 vertexUV;
 layout (location = 4) in ivec4 jointIndices;
 layout (location = 5) in vec4 jointWeights;
+layout (location = 6) in mat4 instanceMatrix; // scattered vegetation, replaces model
+layout (location = 10) in vec4 impostorInstance; // impostor quads: position, scale
+layout (location = 11) in float impostorYaw;
 
 uniform mat4 bones[100];
 
@@ -14,14 +18,63 @@ out vec3 normal;
 out vec2 uv;
 out vec3 fragPos;
 out vec4 fragPosLightSpace;
+flat out vec2 material;
+out vec2 impostorUV;            // the neighbouring frame; uv holds the nearer one
+flat out float impostorBlend;
+flat out vec2 impostorRotation; // cos, sin of the instance yaw
+flat out float fadeDistance;    // to the instance origin, across the ground
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 uniform mat4 lightSpaceMatrix;
 uniform bool useSkinning;
+uniform bool useInstancing;
+uniform bool useImpostor;
+uniform int impostorFrames;
+uniform vec3 impostorAxis;      // baked frame: axis x, 0, axis z
+uniform vec3 impostorExtent;    // half width, bottom, top
+uniform vec3 cameraPos;
+
+void impostorQuad() {
+    // vertexPos is a corner of the unit quad, x across [-1, 1] and y up [0, 1]
+    vec3 position = impostorInstance.xyz;
+    float scale = impostorInstance.w;
+    vec2 rotation = vec2(cos(impostorYaw), sin(impostorYaw));
+    vec3 axis = position + scale * vec3(rotation.x * impostorAxis.x + rotation.y * impostorAxis.z, 0.0,
+                                        -rotation.y * impostorAxis.x + rotation.x * impostorAxis.z);
+
+    // turn about the vertical axis to face the camera
+    vec2 toCamera = cameraPos.xz - axis.xz;
+    vec2 facing = dot(toCamera, toCamera) > 1e-8 ? normalize(toCamera) : vec2(0.0, 1.0);
+    vec3 right = vec3(facing.y, 0.0, -facing.x);
+    vec4 worldPos = vec4(axis + right * (vertexPos.x * impostorExtent.x * scale), 1.0);
+    worldPos.y += mix(impostorExtent.y, impostorExtent.z, vertexPos.y) * scale;
+
+    // the view direction in the model's own frame picks the two baked frames around it
+    float frame = fract((atan(facing.x, facing.y) - impostorYaw) / 6.2831853) * float(impostorFrames);
+    float first = min(floor(frame), float(impostorFrames - 1));
+    float second = mod(first + 1.0, float(impostorFrames));
+    float u = vertexPos.x * 0.5 + 0.5;
+    uv = vec2((first + u) / float(impostorFrames), vertexPos.y);
+    impostorUV = vec2((second + u) / float(impostorFrames), vertexPos.y);
+    impostorBlend = frame - first;
+    impostorRotation = rotation;
+    fadeDistance = length(cameraPos.xz - position.xz);
+
+    gl_Position = projection * view * worldPos;
+    normal = vec3(0.0, 1.0, 0.0); // from the normal atlas
+    material = vec2(0.0);
+    fragPos = vec3(worldPos);
+    fragPosLightSpace = lightSpaceMatrix * worldPos;
+}
 
 void main() {
+    if (useImpostor) {
+        impostorQuad();
+        return;
+    }
+
     vec4 skinnedPos;
     vec3 skinnedNorm = vertexNorm;
     if (useSkinning) {
@@ -36,12 +89,19 @@ void main() {
         skinnedPos = vec4(vertexPos, 1.0);
     }
 
-    vec4 worldPos = model * skinnedPos;
+    mat4 modelMatrix = useInstancing ? instanceMatrix : model;
+    vec4 worldPos = modelMatrix * skinnedPos;
     gl_Position = projection * view * worldPos;
 
     // surfaceColour = vertexCol;
     uv = vertexUV;
-    normal = mat3(transpose(inverse(model))) * skinnedNorm;
+    material = vertexMaterial;
+    // instances are only rotated and uniformly scaled, so skip the inverse
+    normal = useInstancing ? normalize(mat3(instanceMatrix) * skinnedNorm) : mat3(transpose(inverse(model))) * skinnedNorm;
     fragPos = vec3(worldPos);
     fragPosLightSpace = lightSpaceMatrix * worldPos;
+    fadeDistance = useInstancing ? length(cameraPos.xz - instanceMatrix[3].xz) : 0.0;
+    impostorUV = vec2(0.0);
+    impostorBlend = 0.0;
+    impostorRotation = vec2(1.0, 0.0);
 }
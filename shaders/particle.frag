@@ -0,0 +1,14 @@
+#version 330 core
+
+in vec2 corner;
+in vec3 colour;
+
+out vec4 finalColour; // added to the scene
+
+void main() {
+    // a soft round glow
+    float d = dot(corner, corner);
+    if (d >= 1.0) discard;
+    float falloff = 1.0 - d;
+    finalColour = vec4(colour * falloff * falloff, 0.0);
+}
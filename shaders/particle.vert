@@ -0,0 +1,42 @@
+#version 330 core
+
+// one particle per instance, as Particle in particleSystem.h
+layout(location = 0) in vec4 particlePosition;  // xyz, age
+layout(location = 1) in vec4 particleVelocity;  // xyz, lifetime
+layout(location = 2) in vec4 particleColour;
+layout(location = 3) in vec4 particleMotion;    // wander, flicker, seed, size
+
+out vec2 corner;
+out vec3 colour;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float fogStart;
+uniform float fogEnd;
+
+void main() {
+    float age = particlePosition.w;
+    float lifetime = particleVelocity.w;
+    if (age >= lifetime) {
+        // dead, or never emitted: every corner beyond the far plane
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+        corner = vec2(0.0);
+        colour = vec3(0.0);
+        return;
+    }
+
+    // fades in and out, and pulses as much as it flickers; particleBrightness
+    // in particleSystem.cpp matches this
+    float fade = min(min(age, lifetime - age) / min(0.2 * lifetime, 1.0), 1.0);
+    float pulse = 0.5 + 0.5 * sin(age * 2.5 + particleMotion.z * 6.2831853);
+    float brightness = fade * mix(1.0, pulse * pulse * pulse, particleMotion.y);
+
+    // a quad facing the camera, from the triangle strip's vertex
+    corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    vec4 viewPos = view * vec4(particlePosition.xyz, 1.0);
+    viewPos.xy += corner * particleMotion.w;
+    gl_Position = projection * viewPos;
+
+    float fog = clamp((fogEnd + viewPos.z) / (fogEnd - fogStart), 0.0, 1.0);
+    colour = particleColour.rgb * brightness * fog;
+}
@@ -0,0 +1,85 @@
+#version 330 core
+
+#define MAX_BURSTS 8
+
+// one particle per vertex, as Particle in particleSystem.h
+layout(location = 0) in vec4 inPosition;    // xyz, age
+layout(location = 1) in vec4 inVelocity;    // xyz, lifetime
+layout(location = 2) in vec4 inColour;
+layout(location = 3) in vec4 inMotion;      // wander, flicker, seed, size
+
+out vec4 outPosition;
+out vec4 outVelocity;
+out vec4 outColour;
+out vec4 outMotion;
+
+uniform int capacity;
+uniform float deltaTime;
+uniform int seed;                           // new every frame
+
+// the slots being emitted into this frame, and what goes in them
+uniform int burstCount;
+uniform vec4 burstRange[MAX_BURSTS];        // first slot, count, lifetime, prewarm
+uniform vec4 burstCentre[MAX_BURSTS];       // xyz, wander
+uniform vec4 burstExtent[MAX_BURSTS];       // xyz, flicker
+uniform vec4 burstVelocity[MAX_BURSTS];     // xyz, size
+uniform vec4 burstColour[MAX_BURSTS];
+
+// integer hash (Wang), so each slot draws different numbers every frame
+uint hash(uint x)
+{
+    x = (x ^ 61u) ^ (x >> 16);
+    x *= 9u;
+    x ^= x >> 4;
+    x *= 0x27d4eb2du;
+    x ^= x >> 15;
+    return x;
+}
+
+float random(inout uint state)
+{
+    state = hash(state);
+    return float(state) * (1.0 / 4294967296.0);
+}
+
+void main() {
+    vec4 position = inPosition;
+    vec4 velocity = inVelocity;
+    vec4 colour = inColour;
+    vec4 motion = inMotion;
+    float elapsed = deltaTime;
+
+    for (int i = 0; i < burstCount; ++i) {
+        int offset = gl_VertexID - int(burstRange[i].x);
+        if (offset < 0) offset += capacity;
+        if (offset >= int(burstRange[i].y)) continue;
+
+        uint state = uint(gl_VertexID) * 1664525u + uint(seed) * 1013904223u;
+        vec3 at = vec3(random(state), random(state), random(state)) * 2.0 - 1.0;
+        float lifetime = burstRange[i].z * (1.0 + 0.5 * random(state));
+        position = vec4(burstCentre[i].xyz + at * burstExtent[i].xyz, burstRange[i].w > 0.0 ? random(state) * lifetime : 0.0);
+        velocity = vec4(burstVelocity[i].xyz, lifetime);
+        colour = burstColour[i];
+        motion = vec4(burstCentre[i].w, burstExtent[i].w, random(state), burstVelocity[i].w);
+        // starts where it was put
+        elapsed = 0.0;
+    }
+
+    if (position.w < velocity.w) {
+        // the drift: a push that turns slowly at the particle's own rates,
+        // and averages out, so it wanders about where its velocity takes it
+        float phase = motion.z * 6.2831853;
+        float t = position.w;
+        vec3 push = vec3(sin(t * (0.7 + motion.z) + phase),
+                         0.5 * sin(t * 0.9 + phase * 3.0),
+                         cos(t * (1.1 - 0.5 * motion.z) + phase * 5.0));
+        velocity.xyz += push * motion.x * elapsed;
+        position.xyz += velocity.xyz * elapsed;
+    }
+    position.w += elapsed;
+
+    outPosition = position;
+    outVelocity = velocity;
+    outColour = colour;
+    outMotion = motion;
+}
@@ -0,0 +1,26 @@
+#version 330 core
+
+in vec2 uv;
+
+out vec4 finalColour;
+
+uniform sampler2D sceneSampler;
+uniform sampler2D bloomSampler;
+uniform vec4 sourceRect;    // xy: uv scale of the rendered corner, zw: last uv inside it
+uniform vec4 grading;       // exposure, shoulder, bloom intensity
+
+void main() {
+    // bilinear, kept off the texels past the rendered corner
+    vec3 colour = texture(sceneSampler, min(uv * sourceRect.xy, sourceRect.zw)).rgb * grading.x;
+    colour += texture(bloomSampler, uv).rgb * grading.z;
+
+    // as it was below the shoulder; above it the brightest channel eases
+    // towards 1, and the others with it so the hue holds
+    float peak = max(colour.r, max(colour.g, colour.b));
+    float shoulder = grading.y;
+    if (peak > shoulder) {
+        float rolled = shoulder + (1.0 - shoulder) * (1.0 - exp(-(peak - shoulder) / (1.0 - shoulder)));
+        colour *= rolled / peak;
+    }
+    finalColour = vec4(colour, 1.0);
+}
@@ -146,26 +146,26 @@ void Box::initialize(glm::vec3 scale, glm::vec3 position, Shader &program, const
     //this->rotateAxis = rotateAxis;
 
     // Create a vertex array object
-    glGenVertexArrays(1, &vertexArrayID);
+    vertexArrayID = GlVertexArray::create(GpuOwner::Models, GPU_SITE);
     glBindVertexArray(vertexArrayID);
 
     // Create a vertex buffer object to store the vertex data
-    glGenBuffers(1, &vertexBufferID);
+    vertexBufferID = GlBuffer::create(GpuOwner::Models, GPU_SITE);
     glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
+    gpuBufferData(GL_ARRAY_BUFFER, vertexBufferID, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
 
     // Create a vertex buffer object to store the normal data
-    glGenBuffers(1, &normalBufferID);
+    normalBufferID = GlBuffer::create(GpuOwner::Models, GPU_SITE);
     glBindBuffer(GL_ARRAY_BUFFER, normalBufferID);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(normal_buffer_data), normal_buffer_data, GL_STATIC_DRAW);
+    gpuBufferData(GL_ARRAY_BUFFER, normalBufferID, sizeof(normal_buffer_data), normal_buffer_data, GL_STATIC_DRAW);
 
     if (texture_path == nullptr || texture_path[0] == '\0')
     {
         hasTexture = false;
         // Create a vertex buffer object to store the color data
-        glGenBuffers(1, &colorBufferID);
+        colorBufferID = GlBuffer::create(GpuOwner::Models, GPU_SITE);
         glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(color_buffer_data), color_buffer_data, GL_STATIC_DRAW);
+        gpuBufferData(GL_ARRAY_BUFFER, colorBufferID, sizeof(color_buffer_data), color_buffer_data, GL_STATIC_DRAW);
     }
     else
     {
@@ -176,9 +176,9 @@ void Box::initialize(glm::vec3 scale, glm::vec3 position, Shader &program, const
     }
 
     // Create an index buffer object to store the index data that defines triangle faces
-    glGenBuffers(1, &indexBufferID);
+    indexBufferID = GlBuffer::create(GpuOwner::Models, GPU_SITE);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
+    gpuBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferID, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
 
     // Get a handle for our "MVP" uniform
     //mvpMatrixID = glGetUniformLocation(shaderID, "MVP");
@@ -256,8 +256,9 @@ void Box::renderDepth(Shader& program)
 
 
 void Box::cleanup() {
-    glDeleteBuffers(1, &vertexBufferID);
-    glDeleteBuffers(1, &colorBufferID);
-    glDeleteBuffers(1, &indexBufferID);
-    glDeleteVertexArrays(1, &vertexArrayID);
+    vertexBufferID.reset();
+    normalBufferID.reset();
+    colorBufferID.reset();
+    indexBufferID.reset();
+    vertexArrayID.reset();
 }
\ No newline at end of file
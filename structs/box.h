@@ -5,6 +5,7 @@
 #include <glm/glm.hpp>
 #include <string>
 #include "shader.h"
+#include "gpuResources.h"
 struct Box
 {
     glm::vec3 position;			// Position of the box
@@ -19,7 +20,9 @@ struct Box
     bool hasTexture;
 
     // OpenGL buffers
-    GLuint vertexArrayID, vertexBufferID, normalBufferID, indexBufferID, colorBufferID, textureID;
+    GlVertexArray vertexArrayID;
+    GlBuffer vertexBufferID, normalBufferID, indexBufferID, colorBufferID;
+    GLuint textureID = 0;   // the texture streamer's
 
     void initialize(glm::vec3 scale, glm::vec3 position, Shader &program, const char *texture_path);
 
@@ -1,20 +1,58 @@
+// GLTF model loader
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "gltfModel.h"
 #include "shader.h"
+#include "texture.h"
+#include "textureBake.h"
+#include "textureStreamer.h"
+#include "meshLod.h"
+#include "frameArena.h"
+#include "jobSystem.h"
+#include <algorithm>
 #include <iostream>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+// Largest scale a transform applies along any of its axes
+static float maxAxisScale(const glm::mat4& m)
+{
+    return std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+}
+
 GLTFModel::GLTFModel(const std::string& path)
 {
     loadModel(path);
 }
 
+// Path of an external image relative to the model's directory
+static std::string imagePath(const std::string& baseDir, std::string uri)
+{
+    std::replace(uri.begin(), uri.end(), '\\', '/');
+    return baseDir + uri;
+}
+
+// tinygltf image callback: images with a usable baked .ltex are left
+// undecoded, since the texture streamer reads the baked mips instead
+static bool loadImageUnlessBaked(tinygltf::Image* image, const int imageIndex, std::string* err, std::string* warn,
+                                 int reqWidth, int reqHeight, const unsigned char* bytes, int size, void* userData)
+{
+    const std::string& baseDir = *static_cast<const std::string*>(userData);
+    if (!image->uri.empty() && BakedTextureUsable(bakedTexturePath(imagePath(baseDir, image->uri)).c_str()))
+        return true;
+    return tinygltf::LoadImageData(image, imageIndex, err, warn, reqWidth, reqHeight, bytes, size, nullptr);
+}
+
 void GLTFModel::loadModel(const std::string& path)
 {
     tinygltf::TinyGLTF loader;
     tinygltf::Model model;
     std::string err, warn;
 
+    size_t slash = path.find_last_of("/\\");
+    std::string baseDir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    loader.SetImageLoader(loadImageUnlessBaked, &baseDir);
+
     bool ok = loader.LoadASCIIFromFile(&model, &err, &warn, path);
     if (!ok) {
         std::cerr << "Failed to load glTF: " << err << std::endl;
@@ -23,196 +61,139 @@ void GLTFModel::loadModel(const std::string& path)
         std::cout << "Successfully loaded glTF." << std::endl;
     }
 
-    // For each mesh
-    for (const auto& mesh : model.meshes) {
+    // Every primitive is assembled and simplified as a job of its own, which
+    // touches nothing shared; the results are folded in and uploaded here
+    struct PrimitiveBuild {
+        const tinygltf::Primitive* primitive;
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        MeshPrimitive prim;
+        float lodError[maxLods];
+        glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+        glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+    };
+    std::vector<PrimitiveBuild> builds;
+    for (const auto& mesh : model.meshes)
         for (const auto& primitive : mesh.primitives) {
-            // === Extract attributes ===
-            const auto& positionAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
-            const auto& positionBufferView = model.bufferViews[positionAccessor.bufferView];
-            const auto& positionBuffer = model.buffers[positionBufferView.buffer];
-
-            const float* positions = reinterpret_cast<const float*>(
-                &positionBuffer.data[positionBufferView.byteOffset + positionAccessor.byteOffset]);
-            size_t vertexCount = positionAccessor.count;
-
-            const float* normals = nullptr;
-            if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-                const auto& normalAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
-                const auto& normalBufferView = model.bufferViews[normalAccessor.bufferView];
-                const auto& normalBuffer = model.buffers[normalBufferView.buffer];
-                normals = reinterpret_cast<const float*>(
-                    &normalBuffer.data[normalBufferView.byteOffset + normalAccessor.byteOffset]);
-            }
-
-            const float* texcoords = nullptr;
-            if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-                const auto& texAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-                const auto& texBufferView = model.bufferViews[texAccessor.bufferView];
-                const auto& texBuffer = model.buffers[texBufferView.buffer];
-                texcoords = reinterpret_cast<const float*>(
-                    &texBuffer.data[texBufferView.byteOffset + texAccessor.byteOffset]);
-            }
-
-            // === JOINTS_0 (bone IDs)
-            std::vector<glm::uvec4> jointIndices(vertexCount, glm::uvec4(0));
-            if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
-                const auto& accessor = model.accessors[primitive.attributes.at("JOINTS_0")];
-                const auto& bufferView = model.bufferViews[accessor.bufferView];
-                const auto& buffer = model.buffers[bufferView.buffer];
-
-                size_t stride = bufferView.byteStride > 0 ? bufferView.byteStride : 4 * (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint8_t));
-                const uint8_t* base = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
-
-                for (size_t i = 0; i < vertexCount; ++i) {
-                    const void* ptr = base + i * stride;
-
-                    if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
-                        const uint8_t* joints = reinterpret_cast<const uint8_t*>(ptr);
-                        jointIndices[i] = glm::uvec4(joints[0], joints[1], joints[2], joints[3]);
-                    } else if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
-                        const uint16_t* joints = reinterpret_cast<const uint16_t*>(ptr);
-                        jointIndices[i] = glm::uvec4(joints[0], joints[1], joints[2], joints[3]);
-                    }
-                }
-            }
-
-            // === WEIGHTS_0 (bone weights)
-            std::vector<glm::vec4> jointWeights(vertexCount, glm::vec4(0.0f));
-            if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
-                const auto& accessor = model.accessors[primitive.attributes.at("WEIGHTS_0")];
-                const auto& bufferView = model.bufferViews[accessor.bufferView];
-                const auto& buffer = model.buffers[bufferView.buffer];
-
-                size_t stride = bufferView.byteStride > 0 ? bufferView.byteStride : 4 * sizeof(float);
-                const uint8_t* base = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
-
-                for (size_t i = 0; i < vertexCount; ++i) {
-                    const float* weights = reinterpret_cast<const float*>(base + i * stride);
-                    jointWeights[i] = glm::vec4(weights[0], weights[1], weights[2], weights[3]);
-
-                    // Normalize
-                    float sum = jointWeights[i].x + jointWeights[i].y + jointWeights[i].z + jointWeights[i].w;
-
-                    if (sum > 0.0f)
-                        jointWeights[i] /= sum;
-                }
-            }
+            builds.emplace_back();
+            builds.back().primitive = &primitive;
+        }
 
-            // === Combine into Vertex struct ===
-            struct Vertex {
-                glm::vec3 pos;
-                glm::vec3 normal;
-                glm::vec2 uv;
-                glm::uvec4 jointIndices;
-                glm::vec4 jointWeights;
-            };
-
-            std::vector<Vertex> vertices;
-            for (size_t i = 0; i < vertexCount; ++i) {
-                Vertex v;
-                v.pos = glm::vec3(positions[i * 3 + 0], positions[i * 3 + 1], positions[i * 3 + 2]);
-                v.normal = normals ? glm::vec3(normals[i * 3 + 0], normals[i * 3 + 1], normals[i * 3 + 2]) : glm::vec3(0.0f);
-                v.uv = texcoords ? glm::vec2(texcoords[i * 2 + 0], texcoords[i * 2 + 1]) : glm::vec2(0.0f);
-                v.jointIndices = jointIndices[i];
-                v.jointWeights = jointWeights[i];
-                vertices.push_back(v);
+    PrimitiveBuild* built = builds.data();
+    const tinygltf::Model& source = model;
+    GetJobSystem().parallelFor(builds.size(), 1, [built, &source](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            PrimitiveBuild& build = built[i];
+            assemblePrimitive(source, *build.primitive, build.vertices, build.indices);
+            for (const Vertex& v : build.vertices) {
+                build.boundsMin = glm::min(build.boundsMin, v.pos);
+                build.boundsMax = glm::max(build.boundsMax, v.pos);
             }
+            buildLods(build.vertices, build.indices, build.prim, build.lodError);
+        }
+    });
+
+    for (PrimitiveBuild& build : builds) {
+        const tinygltf::Primitive& primitive = *build.primitive;
+        std::vector<Vertex>& vertices = build.vertices;
+        std::vector<unsigned int>& indices = build.indices;
+        MeshPrimitive& prim = build.prim;
+
+        boundsMin = glm::min(boundsMin, build.boundsMin);
+        boundsMax = glm::max(boundsMax, build.boundsMax);
+        for (int i = 0; i < maxLods; ++i) {
+            lodError[i] = std::max(lodError[i], build.lodError[i]);
+            lodTriangles[i] += prim.lodIndexCount[i] / 3;
+        }
 
-            // === Load Indices ===
-            const auto& indexAccessor = model.accessors[primitive.indices];
-            const auto& indexBufferView = model.bufferViews[indexAccessor.bufferView];
-            const auto& indexBuffer = model.buffers[indexBufferView.buffer];
-
-            std::vector<unsigned int> indices;
-            const void* indexData = &indexBuffer.data[indexBufferView.byteOffset + indexAccessor.byteOffset];
-
-            for (size_t i = 0; i < indexAccessor.count; ++i) {
-                if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
-                    indices.push_back(((const uint16_t*)indexData)[i]);
-                } else if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
-                    indices.push_back(((const uint32_t*)indexData)[i]);
-                } else if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
-                    indices.push_back(((const uint8_t*)indexData)[i]);
-                }
-            }
-
-            // === Upload to OpenGL ===
-            GLuint vao, vbo, ebo;
-            glGenVertexArrays(1, &vao);
-            glGenBuffers(1, &vbo);
-            glGenBuffers(1, &ebo);
-
-            glBindVertexArray(vao);
+        // === Upload to OpenGL ===
+        prim.vao = GlVertexArray::create(GpuOwner::Models, GPU_SITE);
+        prim.vbo = GlBuffer::create(GpuOwner::Models, GPU_SITE);
+        prim.ebo = GlBuffer::create(GpuOwner::Models, GPU_SITE);
 
-            glBindBuffer(GL_ARRAY_BUFFER, vbo);
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        glBindVertexArray(prim.vao);
 
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, prim.vbo);
+        gpuBufferData(GL_ARRAY_BUFFER, prim.vbo, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
 
-            // Vertex attributes
-            glEnableVertexAttribArray(0); // position
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, pos));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, prim.ebo);
+        gpuBufferData(GL_ELEMENT_ARRAY_BUFFER, prim.ebo, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
-            glEnableVertexAttribArray(1); // normal
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        // Vertex attributes
+        glEnableVertexAttribArray(0); // position
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, pos));
 
-            glEnableVertexAttribArray(3); // texcoords
-            glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+        glEnableVertexAttribArray(1); // normal
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
 
-            glEnableVertexAttribArray(4); // bone IDs
-            glVertexAttribIPointer(4, 4, GL_UNSIGNED_INT, sizeof(Vertex), (void*)offsetof(Vertex, jointIndices));
+        glEnableVertexAttribArray(3); // texcoords
+        glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
 
-            glEnableVertexAttribArray(5); // bone weights
-            glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, jointWeights));
+        glEnableVertexAttribArray(4); // bone IDs
+        glVertexAttribIPointer(4, 4, GL_UNSIGNED_INT, sizeof(Vertex), (void*)offsetof(Vertex, jointIndices));
 
-            glBindVertexArray(0);
+        glEnableVertexAttribArray(5); // bone weights
+        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, jointWeights));
 
-            // === Load texture if exists ===
-            GLuint textureID = 0;
-            glm::vec4 baseColorFactor = glm::vec4(1.0f);
-            MeshPrimitive prim;
-            if (primitive.material >= 0) {
-                const auto& material = model.materials[primitive.material];
-                const auto& pbr = material.pbrMetallicRoughness;
+        glBindVertexArray(0);
 
-                if (!pbr.baseColorFactor.empty() && pbr.baseColorFactor.size() == 4) {
-                    baseColorFactor = glm::vec4(
-                        pbr.baseColorFactor[0],
-                        pbr.baseColorFactor[1],
-                        pbr.baseColorFactor[2],
-                        pbr.baseColorFactor[3]);
-                }
+        // === Load texture if exists ===
+        GLuint textureID = 0;
+        glm::vec4 baseColorFactor = glm::vec4(1.0f);
+        if (primitive.material >= 0) {
+            const auto& material = model.materials[primitive.material];
+            const auto& pbr = material.pbrMetallicRoughness;
 
-                if (pbr.baseColorTexture.index >= 0) {
-                    int texIndex = pbr.baseColorTexture.index;
-                    const auto& texture = model.textures[texIndex];
-                    const auto& image = model.images[texture.source];
+            if (!pbr.baseColorFactor.empty() && pbr.baseColorFactor.size() == 4) {
+                baseColorFactor = glm::vec4(
+                    pbr.baseColorFactor[0],
+                    pbr.baseColorFactor[1],
+                    pbr.baseColorFactor[2],
+                    pbr.baseColorFactor[3]);
+            }
 
-                    glGenTextures(1, &textureID);
+            if (pbr.baseColorTexture.index >= 0) {
+                int texIndex = pbr.baseColorTexture.index;
+                const auto& texture = model.textures[texIndex];
+                const auto& image = model.images[texture.source];
+
+                // images shared between models (the two pines) share one streamed texture
+                TextureStreamer& streamer = GetTextureStreamer();
+                std::string key = image.uri.empty() ? path + "#" + std::to_string(texture.source) : imagePath(baseDir, image.uri);
+                textureID = streamer.find(key);
+                if (textureID == 0 && !image.uri.empty())
+                    textureID = streamer.acquireBaked(key, bakedTexturePath(key));
+                if (textureID == 0 && !image.image.empty() && image.bits == 8)
+                    textureID = streamer.acquirePixels(key, image.image.data(), image.width, image.height, image.component);
+
+                if (textureID != 0)
+                {
                     glBindTexture(GL_TEXTURE_2D, textureID);
-
                     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
                     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
                     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
                     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-                    GLenum format = image.component == 3 ? GL_RGB : GL_RGBA;
-                    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.image.data());
-                    glGenerateMipmap(GL_TEXTURE_2D);
-
-                    hasTexture = true;
                 }
+
+                hasTexture = true;
             }
+        }
 
-            prim.vao = vao;
-            prim.indexCount = static_cast<GLuint>(indices.size());
-            prim.textureID = textureID;
-            prim.baseColorFactor = baseColorFactor;
-            primitives.push_back(prim);
+        prim.textureID = textureID;
+        prim.baseColorFactor = baseColorFactor;
+        if (model.skins.empty()) {
+            prim.vertices = std::move(vertices);
+            prim.indices = std::move(indices);
         }
+        primitives.push_back(std::move(prim));
     }
 
+    trimLods();
+    std::cout << "LOD triangles:";
+    for (int i = 0; i < lodCount; ++i)
+        std::cout << " " << lodTriangles[i];
+    std::cout << std::endl;
+
     // === Load skin (bones)
     for (const auto& skin : model.skins) {
         jointNodeIndices = skin.joints;
@@ -303,6 +284,163 @@ void GLTFModel::loadModel(const std::string& path)
 
 }
 
+void GLTFModel::buildLods(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, MeshPrimitive& prim,
+                          float levelError[maxLods])
+{
+    const std::vector<unsigned int> source = indices;
+    prim.lodFirstIndex[0] = 0;
+    prim.lodIndexCount[0] = (GLsizei)source.size();
+    levelError[0] = 0.0f;
+
+    // each level aims at half the triangles of the one before and is simplified
+    // from the source, so its error is measured against what level 0 shows
+    std::vector<unsigned int> level;
+    float error = 0.0f;
+    bool stalled = false;
+    for (int i = 1; i < maxLods; ++i)
+    {
+        if (!stalled) {
+            float simplifyError = SimplifyMesh(vertices, source, (source.size() >> i) / 3 * 3, level);
+            stalled = level.size() >= (size_t)prim.lodIndexCount[i - 1];
+            if (!stalled) {
+                error = std::max(error, simplifyError);
+                prim.lodFirstIndex[i] = (GLsizei)indices.size();
+                prim.lodIndexCount[i] = (GLsizei)level.size();
+                indices.insert(indices.end(), level.begin(), level.end());
+            }
+        }
+        if (stalled) {
+            // nothing left to collapse: the level repeats the one before
+            prim.lodFirstIndex[i] = prim.lodFirstIndex[i - 1];
+            prim.lodIndexCount[i] = prim.lodIndexCount[i - 1];
+        }
+        levelError[i] = error;
+    }
+}
+
+void GLTFModel::trimLods()
+{
+    // a level is only worth selecting if it removes a fifth of the triangles
+    lodCount = 1;
+    for (int i = 1; i < maxLods; ++i)
+    {
+        if (lodTriangles[i] > 0.8f * lodTriangles[lodCount - 1]) continue;
+        for (MeshPrimitive& prim : primitives) {
+            prim.lodFirstIndex[lodCount] = prim.lodFirstIndex[i];
+            prim.lodIndexCount[lodCount] = prim.lodIndexCount[i];
+        }
+        lodTriangles[lodCount] = lodTriangles[i];
+        lodError[lodCount] = std::max(lodError[i], lodError[lodCount - 1]);
+        lodCount++;
+    }
+}
+
+void GLTFModel::assemblePrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive,
+                                  std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    // === Extract attributes ===
+    const auto& positionAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
+    const auto& positionBufferView = model.bufferViews[positionAccessor.bufferView];
+    const auto& positionBuffer = model.buffers[positionBufferView.buffer];
+
+    const float* positions = reinterpret_cast<const float*>(
+        &positionBuffer.data[positionBufferView.byteOffset + positionAccessor.byteOffset]);
+    size_t vertexCount = positionAccessor.count;
+
+    const float* normals = nullptr;
+    if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
+        const auto& normalAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
+        const auto& normalBufferView = model.bufferViews[normalAccessor.bufferView];
+        const auto& normalBuffer = model.buffers[normalBufferView.buffer];
+        normals = reinterpret_cast<const float*>(
+            &normalBuffer.data[normalBufferView.byteOffset + normalAccessor.byteOffset]);
+    }
+
+    const float* texcoords = nullptr;
+    if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
+        const auto& texAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
+        const auto& texBufferView = model.bufferViews[texAccessor.bufferView];
+        const auto& texBuffer = model.buffers[texBufferView.buffer];
+        texcoords = reinterpret_cast<const float*>(
+            &texBuffer.data[texBufferView.byteOffset + texAccessor.byteOffset]);
+    }
+
+    // === JOINTS_0 (bone IDs)
+    std::vector<glm::uvec4> jointIndices(vertexCount, glm::uvec4(0));
+    if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
+        const auto& accessor = model.accessors[primitive.attributes.at("JOINTS_0")];
+        const auto& bufferView = model.bufferViews[accessor.bufferView];
+        const auto& buffer = model.buffers[bufferView.buffer];
+
+        size_t stride = bufferView.byteStride > 0 ? bufferView.byteStride : 4 * (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint8_t));
+        const uint8_t* base = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
+
+        for (size_t i = 0; i < vertexCount; ++i) {
+            const void* ptr = base + i * stride;
+
+            if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
+                const uint8_t* joints = reinterpret_cast<const uint8_t*>(ptr);
+                jointIndices[i] = glm::uvec4(joints[0], joints[1], joints[2], joints[3]);
+            } else if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+                const uint16_t* joints = reinterpret_cast<const uint16_t*>(ptr);
+                jointIndices[i] = glm::uvec4(joints[0], joints[1], joints[2], joints[3]);
+            }
+        }
+    }
+
+    // === WEIGHTS_0 (bone weights)
+    std::vector<glm::vec4> jointWeights(vertexCount, glm::vec4(0.0f));
+    if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
+        const auto& accessor = model.accessors[primitive.attributes.at("WEIGHTS_0")];
+        const auto& bufferView = model.bufferViews[accessor.bufferView];
+        const auto& buffer = model.buffers[bufferView.buffer];
+
+        size_t stride = bufferView.byteStride > 0 ? bufferView.byteStride : 4 * sizeof(float);
+        const uint8_t* base = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
+
+        for (size_t i = 0; i < vertexCount; ++i) {
+            const float* weights = reinterpret_cast<const float*>(base + i * stride);
+            jointWeights[i] = glm::vec4(weights[0], weights[1], weights[2], weights[3]);
+
+            // Normalize
+            float sum = jointWeights[i].x + jointWeights[i].y + jointWeights[i].z + jointWeights[i].w;
+
+            if (sum > 0.0f)
+                jointWeights[i] /= sum;
+        }
+    }
+
+    // === Combine into Vertex struct ===
+    vertices.clear();
+    for (size_t i = 0; i < vertexCount; ++i) {
+        Vertex v;
+        v.pos = glm::vec3(positions[i * 3 + 0], positions[i * 3 + 1], positions[i * 3 + 2]);
+        v.normal = normals ? glm::vec3(normals[i * 3 + 0], normals[i * 3 + 1], normals[i * 3 + 2]) : glm::vec3(0.0f);
+        v.uv = texcoords ? glm::vec2(texcoords[i * 2 + 0], texcoords[i * 2 + 1]) : glm::vec2(0.0f);
+        v.jointIndices = jointIndices[i];
+        v.jointWeights = jointWeights[i];
+        vertices.push_back(v);
+    }
+
+    // === Load Indices ===
+    const auto& indexAccessor = model.accessors[primitive.indices];
+    const auto& indexBufferView = model.bufferViews[indexAccessor.bufferView];
+    const auto& indexBuffer = model.buffers[indexBufferView.buffer];
+
+    indices.clear();
+    const void* indexData = &indexBuffer.data[indexBufferView.byteOffset + indexAccessor.byteOffset];
+
+    for (size_t i = 0; i < indexAccessor.count; ++i) {
+        if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
+            indices.push_back(((const uint16_t*)indexData)[i]);
+        } else if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
+            indices.push_back(((const uint32_t*)indexData)[i]);
+        } else if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
+            indices.push_back(((const uint8_t*)indexData)[i]);
+        }
+    }
+}
+
 void GLTFModel::updateAnimation(float deltaTime)
 {
     if (!isAnimated) return;
@@ -314,28 +452,53 @@ void GLTFModel::updateAnimation(float deltaTime)
     if (animationTime > anim.maxTime)
         animationTime = fmod(animationTime, anim.maxTime);
 
-    // Per-joint transform components
-    std::vector<glm::vec3> translations(bones.size(), glm::vec3(0.0f));
-    std::vector<glm::quat> rotations(bones.size(), glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
-    std::vector<glm::vec3> scales(bones.size(), glm::vec3(1.0f));
-    std::vector<bool> hasTranslation(bones.size(), false);
-    std::vector<bool> hasRotation(bones.size(), false);
-    std::vector<bool> hasScale(bones.size(), false);
+    evaluatePose(animationTime, finalBoneMatrices);
+}
+
+void GLTFModel::setPose(const std::vector<glm::mat4>& boneMatrices)
+{
+    finalBoneMatrices.assign(boneMatrices.begin(), boneMatrices.end());
+}
+
+float GLTFModel::animationLength() const
+{
+    return animations.empty() ? 0.0f : animations[0].maxTime;
+}
+
+void GLTFModel::evaluatePose(float time, std::vector<glm::mat4>& boneMatrices) const
+{
+    boneMatrices.resize(bones.size(), glm::mat4(1.0f));
+    evaluatePose(time, boneMatrices.data());
+}
+
+void GLTFModel::evaluatePose(float time, glm::mat4* boneMatrices) const
+{
+    if (animations.empty()) return;
+    const Animation& anim = animations[0];
+    if (anim.maxTime > 0.0f && time > anim.maxTime)
+        time = fmod(time, anim.maxTime);
+
+    // Per-joint transform components, in the calling thread's frame arena
+    FrameVector<glm::vec3> translations(bones.size(), glm::vec3(0.0f));
+    FrameVector<glm::quat> rotations(bones.size(), glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    FrameVector<glm::vec3> scales(bones.size(), glm::vec3(1.0f));
+    FrameVector<bool> hasTranslation(bones.size(), false);
+    FrameVector<bool> hasRotation(bones.size(), false);
+    FrameVector<bool> hasScale(bones.size(), false);
 
     for (const auto& channel : anim.channels) {
         const auto& sampler = anim.samplers[channel.samplerIndex];
         if (sampler.inputs.empty()) continue;
 
         size_t prev = 0;
-        while (prev < sampler.inputs.size() - 1 && animationTime > sampler.inputs[prev + 1]) {
+        while (prev < sampler.inputs.size() - 1 && time > sampler.inputs[prev + 1]) {
             ++prev;
         }
         size_t next = std::min(prev + 1, sampler.inputs.size() - 1);
 
         float t1 = sampler.inputs[prev];
         float t2 = sampler.inputs[next];
-        float factor = (animationTime - t1) / (t2 - t1 + 1e-6f);
-
+        float factor = (time - t1) / (t2 - t1 + 1e-6f);
         // Use nodeIndexToBone map
         auto it = nodeIndexToBone.find(channel.targetNode);
         if (it == nodeIndexToBone.end()) continue;
@@ -361,42 +524,42 @@ void GLTFModel::updateAnimation(float deltaTime)
         }
     }
 
-    // Build local transforms
+    // Global transforms from local ones; parents come before their children
+    FrameVector<glm::mat4> globals(bones.size());
     for (size_t i = 0; i < bones.size(); ++i) {
         glm::mat4 T = glm::translate(glm::mat4(1.0f), hasTranslation[i] ? translations[i] : glm::vec3(0.0f));
         glm::mat4 R = glm::mat4_cast(hasRotation[i] ? rotations[i] : glm::quat(1, 0, 0, 0));
         glm::mat4 S = glm::scale(glm::mat4(1.0f), hasScale[i] ? scales[i] : glm::vec3(1.0f));
-        bones[i].localTransform = T * R * S;
-    }
-
-    // Global transforms
-    for (size_t i = 0; i < bones.size(); ++i) {
-        if (bones[i].parentIndex < 0)
-            bones[i].globalTransform = bones[i].localTransform;
-        else
-            bones[i].globalTransform = bones[bones[i].parentIndex].globalTransform * bones[i].localTransform;
+        glm::mat4 local = T * R * S;
+        globals[i] = bones[i].parentIndex < 0 ? local : globals[bones[i].parentIndex] * local;
     }
 
     // Final bone matrices
     for (size_t i = 0; i < bones.size(); ++i) {
-        finalBoneMatrices[i] = bones[i].globalTransform * bones[i].inverseBindMatrix;
+        boneMatrices[i] = globals[i] * bones[i].inverseBindMatrix;
     }
 }
 
 
 
 void GLTFModel::render(Shader& program, GLuint shadowMap)
+{
+    draw(program, shadowMap, modelMatrix, lod, finalBoneMatrices.data(), (int)finalBoneMatrices.size());
+}
+
+void GLTFModel::draw(Shader& program, GLuint shadowMap, const glm::mat4& transform, int lod, const glm::mat4* bones, int boneCount) const
 {
     program.setFloat("diffuseStrength", diffuseStrength);
-    program.setMatrix("model", &modelMatrix[0][0]);
+    program.setMatrix("model", &transform[0][0]);
     program.setBool("useSkinning", isAnimated);
 
-    program.setMatrixArray("bones", finalBoneMatrices);
+    program.setMatrixArray("bones", bones, boneCount);
 
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, shadowMap);
     program.setInt("shadowMap", 1);
 
+    int level = std::max(lod, 0);
     for (const auto& prim : primitives)
     {
         program.setBool("useTexture", hasTexture);
@@ -408,25 +571,90 @@ void GLTFModel::render(Shader& program, GLuint shadowMap)
         else program.setVec4("modelColour", prim.baseColorFactor);
 
         glBindVertexArray(prim.vao);
-        glDrawElements(GL_TRIANGLES, prim.indexCount, GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, prim.lodIndexCount[level], GL_UNSIGNED_INT, (void*)(prim.lodFirstIndex[level] * sizeof(unsigned int)));
     }
 
     glBindVertexArray(0);
 }
 
+void GLTFModel::requestTextureDetail(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+{
+    requestTextureDetail(viewMatrix, projectionMatrix, modelMatrix);
+}
+
+void GLTFModel::requestTextureDetail(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, const glm::mat4& transform) const
+{
+    if (!hasTexture || boundsMin.x > boundsMax.x) return;
+
+    // bounding sphere of the local box, scaled by the largest axis of the transform
+    glm::vec3 centre = glm::vec3(transform * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+    float radius = boundingRadius() * maxAxisScale(transform);
+
+    TextureStreamer& streamer = GetTextureStreamer();
+    float pixels = streamer.projectedSize(centre, radius, viewMatrix, projectionMatrix);
+    for (const auto& prim : primitives)
+        if (prim.textureID != 0)
+            streamer.request(prim.textureID, pixels);
+}
+
+void GLTFModel::selectLod(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+{
+    lod = selectLod(viewMatrix, projectionMatrix, modelMatrix, lod);
+}
+
+int GLTFModel::selectLod(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, const glm::mat4& transform, int current) const
+{
+    if (boundsMin.x > boundsMax.x) return current;
+
+    // the error is judged at the nearest point of the bounding sphere
+    float scale = maxAxisScale(transform);
+    float distance = distanceTo(glm::vec3(glm::inverse(viewMatrix)[3]), transform);
+
+    LodSelector& selector = GetLodSelector();
+    return selector.select(lodError, lodCount, current, scale * selector.pixelScale(projectionMatrix, distance));
+}
+
+float GLTFModel::distanceTo(const glm::vec3& point) const
+{
+    return distanceTo(point, modelMatrix);
+}
+
+float GLTFModel::distanceTo(const glm::vec3& point, const glm::mat4& transform) const
+{
+    glm::vec3 centre = glm::vec3(transform * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+    return glm::length(centre - point) - boundingRadius() * maxAxisScale(transform);
+}
+
 void GLTFModel::renderDepth(glm::mat4& lightSpaceMatrix, Shader& program)
 {
-    program.setMatrix("model",&modelMatrix[0][0]);
     program.setMatrix("lightSpaceMatrix", &lightSpaceMatrix[0][0]);
+    drawDepth(program, modelMatrix, lod);
+}
+
+void GLTFModel::drawDepth(Shader& program, const glm::mat4& transform, int lod) const
+{
+    program.setMatrix("model", &transform[0][0]);
 
+    int level = std::max(lod, 0);
     for (const auto& prim : primitives)
     {
         // textures unimportant for depth
         glBindVertexArray(prim.vao);
-        glDrawElements(GL_TRIANGLES, prim.indexCount, GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, prim.lodIndexCount[level], GL_UNSIGNED_INT, (void*)(prim.lodFirstIndex[level] * sizeof(unsigned int)));
     }
     glBindVertexArray(0);
 }
+
 void GLTFModel::setTransform(const glm::mat4& transform) {
     modelMatrix = transform;
 }
+
+void GLTFModel::cleanup()
+{
+    // textures belong to the texture streamer, which may share them with other models
+    for (MeshPrimitive& prim : primitives) {
+        prim.vao.reset();
+        prim.vbo.reset();
+        prim.ebo.reset();
+    }
+}
@@ -1,11 +1,13 @@
 #ifndef _GLTF_MODEL_H_
 #define _GLTF_MODEL_H_
 
+#include <cfloat>
 #include <string>
 #include <vector>
 #include <glad/gl.h>  // or GLEW/GL3W
 #include <glm/glm.hpp>
 #include <shader.h>
+#include <gpuResources.h>
 #include <tiny_gltf.h>
 
 struct GLTFModel
@@ -15,8 +17,21 @@ public:
 
     bool isAnimated;
 
+    // Simplified levels built at import; level 0 is the source mesh
+    static constexpr int maxLods = 4;
+    int lodCount = 1;
+    float lodError[maxLods] = {};   // geometric error of each level, in model units
+    int lodTriangles[maxLods] = {};
+    int lod = -1;                   // level drawn by render and renderDepth, -1 before the first selection
+
     GLTFModel(const std::string& path);
 
+    // owns its buffers and a copy of every vertex, so it only moves
+    GLTFModel(const GLTFModel&) = delete;
+    GLTFModel& operator=(const GLTFModel&) = delete;
+    GLTFModel(GLTFModel&&) = default;
+    GLTFModel& operator=(GLTFModel&&) = default;
+
     void render(Shader& shader, GLuint shadowMap);
 
     void setTransform(const glm::mat4& transform);
@@ -25,27 +40,95 @@ public:
 
     void updateAnimation(float deltaTime);
 
+    // Bone matrices of the first animation at time (looping), without
+    // touching the model's own pose, so another thread can evaluate poses.
+    // Scratch space comes from the calling thread's frame arena.
+    void evaluatePose(float time, std::vector<glm::mat4>& boneMatrices) const;
+    void evaluatePose(float time, glm::mat4* boneMatrices) const;  // boneCount() of them
+
+    int boneCount() const { return (int)bones.size(); }
+
+    // Seconds before the first animation loops, 0 without one
+    float animationLength() const;
+
+    // Draws with these bone matrices (from evaluatePose) instead of its own animation
+    void setPose(const std::vector<glm::mat4>& boneMatrices);
+
+    // Reports how large the model's textures appear this frame to the texture streamer
+    void requestTextureDetail(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+
+    // Picks the level to draw from its screen-space error at the current transform
+    void selectLod(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+
+    // Deletes the vertex arrays and buffers while the context is still current
+    void cleanup();
+
+    // Bounding sphere radius in model space
+    float boundingRadius() const { return glm::length(boundsMax - boundsMin) * 0.5f; }
+
+    // From point to the nearest point of the bounding sphere at the current transform
+    float distanceTo(const glm::vec3& point) const;
+
+    // The above for one instance of the model, as the scene store draws it:
+    // the model holds what its instances share, and each instance brings its
+    // own transform, level and pose. The model's own state is left alone.
+    void draw(Shader& shader, GLuint shadowMap, const glm::mat4& transform, int lod, const glm::mat4* bones, int boneCount) const;
+    void drawDepth(Shader& shader, const glm::mat4& transform, int lod) const;
+    void requestTextureDetail(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, const glm::mat4& transform) const;
+    int selectLod(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, const glm::mat4& transform, int current) const;
+    float distanceTo(const glm::vec3& point, const glm::mat4& transform) const;
+
+    struct Vertex {
+        glm::vec3 pos;
+        glm::vec3 normal;
+        glm::vec2 uv;
+        glm::uvec4 jointIndices;
+        glm::vec4 jointWeights;
+    };
+
+    // Interleaves one primitive's attributes and widens its indices to 32 bits
+    static void assemblePrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive,
+                                  std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
 private:
+    friend struct StaticBatch;
+    friend struct Vegetation;
+    friend struct Impostor;
+    friend struct OcclusionCuller;
+    friend struct Scene;
+
     void loadModel(const std::string& path);
 
     struct MeshPrimitive {
-        GLuint vao;
-        GLuint indexCount;
-        GLuint textureID = 0;
+        GlVertexArray vao;
+        GlBuffer vbo;
+        GlBuffer ebo;
+        GLsizei lodIndexCount[maxLods] = {};    // every level lives in the one index buffer
+        GLsizei lodFirstIndex[maxLods] = {};
+        GLuint textureID = 0;   // the texture streamer's
         glm::vec4 baseColorFactor;
         bool hasTexture;
+        std::vector<Vertex> vertices;       // kept for unskinned models so
+        std::vector<unsigned int> indices;  // StaticBatch can pack them (all levels)
     };
 
-    tinygltf::Model model;
+    // Appends the simplified levels of one primitive to its indices and gives
+    // each level's error. Touches nothing shared, so primitives build in parallel
+    static void buildLods(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, MeshPrimitive& prim,
+                          float levelError[maxLods]);
+
+    // Keeps only the levels that noticeably reduce the model, after all primitives are in
+    void trimLods();
+
     bool hasTexture = true;
     std::vector<MeshPrimitive> primitives;
     glm::mat4 modelMatrix = glm::mat4(1.0f);
+    glm::vec3 boundsMin = glm::vec3(FLT_MAX);  // bind-pose bounds in model space
+    glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
 
     struct Bone {
         int parentIndex;
         glm::mat4 inverseBindMatrix;
-        glm::mat4 localTransform;
-        glm::mat4 globalTransform;
     };
 
     struct AnimationSampler {
@@ -0,0 +1,37 @@
+#include "heightfield.h"
+
+#include <stb/stb_image.h>
+#include <cmath>
+#include <iostream>
+
+bool Heightfield::load(const char* path)
+{
+    int channels;
+    uint16_t* pixels = stbi_load_16(path, &width, &height, &channels, 1);
+    if (!pixels) {
+        std::cout << "Failed to load heightfield " << path << std::endl;
+        width = height = 0;
+        samples.clear();
+        return false;
+    }
+
+    samples.assign(pixels, pixels + (size_t)width * height);
+    stbi_image_free(pixels);
+    return true;
+}
+
+float Heightfield::sample(float u, float v) const
+{
+    if (samples.empty()) return 0.0f;
+
+    float x = (u - std::floor(u)) * width;
+    float y = (v - std::floor(v)) * height;
+    int x0 = (int)x % width, y0 = (int)y % height;
+    int x1 = (x0 + 1) % width, y1 = (y0 + 1) % height;
+    float fx = x - std::floor(x), fy = y - std::floor(y);
+
+    float top = samples[(size_t)y0 * width + x0] * (1.0f - fx) + samples[(size_t)y0 * width + x1] * fx;
+    float bottom = samples[(size_t)y1 * width + x0] * (1.0f - fx) + samples[(size_t)y1 * width + x1] * fx;
+    float h = (top * (1.0f - fy) + bottom * fy) / 65535.0f;
+    return (h - 0.5f) * heightScale;
+}
@@ -0,0 +1,23 @@
+#ifndef _HEIGHTFIELD_H_
+#define _HEIGHTFIELD_H_
+
+#include <cstdint>
+#include <vector>
+
+// 16-bit displacement map covering one tile and repeating across the world,
+// the same way the terrain texture does. Heights are centred on y = 0.
+struct Heightfield
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint16_t> samples; // row 0 is v = 0, as in the texture
+    float heightScale = 1.5f;      // world units between the lowest and highest sample
+
+    // Loads the first channel of an 8- or 16-bit image; false leaves the field flat
+    bool load(const char* path);
+
+    // Bilinear height at texture coordinates, wrapping outside [0, 1)
+    float sample(float u, float v) const;
+};
+
+#endif
@@ -0,0 +1,210 @@
+#include "impostor.h"
+#include "textureStreamer.h"
+#include "gpuResources.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Uncovered texels take the mean of their covered neighbours, a ring further
+// out per pass, so filtering and the coarser mips do not pull the clear colour
+// into the silhouette. Alpha stays 0 there.
+static void bleedEdges(std::vector<unsigned char>& colour, std::vector<unsigned char>& normal, int width, int height, int rings)
+{
+    std::vector<unsigned char> covered(width * height);
+    for (int i = 0; i < width * height; ++i)
+        covered[i] = colour[i * 4 + 3] > 0;
+
+    std::vector<int> filled;
+    for (int ring = 0; ring < rings; ++ring)
+    {
+        filled.clear();
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+            {
+                int i = y * width + x;
+                if (covered[i]) continue;
+
+                int sum[6] = {}, count = 0;
+                for (int dy = -1; dy <= 1; ++dy)
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        int nx = x + dx, ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= width || ny >= height || !covered[ny * width + nx]) continue;
+                        int n = ny * width + nx;
+                        for (int c = 0; c < 3; ++c) {
+                            sum[c] += colour[n * 4 + c];
+                            sum[3 + c] += normal[n * 4 + c];
+                        }
+                        count++;
+                    }
+                if (count == 0) continue;
+
+                for (int c = 0; c < 3; ++c) {
+                    colour[i * 4 + c] = (unsigned char)(sum[c] / count);
+                    normal[i * 4 + c] = (unsigned char)(sum[3 + c] / count);
+                }
+                filled.push_back(i);
+            }
+        if (filled.empty()) break;
+        for (int i : filled) covered[i] = 1;
+    }
+}
+
+static GLuint createAtlas(glm::ivec2 size)
+{
+    GLuint texture = gpuCreateTexture(GpuOwner::Vegetation, GPU_SITE);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    GetGpuResources().setBytes(GpuKind::Texture, texture, (size_t)size.x * size.y * 4 * 4 / 3); // with its mips
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+}
+
+void Impostor::bake(const GLTFModel& model, const glm::mat4& base, int frames, int cellPixels, Shader& program)
+{
+    cleanup();
+    this->frames = frames;
+
+    // instances place the impostor at the origin of their base transform, so
+    // the bake leaves its translation out
+    glm::mat4 frame = base;
+    frame[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        glm::vec3 p((corner & 1) ? model.boundsMax.x : model.boundsMin.x,
+                    (corner & 2) ? model.boundsMax.y : model.boundsMin.y,
+                    (corner & 4) ? model.boundsMax.z : model.boundsMin.z);
+        p = glm::vec3(frame * glm::vec4(p, 1.0f));
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    axis = glm::vec2(lo.x + hi.x, lo.z + hi.z) * 0.5f;
+    halfWidth = 0.5f * glm::length(glm::vec2(hi.x - lo.x, hi.z - lo.z)); // covers the bounds from any side
+    bottom = lo.y;
+    top = hi.y;
+
+    float aspect = (top - bottom) / (2.0f * halfWidth);
+    if (aspect >= 1.0f) cellSize = glm::ivec2(std::max(1, (int)std::lround(cellPixels / aspect)), cellPixels);
+    else cellSize = glm::ivec2(cellPixels, std::max(1, (int)std::lround(cellPixels * aspect)));
+    glm::ivec2 atlasSize(cellSize.x * frames, cellSize.y);
+
+    // stream in the texture detail a cell needs before drawing from it
+    TextureStreamer& streamer = GetTextureStreamer();
+    if (model.hasTexture)
+        for (const auto& prim : model.primitives)
+            for (int attempt = 0; attempt < 16; ++attempt)
+            {
+                const TextureStreamer::Entry* entry = streamer.entry(prim.textureID);
+                if (!entry) break;
+                streamer.request(prim.textureID, (float)cellPixels);
+                if (entry->residentTop <= entry->wantedTop) break;
+                streamer.update();
+            }
+
+    colourAtlas = createAtlas(atlasSize);
+    normalAtlas = createAtlas(atlasSize);
+
+    GLint previousFramebuffer, viewport[4];
+    GLfloat clearColour[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColour);
+
+    GLuint fbo = gpuCreateFramebuffer(GpuOwner::Vegetation, GPU_SITE);
+    GLuint depth = gpuCreateRenderbuffer(GpuOwner::Vegetation, GPU_SITE);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    gpuRenderbufferStorage(depth, GL_DEPTH_COMPONENT24, atlasSize.x, atlasSize.y, 4);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colourAtlas, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalAtlas, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    const GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, drawBuffers);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cerr << "Impostor framebuffer is not complete" << std::endl;
+    else
+    {
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        program.use();
+        program.setMatrix("model", &frame[0][0]);
+        program.setBool("useTexture", model.hasTexture);
+        program.setInt("textureSampler", 0);
+
+        // orthographic views from around the axis, frame i looking from angle 2 pi i / frames
+        float distance = 2.0f * halfWidth + 1.0f;
+        glm::mat4 projection = glm::ortho(-halfWidth, halfWidth, bottom, top, distance - halfWidth - 1.0f, distance + halfWidth + 1.0f);
+        glm::vec3 centre(axis.x, 0.0f, axis.y);
+        for (int f = 0; f < frames; ++f)
+        {
+            float angle = 6.2831853f * f / frames;
+            glm::vec3 direction(std::sin(angle), 0.0f, std::cos(angle));
+            glm::mat4 viewProjection = projection * glm::lookAt(centre + direction * distance, centre, glm::vec3(0, 1, 0));
+            program.setMatrix("viewProjection", &viewProjection[0][0]);
+            glViewport(f * cellSize.x, 0, cellSize.x, cellSize.y);
+
+            for (const auto& prim : model.primitives)
+            {
+                if (model.hasTexture) {
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, prim.textureID);
+                }
+                glBindVertexArray(prim.vao);
+                glDrawElements(GL_TRIANGLES, prim.lodIndexCount[0], GL_UNSIGNED_INT, (void*)(prim.lodFirstIndex[0] * sizeof(unsigned int)));
+            }
+        }
+        glBindVertexArray(0);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glClearColor(clearColour[0], clearColour[1], clearColour[2], clearColour[3]);
+    gpuDeleteFramebuffer(fbo);
+    gpuDeleteRenderbuffer(depth);
+
+    std::vector<unsigned char> colour(atlasSize.x * atlasSize.y * 4), normal(colour.size());
+    glBindTexture(GL_TEXTURE_2D, colourAtlas);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, colour.data());
+    glBindTexture(GL_TEXTURE_2D, normalAtlas);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, normal.data());
+    bleedEdges(colour, normal, atlasSize.x, atlasSize.y, 8);
+
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, atlasSize.x, atlasSize.y, GL_RGBA, GL_UNSIGNED_BYTE, normal.data());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, colourAtlas);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, atlasSize.x, atlasSize.y, GL_RGBA, GL_UNSIGNED_BYTE, colour.data());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Impostor::bind(Shader& program) const
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, colourAtlas);
+    program.setInt("textureSampler", 0);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, normalAtlas);
+    program.setInt("impostorNormals", 3);
+
+    program.setInt("impostorFrames", frames);
+    program.setVec3("impostorAxis", glm::vec3(axis.x, 0.0f, axis.y));
+    program.setVec3("impostorExtent", glm::vec3(halfWidth, bottom, top));
+}
+
+void Impostor::cleanup()
+{
+    gpuDeleteTexture(colourAtlas);
+    gpuDeleteTexture(normalAtlas);
+    frames = 0;
+}
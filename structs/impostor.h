@@ -0,0 +1,44 @@
+#ifndef _IMPOSTOR_H_
+#define _IMPOSTOR_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include "gltfModel.h"
+#include "shader.h"
+
+// Per-instance data of an impostor quad (attributes 10 and 11)
+struct ImpostorInstance
+{
+    glm::vec3 position;     // origin of the instance, where its base transform applies
+    float scale;            // uniform instance scale
+    float yaw;              // rotation about the up axis, radians
+};
+
+// Camera-facing stand-in for a distant model. The model is rendered once from
+// `frames` directions around its up axis into a row of atlas cells: base
+// colour with coverage in alpha, and next to it the surface normal, so the
+// quad is lit like the mesh would be. object.vert turns each quad towards the
+// camera and blends the two frames either side of the view direction.
+struct Impostor
+{
+    GLuint colourAtlas = 0;     // RGBA8, colour bled into uncovered texels
+    GLuint normalAtlas = 0;     // RGBA8, normal in the baked frame * 0.5 + 0.5
+    int frames = 0;
+    glm::ivec2 cellSize = glm::ivec2(0);
+
+    // the quad in the frame the model was baked in (after its base transform)
+    glm::vec2 axis = glm::vec2(0.0f);   // x, z of the vertical axis the frames turn around
+    float halfWidth = 0.0f;
+    float bottom = 0.0f, top = 0.0f;
+
+    // Renders model * base from `frames` directions with program
+    // (impostorBake.vert/frag), the longer side of a cell cellPixels
+    void bake(const GLTFModel& model, const glm::mat4& base, int frames, int cellPixels, Shader& program);
+
+    // Sets the useImpostor uniforms and binds the atlases to units 0 and 3
+    void bind(Shader& program) const;
+
+    void cleanup();
+};
+
+#endif
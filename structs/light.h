@@ -16,4 +16,11 @@ struct Light
     float outerCutoff;
 };
 
+inline bool sameLight(const Light& a, const Light& b)
+{
+    return a.type == b.type && a.position == b.position && a.direction == b.direction && a.colour == b.colour &&
+           a.constant == b.constant && a.linear == b.linear && a.quadratic == b.quadratic &&
+           a.cutoff == b.cutoff && a.outerCutoff == b.outerCutoff;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file. Pages are only read from disk
+// when touched. Like GlHandle it moves but never copies, so the mapping has a
+// single owner and is unmapped exactly once.
+struct MappedFile
+{
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept { take(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other) {
+            close();
+            take(other);
+        }
+        return *this;
+    }
+    ~MappedFile() { close(); }
+
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+
+    bool open(const char* path);
+
+    void close();
+
+    bool isOpen() const { return data != nullptr; }
+
+private:
+    void take(MappedFile& other)
+    {
+        data = other.data;
+        size = other.size;
+        other.data = nullptr;
+        other.size = 0;
+#ifdef _WIN32
+        fileHandle = other.fileHandle;
+        mappingHandle = other.mappingHandle;
+        other.fileHandle = other.mappingHandle = nullptr;
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,353 @@
+#include "meshLod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cfloat>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// Sum of squared distances to a set of weighted planes, stored as the
+// symmetric 4x4 matrix plus the total weight so it can be normalised
+struct Quadric
+{
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0, c = 0;
+    double weight = 0;
+
+    void addPlane(glm::vec3 n, float d, float w)
+    {
+        a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+        b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c;
+        weight += q.weight;
+    }
+
+    // mean squared distance of p to the planes
+    double error(glm::vec3 p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                 + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return weight > 0.0 ? std::fabs(e) / weight : 0.0;
+    }
+};
+
+struct PositionHash
+{
+    size_t operator()(const glm::vec3& p) const
+    {
+        uint32_t bits[3];
+        memcpy(bits, &p, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+
+enum VertexKind : uint8_t { Manifold, Border, Seam, Locked };
+
+struct Collapse
+{
+    unsigned int from, to;
+    double cost;
+};
+
+uint64_t edgeKey(unsigned int a, unsigned int b) { return ((uint64_t)a << 32) | b; }
+
+} // namespace
+
+float SimplifyMesh(const std::vector<GLTFModel::Vertex>& vertices, const std::vector<unsigned int>& indices,
+                   size_t targetIndexCount, std::vector<unsigned int>& out)
+{
+    const size_t vertexCount = vertices.size();
+
+    // positions shared by several vertices get one id; they form the seams
+    std::vector<unsigned int> positionId(vertexCount);
+    std::unordered_map<glm::vec3, unsigned int, PositionHash> positions;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        glm::vec3 p = vertices[i].pos + glm::vec3(0.0f); // -0 and 0 are one position
+        positionId[i] = positions.emplace(p, (unsigned int)positions.size()).first->second;
+    }
+
+    // vertices that differ only in their normal (hard edges of flat shaded
+    // models) are one vertex while collapsing; each corner of the result picks
+    // the copy whose normal suits its face best at the end
+    auto attributes = [&](unsigned int a, unsigned int b) {
+        const GLTFModel::Vertex& va = vertices[a];
+        const GLTFModel::Vertex& vb = vertices[b];
+        if (int c = memcmp(&va.uv, &vb.uv, sizeof(va.uv))) return c;
+        if (int c = memcmp(&va.jointIndices, &vb.jointIndices, sizeof(va.jointIndices))) return c;
+        return memcmp(&va.jointWeights, &vb.jointWeights, sizeof(va.jointWeights));
+    };
+    std::vector<unsigned int> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+        if (positionId[a] != positionId[b]) return positionId[a] < positionId[b];
+        int c = attributes(a, b);
+        return c != 0 ? c < 0 : a < b;
+    });
+    std::vector<unsigned int> canonical(vertexCount), copiesStart(vertexCount), copiesEnd(vertexCount);
+    for (size_t i = 0, end; i < vertexCount; i = end)
+    {
+        end = i + 1;
+        while (end < vertexCount && positionId[order[end]] == positionId[order[i]] && attributes(order[end], order[i]) == 0) ++end;
+        for (size_t j = i; j < end; ++j)
+            canonical[order[j]] = order[i];
+        copiesStart[order[i]] = (unsigned int)i;
+        copiesEnd[order[i]] = (unsigned int)end;
+    }
+
+    out.clear();
+    out.reserve(indices.size());
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        unsigned int a = canonical[indices[t]], b = canonical[indices[t + 1]], c = canonical[indices[t + 2]];
+        if (a != b && b != c && a != c) out.insert(out.end(), {a, b, c});
+    }
+
+    std::unordered_set<uint64_t> halfEdges;
+    auto buildHalfEdges = [&]() {
+        halfEdges.clear();
+        for (size_t t = 0; t < out.size(); t += 3)
+            for (int k = 0; k < 3; ++k)
+                halfEdges.insert(edgeKey(out[t + k], out[t + (k + 1) % 3]));
+    };
+
+    // face planes weighted by area, and planes standing on open edges (borders
+    // and seams) so the outline of those edges is kept
+    std::vector<Quadric> quadrics(positions.size());
+    buildHalfEdges();
+    for (size_t t = 0; t < out.size(); t += 3)
+    {
+        glm::vec3 p0 = vertices[out[t]].pos, p1 = vertices[out[t + 1]].pos, p2 = vertices[out[t + 2]].pos;
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(n);
+        if (length == 0.0f) continue;
+        n /= length;
+        for (int k = 0; k < 3; ++k)
+            quadrics[positionId[out[t + k]]].addPlane(n, -glm::dot(n, p0), 0.5f * length);
+
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int a = out[t + k], b = out[t + (k + 1) % 3];
+            if (halfEdges.count(edgeKey(b, a))) continue;
+            glm::vec3 edge = vertices[b].pos - vertices[a].pos;
+            glm::vec3 side = glm::cross(edge, n);
+            float sideLength = glm::length(side);
+            if (sideLength == 0.0f) continue;
+            side /= sideLength;
+            float weight = glm::dot(edge, edge);
+            quadrics[positionId[a]].addPlane(side, -glm::dot(side, vertices[a].pos), weight);
+            quadrics[positionId[b]].addPlane(side, -glm::dot(side, vertices[a].pos), weight);
+        }
+    }
+
+    std::vector<VertexKind> kind(vertexCount);
+    std::vector<unsigned int> wedge(vertexCount), openTo(vertexCount), openFrom(vertexCount);
+    std::vector<int> openOut(vertexCount), openIn(vertexCount);
+    std::vector<unsigned int> usedAtPosition(positions.size()), firstAtPosition(positions.size());
+    std::vector<unsigned int> adjacencyStart(vertexCount + 1), adjacency;
+    std::vector<unsigned int> collapseTo(vertexCount);
+    std::vector<bool> positionLocked(positions.size());
+    std::vector<Collapse> collapses;
+    double worstError = 0.0;
+
+    auto flips = [&](unsigned int from, unsigned int to) {
+        glm::vec3 target = vertices[to].pos;
+        for (unsigned int i = adjacencyStart[from]; i < adjacencyStart[from + 1]; ++i)
+        {
+            const unsigned int* corner = &out[adjacency[i]];
+            glm::vec3 p[3], moved[3];
+            bool collapses = false;
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int v = corner[k] == from ? from : collapseTo[corner[k]];
+                collapses = collapses || (v != from && positionId[v] == positionId[to]);
+                p[k] = moved[k] = vertices[v].pos;
+                if (v == from) moved[k] = target;
+            }
+            if (collapses) continue; // the triangle disappears with the edge
+
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            if (glm::dot(before, after) <= 0.0f) return true;
+        }
+        return false;
+    };
+
+    for (int pass = 0; pass < 100 && out.size() > targetIndexCount; ++pass)
+    {
+        buildHalfEdges();
+
+        // which vertices are still referenced, and the twins sharing their position
+        std::fill(usedAtPosition.begin(), usedAtPosition.end(), 0u);
+        std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0u);
+        std::fill(openOut.begin(), openOut.end(), 0);
+        std::fill(openIn.begin(), openIn.end(), 0);
+        for (unsigned int v : out)
+            adjacencyStart[v + 1]++;
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            if (adjacencyStart[v + 1] == 0) continue;
+            unsigned int id = positionId[v];
+            if (usedAtPosition[id]++ == 0) firstAtPosition[id] = (unsigned int)v;
+            else {
+                wedge[v] = firstAtPosition[id];
+                wedge[firstAtPosition[id]] = (unsigned int)v;
+            }
+        }
+        for (size_t v = 0; v < vertexCount; ++v)
+            adjacencyStart[v + 1] += adjacencyStart[v];
+        adjacency.resize(out.size());
+        {
+            std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            for (size_t i = 0; i < out.size(); ++i)
+                adjacency[fill[out[i]]++] = (unsigned int)(i - i % 3);
+        }
+
+        for (size_t t = 0; t < out.size(); t += 3)
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int a = out[t + k], b = out[t + (k + 1) % 3];
+                if (halfEdges.count(edgeKey(b, a))) continue;
+                openOut[a]++; openTo[a] = b;
+                openIn[b]++; openFrom[b] = a;
+            }
+
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            if (adjacencyStart[v + 1] == adjacencyStart[v]) continue;
+            unsigned int shared = usedAtPosition[positionId[v]];
+            if (shared == 1)
+                kind[v] = openOut[v] == 0 && openIn[v] == 0 ? Manifold : openOut[v] == 1 && openIn[v] == 1 ? Border : Locked;
+            else if (shared == 2) {
+                // a seam: both twins are open along the same two positions
+                unsigned int w = wedge[v];
+                bool seam = openOut[v] == 1 && openIn[v] == 1 && openOut[w] == 1 && openIn[w] == 1 &&
+                            positionId[openTo[v]] == positionId[openFrom[w]] && positionId[openFrom[v]] == positionId[openTo[w]];
+                kind[v] = seam ? Seam : Locked;
+            }
+            else kind[v] = Locked;
+        }
+
+        // every allowed move of an endpoint onto the other, cheapest first
+        collapses.clear();
+        auto consider = [&](unsigned int from, unsigned int to) {
+            if (kind[from] == Locked) return;
+            if (kind[from] != Manifold && to != openTo[from] && to != openFrom[from]) return;
+            collapses.push_back({from, to, quadrics[positionId[from]].error(vertices[to].pos)});
+        };
+        for (size_t t = 0; t < out.size(); t += 3)
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int a = out[t + k], b = out[t + (k + 1) % 3];
+                if (a > b && halfEdges.count(edgeKey(b, a))) continue; // the other half-edge covers it
+                consider(a, b);
+                consider(b, a);
+            }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        std::iota(collapseTo.begin(), collapseTo.end(), 0u);
+        std::fill(positionLocked.begin(), positionLocked.end(), false);
+        size_t trianglesToRemove = (out.size() - std::min(out.size(), targetIndexCount)) / 3;
+        size_t removed = 0;
+        for (const Collapse& collapse : collapses)
+        {
+            if (removed >= trianglesToRemove) break;
+            unsigned int from = collapse.from, to = collapse.to;
+            if (positionLocked[positionId[from]] || positionLocked[positionId[to]]) continue;
+
+            // a seam moves both twins, each along its own side of the seam
+            unsigned int twin = 0, twinTo = 0;
+            if (kind[from] == Seam) {
+                twin = wedge[from];
+                twinTo = to == openTo[from] ? openFrom[twin] : openTo[twin];
+                if (positionId[twinTo] != positionId[to] || flips(twin, twinTo)) continue;
+            }
+            if (flips(from, to)) continue;
+
+            collapseTo[from] = to;
+            if (kind[from] == Seam) collapseTo[twin] = twinTo;
+            quadrics[positionId[to]].add(quadrics[positionId[from]]);
+            positionLocked[positionId[from]] = positionLocked[positionId[to]] = true;
+            worstError = std::max(worstError, collapse.cost);
+            removed += kind[from] == Border ? 1 : 2;
+        }
+        if (removed == 0) break;
+
+        size_t write = 0;
+        for (size_t t = 0; t < out.size(); t += 3)
+        {
+            unsigned int a = collapseTo[out[t]], b = collapseTo[out[t + 1]], c = collapseTo[out[t + 2]];
+            if (positionId[a] == positionId[b] || positionId[b] == positionId[c] || positionId[a] == positionId[c]) continue;
+            out[write++] = a; out[write++] = b; out[write++] = c;
+        }
+        out.resize(write);
+    }
+
+    for (size_t t = 0; t < out.size(); t += 3)
+    {
+        glm::vec3 p0 = vertices[out[t]].pos, p1 = vertices[out[t + 1]].pos, p2 = vertices[out[t + 2]].pos;
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        for (int k = 0; k < 3; ++k)
+        {
+            unsigned int v = out[t + k], best = v;
+            float bestDot = -FLT_MAX;
+            for (unsigned int i = copiesStart[v]; i < copiesEnd[v]; ++i)
+            {
+                float d = glm::dot(vertices[order[i]].normal, n);
+                if (d > bestDot) { bestDot = d; best = order[i]; }
+            }
+            out[t + k] = best;
+        }
+    }
+
+    return (float)std::sqrt(worstError);
+}
+
+float LodSelector::pixelScale(const glm::mat4& projectionMatrix, float distance) const
+{
+    return 0.5f * viewportHeight * projectionMatrix[1][1] / std::max(distance, 1e-3f);
+}
+
+int LodSelector::select(const float* errors, int count, int current, float scale)
+{
+    int lod = 0;
+    while (lod + 1 < count && errors[lod + 1] * scale <= maxPixelError) ++lod;
+
+    if (current >= 0 && current < count && lod != current)
+    {
+        if (lod > current) {
+            // coarser only once the error is comfortably below the limit
+            while (lod > current && errors[lod] * scale > maxPixelError * (1.0f - hysteresis)) --lod;
+        }
+        else if (errors[current] * scale <= maxPixelError * (1.0f + hysteresis))
+            lod = current; // finer only once the current level is clearly too coarse
+    }
+
+    histogram[lod]++;
+    return lod;
+}
+
+void LodSelector::resetHistogram()
+{
+    std::fill(std::begin(histogram), std::end(histogram), 0);
+}
+
+LodSelector& GetLodSelector()
+{
+    static LodSelector selector;
+    return selector;
+}
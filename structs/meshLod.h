@@ -0,0 +1,44 @@
+#ifndef _MESH_LOD_H_
+#define _MESH_LOD_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "gltfModel.h"
+
+// Quadric edge collapse simplification of one primitive. The vertex buffer is
+// kept and only a new index list is produced, so every level of a chain can
+// share the original vertices. Vertices split by a seam (UV or skin weights
+// differ at one position) only collapse along the seam together with their
+// twin, open borders only along the border, and vertices where three or more
+// attribute sets meet never move. Hard edges are not seams: copies differing
+// only in their normal collapse as one, and each corner of the result takes
+// the copy facing its new triangle best. Stops at targetIndexCount or when no
+// collapse is left; returns the geometric error introduced, in model units.
+float SimplifyMesh(const std::vector<GLTFModel::Vertex>& vertices, const std::vector<unsigned int>& indices,
+                   size_t targetIndexCount, std::vector<unsigned int>& out);
+
+// Picks LOD levels from their screen-space error, shared by everything that
+// draws GLTFModel levels. A level is used while its error projects to at most
+// maxPixelError pixels; switching needs a margin of hysteresis either side so
+// objects near a threshold do not flicker between levels.
+struct LodSelector
+{
+    float maxPixelError = 1.0f;
+    float hysteresis = 0.25f;
+    int viewportHeight = 768;
+
+    long long histogram[GLTFModel::maxLods] = {}; // selections per level since the last reset
+
+    // Pixels per model unit at a distance from the camera
+    float pixelScale(const glm::mat4& projectionMatrix, float distance) const;
+
+    // Level for errors (model units, ascending) scaled by pixelScale.
+    // current is the level used last frame, or -1 when there is none.
+    int select(const float* errors, int count, int current, float scale);
+
+    void resetHistogram();
+};
+
+LodSelector& GetLodSelector();
+
+#endif
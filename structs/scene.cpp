@@ -0,0 +1,220 @@
+#include "scene.h"
+#include "gltfModel.h"
+#include "shader.h"
+#include "occlusionCuller.h"
+#include "frameArena.h"
+
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+Entity Scene::create()
+{
+    Entity entity;
+    if (!freeSlots.empty()) {
+        entity.index = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        entity.index = (uint32_t)generations.size();
+        generations.push_back(0);
+    }
+    entity.generation = generations[entity.index];
+    return entity;
+}
+
+void Scene::destroy(Entity entity)
+{
+    if (!alive(entity)) return;
+    if (const Animator* animator = animators.get(entity.index))
+        freeBones.push_back({animator->firstBone, animator->boneCount});
+    transforms.remove(entity.index);
+    meshes.remove(entity.index);
+    animators.remove(entity.index);
+    bounds.remove(entity.index);
+    lights.remove(entity.index);
+    generations[entity.index]++;
+    freeSlots.push_back(entity.index);
+}
+
+bool Scene::alive(Entity entity) const
+{
+    return entity.index < generations.size() && generations[entity.index] == entity.generation;
+}
+
+Transform& Scene::addTransform(Entity entity, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+    Transform transform;
+    transform.position = position;
+    transform.rotation = rotation;
+    transform.scale = scale;
+    Transform& added = transforms.add(entity.index, transform);
+    added.world = glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+    return added;
+}
+
+void Scene::addModel(Entity entity, GLTFModel& model)
+{
+    MeshRef mesh;
+    mesh.model = &model;
+    mesh.occlusionTested = !model.isAnimated;
+    meshes.add(entity.index, mesh);
+
+    Bounds sphere;
+    if (model.boundsMin.x <= model.boundsMax.x) {
+        sphere.localCentre = (model.boundsMin + model.boundsMax) * 0.5f;
+        sphere.localRadius = model.boundingRadius();
+    }
+    bounds.add(entity.index, sphere);
+
+    if (model.isAnimated && model.boneCount() > 0) {
+        Animator animator;
+        animator.model = &model;
+        animator.boneCount = (uint32_t)model.boneCount();
+        auto reuse = std::find_if(freeBones.begin(), freeBones.end(), [&](const BoneRange& range) { return range.count == animator.boneCount; });
+        if (reuse != freeBones.end()) {
+            animator.firstBone = reuse->first;
+            freeBones.erase(reuse);
+        } else {
+            animator.firstBone = (uint32_t)bonePool.size();
+            bonePool.resize(bonePool.size() + animator.boneCount, glm::mat4(1.0f));
+        }
+        model.evaluatePose(0.0f, &bonePool[animator.firstBone]);
+        animators.add(entity.index, animator);
+    }
+}
+
+LightSource& Scene::addLight(Entity entity, const Light& light)
+{
+    return lights.add(entity.index, {light});
+}
+
+void Scene::setPose(Entity entity, const std::vector<glm::mat4>& boneMatrices)
+{
+    const Animator* animator = animators.get(entity.index);
+    if (!animator) return;
+    size_t count = std::min((size_t)animator->boneCount, boneMatrices.size());
+    std::copy(boneMatrices.begin(), boneMatrices.begin() + count, bonePool.begin() + animator->firstBone);
+}
+
+void Scene::setPose(const GLTFModel* model, const std::vector<glm::mat4>& boneMatrices)
+{
+    for (const Animator& animator : animators.values) {
+        if (animator.model != model) continue;
+        size_t count = std::min((size_t)animator.boneCount, boneMatrices.size());
+        std::copy(boneMatrices.begin(), boneMatrices.begin() + count, bonePool.begin() + animator.firstBone);
+    }
+}
+
+void Scene::updateTransforms()
+{
+    Transform* values = transforms.values.data();
+    parallelFor(transforms.size(), [values](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Transform& t = values[i];
+            t.world = glm::translate(glm::mat4(1.0f), t.position) * glm::mat4_cast(t.rotation) * glm::scale(glm::mat4(1.0f), t.scale);
+        }
+    });
+}
+
+void Scene::animate(float deltaTime)
+{
+    Animator* values = animators.values.data();
+    glm::mat4* pool = bonePool.data();
+    parallelFor(animators.size(), [values, pool, deltaTime](size_t begin, size_t end) {
+        // each pose's scratch is done with once it is written, so every
+        // animator reuses the same stretch of this thread's frame arena
+        FrameArena& arena = GetFrameArena();
+        FrameArena::Marker start = arena.mark();
+        for (size_t i = begin; i < end; ++i) {
+            Animator& animator = values[i];
+            float length = animator.model->animationLength();
+            animator.time += deltaTime * animator.speed;
+            if (length > 0.0f && animator.time > length)
+                animator.time = std::fmod(animator.time, length);
+            animator.model->evaluatePose(animator.time, pool + animator.firstBone);
+            arena.rewind(start);
+        }
+    });
+}
+
+void Scene::updateBounds()
+{
+    Bounds* values = bounds.values.data();
+    const uint32_t* owners = bounds.owners.data();
+    const ComponentStore<Transform>& placed = transforms;
+    parallelFor(bounds.size(), [values, owners, &placed](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Bounds& b = values[i];
+            const Transform* t = placed.get(owners[i]);
+            if (!t) {
+                b.centre = b.localCentre;
+                b.radius = b.localRadius;
+                continue;
+            }
+            const glm::mat4& m = t->world;
+            float scale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+            b.centre = glm::vec3(m * glm::vec4(b.localCentre, 1.0f));
+            b.radius = b.localRadius * scale;
+        }
+    });
+}
+
+void Scene::gatherLights(std::vector<Light>& out) const
+{
+    out.clear();
+    for (size_t i = 0; i < lights.size(); ++i) {
+        Light light = lights.values[i].light;
+        if (const Transform* t = transforms.get(lights.owners[i]))
+            light.position = glm::vec3(t->world[3]);
+        out.push_back(light);
+    }
+}
+
+void Scene::render(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, Shader& program, GLuint shadowMap,
+                   float cullDistance, OcclusionCuller* occlusion)
+{
+    static const glm::mat4 identity(1.0f);
+    glm::vec3 cameraPos = glm::vec3(glm::inverse(viewMatrix)[3]);
+    drawnLastFrame = 0;
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        MeshRef& mesh = meshes.values[i];
+        if (mesh.batched) continue;
+        uint32_t owner = meshes.owners[i];
+        const Transform* t = transforms.get(owner);
+        const glm::mat4& world = t ? t->world : identity;
+
+        const Bounds* sphere = bounds.get(owner);
+        if (sphere && glm::length(sphere->centre - cameraPos) - sphere->radius > cullDistance) continue;
+        if (occlusion && mesh.occlusionTested && !occlusion->isVisible(mesh.model->boundsMin, mesh.model->boundsMax, world)) continue;
+
+        mesh.model->requestTextureDetail(viewMatrix, projectionMatrix, world);
+        mesh.lod = mesh.model->selectLod(viewMatrix, projectionMatrix, world, mesh.lod);
+        const Animator* animator = animators.get(owner);
+        if (animator)
+            mesh.model->draw(program, shadowMap, world, mesh.lod, &bonePool[animator->firstBone], (int)animator->boneCount);
+        else
+            mesh.model->draw(program, shadowMap, world, mesh.lod, nullptr, 0);
+        drawnLastFrame++;
+    }
+}
+
+void Scene::renderDepth(Shader& program)
+{
+    static const glm::mat4 identity(1.0f);
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        const MeshRef& mesh = meshes.values[i];
+        if (mesh.batched) continue;
+        const Transform* t = transforms.get(meshes.owners[i]);
+        mesh.model->drawDepth(program, t ? t->world : identity, mesh.lod);
+    }
+}
+
+void Scene::addOccluders(OcclusionCuller& occlusion) const
+{
+    static const glm::mat4 identity(1.0f);
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        const MeshRef& mesh = meshes.values[i];
+        if (mesh.occluder < 0) continue;
+        const Transform* t = transforms.get(meshes.owners[i]);
+        occlusion.addOccluder(mesh.occluder, t ? t->world : identity);
+    }
+}
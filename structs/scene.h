@@ -0,0 +1,215 @@
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glad/gl.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "jobSystem.h"
+#include "light.h"
+
+struct GLTFModel;
+struct Shader;
+struct OcclusionCuller;
+
+// An index into the scene's entity slots, with the generation of the slot it
+// was handed out from so a handle to a destroyed entity is told apart from
+// whatever reuses its slot
+struct Entity
+{
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+// One kind of component, stored densely: the values sit back to back in
+// whatever order they were added, so a system walks a plain array. A sparse
+// table maps entity index to slot for lookups, and removal moves the last
+// value into the hole.
+template <typename T>
+struct ComponentStore
+{
+    static constexpr uint32_t none = UINT32_MAX;
+
+    std::vector<T> values;
+    std::vector<uint32_t> owners;   // entity index of each value
+    std::vector<uint32_t> slots;    // by entity index; none without the component
+
+    size_t size() const { return values.size(); }
+
+    bool has(uint32_t entity) const { return entity < slots.size() && slots[entity] != none; }
+
+    T* get(uint32_t entity) { return has(entity) ? &values[slots[entity]] : nullptr; }
+    const T* get(uint32_t entity) const { return has(entity) ? &values[slots[entity]] : nullptr; }
+
+    // Replaces the value when the entity already has one
+    T& add(uint32_t entity, const T& value)
+    {
+        if (entity >= slots.size()) slots.resize(entity + 1, none);
+        if (slots[entity] != none) return values[slots[entity]] = value;
+        slots[entity] = (uint32_t)values.size();
+        values.push_back(value);
+        owners.push_back(entity);
+        return values.back();
+    }
+
+    void remove(uint32_t entity)
+    {
+        if (!has(entity)) return;
+        uint32_t slot = slots[entity];
+        uint32_t last = (uint32_t)values.size() - 1;
+        if (slot != last) {
+            values[slot] = std::move(values[last]);
+            owners[slot] = owners[last];
+            slots[owners[slot]] = slot;
+        }
+        values.pop_back();
+        owners.pop_back();
+        slots[entity] = none;
+    }
+
+    void reserve(size_t count)
+    {
+        values.reserve(count);
+        owners.reserve(count);
+    }
+
+    void clear()
+    {
+        values.clear();
+        owners.clear();
+        slots.clear();
+    }
+};
+
+struct Transform
+{
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::mat4 world = glm::mat4(1.0f); // translate * rotate * scale, from updateTransforms
+};
+
+// A drawn model; the model is shared by every entity showing it
+struct MeshRef
+{
+    GLTFModel* model = nullptr;
+    int lod = -1;
+    bool occlusionTested = true;    // skinned models reach past their bind-pose bounds, so they are not
+    bool batched = false;           // drawn by a StaticBatch instead, so render and renderDepth skip it
+    int occluder = -1;              // OcclusionCuller mesh placed at the entity by addOccluders
+};
+
+// Plays the model's first animation into boneCount matrices at firstBone of
+// the scene's bone pool
+struct Animator
+{
+    const GLTFModel* model = nullptr;
+    float time = 0.0f;
+    float speed = 1.0f;
+    uint32_t firstBone = 0;
+    uint32_t boneCount = 0;
+};
+
+// World-space bounding sphere, from the model-space one and the transform
+struct Bounds
+{
+    glm::vec3 localCentre = glm::vec3(0.0f);
+    float localRadius = 0.0f;
+    glm::vec3 centre = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+// A light; one on an entity with a Transform sits at its position
+struct LightSource
+{
+    Light light;
+};
+
+// The scene's entities, each a set of components held in dense per-type
+// stores. Systems walk only the stores they need, in slot order; the ones
+// with no GL work split the walk across threads once there are enough
+// entities to be worth it. Everything else is on the main thread.
+struct Scene
+{
+    ComponentStore<Transform> transforms;
+    ComponentStore<MeshRef> meshes;
+    ComponentStore<Animator> animators;
+    ComponentStore<Bounds> bounds;
+    ComponentStore<LightSource> lights;
+
+    std::vector<glm::mat4> bonePool;    // every animator's pose, back to back
+
+    size_t parallelThreshold = 4096;    // systems over fewer components run on the calling thread
+
+    Entity create();
+    void destroy(Entity entity);
+    bool alive(Entity entity) const;
+    Entity entityAt(uint32_t index) const { return {index, generations[index]}; }  // as a store's owners hold them
+    size_t entityCount() const { return generations.size() - freeSlots.size(); }
+
+    Transform& addTransform(Entity entity, const glm::vec3& position, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                            const glm::vec3& scale = glm::vec3(1.0f));
+
+    // A MeshRef and its Bounds; skinned models get an Animator too
+    void addModel(Entity entity, GLTFModel& model);
+
+    LightSource& addLight(Entity entity, const Light& light);
+
+    // Copies a pose evaluated elsewhere (the simulation thread) into the
+    // entity's bones
+    void setPose(Entity entity, const std::vector<glm::mat4>& boneMatrices);
+
+    // The same for every entity animating model
+    void setPose(const GLTFModel* model, const std::vector<glm::mat4>& boneMatrices);
+
+    // Systems, in the order a frame runs them
+    void updateTransforms();
+    void animate(float deltaTime);
+    void updateBounds();
+
+    // Lights in store order, placed at their entities' positions
+    void gatherLights(std::vector<Light>& out) const;
+
+    // Drops what is further than cullDistance or hidden behind the occluders,
+    // then picks levels and draws the rest
+    void render(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, Shader& program, GLuint shadowMap,
+                float cullDistance, OcclusionCuller* occlusion = nullptr);
+    void renderDepth(Shader& program);
+
+    void addOccluders(OcclusionCuller& occlusion) const;
+
+    int drawnLastFrame = 0;
+
+    // Runs work(begin, end) over [0, count), across the job system when count
+    // is at least parallelThreshold
+    template <typename Work>
+    void parallelFor(size_t count, Work work) const;
+
+private:
+    std::vector<uint32_t> generations;  // by entity index
+    std::vector<uint32_t> freeSlots;
+
+    struct BoneRange {
+        uint32_t first;
+        uint32_t count;
+    };
+    std::vector<BoneRange> freeBones;   // pool ranges of destroyed animators, reused by the next of the same size
+};
+
+template <typename Work>
+void Scene::parallelFor(size_t count, Work work) const
+{
+    if (count < parallelThreshold) {
+        work((size_t)0, count);
+        return;
+    }
+    GetJobSystem().parallelFor(count, parallelThreshold / 4, work);
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include "simulation.h"
+#include "gltfModel.h"
+#include "benchmark.h"
+#include "frameArena.h"
+#include "jobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+
+void Simulation::initialise(const FrameSnapshot& initial)
+{
+    FrameSnapshot first = initial;
+    first.poses.resize(animated.size());
+    for (size_t i = 0; i < animated.size(); ++i)
+        animated[i]->evaluatePose(0.0f, first.poses[i]);
+    for (FrameSnapshot& snapshot : history)
+        snapshot = first;
+    next = first;
+    latest = 0;
+    targetTime = first.time;
+    animationTimes.assign(animated.size(), 0.0f);
+
+    stopping = false;
+    worker = std::thread(&Simulation::workerLoop, this);
+}
+
+void Simulation::setMove(const glm::vec3& move)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->move = move;
+}
+
+void Simulation::addLook(float yawDelta, float pitchDelta)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->yawDelta += yawDelta;
+    this->pitchDelta += pitchDelta;
+}
+
+void Simulation::advanceTo(double time)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (time <= targetTime) return;
+        targetTime = time;
+    }
+    wake.notify_one();
+}
+
+void Simulation::snapshotAt(double time, FrameSnapshot& out)
+{
+    advanceTo(time);
+    std::unique_lock<std::mutex> lock(mutex);
+    published.wait(lock, [&]() { return stopping || history[latest % historySize].time >= time; });
+
+    // the newest tick not after time, or the oldest kept when time is older still
+    long long oldest = std::max(0ll, latest - historySize + 1);
+    long long before = latest;
+    while (before > oldest && history[before % historySize].time > time) --before;
+    long long after = std::min(before + 1, latest);
+    const FrameSnapshot& a = history[before % historySize];
+    const FrameSnapshot& b = history[after % historySize];
+    float factor = b.time > a.time ? (float)glm::clamp((time - a.time) / (b.time - a.time), 0.0, 1.0) : 0.0f;
+
+    out.tick = a.tick;
+    out.time = time;
+    out.eyeCentre = glm::mix(a.eyeCentre, b.eyeCentre, factor);
+    out.cameraTarget = glm::mix(a.cameraTarget, b.cameraTarget, factor);
+    out.yaw = glm::mix(a.yaw, b.yaw, factor);
+    out.pitch = glm::mix(a.pitch, b.pitch, factor);
+    out.poses.resize(a.poses.size());
+    for (size_t m = 0; m < a.poses.size(); ++m)
+    {
+        out.poses[m].resize(a.poses[m].size());
+        for (size_t j = 0; j < a.poses[m].size(); ++j)
+            out.poses[m][j] = a.poses[m][j] * (1.0f - factor) + b.poses[m][j] * factor;
+    }
+}
+
+void Simulation::tick()
+{
+    // nothing from the previous tick is still using it
+    GetFrameArena().reset();
+
+    glm::vec3 held;
+    float turn, tilt;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        held = move;
+        turn = yawDelta;
+        tilt = pitchDelta;
+        yawDelta = pitchDelta = 0.0f;
+    }
+
+    // the worker is the only writer of history, so it reads it unlocked
+    const FrameSnapshot& last = history[latest % historySize];
+    next.tick = last.tick + 1;
+    next.time = next.tick * (double)timestep;
+    next.eyeCentre = last.eyeCentre;
+    next.cameraTarget = last.cameraTarget;
+    next.yaw = last.yaw;
+    next.pitch = last.pitch;
+
+    if (path)
+        path->sample((float)next.time, next.cameraTarget, next.yaw, next.pitch);
+    else
+    {
+        next.yaw += turn;
+        next.pitch = glm::clamp(next.pitch + tilt, -89.0f, 89.0f);
+
+        glm::vec3 flatFront = glm::normalize(glm::vec3(std::cos(glm::radians(next.yaw)), 0.0f, std::sin(glm::radians(next.yaw))));
+        glm::vec3 right = glm::normalize(glm::cross(flatFront, glm::vec3(0, 1, 0)));
+        glm::vec3 direction = flatFront * held.z + right * held.x;
+        if ((held.y > 0.0f && last.eyeCentre.y < maxHeight) || (held.y < 0.0f && last.eyeCentre.y > minHeight))
+            direction.y = held.y;
+        if (glm::length(direction) > 0.0f)
+            next.cameraTarget += glm::normalize(direction) * moveSpeed * timestep;
+    }
+    next.eyeCentre = glm::mix(last.eyeCentre, next.cameraTarget, followRate * timestep);
+
+    // a model's pose depends only on its own time, so they are evaluated as
+    // jobs; each one's scratch goes back to its thread's arena once written
+    next.poses.resize(animated.size());
+    GetJobSystem().parallelFor(animated.size(), 1, [this](size_t begin, size_t end) {
+        FrameArena& arena = GetFrameArena();
+        FrameArena::Marker start = arena.mark();
+        for (size_t i = begin; i < end; ++i) {
+            float length = animated[i]->animationLength();
+            animationTimes[i] += timestep;
+            if (length > 0.0f && animationTimes[i] > length)
+                animationTimes[i] = std::fmod(animationTimes[i], length);
+            animated[i]->evaluatePose(animationTimes[i], next.poses[i]);
+            arena.rewind(start);
+        }
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        latest++;
+        std::swap(history[latest % historySize], next);
+    }
+    published.notify_all();
+}
+
+void Simulation::workerLoop()
+{
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || history[latest % historySize].time < targetTime; });
+            if (stopping) return;
+        }
+        tick();
+    }
+}
+
+void Simulation::cleanup()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    published.notify_all();
+    if (worker.joinable()) worker.join();
+}
@@ -0,0 +1,80 @@
+#ifndef _SIMULATION_H_
+#define _SIMULATION_H_
+
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct GLTFModel;
+struct CameraPath;
+
+// Everything the renderer takes from one tick. A published snapshot is never
+// written again, so the GL thread can read it while later ticks run.
+struct FrameSnapshot
+{
+    long long tick = 0;
+    double time = 0.0;                          // simulated seconds
+    glm::vec3 eyeCentre = glm::vec3(0.0f);      // the camera, easing towards cameraTarget
+    glm::vec3 cameraTarget = glm::vec3(0.0f);
+    float yaw = -90.0f, pitch = 0.0f;           // degrees
+    std::vector<std::vector<glm::mat4>> poses;  // bone matrices per Simulation::animated model
+};
+
+// Fixed-timestep simulation on its own thread: the camera (from input or a
+// camera path) and skeletal poses. The GL thread lets it run ahead to a point
+// in time and then blends the two ticks either side of the time it renders,
+// so ticks overlap with submission and rendering is smooth at any frame rate.
+// A tick depends only on the previous one, the timestep, the input it sees
+// and the path, so a scripted run always produces the same frames.
+struct Simulation
+{
+    static const int historySize = 4;   // ticks kept for blending
+
+    float timestep = 1.0f / 60.0f;
+    float moveSpeed = 15.0f;            // units per second
+    float followRate = 5.0f;            // eye easing towards the target, per second
+    float minHeight = 5.0f;             // the eye does not fly lower or higher than this
+    float maxHeight = 40.0f;
+    const CameraPath* path = nullptr;   // drives the camera instead of input when set
+    std::vector<const GLTFModel*> animated; // only read; their poses go to the snapshots
+
+    // Starts the thread from initial; path and animated must be final by now
+    void initialise(const FrameSnapshot& initial);
+
+    // Held movement keys: x right, y up, z forward, each -1, 0 or 1
+    void setMove(const glm::vec3& move);
+
+    // Mouse look in degrees, taken by the next tick
+    void addLook(float yawDelta, float pitchDelta);
+
+    // Lets the thread run the ticks up to time without waiting for them
+    void advanceTo(double time);
+
+    // Waits for the first tick at or after time and blends it with the one before
+    void snapshotAt(double time, FrameSnapshot& out);
+
+    void cleanup();
+
+private:
+    // published ticks, newest at latest % historySize
+    FrameSnapshot history[historySize];
+    long long latest = 0;
+    FrameSnapshot next;                 // the tick being built, worker only
+
+    glm::vec3 move = glm::vec3(0.0f);
+    float yawDelta = 0.0f, pitchDelta = 0.0f;
+    std::vector<float> animationTimes;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake, published;
+    double targetTime = 0.0;
+    bool stopping = false;
+
+    void tick();
+    void workerLoop();
+};
+
+#endif
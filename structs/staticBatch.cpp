@@ -0,0 +1,363 @@
+#include "staticBatch.h"
+#include "textureStreamer.h"
+#include "meshLod.h"
+#include "occlusionCuller.h"
+#include "gpuResources.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <string>
+
+bool StaticBatch::add(const GLTFModel& model, uint32_t owner)
+{
+    for (const auto& prim : model.primitives)
+        if (prim.vertices.empty()) return false;
+
+    glm::mat4 modelMatrix = model.modelMatrix;
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
+    TextureStreamer& streamer = GetTextureStreamer();
+
+    Instance instance;
+    float scale = std::max(glm::length(glm::vec3(modelMatrix[0])), std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+    instance.centre = glm::vec3(modelMatrix * glm::vec4((model.boundsMin + model.boundsMax) * 0.5f, 1.0f));
+    instance.radius = model.boundingRadius() * scale;
+    instance.lodCount = model.lodCount;
+    for (int i = 0; i < model.lodCount; ++i)
+        instance.lodError[i] = model.lodError[i] * scale;
+    instance.owner = owner;
+    instance.firstVertex = (GLint)(vertexCount + vertices.size());
+    instance.firstIndex = (GLuint)(indexCount + indices.size());
+
+    // a removed model's slot if there is one, so the list does not grow as tiles stream
+    int slot = 0;
+    while (slot < (int)instances.size() && instances[slot].live) ++slot;
+    if (slot == (int)instances.size()) instances.push_back(instance);
+    else instances[slot] = instance;
+
+    for (const auto& prim : model.primitives)
+    {
+        // materials of one size and format share an array
+        const TextureStreamer::Entry* texture = model.hasTexture ? streamer.entry(prim.textureID) : nullptr;
+        glm::ivec2 size = texture ? texture->levelSize[0] : glm::ivec2(0);
+        BakedFormat format = texture ? texture->format : BakedFormat::RGB8;
+
+        Group* group = nullptr;
+        for (Group& g : groups)
+            if (g.size == size && g.format == format) group = &g;
+        if (!group) {
+            groups.emplace_back();
+            group = &groups.back();
+            group->size = size;
+            group->format = format;
+        }
+
+        // a material whose image failed to load samples the empty default
+        // texture (black), as GLTFModel::render does
+        float layer = model.hasTexture ? 0.0f : -1.0f;
+        if (texture) {
+            size_t i = 0;
+            while (i < group->layers.size() && group->layers[i] != prim.textureID) ++i;
+            if (i == group->layers.size()) group->layers.push_back(prim.textureID);
+            layer = (float)i;
+        }
+
+        Draw draw;
+        for (int i = 0; i < GLTFModel::maxLods; ++i) {
+            draw.lodIndexCount[i] = prim.lodIndexCount[i];
+            draw.lodFirstIndex[i] = (GLuint)(indexCount + indices.size()) + prim.lodFirstIndex[i];
+        }
+        draw.baseVertex = (GLint)(vertexCount + vertices.size());
+        draw.instance = slot;
+
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        for (const GLTFModel::Vertex& v : prim.vertices)
+        {
+            Vertex out;
+            out.pos = glm::vec3(modelMatrix * glm::vec4(v.pos, 1.0f));
+            out.normal = glm::normalize(normalMatrix * v.normal);
+            out.uv = v.uv;
+            out.material = glm::vec2(layer, model.diffuseStrength);
+            vertices.push_back(out);
+
+            boundsMin = glm::min(boundsMin, out.pos);
+            boundsMax = glm::max(boundsMax, out.pos);
+        }
+        indices.insert(indices.end(), prim.indices.begin(), prim.indices.end());
+
+        draw.centre = (boundsMin + boundsMax) * 0.5f;
+        draw.radius = glm::length(boundsMax - boundsMin) * 0.5f;
+        group->draws.push_back(draw);
+    }
+    instances[slot].vertexCount = (GLsizei)(vertexCount + vertices.size()) - instances[slot].firstVertex;
+    instances[slot].indexCount = (GLsizei)(indexCount + indices.size() - instances[slot].firstIndex);
+    changed.push_back(glm::vec4(instance.centre, instance.radius));
+    return true;
+}
+
+bool StaticBatch::remove(uint32_t owner)
+{
+    int slot = 0;
+    while (slot < (int)instances.size() && !(instances[slot].live && instances[slot].owner == owner)) ++slot;
+    if (slot == (int)instances.size()) return false;
+
+    Instance& instance = instances[slot];
+    instance.live = false;
+    deadVertices += instance.vertexCount;
+    deadIndices += instance.indexCount;
+    changed.push_back(glm::vec4(instance.centre, instance.radius));
+
+    // its draws leave the groups; the rest keep their order
+    for (Group& group : groups) {
+        size_t built = group.counts.size();
+        size_t kept = 0, keptBuilt = 0;
+        for (size_t i = 0; i < group.draws.size(); ++i) {
+            if (group.draws[i].instance == slot) continue;
+            group.draws[kept++] = group.draws[i];
+            if (i < built) {
+                group.counts[keptBuilt] = group.counts[i];
+                group.visibleCounts[keptBuilt] = group.visibleCounts[i];
+                group.offsets[keptBuilt] = group.offsets[i];
+                group.baseVertices[keptBuilt] = group.baseVertices[i];
+                keptBuilt++;
+            }
+        }
+        group.draws.resize(kept);
+        group.counts.resize(keptBuilt);
+        group.visibleCounts.resize(keptBuilt);
+        group.offsets.resize(keptBuilt);
+        group.baseVertices.resize(keptBuilt);
+    }
+    return true;
+}
+
+void StaticBatch::build()
+{
+    TextureStreamer& streamer = GetTextureStreamer();
+    for (size_t i = 0; i < groups.size(); ++i)
+    {
+        Group& group = groups[i];
+        // layers are only ever appended, so what was drawn keeps its layer
+        if (group.layers.size() != group.arrayLayers) {
+            streamer.release(group.texture);
+            group.texture = streamer.acquireArray("static-batch/" + std::to_string(i), group.layers);
+            group.arrayLayers = group.layers.size();
+            if (group.texture != 0) {
+                glBindTexture(GL_TEXTURE_2D_ARRAY, group.texture);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            }
+        }
+    }
+
+    // a new arena when the additions do not fit, or when holes outweigh what is live
+    if (VAO == 0 || vertexCount + vertices.size() > vertexCapacity || indexCount + indices.size() > indexCapacity ||
+        deadVertices > vertexCount + vertices.size() - deadVertices)
+        reallocate();
+
+    // the additions go on the end
+    glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, vertexCount * sizeof(Vertex), vertices.size() * sizeof(Vertex), vertices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    vertexCount += vertices.size();
+    indexCount += indices.size();
+
+    for (Group& group : groups)
+        for (size_t i = group.counts.size(); i < group.draws.size(); ++i) {
+            const Draw& draw = group.draws[i];
+            group.counts.push_back(draw.lodIndexCount[0]);
+            group.visibleCounts.push_back(draw.lodIndexCount[0]);
+            group.offsets.push_back((const void*)(draw.lodFirstIndex[0] * sizeof(unsigned int)));
+            group.baseVertices.push_back(draw.baseVertex);
+        }
+
+    // the GPU copy is all that is drawn from now on
+    std::vector<Vertex>().swap(vertices);
+    std::vector<unsigned int>().swap(indices);
+}
+
+void StaticBatch::reallocate()
+{
+    size_t packedVertices = 0, packedIndices = 0;
+    for (const Instance& instance : instances)
+        if (instance.live && (size_t)instance.firstVertex < vertexCount) {
+            packedVertices += instance.vertexCount;
+            packedIndices += instance.indexCount;
+        }
+    size_t newVertexCapacity = (packedVertices + vertices.size()) * 3 / 2;
+    size_t newIndexCapacity = (packedIndices + indices.size()) * 3 / 2;
+
+    GLuint newVBO = gpuCreateBuffer(GpuOwner::Models, GPU_SITE);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+    gpuBufferData(GL_COPY_WRITE_BUFFER, newVBO, newVertexCapacity * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+    GLuint newEBO = gpuCreateBuffer(GpuOwner::Models, GPU_SITE);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newEBO);
+    gpuBufferData(GL_COPY_WRITE_BUFFER, newEBO, newIndexCapacity * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+
+    // live uploaded ranges are copied down on the GPU; ranges still waiting
+    // to be uploaded move down by as much as the holes before them
+    std::vector<GLint> vertexShift(instances.size(), 0);
+    std::vector<GLint> indexShift(instances.size(), 0);
+    packedVertices = packedIndices = 0;
+    for (size_t i = 0; i < instances.size(); ++i) {
+        Instance& instance = instances[i];
+        if (!instance.live || (size_t)instance.firstVertex >= vertexCount) continue;
+        glBindBuffer(GL_COPY_READ_BUFFER, VBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, instance.firstVertex * sizeof(Vertex),
+                            packedVertices * sizeof(Vertex), instance.vertexCount * sizeof(Vertex));
+        glBindBuffer(GL_COPY_READ_BUFFER, EBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newEBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, instance.firstIndex * sizeof(unsigned int),
+                            packedIndices * sizeof(unsigned int), instance.indexCount * sizeof(unsigned int));
+        vertexShift[i] = (GLint)packedVertices - instance.firstVertex;
+        indexShift[i] = (GLint)packedIndices - (GLint)instance.firstIndex;
+        packedVertices += instance.vertexCount;
+        packedIndices += instance.indexCount;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    for (size_t i = 0; i < instances.size(); ++i)
+        if (instances[i].live && (size_t)instances[i].firstVertex >= vertexCount) {
+            vertexShift[i] = (GLint)packedVertices - (GLint)vertexCount;
+            indexShift[i] = (GLint)packedIndices - (GLint)indexCount;
+        }
+
+    for (size_t i = 0; i < instances.size(); ++i) {
+        instances[i].firstVertex += vertexShift[i];
+        instances[i].firstIndex += indexShift[i];
+    }
+    for (Group& group : groups)
+        for (size_t i = 0; i < group.draws.size(); ++i) {
+            Draw& draw = group.draws[i];
+            draw.baseVertex += vertexShift[draw.instance];
+            for (int l = 0; l < GLTFModel::maxLods; ++l)
+                draw.lodFirstIndex[l] += indexShift[draw.instance];
+            if (i < group.baseVertices.size()) {
+                group.baseVertices[i] = draw.baseVertex;
+                int lod = std::max(instances[draw.instance].lod, 0);
+                group.offsets[i] = (const void*)(draw.lodFirstIndex[lod] * sizeof(unsigned int));
+            }
+        }
+
+    gpuDeleteBuffer(VBO);
+    gpuDeleteBuffer(EBO);
+    VBO = newVBO;
+    EBO = newEBO;
+    vertexCount = packedVertices;
+    indexCount = packedIndices;
+    vertexCapacity = newVertexCapacity;
+    indexCapacity = newIndexCapacity;
+    deadVertices = deadIndices = 0;
+
+    if (VAO == 0) VAO = gpuCreateVertexArray(GpuOwner::Models, GPU_SITE);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+    glEnableVertexAttribArray(0); // position
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, pos));
+
+    glEnableVertexAttribArray(1); // normal
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+
+    glEnableVertexAttribArray(2); // layer, diffuse strength
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, material));
+
+    glEnableVertexAttribArray(3); // texcoords
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+
+    glBindVertexArray(0);
+}
+
+void StaticBatch::selectLods(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, OcclusionCuller* occlusion)
+{
+    LodSelector& selector = GetLodSelector();
+    glm::vec3 cameraPos = glm::vec3(glm::inverse(viewMatrix)[3]);
+    for (Instance& instance : instances)
+    {
+        if (!instance.live) continue;
+        float distance = glm::length(instance.centre - cameraPos) - instance.radius;
+        instance.lod = selector.select(instance.lodError, instance.lodCount, instance.lod, selector.pixelScale(projectionMatrix, distance));
+        instance.visible = distance <= cullDistance && (!occlusion || occlusion->isVisible(instance.centre - glm::vec3(instance.radius), instance.centre + glm::vec3(instance.radius)));
+    }
+
+    // draws added since the last build have no arguments to rewrite yet
+    for (Group& group : groups)
+        for (size_t i = 0; i < group.counts.size(); ++i)
+        {
+            const Draw& draw = group.draws[i];
+            int lod = instances[draw.instance].lod;
+            group.counts[i] = draw.lodIndexCount[lod];
+            group.visibleCounts[i] = instances[draw.instance].visible ? group.counts[i] : 0;
+            group.offsets[i] = (const void*)(draw.lodFirstIndex[lod] * sizeof(unsigned int));
+        }
+}
+
+void StaticBatch::render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, Shader &program, GLuint shadowMap)
+{
+    glm::mat4 identity(1.0f);
+    program.setMatrix("model", &identity[0][0]);
+    program.setBool("useSkinning", false);
+    program.setBool("useTexture", false);
+    program.setBool("useTextureArray", true);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, shadowMap);
+    program.setInt("shadowMap", 1);
+
+    TextureStreamer& streamer = GetTextureStreamer();
+    drawCalls = 0;
+    glBindVertexArray(VAO);
+    for (const Group& group : groups)
+    {
+        if (group.texture != 0) {
+            float pixels = 0.0f;
+            for (const Draw& draw : group.draws)
+                pixels = std::max(pixels, streamer.projectedSize(draw.centre, draw.radius, viewMatrix, projectionMatrix));
+            streamer.request(group.texture, pixels);
+        }
+
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, group.texture);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, group.visibleCounts.data(), GL_UNSIGNED_INT, group.offsets.data(),
+                                      (GLsizei)group.visibleCounts.size(), group.baseVertices.data());
+        drawCalls++;
+    }
+    glBindVertexArray(0);
+
+    program.setBool("useTextureArray", false);
+}
+
+void StaticBatch::renderDepth(Shader &program)
+{
+    glm::mat4 identity(1.0f);
+    program.setMatrix("model", &identity[0][0]);
+
+    // materials do not matter for depth, but each group is already one call
+    glBindVertexArray(VAO);
+    for (const Group& group : groups)
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, group.counts.data(), GL_UNSIGNED_INT, group.offsets.data(),
+                                      (GLsizei)group.counts.size(), group.baseVertices.data());
+    glBindVertexArray(0);
+}
+
+void StaticBatch::cleanup()
+{
+    gpuDeleteBuffer(VBO);
+    gpuDeleteBuffer(EBO);
+    gpuDeleteVertexArray(VAO);
+    for (Group& group : groups)
+        GetTextureStreamer().release(group.texture);
+    groups.clear();
+    instances.clear();
+    changed.clear();
+    vertices.clear();
+    indices.clear();
+    vertexCount = indexCount = 0;
+    vertexCapacity = indexCapacity = 0;
+    deadVertices = deadIndices = 0;
+}
@@ -0,0 +1,125 @@
+#ifndef _STATIC_BATCH_H_
+#define _STATIC_BATCH_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "shader.h"
+#include "gltfModel.h"
+#include "textureBake.h"
+
+struct OcclusionCuller;
+
+// Static scenery packed into one shared vertex/index arena. Vertices are
+// pre-transformed to world space and carry their material (texture array
+// layer and diffuse strength) in attribute 2, since GL 3.3 has no per-draw
+// id a shader could index uniforms with. Materials of one size and format
+// share a GL_TEXTURE_2D_ARRAY, and all primitives using that array are
+// submitted with a single glMultiDrawElementsBaseVertex. Every added model
+// keeps its LOD chain in the arena and picks its level each frame; the
+// multi-draw arguments are rewritten to match.
+//
+// Models can come and go after the first build: added ones are appended to
+// the arena by the next build, removed ones leave a hole that is only
+// reclaimed when holes outweigh what is live, by copying the live ranges
+// into a new arena on the GPU. A group's texture array is only made again
+// when a model brings in a texture it does not have yet.
+struct StaticBatch
+{
+    struct Vertex {
+        glm::vec3 pos;
+        glm::vec3 normal;
+        glm::vec2 uv;
+        glm::vec2 material; // layer (-1 untextured), diffuse strength
+    };
+
+    struct Draw {
+        GLsizei lodIndexCount[GLTFModel::maxLods];
+        GLuint lodFirstIndex[GLTFModel::maxLods];
+        GLint baseVertex;
+        int instance;           // the model it came from
+        glm::vec3 centre;       // world-space bounding sphere
+        float radius;
+    };
+
+    // One added model; all of its draws use the same level
+    struct Instance {
+        glm::vec3 centre;       // world-space bounding sphere
+        float radius;
+        int lodCount;
+        float lodError[GLTFModel::maxLods]; // world units
+        int lod = -1;
+        bool visible = true;    // not hidden behind occluders or past cullDistance this frame
+        uint32_t owner = 0;     // as passed to add
+        bool live = true;       // false once removed; the slot goes to the next add
+        GLint firstVertex = 0;  // its vertices and indices are one range each in the arena
+        GLsizei vertexCount = 0;
+        GLuint firstIndex = 0;
+        GLsizei indexCount = 0;
+    };
+
+    struct Group {
+        GLuint texture = 0;     // GL_TEXTURE_2D_ARRAY, 0 for untextured or missing images
+        BakedFormat format;
+        glm::ivec2 size;
+        std::vector<GLuint> layers;
+        size_t arrayLayers = 0; // layers in texture, made by the last build
+        std::vector<Draw> draws;
+
+        // multi-draw arguments, rewritten for the selected levels each frame;
+        // the depth pass draws counts, the main pass visibleCounts (0 when occluded);
+        // draws added since the last build have none yet
+        std::vector<GLsizei> counts;
+        std::vector<GLsizei> visibleCounts;
+        std::vector<const void*> offsets;
+        std::vector<GLint> baseVertices;
+    };
+
+    float cullDistance = FLT_MAX;   // models wholly further away are left out of the main pass
+
+    std::vector<Vertex> vertices;       // added since the last build, not uploaded yet
+    std::vector<unsigned int> indices;
+    std::vector<Group> groups;
+    std::vector<Instance> instances;
+
+    // bounding spheres (centre, radius) of the models added or removed since
+    // the caller last cleared it: the static casters a shadow cache has to redraw
+    std::vector<glm::vec4> changed;
+
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    size_t vertexCount = 0, indexCount = 0;         // in the arena, holes included
+    size_t vertexCapacity = 0, indexCapacity = 0;
+    size_t deadVertices = 0, deadIndices = 0;       // left in holes by removed models
+    int drawCalls = 0;  // submissions in the last render
+
+    // Copies the model's primitives into the arena at its current transform,
+    // under owner, for remove. Skinned models keep no CPU geometry and are
+    // skipped (returns false).
+    bool add(const GLTFModel& model, uint32_t owner = 0);
+
+    // Takes the model added under owner back out; false when there is none
+    bool remove(uint32_t owner);
+
+    // Makes the texture arrays that gained layers and uploads what was added
+    // since the last build; call after the last add of a batch of changes
+    void build();
+
+    // Picks each model's level and rewrites the multi-draw arguments,
+    // leaving models the culler finds hidden out of the main pass
+    void selectLods(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, OcclusionCuller* occlusion = nullptr);
+
+    void render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, Shader &program, GLuint shadowMap);
+
+    void renderDepth(Shader &program);
+
+    // Frees the arena and its texture arrays; models can be added again afterwards
+    void cleanup();
+
+private:
+    // Moves the live ranges into new buffers with room for half as much again
+    // as is live and waiting, packed from the start, and points the vertex
+    // array at them
+    void reallocate();
+};
+
+#endif
@@ -1,29 +1,75 @@
 #include "texture.h"
+#include "textureStreamer.h"
+#include "mappedFile.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
+#include <cstring>
 #include <iostream>
+#include <string>
+
+static bool supportsS3TC()
+{
+    static int supported = -1;
+    if (supported < 0)
+    {
+        supported = 0;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (name && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) {
+                supported = 1;
+                break;
+            }
+        }
+    }
+    return supported == 1;
+}
+
+bool BakedFormatSupported(BakedFormat format)
+{
+    return (format != BakedFormat::BC1 && format != BakedFormat::BC3) || supportsS3TC();
+}
+
+bool BakedTextureUsable(const char *baked_file_path)
+{
+    MappedFile file;
+    if (!file.open(baked_file_path)) return false;
+    const BakedTextureHeader* header = validateBakedTexture(file.data, file.size);
+    bool usable = header && BakedFormatSupported((BakedFormat)header->format);
+    file.close();
+    return usable;
+}
 
 GLuint LoadTextureTileBox(const char *texture_file_path) {
-    int w, h, channels;
-    uint8_t* img = stbi_load(texture_file_path, &w, &h, &channels, 3);
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    // every tile asks for the same terrain texture; decode and upload it once
+    TextureStreamer& streamer = GetTextureStreamer();
+    GLuint texture = streamer.find(texture_file_path);
+    if (texture != 0)
+        return texture;
+
+    texture = streamer.acquireBaked(texture_file_path, bakedTexturePath(texture_file_path));
+    if (texture == 0)
+    {
+        int w, h, channels;
+        uint8_t* img = stbi_load(texture_file_path, &w, &h, &channels, 3);
+        if (img) {
+            texture = streamer.acquirePixels(texture_file_path, img, w, h, 3);
+        } else {
+            std::cout << "Failed to load texture " << texture_file_path << std::endl;
+        }
+        stbi_image_free(img);
+    }
+    if (texture == 0)
+        return 0;
 
     // To tile textures on a box, we set wrapping to repeat
+    glBindTexture(GL_TEXTURE_2D, texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    if (img) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, img);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture " << texture_file_path << std::endl;
-    }
-    stbi_image_free(img);
-
     return texture;
-}
\ No newline at end of file
+}
@@ -2,7 +2,25 @@
 #define _TEXTURE_H_
 
 #include <glad/gl.h>
+#include "textureBake.h"
 
+// S3TC enums are not part of the 3.3 core loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Loads an image for tiles and boxes. Prefers a baked .ltex next to the
+// source (see texbake) and shares one streamed GL texture per path.
 GLuint LoadTextureTileBox(const char *texture_file_path);
 
-#endif
\ No newline at end of file
+// Whether this context can sample a baked format
+bool BakedFormatSupported(BakedFormat format);
+
+// Whether a baked .ltex exists, is valid and can be sampled, without
+// uploading anything
+bool BakedTextureUsable(const char *baked_file_path);
+
+#endif
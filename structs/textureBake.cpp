@@ -0,0 +1,277 @@
+#include "textureBake.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+std::string bakedTexturePath(const std::string& sourcePath)
+{
+    size_t dot = sourcePath.find_last_of('.');
+    size_t slash = sourcePath.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return sourcePath + ".ltex";
+    return sourcePath.substr(0, dot) + ".ltex";
+}
+
+void buildMipChain(const unsigned char* pixels, int width, int height, int channels,
+                   std::vector<std::vector<unsigned char>>& levels)
+{
+    levels.clear();
+    levels.emplace_back(pixels, pixels + (size_t)width * height * channels);
+
+    while (width > 1 || height > 1)
+    {
+        int nextWidth = std::max(1, width / 2);
+        int nextHeight = std::max(1, height / 2);
+        const std::vector<unsigned char>& src = levels.back();
+        std::vector<unsigned char> dst((size_t)nextWidth * nextHeight * channels);
+
+        // 2x2 box filter; odd edges reuse the last row/column
+        for (int y = 0; y < nextHeight; ++y)
+        {
+            int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+            for (int x = 0; x < nextWidth; ++x)
+            {
+                int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                for (int c = 0; c < channels; ++c)
+                {
+                    int sum = src[((size_t)y0 * width + x0) * channels + c] + src[((size_t)y0 * width + x1) * channels + c]
+                            + src[((size_t)y1 * width + x0) * channels + c] + src[((size_t)y1 * width + x1) * channels + c];
+                    dst[((size_t)y * nextWidth + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+
+        levels.push_back(std::move(dst));
+        width = nextWidth;
+        height = nextHeight;
+    }
+}
+
+static uint16_t packRGB565(const int* rgb)
+{
+    return (uint16_t)(((rgb[0] * 31 + 127) / 255) << 11 | ((rgb[1] * 63 + 127) / 255) << 5 | ((rgb[2] * 31 + 127) / 255));
+}
+
+static void unpackRGB565(uint16_t c, int* rgb)
+{
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Endpoints from the inset bounding box of the block's colours, indices from
+// the nearest of the four palette entries
+static void compressColourBlock(const unsigned char block[16][4], unsigned char* out)
+{
+    int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c) {
+            lo[c] = std::min(lo[c], (int)block[i][c]);
+            hi[c] = std::max(hi[c], (int)block[i][c]);
+        }
+    for (int c = 0; c < 3; ++c) {
+        int inset = (hi[c] - lo[c]) / 16;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+
+    uint16_t c0 = packRGB565(hi), c1 = packRGB565(lo);
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        if (c0 < c1) std::swap(c0, c1); // c0 > c1 selects the four-colour mode
+
+        int palette[4][3];
+        unpackRGB565(c0, palette[0]);
+        unpackRGB565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 4; ++p)
+            {
+                int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance) { bestDistance = distance; best = p; }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    out[0] = c0 & 0xff; out[1] = c0 >> 8;
+    out[2] = c1 & 0xff; out[3] = c1 >> 8;
+    for (int i = 0; i < 4; ++i) out[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+// Eight-value alpha block (a0 > a1)
+static void compressAlphaBlock(const unsigned char block[16][4], unsigned char* out)
+{
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        a0 = std::max(a0, (int)block[i][3]);
+        a1 = std::min(a1, (int)block[i][3]);
+    }
+
+    uint64_t indices = 0;
+    if (a0 != a1)
+    {
+        int palette[8] = {a0, a1};
+        for (int p = 1; p < 7; ++p)
+            palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0, bestDistance = 256;
+            for (int p = 0; p < 8; ++p)
+            {
+                int distance = std::abs(block[i][3] - palette[p]);
+                if (distance < bestDistance) { bestDistance = distance; best = p; }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+    for (int i = 0; i < 6; ++i) out[2 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+void compressLevel(const unsigned char* pixels, int width, int height, int channels,
+                   std::vector<unsigned char>& blocks)
+{
+    int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    int blockBytes = channels == 4 ? 16 : 8;
+    blocks.assign((size_t)blocksX * blocksY * blockBytes, 0);
+
+    unsigned char block[16][4];
+    for (int by = 0; by < blocksY; ++by)
+    {
+        for (int bx = 0; bx < blocksX; ++bx)
+        {
+            // blocks overhanging a small mip repeat its edge pixels
+            for (int i = 0; i < 16; ++i)
+            {
+                int x = std::min(bx * 4 + (i & 3), width - 1);
+                int y = std::min(by * 4 + (i >> 2), height - 1);
+                const unsigned char* p = pixels + ((size_t)y * width + x) * channels;
+                block[i][0] = p[0];
+                block[i][1] = p[1];
+                block[i][2] = p[2];
+                block[i][3] = channels == 4 ? p[3] : 255;
+            }
+
+            unsigned char* out = &blocks[((size_t)by * blocksX + bx) * blockBytes];
+            if (channels == 4) {
+                compressAlphaBlock(block, out);
+                out += 8;
+            }
+            compressColourBlock(block, out);
+        }
+    }
+}
+
+void bakeTexture(const unsigned char* pixels, int width, int height, int channels, bool compress,
+                 std::vector<unsigned char>& container)
+{
+    // drop an alpha channel that carries nothing
+    std::vector<unsigned char> rgb;
+    if (channels == 4)
+    {
+        bool opaque = true;
+        for (size_t i = 0; i < (size_t)width * height && opaque; ++i)
+            opaque = pixels[i * 4 + 3] == 255;
+        if (opaque)
+        {
+            rgb.resize((size_t)width * height * 3);
+            for (size_t i = 0; i < (size_t)width * height; ++i)
+                memcpy(&rgb[i * 3], &pixels[i * 4], 3);
+            pixels = rgb.data();
+            channels = 3;
+        }
+    }
+
+    std::vector<std::vector<unsigned char>> levels;
+    buildMipChain(pixels, width, height, channels, levels);
+
+    BakedFormat format;
+    if (compress) {
+        format = channels == 4 ? BakedFormat::BC3 : BakedFormat::BC1;
+        int w = width, h = height;
+        for (std::vector<unsigned char>& level : levels)
+        {
+            std::vector<unsigned char> blocks;
+            compressLevel(level.data(), w, h, channels, blocks);
+            level.swap(blocks);
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+    } else {
+        format = channels == 4 ? BakedFormat::RGBA8 : BakedFormat::RGB8;
+    }
+
+    BakedTextureHeader header;
+    memcpy(header.magic, "LTEX", 4);
+    header.version = bakedTextureVersion;
+    header.format = (uint32_t)format;
+    header.width = width;
+    header.height = height;
+    header.levels = (uint32_t)levels.size();
+
+    std::vector<BakedTextureLevel> table(levels.size());
+    uint64_t offset = sizeof(header) + table.size() * sizeof(BakedTextureLevel);
+    int w = width, h = height;
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        offset = (offset + 15) & ~(uint64_t)15;
+        table[i] = {(uint32_t)w, (uint32_t)h, offset, levels[i].size()};
+        offset += levels[i].size();
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+
+    container.assign(offset, 0);
+    memcpy(container.data(), &header, sizeof(header));
+    memcpy(container.data() + sizeof(header), table.data(), table.size() * sizeof(BakedTextureLevel));
+    for (size_t i = 0; i < levels.size(); ++i)
+        memcpy(container.data() + table[i].offset, levels[i].data(), levels[i].size());
+}
+
+// Bytes a level of that size takes in format: 4x4 blocks for BC, tightly packed pixels otherwise
+static uint64_t levelBytes(BakedFormat format, uint64_t width, uint64_t height)
+{
+    switch (format) {
+        case BakedFormat::RGB8: return width * height * 3;
+        case BakedFormat::RGBA8: return width * height * 4;
+        case BakedFormat::BC1: return ((width + 3) / 4) * ((height + 3) / 4) * 8;
+        case BakedFormat::BC3: return ((width + 3) / 4) * ((height + 3) / 4) * 16;
+    }
+    return 0;
+}
+
+const BakedTextureHeader* validateBakedTexture(const void* data, size_t size)
+{
+    if (!data || size < sizeof(BakedTextureHeader)) return nullptr;
+
+    const BakedTextureHeader* header = static_cast<const BakedTextureHeader*>(data);
+    if (memcmp(header->magic, "LTEX", 4) != 0 || header->version != bakedTextureVersion) return nullptr;
+    if (header->format > (uint32_t)BakedFormat::BC3 || header->levels == 0 || header->levels > 32) return nullptr;
+
+    size_t tableEnd = sizeof(BakedTextureHeader) + header->levels * sizeof(BakedTextureLevel);
+    if (size < tableEnd) return nullptr;
+
+    // every level must hold exactly what its size needs, or the upload reads past the data
+    const BakedTextureLevel* levels = reinterpret_cast<const BakedTextureLevel*>(header + 1);
+    for (uint32_t i = 0; i < header->levels; ++i) {
+        const BakedTextureLevel& level = levels[i];
+        if (level.width == 0 || level.height == 0 || level.width > 65536 || level.height > 65536) return nullptr;
+        if (level.offset < tableEnd || level.offset > size || level.size > size - level.offset) return nullptr;
+        if (level.size != levelBytes((BakedFormat)header->format, level.width, level.height)) return nullptr;
+    }
+    return header;
+}
@@ -0,0 +1,59 @@
+#ifndef _TEXTURE_BAKE_H_
+#define _TEXTURE_BAKE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// .ltex: GPU-ready texture container written by texbake and streamed by
+// TextureStreamer. All mip levels are stored, smallest last, so the runtime
+// uploads them as-is with no decoding or mip generation.
+//
+//   BakedTextureHeader
+//   BakedTextureLevel[levels]
+//   level data, each level 16-byte aligned
+
+enum class BakedFormat : uint32_t {RGB8 = 0, RGBA8 = 1, BC1 = 2, BC3 = 3};
+
+struct BakedTextureHeader
+{
+    char magic[4];      // "LTEX"
+    uint32_t version;
+    uint32_t format;    // BakedFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;
+};
+
+struct BakedTextureLevel
+{
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;    // from the start of the file
+    uint64_t size;
+};
+
+static const uint32_t bakedTextureVersion = 1;
+
+// Path of the baked container for a source image: same name, .ltex extension
+std::string bakedTexturePath(const std::string& sourcePath);
+
+// Full mip chain of an 8-bit image with 3 or 4 channels, box filtered.
+// Level 0 is a copy of the source.
+void buildMipChain(const unsigned char* pixels, int width, int height, int channels,
+                   std::vector<std::vector<unsigned char>>& levels);
+
+// BC1 (3 channels) or BC3 (4 channels) blocks for one level
+void compressLevel(const unsigned char* pixels, int width, int height, int channels,
+                   std::vector<unsigned char>& blocks);
+
+// Builds the container in memory. Images whose alpha is fully opaque are
+// stored without it.
+void bakeTexture(const unsigned char* pixels, int width, int height, int channels, bool compress,
+                 std::vector<unsigned char>& container);
+
+// Checks magic, version, that the level table lies inside the data and that
+// every level is inside it too and exactly the size its dimensions and format need
+const BakedTextureHeader* validateBakedTexture(const void* data, size_t size);
+
+#endif
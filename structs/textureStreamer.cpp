@@ -0,0 +1,342 @@
+#include "textureStreamer.h"
+#include "texture.h"
+#include "profiler.h"
+#include "gpuResources.h"
+#include "frameArena.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+TextureStreamer& GetTextureStreamer()
+{
+    static TextureStreamer streamer;
+    return streamer;
+}
+
+GLuint TextureStreamer::find(const std::string& key) const
+{
+    auto it = byKey.find(key);
+    return it == byKey.end() ? 0 : it->second;
+}
+
+GLuint TextureStreamer::acquireBaked(const std::string& key, const std::string& bakedPath)
+{
+    MappedFile file;
+    if (!file.open(bakedPath.c_str())) return 0;
+
+    const BakedTextureHeader* header = validateBakedTexture(file.data, file.size);
+    if (!header) {
+        std::cerr << "Invalid baked texture " << bakedPath << std::endl;
+        file.close();
+        return 0;
+    }
+    if (!BakedFormatSupported((BakedFormat)header->format)) {
+        file.close();
+        return 0;
+    }
+
+    Entry entry;
+    entry.format = (BakedFormat)header->format;
+    entry.levels = header->levels;
+    entry.file = std::move(file);
+
+    // the mapping itself moved, so header and levels still point into it
+    const BakedTextureLevel* levels = reinterpret_cast<const BakedTextureLevel*>(header + 1);
+    for (uint32_t i = 0; i < header->levels; ++i) {
+        entry.levelSize.push_back(glm::ivec2(levels[i].width, levels[i].height));
+        entry.levelData.push_back(entry.file.data + levels[i].offset);
+        entry.levelBytes.push_back(levels[i].size);
+    }
+    return createEntry(key, entry);
+}
+
+GLuint TextureStreamer::acquirePixels(const std::string& key, const unsigned char* pixels, int width, int height, int channels)
+{
+    if (!pixels || (channels != 3 && channels != 4)) return 0;
+
+    Entry entry;
+    entry.format = channels == 4 ? BakedFormat::RGBA8 : BakedFormat::RGB8;
+    buildMipChain(pixels, width, height, channels, entry.cpuLevels);
+    entry.levels = (int)entry.cpuLevels.size();
+
+    for (std::vector<unsigned char>& level : entry.cpuLevels) {
+        entry.levelSize.push_back(glm::ivec2(width, height));
+        entry.levelData.push_back(level.data()); // inner buffers survive moving the entry
+        entry.levelBytes.push_back(level.size());
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return createEntry(key, entry);
+}
+
+GLuint TextureStreamer::acquireArray(const std::string& key, const std::vector<GLuint>& sources)
+{
+    std::vector<const Entry*> layers;
+    for (GLuint source : sources)
+    {
+        const Entry* layer = entry(source);
+        if (!layer || layer->target != GL_TEXTURE_2D) return 0;
+        if (!layers.empty() && (layer->format != layers[0]->format || layer->levelSize[0] != layers[0]->levelSize[0])) return 0;
+        layers.push_back(layer);
+    }
+    if (layers.empty()) return 0;
+
+    Entry array;
+    array.target = GL_TEXTURE_2D_ARRAY;
+    array.layers = (int)layers.size();
+    array.format = layers[0]->format;
+    array.levels = layers[0]->levels;
+    array.levelSize = layers[0]->levelSize;
+    array.layerSources = sources;
+    for (int i = 0; i < array.levels; ++i)
+        array.levelBytes.push_back(layers[0]->levelBytes[i] * layers.size());
+    return createEntry(key, array);
+}
+
+void TextureStreamer::release(GLuint texture)
+{
+    auto it = entries.find(texture);
+    if (it == entries.end()) return;
+    Entry& entry = it->second;
+    for (int i = entry.residentTop; i < entry.levels; ++i)
+        residentBytes -= entry.levelBytes[i];
+    gpuDeleteTexture(entry.texture);
+    entry.file.close();
+    entries.erase(it);
+    for (auto key = byKey.begin(); key != byKey.end(); ++key)
+        if (key->second == texture) {
+            byKey.erase(key);
+            break;
+        }
+}
+
+const TextureStreamer::Entry* TextureStreamer::entry(GLuint texture) const
+{
+    auto it = entries.find(texture);
+    return it == entries.end() ? nullptr : &it->second;
+}
+
+GLuint TextureStreamer::createEntry(const std::string& key, Entry& source)
+{
+    GLuint texture = gpuCreateTexture(GpuOwner::Textures, GPU_SITE);
+    Entry& entry = entries[texture];
+    entry = std::move(source);
+    entry.texture = texture;
+
+    entry.tailLevel = entry.levels - 1;
+    for (int i = 0; i < entry.levels; ++i)
+        if (std::max(entry.levelSize[i].x, entry.levelSize[i].y) <= tailSize) {
+            entry.tailLevel = i;
+            break;
+        }
+
+    glBindTexture(entry.target, texture);
+    glTexParameteri(entry.target, GL_TEXTURE_MAX_LEVEL, entry.levels - 1);
+
+    // the tail is small enough to upload at once and keeps the texture complete
+    entry.residentTop = entry.levels;
+    for (int i = entry.levels - 1; i >= entry.tailLevel; --i)
+        uploadLevel(entry, i);
+    entry.wantedTop = entry.tailLevel;
+
+    byKey[key] = texture;
+    peakResidentBytes = std::max(peakResidentBytes, residentBytes);
+    return texture;
+}
+
+void TextureStreamer::uploadLevel(Entry& entry, int level)
+{
+    const glm::ivec2& size = entry.levelSize[level];
+    GLsizei bytes = (GLsizei)entry.levelBytes[level];
+
+    glBindTexture(entry.target, entry.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // RGB8 rows of small mips are not 4-byte aligned
+    if (entry.target == GL_TEXTURE_2D_ARRAY)
+    {
+        // the level is made empty, then filled a layer at a time from the sources
+        GLenum compressed = entry.format == BakedFormat::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        switch (entry.format)
+        {
+            case BakedFormat::RGB8:
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGB, size.x, size.y, entry.layers, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+                break;
+            case BakedFormat::RGBA8:
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, size.x, size.y, entry.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                break;
+            case BakedFormat::BC1:
+            case BakedFormat::BC3:
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, compressed, size.x, size.y, entry.layers, 0, bytes, nullptr);
+                break;
+        }
+        for (int layer = 0; layer < entry.layers; ++layer)
+        {
+            const Entry* source = this->entry(entry.layerSources[layer]);
+            if (!source) continue; // released too early; the layer stays undefined
+            const void* pixels = source->levelData[level];
+            switch (entry.format)
+            {
+                case BakedFormat::RGB8:
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, size.x, size.y, 1, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+                    break;
+                case BakedFormat::RGBA8:
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, size.x, size.y, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+                    break;
+                case BakedFormat::BC1:
+                case BakedFormat::BC3:
+                    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, size.x, size.y, 1, compressed,
+                                              (GLsizei)source->levelBytes[level], pixels);
+                    break;
+            }
+        }
+    }
+    else
+    {
+        const void* pixels = entry.levelData[level];
+        switch (entry.format)
+        {
+            case BakedFormat::RGB8:
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, size.x, size.y, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+                break;
+            case BakedFormat::RGBA8:
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+                break;
+            case BakedFormat::BC1:
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, size.x, size.y, 0, bytes, pixels);
+                break;
+            case BakedFormat::BC3:
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, size.x, size.y, 0, bytes, pixels);
+                break;
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    entry.residentTop = level;
+    glTexParameteri(entry.target, GL_TEXTURE_BASE_LEVEL, level);
+    residentBytes += entry.levelBytes[level];
+    GetGpuResources().addBytes(GpuKind::Texture, entry.texture, (ptrdiff_t)entry.levelBytes[level]);
+}
+
+void TextureStreamer::evictLevel(Entry& entry)
+{
+    int level = entry.residentTop;
+
+    // levels below GL_TEXTURE_BASE_LEVEL do not count towards completeness,
+    // so respecifying one as empty releases it without touching the rest
+    glBindTexture(entry.target, entry.texture);
+    glTexParameteri(entry.target, GL_TEXTURE_BASE_LEVEL, level + 1);
+    if (entry.target == GL_TEXTURE_2D_ARRAY)
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    else
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    entry.residentTop = level + 1;
+    residentBytes -= entry.levelBytes[level];
+    GetGpuResources().addBytes(GpuKind::Texture, entry.texture, -(ptrdiff_t)entry.levelBytes[level]);
+    evictionsLastFrame++;
+}
+
+void TextureStreamer::request(GLuint texture, float screenPixels)
+{
+    auto it = entries.find(texture);
+    if (it == entries.end()) return;
+    Entry& entry = it->second;
+
+    if (entry.lastRequested != frame) {
+        entry.lastRequested = frame;
+        entry.priority = 0.0f;
+    }
+    if (screenPixels <= entry.priority) return;
+    entry.priority = screenPixels;
+
+    // one texel per pixel across the object's footprint
+    float texels = (float)std::max(entry.levelSize[0].x, entry.levelSize[0].y);
+    float level = std::log2(texels / std::max(screenPixels, 1.0f)) + detailBias;
+    entry.wantedTop = std::clamp((int)std::floor(level), 0, entry.tailLevel);
+}
+
+float TextureStreamer::projectedSize(const glm::vec3& centre, float radius, const glm::mat4& view, const glm::mat4& projection) const
+{
+    float depth = -(view * glm::vec4(centre, 1.0f)).z;
+    if (depth <= radius) return (float)viewportHeight; // camera inside or touching the bounds
+    return 2.0f * radius / depth * projection[1][1] * 0.5f * viewportHeight;
+}
+
+bool TextureStreamer::makeRoom(size_t bytes, const Entry* requester)
+{
+    while (residentBytes + bytes > budgetBytes)
+    {
+        // detail nothing asked for this frame goes first, then the least visible
+        Entry* victim = nullptr;
+        for (auto& [texture, entry] : entries)
+        {
+            if (&entry == requester || entry.residentTop >= entry.tailLevel) continue;
+            if (requester && entry.residentTop >= entry.wantedTop && entry.priority >= requester->priority) continue;
+
+            bool surplus = entry.residentTop < entry.wantedTop;
+            if (!victim) { victim = &entry; continue; }
+
+            bool victimSurplus = victim->residentTop < victim->wantedTop;
+            if (surplus != victimSurplus) {
+                if (surplus) victim = &entry;
+            } else if (entry.priority < victim->priority
+                       || (entry.priority == victim->priority && entry.lastRequested < victim->lastRequested)) {
+                victim = &entry;
+            }
+        }
+        if (!victim) return false;
+        evictLevel(*victim);
+    }
+    return true;
+}
+
+void TextureStreamer::update()
+{
+    PROFILE_SCOPE("texture_streaming");
+    uploadsLastFrame = 0;
+    evictionsLastFrame = 0;
+
+    FrameVector<Entry*> pending;
+    for (auto& [texture, entry] : entries)
+    {
+        if (entry.lastRequested != frame) {
+            entry.wantedTop = entry.tailLevel;
+            entry.priority = 0.0f;
+        }
+        if (entry.residentTop > entry.wantedTop)
+            pending.push_back(&entry);
+    }
+    std::sort(pending.begin(), pending.end(), [](const Entry* a, const Entry* b) { return a->priority > b->priority; });
+
+    // refine coarse to fine, largest on screen first, a few levels per frame
+    for (Entry* entry : pending)
+    {
+        while (entry->residentTop > entry->wantedTop && uploadsLastFrame < uploadsPerFrame)
+        {
+            int level = entry->residentTop - 1;
+            if (!makeRoom(entry->levelBytes[level], entry)) break;
+            uploadLevel(*entry, level);
+            uploadsLastFrame++;
+        }
+        if (uploadsLastFrame == uploadsPerFrame) break;
+    }
+
+    // the budget may have been lowered since the last frame
+    if (residentBytes > budgetBytes)
+        makeRoom(0, nullptr);
+
+    peakResidentBytes = std::max(peakResidentBytes, residentBytes);
+    frame++;
+}
+
+void TextureStreamer::cleanup()
+{
+    for (auto& [texture, entry] : entries) {
+        gpuDeleteTexture(entry.texture);
+        entry.file.close();
+    }
+    entries.clear();
+    byKey.clear();
+    residentBytes = 0;
+}
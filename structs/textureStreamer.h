@@ -0,0 +1,99 @@
+#ifndef _TEXTURE_STREAMER_H_
+#define _TEXTURE_STREAMER_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "mappedFile.h"
+#include "textureBake.h"
+
+// Mip residency for shared textures. Only the small tail of the mip chain is
+// uploaded when a texture is created; finer levels are streamed in (a few
+// per frame) as objects using the texture get large on screen, and the
+// finest levels of the least important textures are dropped again when the
+// resident total exceeds the budget. GL_TEXTURE_BASE_LEVEL always points at
+// the finest resident level, so texture names stay valid throughout.
+struct TextureStreamer
+{
+    struct Entry {
+        GLuint texture = 0;
+        GLenum target = GL_TEXTURE_2D;
+        int layers = 1;
+        BakedFormat format;
+        int levels = 0;
+        std::vector<glm::ivec2> levelSize;
+        std::vector<const unsigned char*> levelData;    // empty for an array
+        std::vector<size_t> levelBytes;                 // every layer's, for an array
+
+        // GL_TEXTURE_2D_ARRAY: the entries layer i is uploaded from, straight
+        // out of their level data, so an array keeps no copy of its own
+        std::vector<GLuint> layerSources;
+
+        MappedFile file;                                  // baked source
+        std::vector<std::vector<unsigned char>> cpuLevels; // decoded source
+
+        int tailLevel = 0;      // first level that is always resident
+        int residentTop = 0;    // finest resident level
+        int wantedTop = 0;      // finest level requested this frame
+        float priority = 0.0f;  // largest on-screen size requested this frame, in pixels
+        int lastRequested = -1; // frame of the last request
+    };
+
+    size_t budgetBytes = 128 * 1024 * 1024;
+    int uploadsPerFrame = 4;      // mip levels uploaded per update
+    int tailSize = 64;            // levels this size or smaller are always resident
+    float detailBias = 0.0f;      // added to the wanted level; positive = blurrier
+    int viewportHeight = 768;
+
+    size_t residentBytes = 0;
+    size_t peakResidentBytes = 0;
+    int uploadsLastFrame = 0;
+    int evictionsLastFrame = 0;
+
+    std::map<std::string, GLuint> byKey;
+    std::unordered_map<GLuint, Entry> entries;
+    int frame = 0;
+
+    GLuint find(const std::string& key) const;
+
+    // Streams from a memory-mapped .ltex; 0 if it is missing or unusable
+    GLuint acquireBaked(const std::string& key, const std::string& bakedPath);
+
+    // Builds a mip chain from decoded 8-bit RGB/RGBA pixels and streams from it
+    GLuint acquirePixels(const std::string& key, const unsigned char* pixels, int width, int height, int channels);
+
+    // Stacks 2D textures of one size and format into a GL_TEXTURE_2D_ARRAY,
+    // layer i taken from sources[i]; 0 if they differ. The sources must stay
+    // acquired while the array is, as its levels are uploaded from theirs.
+    GLuint acquireArray(const std::string& key, const std::vector<GLuint>& sources);
+
+    // Deletes a texture acquired here once nothing samples it any more
+    void release(GLuint texture);
+
+    const Entry* entry(GLuint texture) const;
+
+    // An object covering screenPixels (projected diameter) samples texture this frame
+    void request(GLuint texture, float screenPixels);
+
+    // Projected diameter in pixels of a bounding sphere
+    float projectedSize(const glm::vec3& centre, float radius, const glm::mat4& view, const glm::mat4& projection) const;
+
+    // Uploads and evicts levels for this frame's requests
+    void update();
+
+    void cleanup();
+
+private:
+    GLuint createEntry(const std::string& key, Entry& entry);
+    void uploadLevel(Entry& entry, int level);
+    void evictLevel(Entry& entry);
+    bool makeRoom(size_t bytes, const Entry* requester);
+};
+
+// Process-wide streamer shared by tiles and models
+TextureStreamer& GetTextureStreamer();
+
+#endif
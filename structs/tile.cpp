@@ -1,78 +1,143 @@
 #include "tile.h"
 #include "texture.h"
 #include <iostream>
+#include <vector>
 
 #include <glm/gtc/matrix_transform.hpp>
 
-const GLfloat Tile::vertices[12] = {
-    // to have position as center rather than front left:
-    -0.5f, 0.0f, 0.5f, // front left
-    0.5f, 0.0f, 0.5f, // front right
-    0.5f, 0.0f, -0.5f, // back right
-    -0.5f, 0.0f, -0.5f // back left
-};
-
-const GLfloat Tile::normals[12] = {
-    0.0f, 1.0f, 0.0f, // front left
-    0.0f, 1.0f, 0.0f, // front right
-    0.0f, 1.0f, 0.0f, // back right
-    0.0f, 1.0f, 0.0f  // back left
-};
-
-const GLfloat Tile::colours[12] = {
-    1.0f, 0.0f, 1.0f,
-    1.0f, 0.0f, 1.0f,
-    1.0f, 0.0f, 1.0f,
-    1.0f, 0.0f, 1.0f
-};
-
-const GLfloat Tile::uv[8] = {
-    0.0f, 0.0f,
-    1.0f, 0.0f,
-    1.0f, 1.0f,
-    0.0f, 1.0f
-};
-
-const GLint Tile::indices[6] = {
-    0, 1, 2,
-    0, 2, 3
-};
-
-void Tile::initialise(glm::vec3 position, Shader program, const char* texture_path)
+GlVertexArray Tile::meshVAO;
+GlBuffer Tile::meshVBO;
+GlBuffer Tile::lodEBO;
+GLsizei Tile::lodIndexCount[Tile::lodCount];
+GLsizei Tile::lodIndexOffset[Tile::lodCount];
+
+static const int rowLength = Tile::gridSize + 1;
+
+static GLuint gridIndex(int ix, int iz)
 {
-    this->position = position;
-    hasTexture = true;
+    return iz * rowLength + ix;
+}
+
+// skirt vertices follow the grid: back, front, left, right edge
+static GLuint skirtIndex(int edge, int i)
+{
+    return rowLength * rowLength + edge * rowLength + i;
+}
+
+void Tile::initialiseMesh(const Heightfield& heights)
+{
+    std::vector<GLuint> indices;
+    for (int lod = 0; lod < lodCount; ++lod)
+    {
+        lodIndexOffset[lod] = (GLsizei)indices.size();
+        int step = 1 << lod;
+
+        // counter-clockwise seen from above
+        for (int iz = 0; iz < gridSize; iz += step)
+            for (int ix = 0; ix < gridSize; ix += step)
+            {
+                GLuint a = gridIndex(ix, iz), b = gridIndex(ix + step, iz);
+                GLuint c = gridIndex(ix + step, iz + step), d = gridIndex(ix, iz + step);
+                indices.insert(indices.end(), {a, d, c, a, c, b});
+            }
+
+        // skirt quads facing away from the tile
+        for (int i = 0; i < gridSize; i += step)
+        {
+            GLuint a, b, as, bs;
+
+            a = gridIndex(i, 0); b = gridIndex(i + step, 0); as = skirtIndex(0, i); bs = skirtIndex(0, i + step);
+            indices.insert(indices.end(), {a, b, bs, a, bs, as});
+
+            a = gridIndex(i, gridSize); b = gridIndex(i + step, gridSize); as = skirtIndex(1, i); bs = skirtIndex(1, i + step);
+            indices.insert(indices.end(), {a, bs, b, a, as, bs});
+
+            a = gridIndex(0, i); b = gridIndex(0, i + step); as = skirtIndex(2, i); bs = skirtIndex(2, i + step);
+            indices.insert(indices.end(), {a, bs, b, a, as, bs});
+
+            a = gridIndex(gridSize, i); b = gridIndex(gridSize, i + step); as = skirtIndex(3, i); bs = skirtIndex(3, i + step);
+            indices.insert(indices.end(), {a, b, bs, a, bs, as});
+        }
+        lodIndexCount[lod] = (GLsizei)indices.size() - lodIndexOffset[lod];
+    }
+
+    std::vector<Vertex> vertices(vertexCount);
+    buildVertices(heights, vertices.data());
 
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+    meshVAO = GlVertexArray::create(GpuOwner::Tiles, GPU_SITE);
+    glBindVertexArray(meshVAO);
 
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    meshVBO = GlBuffer::create(GpuOwner::Tiles, GPU_SITE);
+    glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+    gpuBufferData(GL_ARRAY_BUFFER, meshVBO, vertexCount * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
 
-    glGenBuffers(1, &NBO);
-    glBindBuffer(GL_ARRAY_BUFFER, NBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(normals), normals, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, pos));
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+
+    lodEBO = GlBuffer::create(GpuOwner::Tiles, GPU_SITE);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lodEBO);
+    gpuBufferData(GL_ELEMENT_ARRAY_BUFFER, lodEBO, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+}
 
-    glGenBuffers(1, &CBO);
-    glBindBuffer(GL_ARRAY_BUFFER, CBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(colours), colours, GL_STATIC_DRAW);
+void Tile::cleanupMesh()
+{
+    meshVAO.reset();
+    meshVBO.reset();
+    lodEBO.reset();
+}
 
-    glGenBuffers(1, &UVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, UVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(uv), uv, GL_STATIC_DRAW);
+void Tile::buildVertices(const Heightfield& heights, Vertex* vertices)
+{
+    // the texture spans the tile with v = 0 at the front (+z) edge. Heights
+    // are sampled once each, with a one-vertex border for the normals.
+    float spacing = tileSize / gridSize;
+    float du = 1.0f / gridSize;
+    const int border = rowLength + 2;
+    std::vector<float> h(border * border);
+    for (int iz = -1; iz <= gridSize + 1; ++iz)
+        for (int ix = -1; ix <= gridSize + 1; ++ix)
+            h[(iz + 1) * border + ix + 1] = heights.sample(ix * du, 1.0f - iz * du);
+    auto height = [&](int ix, int iz) { return h[(iz + 1) * border + ix + 1]; };
+
+    for (int iz = 0; iz <= gridSize; ++iz)
+        for (int ix = 0; ix <= gridSize; ++ix)
+        {
+            Vertex& vertex = vertices[gridIndex(ix, iz)];
+            vertex.pos = glm::vec3(ix * spacing - 0.5f * tileSize, height(ix, iz), iz * spacing - 0.5f * tileSize);
+            vertex.uv = glm::vec2(ix * du, 1.0f - iz * du);
+
+            // central differences
+            float dx = height(ix + 1, iz) - height(ix - 1, iz);
+            float dz = height(ix, iz + 1) - height(ix, iz - 1);
+            vertex.normal = glm::normalize(glm::vec3(-dx, 2.0f * spacing, -dz));
+        }
+
+    for (int i = 0; i <= gridSize; ++i)
+    {
+        const GLuint edges[4] = {gridIndex(i, 0), gridIndex(i, gridSize), gridIndex(0, i), gridIndex(gridSize, i)};
+        for (int edge = 0; edge < 4; ++edge) {
+            Vertex& skirt = vertices[skirtIndex(edge, i)];
+            skirt = vertices[edges[edge]];
+            skirt.pos.y -= skirtDepth;
+        }
+    }
+}
 
-    glGenBuffers(1, &EBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+void Tile::load(glm::vec3 position, const char* texture_path)
+{
+    this->position = position;
 
     if (texture_path == nullptr || texture_path[0] == '\0')
     {
         hasTexture = false;
-        // Create a vertex buffer object to store the color data
-        glGenBuffers(1, &CBO);
-        glBindBuffer(GL_ARRAY_BUFFER, CBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(colours), colours, GL_STATIC_DRAW);
+        textureID = 0;
     }
     else
     {
@@ -81,99 +146,35 @@ void Tile::initialise(glm::vec3 position, Shader program, const char* texture_pa
         if (!glIsTexture(textureID))
             std::cerr << "Invalid texture loaded from " << texture_path << std::endl;
     }
-
-    /*normalID = LoadTextureTileBox(normal_path);
-    if (!glIsTexture(normalID))
-        std::cerr << "Invalid texture loaded from " << texture_path << std::endl;*/
 }
 
-void Tile::render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, Shader &program)
+void Tile::render(int lod, Shader &program)
 {
     program.setBool("useSkinning", false);
-    glBindVertexArray(VAO);
-
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, NBO);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    if (hasTexture == false) {
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, CBO);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    }
-    else
+    if (hasTexture)
     {
         // set texture sampler to use texture unit 0
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, textureID);
-        //textureSamplerID = glGetUniformLocation(shaderID, "textureSampler");
-        //glUniform1i(textureSamplerID, 0);
         program.setInt("textureSampler", 0);
     }
     program.setBool("useTexture", hasTexture);
-    //mvpMatrixID = glGetUniformLocation(shaderID, "MVP");
-
-    glm::mat4 modelMatrix = glm::mat4(1.0f);
-    modelMatrix = glm::translate(modelMatrix, position);  // Apply translation
-    modelMatrix = glm::scale(modelMatrix, glm::vec3(tileSize, 1, tileSize));
-    // Calculate MVP matrix
-
 
-    // Send MVP matrix to the shader
-    //glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &MVP[0][0]);
-    //program.setMatrix("MVP", &mvp[0][0]);
+    glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), position);
     program.setMatrix("model", &modelMatrix[0][0]);
 
-    glEnableVertexAttribArray(3);
-    glBindBuffer(GL_ARRAY_BUFFER, UVBO);
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glEnableVertexAttribArray(4);
-    glVertexAttrib4f(4, 0.0f, 0.0f, 0.0f, 0.0f); // set joint indices at 0
-
-    glEnableVertexAttribArray(5);
-    glVertexAttrib4f(5, 0.0f, 0.0f, 0.0f, 0.0f); // set joint weights at -
-
-    /* set normal sampler to use texture unit 1
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalID);
-    program.setInt("normalSampler", 1);*/
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, (void*)0);
-
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(2);
-    glDisableVertexAttribArray(3);
-    glDisableVertexAttribArray(4);
-    glDisableVertexAttribArray(5);
+    glBindVertexArray(meshVAO);
+    glDrawElements(GL_TRIANGLES, lodIndexCount[lod], GL_UNSIGNED_INT, (void*)(lodIndexOffset[lod] * sizeof(GLuint)));
+    glBindVertexArray(0);
 }
 
-void Tile::renderDepth(Shader& program)
+void Tile::renderDepth(int lod, Shader& program)
 {
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-
     glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), position);
-    modelMatrix = glm::scale(modelMatrix, glm::vec3(tileSize, 1, tileSize));
     program.setMatrix("model", &modelMatrix[0][0]);
 
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(meshVAO);
+    glDrawElements(GL_TRIANGLES, lodIndexCount[lod], GL_UNSIGNED_INT, (void*)(lodIndexOffset[lod] * sizeof(GLuint)));
+    glBindVertexArray(0);
 }
-
-void Tile::cleanup()
-{
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &CBO);
-    glDeleteBuffers(1, &EBO);
-    glDeleteBuffers(1, &UVBO);
-    glDeleteVertexArrays(1,&VAO);
-}
\ No newline at end of file
@@ -3,30 +3,59 @@
 
 #include <glad/gl.h>
 #include "shader.h"
+#include "heightfield.h"
+#include "gpuResources.h"
 #include <glm/glm.hpp>
 
+// One terrain chunk: a gridSize x gridSize heightfield grid plus a skirt
+// hanging below its border. The heightfield is one patch repeated on every
+// tile, so all tiles draw the same mesh: one vertex buffer built once, and
+// one index buffer holding a triangle list per LOD (geomipmapping: LOD n
+// uses every 2^n-th vertex). The skirts hide the cracks where neighbours use
+// different LODs. A tile itself is only its position and texture.
 struct Tile
 {
     glm::vec3 position;
     static constexpr float tileSize = 32.0f;
-
-    static const GLfloat vertices[12];
-    static const GLfloat colours[12];
-    static const GLfloat normals[12];
-    static const GLfloat uv[8];
-    static const GLint indices[6];
+    static constexpr int gridSize = 32;     // quads per side at LOD 0
+    static constexpr int lodCount = 4;      // down to 4 quads per side
+    static constexpr float skirtDepth = 1.0f;
+
+    struct Vertex {
+        glm::vec3 pos;      // relative to position
+        glm::vec3 normal;
+        glm::vec2 uv;
+    };
+
+    // shared mesh and LOD index lists, built once by initialiseMesh
+    static GlVertexArray meshVAO;
+    static GlBuffer meshVBO;
+    static GlBuffer lodEBO;
+    static GLsizei lodIndexCount[lodCount];
+    static GLsizei lodIndexOffset[lodCount]; // in indices
 
     bool hasTexture;
 
-    GLuint VAO, VBO, UVBO, EBO, CBO, NBO, textureID;
+    GLuint textureID;   // the texture streamer's
+
+    // Builds the shared mesh from the heightfield, on the GL thread
+    static void initialiseMesh(const Heightfield& heights);
+    static void cleanupMesh();
+
+    // Triangles drawn at a LOD, skirt included
+    static int triangleCount(int lod) { return lodIndexCount[lod] / 3; }
+
+    // Grid then skirt vertices of a tile
+    static constexpr int vertexCount = (gridSize + 1) * (gridSize + 1) + 4 * (gridSize + 1);
 
-    void initialise(glm::vec3 position, Shader program, const char* texture_path);
+    // Fills vertexCount vertices from the heightfield samples under a tile
+    static void buildVertices(const Heightfield& heights, Vertex* vertices);
 
-    void render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, Shader &program);
+    void load(glm::vec3 position, const char* texture_path);
 
-    void renderDepth(Shader &program);
+    void render(int lod, Shader &program);
 
-    void cleanup();
+    void renderDepth(int lod, Shader &program);
 };
 
-#endif
\ No newline at end of file
+#endif
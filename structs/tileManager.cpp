@@ -1,13 +1,23 @@
 #include "tileManager.h"
+#include "textureStreamer.h"
+#include "vegetation.h"
+#include "worldStreamer.h"
+#include "occlusionCuller.h"
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 void TileManager::initialise()
 {
 	texture_path = "../textures/coast_sand_rocks_02/coast_sand_rocks_02_diff_1k.jpg"; //"../assets/grass 12 - 128x128.png";
+	heightfield_path = "../textures/coast_sand_rocks_02/coast_sand_rocks_02_disp_1k.png";
+	heights.load(heightfield_path);
+	Tile::initialiseMesh(heights);
 }
 
-void TileManager::updateTiles(glm::vec3 playerPosition, Shader &program)
+void TileManager::updateTiles(glm::vec3 playerPosition)
 	{
 		//std::cout << "Camera position: " << playerPosition.x << ", " << playerPosition.z << std::endl;
 		//std::cout << "Tile size: " << tileSize << std::endl;
@@ -23,7 +33,9 @@ void TileManager::updateTiles(glm::vec3 playerPosition, Shader &program)
 			currentTile_X = playerTileX;
 			currentTile_Z = playerTileZ;
 			runFirstUpdate = false;
+			boundaryCrossings++;
 
+			newTiles.clear();
 			for (int x = playerTileX - tileDistance; x <= playerTileX + tileDistance; ++x)
 			{
 				for (int z = playerTileZ - tileDistance; z <= playerTileZ + tileDistance; ++z)
@@ -33,18 +45,20 @@ void TileManager::updateTiles(glm::vec3 playerPosition, Shader &program)
 					//std::cout << "Checking tile: " << x << ", " << z << std::endl;
 
 					if (tiles.find(tileKey) == tiles.end()) // not found-> make the tile
-					{
-						//std::cout << "Spawning tile at " << x << ", " << z << std::endl;
-
-						Tile tile;
-						tile.initialise(glm::vec3(x * tileSize, 0.0f, z * tileSize), program, texture_path);
-						tiles[tileKey] = tile;
-
-						//std::cout << "Spawned tile at " << x << ", " << z << std::endl;
-					}
+						newTiles.push_back(tileKey);
 				}
 			}
 
+			// every tile draws the shared mesh, so a new tile is only placed
+			for (const std::pair<int, int>& key : newTiles)
+			{
+				int x = key.first, z = key.second;
+				Tile& tile = tiles.try_emplace(key).first->second;
+				tile.load(glm::vec3(x * tileSize, 0.0f, z * tileSize), texture_path);
+				if (vegetation) vegetation->tileLoaded(x, z);
+				if (world) world->tileLoaded(x, z);
+			}
+
 			if (frameCounter % cleanupInterval == 0)
 			{
 				for (auto t = tiles.begin(); t != tiles.end(); )
@@ -54,39 +68,94 @@ void TileManager::updateTiles(glm::vec3 playerPosition, Shader &program)
 
 					if (std::abs(x - playerTileX) > tileDistance || std::abs(z - playerTileZ) > tileDistance)
 					{
-						// Clean up the tile if needed (e.g., GPU cleanup)
-						t->second.cleanup();
+						if (vegetation) vegetation->tileUnloaded(x, z);
+						if (world) world->tileUnloaded(x, z);
 						t = tiles.erase(t); // erase returns the next iterator
 					}
 					else ++t;
 				}
 			}
 
-			for (auto& [key, tile] : tiles) {
-				int x = key.first;
-				int z = key.second;
-
-				bool shouldBeActive = std::abs(x - playerTileX) <= renderDistance && std::abs(z - playerTileZ) <= renderDistance;
-				tileActiveStatus[key] = shouldBeActive;
-			}
+			updateActiveStatus();
 		}
 	frameCounter++;
 	}
 
+void TileManager::setRenderDistance(int distance)
+{
+	distance = std::clamp(distance, 0, tileDistance);
+	if (distance == renderDistance) return;
+	renderDistance = distance;
+	if (!runFirstUpdate)
+		updateActiveStatus();
+}
+
+void TileManager::updateActiveStatus()
+{
+	for (auto& [key, tile] : tiles) {
+		int x = key.first;
+		int z = key.second;
+
+		bool shouldBeActive = std::abs(x - currentTile_X) <= renderDistance && std::abs(z - currentTile_Z) <= renderDistance;
+		tileActiveStatus[key] = shouldBeActive;
+	}
+	activeChanges++;
+}
+
 void TileManager::renderTiles(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, Shader &program)
 {
+    TextureStreamer& streamer = GetTextureStreamer();
+    glm::vec3 cameraPos = glm::vec3(glm::inverse(viewMatrix)[3]);
+    trianglesLastFrame = 0;
+
     for (auto& [pos, tile] : tiles)
     {
         if (!tileActiveStatus[pos]) continue; // only active tiles
-        tile.render(viewMatrix, projectionMatrix, program);
+        if (distanceTo(tile, cameraPos) > cullDistance) continue;
+
+        // the texture spans the whole tile, so the tile's footprint decides its mip
+        float pixels = streamer.projectedSize(tile.position, tileSize * 0.7071f, viewMatrix, projectionMatrix);
+        streamer.request(tile.textureID, pixels);
+
+        int lod = selectLod(tile, cameraPos);
+        trianglesLastFrame += Tile::triangleCount(lod);
+        tile.render(lod, program);
         //std::cout << "Rendering tile at " << tile.position.x/tileSize << ", " << tile.position.z/tileSize << std::endl;
     }
 }
 
-void TileManager::cleanup()
+int TileManager::selectLod(const Tile& tile, glm::vec3 cameraPos) const
 {
-    for (auto& [pos, tile] : tiles)
-        tile.cleanup();
+    // distance to the nearest point of the tile, so the tile underfoot is always full detail
+    float distance = distanceTo(tile, cameraPos);
+    if (distance < lodDistance) return 0;
+    return std::min(Tile::lodCount - 1, 1 + (int)std::log2(distance / lodDistance));
+}
+
+float TileManager::distanceTo(const Tile& tile, glm::vec3 cameraPos) const
+{
+    glm::vec2 offset = glm::abs(glm::vec2(cameraPos.x - tile.position.x, cameraPos.z - tile.position.z)) - 0.5f * tileSize;
+    return glm::length(glm::max(offset, glm::vec2(0.0f)));
+}
+
+float TileManager::heightAt(float x, float z) const
+{
+    // same mapping as Tile::buildVertices: u runs with x, v against z, from the tile's corner
+    return heights.sample(x / tileSize + 0.5f, 0.5f - z / tileSize);
+}
 
+void TileManager::addOccluders(OcclusionCuller& occlusion, int mesh) const
+{
+    for (const auto& [pos, tile] : tiles)
+    {
+        auto active = tileActiveStatus.find(pos);
+        if (active == tileActiveStatus.end() || !active->second) continue;
+        occlusion.addOccluder(mesh, glm::translate(glm::mat4(1.0f), tile.position));
+    }
+}
+
+void TileManager::cleanup()
+{
     tiles.clear();
+    Tile::cleanupMesh();
 }
\ No newline at end of file
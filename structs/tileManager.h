@@ -4,7 +4,14 @@
 #include <glm/glm.hpp>
 #include "shader.h"
 #include "tile.h"
+#include "heightfield.h"
+#include <cfloat>
 #include <map>
+#include <vector>
+
+struct Vegetation;
+struct WorldStreamer;
+struct OcclusionCuller;
 
 struct TileManager
 {
@@ -12,6 +19,11 @@ struct TileManager
     int tileDistance = 4; // load 8x8 tile
     int renderDistance = 3; // draw 6x6 tile
     const char* texture_path;
+    const char* heightfield_path;
+    Heightfield heights;
+
+    float lodDistance = 32.0f; // tiles closer than this use LOD 0; each doubling drops one level
+    int trianglesLastFrame = 0;
 
     const float tileSize = Tile::tileSize;
 
@@ -20,18 +32,46 @@ struct TileManager
     int currentTile_X; // x value of the tile camera was on in last frame
     int currentTile_Z; // z value of the tile camera was on in last frame
 
+    int boundaryCrossings = 0; // times the tile set was rebuilt, for benchmark reports
+    int activeChanges = 0; // times tileActiveStatus was rewritten, by crossings or setRenderDistance
+
+    float cullDistance = FLT_MAX; // tiles wholly further away (across the ground) are not drawn
+
     int frameCounter = 0;
     int cleanupInterval = 10; // unload tiles every 10 frames for memory
 
     std::map<std::pair<int,int>, bool> tileActiveStatus;
 
+    Vegetation* vegetation = nullptr; // told about tiles as they load and unload
+    WorldStreamer* world = nullptr;   // likewise, for the authored placements
+
     void initialise();
 
-    void updateTiles(glm::vec3 playerPosition, Shader &program);
+    void updateTiles(glm::vec3 playerPosition);
+
+    // Changes the drawn square at run time, within the loaded tileDistance
+    void setRenderDistance(int distance);
 
     void renderTiles(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, Shader &program);
 
+    // LOD from the camera's distance to the tile
+    int selectLod(const Tile& tile, glm::vec3 cameraPos) const;
+
+    // Ground distance from the camera to the nearest point of the tile
+    float distanceTo(const Tile& tile, glm::vec3 cameraPos) const;
+
+    // Terrain height at a world position, matching the tile meshes
+    float heightAt(float x, float z) const;
+
+    // Places mesh (from OcclusionCuller::addTerrain) on every active tile
+    void addOccluders(OcclusionCuller& occlusion, int mesh) const;
+
     void cleanup();
+
+private:
+    std::vector<std::pair<int,int>> newTiles;   // made by the current crossing
+
+    void updateActiveStatus();
 };
 
 #endif
\ No newline at end of file
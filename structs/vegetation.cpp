@@ -0,0 +1,481 @@
+#include "vegetation.h"
+#include "tileManager.h"
+#include "textureStreamer.h"
+#include "meshLod.h"
+#include "occlusionCuller.h"
+#include "gpuResources.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <glm/gtc/matrix_transform.hpp>
+
+// splitmix64 finaliser: the only source of randomness, so placement does not
+// depend on the standard library's distributions
+static uint64_t mixBits(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static uint64_t hashCell(uint32_t seed, int layer, int x, int z)
+{
+    return mixBits(mixBits(mixBits(((uint64_t)seed << 32) | (uint32_t)layer) ^ (uint32_t)x) ^ ((uint64_t)(uint32_t)z << 16));
+}
+
+struct CellRandom
+{
+    uint64_t state;
+
+    float next()
+    {
+        state = mixBits(state);
+        return (float)(state >> 40) * (1.0f / 16777216.0f);
+    }
+};
+
+// smooth [0, 1] noise on a lattice of one unit
+static float valueNoise(uint32_t seed, float x, float z)
+{
+    int x0 = (int)std::floor(x), z0 = (int)std::floor(z);
+    float fx = x - x0, fz = z - z0;
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fz = fz * fz * (3.0f - 2.0f * fz);
+
+    auto lattice = [&](int lx, int lz) { return (float)(hashCell(seed, -1, lx, lz) >> 40) * (1.0f / 16777216.0f); };
+    float top = lattice(x0, z0) * (1.0f - fx) + lattice(x0 + 1, z0) * fx;
+    float bottom = lattice(x0, z0 + 1) * (1.0f - fx) + lattice(x0 + 1, z0 + 1) * fx;
+    return top * (1.0f - fz) + bottom * fz;
+}
+
+static const float patchSize = 64.0f; // world units per clumping noise cell
+
+void Vegetation::scatter(int tileX, int tileZ, const std::vector<ScatterRule>& rules, const std::vector<ExclusionZone>& exclusions,
+                         const std::vector<VegetationAsset>& assets, uint32_t seed, float densityScale,
+                         const TileManager& terrain, TileInstances& out)
+{
+    float tileSize = terrain.tileSize;
+    float minX = (tileX - 0.5f) * tileSize, maxX = minX + tileSize;
+    float minZ = (tileZ - 0.5f) * tileSize, maxZ = minZ + tileSize;
+
+    out.assign(assets.size(), {});
+    std::vector<glm::vec3> blockers; // x, z, radius
+
+    for (size_t r = 0; r < rules.size(); ++r)
+    {
+        const ScatterRule& rule = rules[r];
+        float density = rule.density * densityScale;
+        if (density <= 0.0f) continue;
+
+        // candidates come from a world-aligned jittered grid; instances that
+        // clear space are also generated a little past the edges, so a cabin
+        // in the next tile still keeps trees in this one away
+        float cell = 1.0f / std::sqrt(density);
+        float margin = rule.clearance * rule.maxScale;
+        int cellX0 = (int)std::floor((minX - margin) / cell), cellX1 = (int)std::floor((maxX + margin) / cell);
+        int cellZ0 = (int)std::floor((minZ - margin) / cell), cellZ1 = (int)std::floor((maxZ + margin) / cell);
+
+        std::vector<glm::vec3> ruleBlockers;
+        for (int cz = cellZ0; cz <= cellZ1; ++cz)
+            for (int cx = cellX0; cx <= cellX1; ++cx)
+            {
+                CellRandom random{hashCell(seed, (int)r, cx, cz)};
+                float x = (cx + random.next()) * cell;
+                float z = (cz + random.next()) * cell;
+                float accept = random.next();
+                float angle = random.next() * 6.2831853f;
+                float scale = rule.minScale + (rule.maxScale - rule.minScale) * random.next();
+
+                bool inside = x >= minX && x < maxX && z >= minZ && z < maxZ;
+                if (!inside && rule.clearance <= 0.0f) continue;
+
+                float patch = valueNoise(seed, x / patchSize, z / patchSize);
+                float clump = glm::clamp((patch - 0.4f) / 0.2f, 0.0f, 1.0f);
+                if (accept >= 1.0f - rule.clumping * (1.0f - clump)) continue;
+
+                bool blocked = false;
+                for (const ExclusionZone& zone : exclusions)
+                    blocked = blocked || glm::length(glm::vec2(x, z) - zone.centre) < zone.radius;
+                for (const glm::vec3& blocker : blockers)
+                    blocked = blocked || glm::length(glm::vec2(x, z) - glm::vec2(blocker.x, blocker.y)) < blocker.z;
+                if (blocked) continue;
+
+                float slopeX = terrain.heightAt(x + 0.5f, z) - terrain.heightAt(x - 0.5f, z);
+                float slopeZ = terrain.heightAt(x, z + 0.5f) - terrain.heightAt(x, z - 0.5f);
+                if (glm::length(glm::vec2(slopeX, slopeZ)) > rule.maxSlope) continue;
+
+                if (inside) {
+                    glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(x, terrain.heightAt(x, z), z));
+                    transform = glm::rotate(transform, angle, glm::vec3(0, 1, 0));
+                    transform = glm::scale(transform, glm::vec3(scale));
+                    out[rule.asset].push_back(transform * assets[rule.asset].base);
+                }
+                if (rule.clearance > 0.0f)
+                    ruleBlockers.push_back(glm::vec3(x, z, rule.clearance * scale));
+            }
+
+        // a rule never blocks itself, so cell visiting order cannot matter
+        blockers.insert(blockers.end(), ruleBlockers.begin(), ruleBlockers.end());
+    }
+}
+
+void Vegetation::initialise(const TileManager& terrain, Shader& impostorProgram)
+{
+    this->terrain = &terrain;
+
+    // corners of the quad every impostor is drawn from, as a triangle strip
+    const glm::vec3 quad[4] = {{-1.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, {-1.0f, 1.0f, 0.0f}, {1.0f, 1.0f, 0.0f}};
+    quadVBO = gpuCreateBuffer(GpuOwner::Vegetation, GPU_SITE);
+    glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+    gpuBufferData(GL_ARRAY_BUFFER, quadVBO, sizeof(quad), quad, GL_STATIC_DRAW);
+
+    for (VegetationAsset& asset : assets)
+    {
+        const GLTFModel& model = *asset.model;
+        float scale = std::max(glm::length(glm::vec3(asset.base[0])), std::max(glm::length(glm::vec3(asset.base[1])), glm::length(glm::vec3(asset.base[2]))));
+        asset.radius = glm::length(model.boundsMax - model.boundsMin) * 0.5f * scale;
+
+        asset.instanceVBO = gpuCreateBuffer(GpuOwner::Vegetation, GPU_SITE);
+        for (const auto& prim : asset.model->primitives)
+        {
+            glBindVertexArray(prim.vao);
+            glBindBuffer(GL_ARRAY_BUFFER, asset.instanceVBO);
+            for (int column = 0; column < 4; ++column) {
+                glEnableVertexAttribArray(6 + column); // instanceMatrix
+                glVertexAttribPointer(6 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+                glVertexAttribDivisor(6 + column, 1);
+            }
+        }
+
+        if (asset.impostorDistance > 0.0f)
+        {
+            asset.impostor.bake(model, asset.base, impostorFrames, impostorCellPixels, impostorProgram);
+
+            asset.impostorVAO = gpuCreateVertexArray(GpuOwner::Vegetation, GPU_SITE);
+            asset.impostorVBO = gpuCreateBuffer(GpuOwner::Vegetation, GPU_SITE);
+            glBindVertexArray(asset.impostorVAO);
+            glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+            glBindBuffer(GL_ARRAY_BUFFER, asset.impostorVBO);
+            glEnableVertexAttribArray(10); // impostorInstance
+            glVertexAttribPointer(10, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), (void*)offsetof(ImpostorInstance, position));
+            glVertexAttribDivisor(10, 1);
+            glEnableVertexAttribArray(11); // impostorYaw
+            glVertexAttribPointer(11, 1, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), (void*)offsetof(ImpostorInstance, yaw));
+            glVertexAttribDivisor(11, 1);
+        }
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    stopping = false;
+    worker = std::thread(&Vegetation::workerLoop, this);
+}
+
+void Vegetation::tileLoaded(int x, int z)
+{
+    TileKey key(x, z);
+    pending.insert(key);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back(key);
+    }
+    wake.notify_one();
+}
+
+void Vegetation::tileUnloaded(int x, int z)
+{
+    TileKey key(x, z);
+    if (pending.erase(key)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.erase(std::remove(requests.begin(), requests.end(), key), requests.end());
+    }
+    if (tiles.erase(key))
+        dirty = true;
+}
+
+void Vegetation::update()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.swap(results);
+    }
+    for (Job& job : finished)
+    {
+        // tiles unloaded while their placement was running are dropped
+        if (pending.erase(job.key)) {
+            tiles[job.key] = std::move(job.instances);
+            dirty = true;
+        }
+    }
+    finished.clear();
+
+    if (terrain->activeChanges != builtChanges)
+        dirty = true;
+    if (dirty)
+        rebuild();
+}
+
+void Vegetation::rebuild()
+{
+    builds++;
+    instancesLastBuild = 0;
+    for (size_t a = 0; a < assets.size(); ++a)
+    {
+        VegetationAsset& asset = assets[a];
+        asset.instances.clear();
+        for (const auto& [key, instances] : tiles)
+        {
+            auto active = terrain->tileActiveStatus.find(key);
+            if (active == terrain->tileActiveStatus.end() || !active->second) continue;
+            asset.instances.insert(asset.instances.end(), instances[a].begin(), instances[a].end());
+        }
+        asset.lods.assign(asset.instances.size(), -1);
+        asset.instanceCount = (GLsizei)asset.instances.size();
+
+        // instances are translate * rotate about y * uniform scale * base
+        asset.impostorSources.clear();
+        if (asset.impostorDistance > 0.0f)
+        {
+            glm::mat4 unbase = glm::inverse(asset.base);
+            for (const glm::mat4& transform : asset.instances)
+            {
+                glm::vec3 x = glm::vec3((transform * unbase)[0]);
+                asset.impostorSources.push_back({glm::vec3(transform[3]), glm::length(x), std::atan2(-x.z, x.x)});
+            }
+        }
+        instancesLastBuild += asset.instanceCount;
+    }
+
+    builtChanges = terrain->activeChanges;
+    dirty = false;
+}
+
+void Vegetation::selectLods(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, OcclusionCuller* occlusion)
+{
+    LodSelector& selector = GetLodSelector();
+    glm::vec3 cameraPos = glm::vec3(glm::inverse(viewMatrix)[3]);
+    impostorsLastFrame = 0;
+    for (VegetationAsset& asset : assets)
+    {
+        if (asset.instanceCount == 0) continue;
+        const GLTFModel& model = *asset.model;
+        glm::vec3 modelCentre = (model.boundsMin + model.boundsMax) * 0.5f;
+
+        // both sides of the cross-fade measure the ground distance to the
+        // instance origin, as object.vert does
+        bool hasImpostor = asset.impostorDistance > 0.0f;
+        float meshEnd = hasImpostor ? asset.impostorDistance + impostorFadeRange : FLT_MAX;
+        distant.clear();
+        ranges.assign(asset.instances.size(), -1);
+
+        GLsizei counts[2 * GLTFModel::maxLods] = {};
+        for (size_t i = 0; i < asset.instances.size(); ++i)
+        {
+            // base may stretch the model, so the largest axis bounds the error
+            const glm::mat4& transform = asset.instances[i];
+            float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+            float distance = glm::length(glm::vec3(transform * glm::vec4(modelCentre, 1.0f)) - cameraPos) - model.boundingRadius() * scale;
+            if (distance > cullDistance) {
+                asset.lods[i] = -1;
+                continue;
+            }
+
+            bool visible = !occlusion || occlusion->isVisible(model.boundsMin, model.boundsMax, transform);
+            if (hasImpostor) {
+                const ImpostorInstance& source = asset.impostorSources[i];
+                float ground = glm::length(glm::vec2(source.position.x - cameraPos.x, source.position.z - cameraPos.z));
+                if (ground >= asset.impostorDistance && visible)
+                    distant.push_back(source);
+                if (ground >= meshEnd) {
+                    asset.lods[i] = -1;
+                    continue;
+                }
+            }
+
+            asset.lods[i] = selector.select(model.lodError, model.lodCount, asset.lods[i], scale * selector.pixelScale(projectionMatrix, distance));
+            ranges[i] = asset.lods[i] + (visible ? 0 : GLTFModel::maxLods);
+            counts[ranges[i]]++;
+        }
+
+        const int rangeCount = 2 * GLTFModel::maxLods;
+        GLsizei next[rangeCount];
+        for (int range = 0; range < rangeCount; ++range) {
+            asset.lodFirstInstance[range] = next[range] = range == 0 ? 0 : asset.lodFirstInstance[range - 1] + counts[range - 1];
+            asset.lodInstanceCount[range] = counts[range];
+        }
+        sorted.resize(next[rangeCount - 1] + counts[rangeCount - 1]);
+        for (size_t i = 0; i < asset.instances.size(); ++i)
+            if (ranges[i] >= 0)
+                sorted[next[ranges[i]]++] = asset.instances[i];
+
+        glBindBuffer(GL_ARRAY_BUFFER, asset.instanceVBO);
+        gpuBufferData(GL_ARRAY_BUFFER, asset.instanceVBO, sorted.size() * sizeof(glm::mat4), sorted.data(), GL_STREAM_DRAW);
+
+        asset.impostorCount = (GLsizei)distant.size();
+        impostorsLastFrame += asset.impostorCount;
+        if (hasImpostor) {
+            glBindBuffer(GL_ARRAY_BUFFER, asset.impostorVBO);
+            gpuBufferData(GL_ARRAY_BUFFER, asset.impostorVBO, distant.size() * sizeof(ImpostorInstance), distant.data(), GL_STREAM_DRAW);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Vegetation::addOccluders(OcclusionCuller& occlusion) const
+{
+    for (const VegetationAsset& asset : assets)
+        if (asset.occluder >= 0)
+            for (const glm::mat4& transform : asset.instances)
+                occlusion.addOccluder(asset.occluder, transform);
+}
+
+void Vegetation::drawPrimitive(const VegetationAsset& asset, const GLTFModel::MeshPrimitive& prim, int rangeCount)
+{
+    glBindVertexArray(prim.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, asset.instanceVBO);
+    for (int range = 0; range < rangeCount; ++range)
+    {
+        if (asset.lodInstanceCount[range] == 0) continue;
+        int lod = range % GLTFModel::maxLods;
+        size_t offset = asset.lodFirstInstance[range] * sizeof(glm::mat4);
+        for (int column = 0; column < 4; ++column)
+            glVertexAttribPointer(6 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + column * sizeof(glm::vec4)));
+        glDrawElementsInstanced(GL_TRIANGLES, prim.lodIndexCount[lod], GL_UNSIGNED_INT,
+                                (void*)(prim.lodFirstIndex[lod] * sizeof(unsigned int)), asset.lodInstanceCount[range]);
+    }
+}
+
+void Vegetation::render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, Shader &program, GLuint shadowMap)
+{
+    program.setBool("useSkinning", false);
+    program.setBool("useInstancing", true);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, shadowMap);
+    program.setInt("shadowMap", 1);
+
+    TextureStreamer& streamer = GetTextureStreamer();
+    float tileSize = terrain->tileSize;
+    for (size_t a = 0; a < assets.size(); ++a)
+    {
+        const VegetationAsset& asset = assets[a];
+        if (asset.instanceCount == 0) continue;
+        const GLTFModel& model = *asset.model;
+
+        // the nearest tile holding the asset decides how sharp its textures need to be
+        float pixels = 0.0f;
+        for (const auto& [key, instances] : tiles)
+            if (!instances[a].empty())
+                pixels = std::max(pixels, streamer.projectedSize(glm::vec3(key.first * tileSize, 0.0f, key.second * tileSize),
+                                                                 asset.radius + 0.7071f * tileSize, viewMatrix, projectionMatrix));
+
+        program.setFloat("diffuseStrength", model.diffuseStrength);
+        program.setBool("useTexture", model.hasTexture);
+        program.setInt("crossFade", asset.impostorDistance > 0.0f ? 1 : 0);
+        program.setFloat("crossFadeStart", asset.impostorDistance);
+        program.setFloat("crossFadeEnd", asset.impostorDistance + impostorFadeRange);
+        for (const auto& prim : model.primitives)
+        {
+            if (model.hasTexture) {
+                streamer.request(prim.textureID, pixels);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, prim.textureID);
+                program.setInt("textureSampler", 0);
+            }
+            else program.setVec4("modelColour", prim.baseColorFactor);
+            drawPrimitive(asset, prim, GLTFModel::maxLods);
+        }
+    }
+    program.setBool("useInstancing", false);
+
+    // the distant instances, fading in where the meshes fade out
+    program.setBool("useImpostor", true);
+    program.setBool("useTexture", false);
+    program.setInt("crossFade", 2);
+    for (const VegetationAsset& asset : assets)
+    {
+        if (asset.impostorCount == 0) continue;
+        asset.impostor.bind(program);
+        program.setFloat("diffuseStrength", asset.model->diffuseStrength);
+        program.setFloat("crossFadeStart", asset.impostorDistance);
+        program.setFloat("crossFadeEnd", asset.impostorDistance + impostorFadeRange);
+        glBindVertexArray(asset.impostorVAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, asset.impostorCount);
+    }
+    program.setBool("useImpostor", false);
+    program.setInt("crossFade", 0);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Vegetation::renderDepth(Shader &program)
+{
+    program.setBool("useInstancing", true);
+    for (const VegetationAsset& asset : assets)
+    {
+        if (asset.instanceCount == 0) continue;
+        for (const auto& prim : asset.model->primitives)
+            drawPrimitive(asset, prim, 2 * GLTFModel::maxLods);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    program.setBool("useInstancing", false);
+}
+
+void Vegetation::cleanup()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) worker.join();
+
+    for (VegetationAsset& asset : assets) {
+        gpuDeleteBuffer(asset.instanceVBO);
+        asset.instanceCount = 0;
+        asset.instances.clear();
+        asset.lods.clear();
+
+        asset.impostor.cleanup();
+        gpuDeleteVertexArray(asset.impostorVAO);
+        gpuDeleteBuffer(asset.impostorVBO);
+        asset.impostorCount = 0;
+        asset.impostorSources.clear();
+    }
+    gpuDeleteBuffer(quadVBO);
+    tiles.clear();
+    pending.clear();
+    requests.clear();
+    results.clear();
+}
+
+void Vegetation::workerLoop()
+{
+    for (;;)
+    {
+        TileKey key;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !requests.empty(); });
+            if (stopping) return;
+            key = requests.front();
+            requests.pop_front();
+        }
+
+        Job job;
+        job.key = key;
+        scatter(key.first, key.second, rules, exclusions, assets, seed, densityScale, *terrain, job.instances);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            results.push_back(std::move(job));
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#ifndef _VEGETATION_H_
+#define _VEGETATION_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cfloat>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include "gltfModel.h"
+#include "impostor.h"
+#include "shader.h"
+
+struct TileManager;
+struct OcclusionCuller;
+
+// A model scattered by the rules, drawn with one instanced draw per primitive
+struct VegetationAsset
+{
+    GLTFModel* model = nullptr;         // geometry and textures; its VAOs gain the instance attributes
+    glm::mat4 base = glm::mat4(1.0f);   // turns the source model upright at the right size
+    float radius = 0.0f;    // bounding radius after base at instance scale 1, set by initialise
+
+    GLuint instanceVBO = 0;
+    GLsizei instanceCount = 0;
+
+    // visible instances and the level each drew last frame (-1 for new ones);
+    // the buffer holds them sorted by level, one range per level, followed
+    // by the same ranges for instances behind occluders (shadow pass only)
+    std::vector<glm::mat4> instances;
+    std::vector<int> lods;
+    GLsizei lodFirstInstance[2 * GLTFModel::maxLods] = {};
+    GLsizei lodInstanceCount[2 * GLTFModel::maxLods] = {};
+
+    int occluder = -1;      // OcclusionCuller mesh drawn at every instance, -1 for none
+
+    // instances at least this far away (across the ground) are drawn as
+    // impostors, cross-fading over Vegetation::impostorFadeRange; 0 never does
+    float impostorDistance = 0.0f;
+    Impostor impostor;
+    GLuint impostorVAO = 0;
+    GLuint impostorVBO = 0;
+    GLsizei impostorCount = 0;                      // drawn this frame
+    std::vector<ImpostorInstance> impostorSources;  // one per entry of instances
+};
+
+struct ScatterRule
+{
+    int asset;
+    float density;          // candidates per square unit, one per jittered grid cell
+    float minScale, maxScale;
+    float maxSlope;         // steepest terrain (rise over run) it grows on
+    float clumping;         // 0 = even cover, 1 = only inside noise patches
+    float clearance;        // kept free of later rules around each instance, 0 for none
+};
+
+struct ExclusionZone
+{
+    glm::vec2 centre;       // x, z
+    float radius;
+};
+
+// Deterministic scattering of models over streamed tiles. Every candidate
+// position comes from a hash of the seed, the rule and its world grid cell,
+// so a tile always gets the same instances no matter when or in which order
+// it is loaded. Placement runs on a worker thread as tiles load; instances
+// of visible tiles are packed into one instance buffer per asset, sorted by
+// the LOD each instance picks that frame. Far enough away an asset switches
+// to impostor quads, dithering between mesh and quad over a fade band.
+struct Vegetation
+{
+    std::vector<VegetationAsset> assets;
+    std::vector<ScatterRule> rules;      // applied in order; earlier clearances block later rules
+    std::vector<ExclusionZone> exclusions;
+    uint32_t seed = 0x5eed;
+    float densityScale = 1.0f;
+    int impostorFrames = 8;             // view directions baked per impostor
+    int impostorCellPixels = 128;
+    float impostorFadeRange = 10.0f;    // world units both mesh and impostor are drawn over
+    float cullDistance = FLT_MAX;       // instances wholly further away are not drawn at all
+
+    const TileManager* terrain = nullptr;
+
+    typedef std::pair<int, int> TileKey;
+    typedef std::vector<std::vector<glm::mat4>> TileInstances; // per asset
+
+    std::map<TileKey, TileInstances> tiles;
+    int instancesLastBuild = 0;
+    int builds = 0;                     // times the instances were repacked
+    int impostorsLastFrame = 0;
+
+    // Bakes the impostors with impostorProgram (impostorBake.vert/frag) and
+    // starts the worker; rules, assets and exclusions must be final by now
+    void initialise(const TileManager& terrain, Shader& impostorProgram);
+
+    void tileLoaded(int x, int z);
+    void tileUnloaded(int x, int z);
+
+    // Takes finished placements and repacks the visible instances when the
+    // set of visible tiles changed
+    void update();
+
+    // Picks every instance's level, or its impostor, and uploads the
+    // instances sorted by level; instances the culler finds hidden still
+    // cast shadows but are left out of the main pass
+    void selectLods(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, OcclusionCuller* occlusion = nullptr);
+
+    // Places the occluder of every asset that has one at its instances
+    void addOccluders(OcclusionCuller& occlusion) const;
+
+    void render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix, Shader &program, GLuint shadowMap);
+
+    void renderDepth(Shader &program);
+
+    void cleanup();
+
+    // Instances of one tile, per asset
+    static void scatter(int tileX, int tileZ, const std::vector<ScatterRule>& rules, const std::vector<ExclusionZone>& exclusions,
+                        const std::vector<VegetationAsset>& assets, uint32_t seed, float densityScale,
+                        const TileManager& terrain, TileInstances& out);
+
+private:
+    struct Job {
+        TileKey key;
+        TileInstances instances;
+    };
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<TileKey> requests;
+    std::deque<Job> results;
+    std::deque<Job> finished;           // swapped with results by update; kept so an empty deque is not built every frame
+    bool stopping = false;
+
+    std::set<TileKey> pending;
+    int builtChanges = -1;
+    bool dirty = false;
+
+    std::vector<glm::mat4> sorted;
+    std::vector<int> ranges;            // per instance, the range selectLods files it under
+    std::vector<ImpostorInstance> distant;
+    GLuint quadVBO = 0;                 // unit quad shared by every impostor VAO
+
+    void rebuild();
+    void workerLoop();
+
+    // One instanced draw per level range among the first rangeCount, with
+    // the instance attributes moved to the range (GL 3.3 has no base instance)
+    void drawPrimitive(const VegetationAsset& asset, const GLTFModel::MeshPrimitive& prim, int rangeCount);
+};
+
+#endif
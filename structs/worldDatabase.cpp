@@ -0,0 +1,248 @@
+#include "worldDatabase.h"
+#include "light.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+std::string bakedWorldPath(const std::string& sourcePath)
+{
+    size_t dot = sourcePath.find_last_of('.');
+    size_t slash = sourcePath.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return sourcePath + ".lwld";
+    return sourcePath.substr(0, dot) + ".lwld";
+}
+
+template <typename T>
+static void append(std::vector<unsigned char>& out, const T* values, size_t count)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+    out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+static bool parseLight(std::istringstream& line, WorldLight& light, bool& global)
+{
+    std::string type;
+    line >> type;
+    memset(&light, 0, sizeof(light));
+    global = type == "directional";
+    if (global) {
+        light.type = (int32_t)LightType::Directional;
+        line >> light.direction[0] >> light.direction[1] >> light.direction[2];
+    } else if (type == "point" || type == "spot") {
+        light.type = (int32_t)(type == "point" ? LightType::Point : LightType::Spot);
+        line >> light.position[0] >> light.position[1] >> light.position[2];
+        if (type == "spot")
+            line >> light.direction[0] >> light.direction[1] >> light.direction[2];
+    } else {
+        return false;
+    }
+    line >> light.colour[0] >> light.colour[1] >> light.colour[2] >> light.constant >> light.linear >> light.quadratic;
+    if (light.type == (int32_t)LightType::Spot) {
+        float cutoff, outerCutoff;
+        line >> cutoff >> outerCutoff;
+        light.cutoff = glm::cos(glm::radians(cutoff));
+        light.outerCutoff = glm::cos(glm::radians(outerCutoff));
+    }
+    return !line.fail();
+}
+
+bool bakeWorld(const char* sourcePath, std::vector<unsigned char>& out)
+{
+    std::ifstream source(sourcePath);
+    if (!source.is_open()) {
+        std::cerr << "Failed to open world " << sourcePath << std::endl;
+        return false;
+    }
+
+    struct Bucket {
+        std::vector<WorldInstance> instances;
+        std::vector<WorldLight> lights;
+    };
+    float tileSize = 32.0f;
+    std::vector<WorldModel> models;
+    std::vector<WorldLight> globalLights;
+    std::map<std::pair<int, int>, Bucket> buckets;
+    auto bucketOf = [&](const float* position) -> Bucket& {
+        return buckets[{(int)std::round(position[0] / tileSize), (int)std::round(position[2] / tileSize)}];
+    };
+
+    std::string text;
+    int lineNumber = 0;
+    while (std::getline(source, text))
+    {
+        lineNumber++;
+        std::istringstream line(text);
+        std::string keyword;
+        if (!(line >> keyword) || keyword[0] == '#') continue;
+
+        bool ok = true;
+        if (keyword == "tile-size") {
+            // buckets are formed as placements are read
+            ok = buckets.empty() && (line >> tileSize) && tileSize > 0.0f;
+        } else if (keyword == "model") {
+            WorldModel model;
+            memset(&model, 0, sizeof(model));
+            std::string name, path, kind;
+            line >> name >> path >> kind >> model.diffuseStrength;
+            ok = !line.fail() && name.size() < sizeof(model.name) && path.size() < sizeof(model.path) && (kind == "static" || kind == "animated");
+            if (ok) {
+                memcpy(model.name, name.c_str(), name.size());
+                memcpy(model.path, path.c_str(), path.size());
+                model.flags = kind == "animated" ? (uint32_t)WorldModelAnimated : 0u;
+                models.push_back(model);
+            }
+        } else if (keyword == "instance") {
+            std::string name;
+            float yaw, pitch, roll;
+            WorldInstance instance;
+            line >> name >> instance.position[0] >> instance.position[1] >> instance.position[2] >> yaw >> pitch >> roll >> instance.scale;
+            auto model = std::find_if(models.begin(), models.end(), [&](const WorldModel& m) { return name == m.name; });
+            ok = !line.fail() && model != models.end();
+            if (ok) {
+                instance.model = (uint32_t)(model - models.begin());
+                glm::quat rotation(glm::radians(glm::vec3(pitch, yaw, roll)));
+                instance.rotation[0] = rotation.x;
+                instance.rotation[1] = rotation.y;
+                instance.rotation[2] = rotation.z;
+                instance.rotation[3] = rotation.w;
+                bucketOf(instance.position).instances.push_back(instance);
+            }
+        } else if (keyword == "light") {
+            WorldLight light;
+            bool global;
+            ok = parseLight(line, light, global);
+            if (ok) {
+                if (global) globalLights.push_back(light);
+                else bucketOf(light.position).lights.push_back(light);
+            }
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            std::cerr << sourcePath << ":" << lineNumber << ": cannot read \"" << text << "\"" << std::endl;
+            return false;
+        }
+    }
+
+    WorldHeader header;
+    memcpy(header.magic, "LWLD", 4);
+    header.version = worldVersion;
+    header.tileSize = tileSize;
+    header.modelCount = (uint32_t)models.size();
+    header.globalLightCount = (uint32_t)globalLights.size();
+    header.tileCount = (uint32_t)buckets.size();
+    header.instanceCount = 0;
+    header.lightCount = 0;
+
+    std::vector<WorldTile> tiles;
+    for (const auto& [key, bucket] : buckets) {
+        tiles.push_back({key.first, key.second, header.instanceCount, (uint32_t)bucket.instances.size(),
+                         header.lightCount, (uint32_t)bucket.lights.size()});
+        header.instanceCount += (uint32_t)bucket.instances.size();
+        header.lightCount += (uint32_t)bucket.lights.size();
+    }
+
+    out.clear();
+    append(out, &header, 1);
+    append(out, models.data(), models.size());
+    append(out, globalLights.data(), globalLights.size());
+    append(out, tiles.data(), tiles.size());
+    for (const auto& [key, bucket] : buckets)
+        append(out, bucket.instances.data(), bucket.instances.size());
+    for (const auto& [key, bucket] : buckets)
+        append(out, bucket.lights.data(), bucket.lights.size());
+    return true;
+}
+
+bool WorldDatabase::open(const char* sourcePath)
+{
+    close();
+
+    // a baked file older than the text it came from would hide the edits
+    std::string bakedPath = bakedWorldPath(sourcePath);
+    std::error_code sourceError, bakedError;
+    auto sourceTime = std::filesystem::last_write_time(sourcePath, sourceError);
+    auto bakedTime = std::filesystem::last_write_time(bakedPath, bakedError);
+    if (!sourceError && !bakedError && bakedTime < sourceTime)
+        std::cerr << "Baked world " << bakedPath << " is older than " << sourcePath << "; baking the text again" << std::endl;
+    else if (file.open(bakedPath.c_str())) {
+        if (attach(file.data, file.size)) return true;
+        std::cerr << "Ignoring invalid baked world " << bakedPath << std::endl;
+        file.close();
+    }
+
+    if (!bakeWorld(sourcePath, baked)) return false;
+    return attach(baked.data(), baked.size());
+}
+
+bool WorldDatabase::attach(const unsigned char* data, size_t size)
+{
+    if (size < sizeof(WorldHeader)) return false;
+    const WorldHeader* h = reinterpret_cast<const WorldHeader*>(data);
+    if (memcmp(h->magic, "LWLD", 4) != 0 || h->version != worldVersion || !(h->tileSize > 0.0f)) return false;
+
+    size_t modelsAt = sizeof(WorldHeader);
+    size_t globalsAt = modelsAt + (size_t)h->modelCount * sizeof(WorldModel);
+    size_t tilesAt = globalsAt + (size_t)h->globalLightCount * sizeof(WorldLight);
+    size_t instancesAt = tilesAt + (size_t)h->tileCount * sizeof(WorldTile);
+    size_t lightsAt = instancesAt + (size_t)h->instanceCount * sizeof(WorldInstance);
+    size_t end = lightsAt + (size_t)h->lightCount * sizeof(WorldLight);
+    if (end != size) return false;
+
+    // the tile table is checked as tiles are found, so opening never reads past it
+    header = h;
+    models = reinterpret_cast<const WorldModel*>(data + modelsAt);
+    globalLights = reinterpret_cast<const WorldLight*>(data + globalsAt);
+    tiles = reinterpret_cast<const WorldTile*>(data + tilesAt);
+    instanceTable = reinterpret_cast<const WorldInstance*>(data + instancesAt);
+    lightTable = reinterpret_cast<const WorldLight*>(data + lightsAt);
+    return true;
+}
+
+void WorldDatabase::close()
+{
+    file.close();
+    baked.clear();
+    baked.shrink_to_fit();
+    header = nullptr;
+    models = nullptr;
+    globalLights = nullptr;
+    tiles = nullptr;
+    instanceTable = nullptr;
+    lightTable = nullptr;
+}
+
+const WorldTile* WorldDatabase::findTile(int x, int z) const
+{
+    if (!header) return nullptr;
+    const WorldTile* end = tiles + header->tileCount;
+    const WorldTile* tile = std::lower_bound(tiles, end, std::make_pair(x, z), [](const WorldTile& t, const std::pair<int, int>& key) {
+        return t.x < key.first || (t.x == key.first && t.z < key.second);
+    });
+    if (tile == end || tile->x != x || tile->z != z) return nullptr;
+    if ((uint64_t)tile->firstInstance + tile->instanceCount > header->instanceCount ||
+        (uint64_t)tile->firstLight + tile->lightCount > header->lightCount) {
+        std::cerr << "World tile " << x << ", " << z << " lies outside the world file" << std::endl;
+        return nullptr;
+    }
+    return tile;
+}
+
+int WorldDatabase::findModel(const char* name) const
+{
+    if (!header) return -1;
+    for (uint32_t i = 0; i < header->modelCount; ++i)
+        if (strncmp(models[i].name, name, sizeof(models[i].name)) == 0)
+            return (int)i;
+    return -1;
+}
@@ -0,0 +1,116 @@
+#ifndef _WORLD_DATABASE_H_
+#define _WORLD_DATABASE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mappedFile.h"
+
+// .lwld: authored placements, bucketed by terrain tile, written by worldbake
+// from a text world (see assets/world.txt) and memory-mapped at run time.
+// Opening only checks the header and section sizes; a tile's instances and
+// lights are read when the tile streams in, so neither the time to open nor
+// the memory touched grows with the size of the world.
+//
+//   WorldHeader
+//   WorldModel[modelCount]
+//   WorldLight[globalLightCount]   lit everywhere (directional lights)
+//   WorldTile[tileCount]           sorted by x, then z
+//   WorldInstance[instanceCount]   grouped by tile
+//   WorldLight[lightCount]         grouped by tile
+
+struct WorldHeader
+{
+    char magic[4];      // "LWLD"
+    uint32_t version;
+    float tileSize;     // placements were bucketed with this; must match the terrain's
+    uint32_t modelCount;
+    uint32_t globalLightCount;
+    uint32_t tileCount;
+    uint32_t instanceCount;
+    uint32_t lightCount;
+};
+
+enum WorldModelFlags : uint32_t {WorldModelAnimated = 1};
+
+struct WorldModel
+{
+    char name[32];      // what instances refer to it by in the text world
+    char path[128];     // glTF, relative to the working directory
+    uint32_t flags;     // WorldModelFlags
+    float diffuseStrength;
+};
+
+struct WorldTile
+{
+    int32_t x;
+    int32_t z;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+    uint32_t firstLight;
+    uint32_t lightCount;
+};
+
+struct WorldInstance
+{
+    uint32_t model;     // into the model table
+    float position[3];
+    float rotation[4];  // quaternion x, y, z, w
+    float scale;
+};
+
+struct WorldLight
+{
+    int32_t type;       // LightType
+    float position[3];
+    float direction[3];
+    float colour[3];
+    float constant;
+    float linear;
+    float quadratic;
+    float cutoff;       // cosines, as the shader takes them
+    float outerCutoff;
+};
+
+static const uint32_t worldVersion = 1;
+
+// Path of the baked world for a text world: same name, .lwld extension
+std::string bakedWorldPath(const std::string& sourcePath);
+
+// Parses a text world and builds the .lwld in memory; false (with the line
+// reported) on a malformed source
+bool bakeWorld(const char* sourcePath, std::vector<unsigned char>& out);
+
+// Read-only view of a world. open maps the baked file next to the text
+// world when there is one no older than the text, and bakes the text in
+// memory otherwise.
+struct WorldDatabase
+{
+    const WorldHeader* header = nullptr;
+    const WorldModel* models = nullptr;
+    const WorldLight* globalLights = nullptr;
+
+    bool open(const char* sourcePath);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    // Binary search of the tile table; nullptr for a tile with nothing on it
+    const WorldTile* findTile(int x, int z) const;
+
+    const WorldInstance* instances(const WorldTile& tile) const { return instanceTable + tile.firstInstance; }
+    const WorldLight* lights(const WorldTile& tile) const { return lightTable + tile.firstLight; }
+
+    // Index of the named model, -1 when there is none
+    int findModel(const char* name) const;
+
+private:
+    bool attach(const unsigned char* data, size_t size);
+
+    MappedFile file;
+    std::vector<unsigned char> baked;   // when there was no baked file
+    const WorldTile* tiles = nullptr;
+    const WorldInstance* instanceTable = nullptr;
+    const WorldLight* lightTable = nullptr;
+};
+
+#endif
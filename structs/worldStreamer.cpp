@@ -0,0 +1,98 @@
+#include "worldStreamer.h"
+#include "worldDatabase.h"
+
+static Light toLight(const WorldLight& source)
+{
+    Light light;
+    light.type = source.type;
+    light.position = glm::vec3(source.position[0], source.position[1], source.position[2]);
+    light.direction = glm::vec3(source.direction[0], source.direction[1], source.direction[2]);
+    light.colour = glm::vec3(source.colour[0], source.colour[1], source.colour[2]);
+    light.constant = source.constant;
+    light.linear = source.linear;
+    light.quadratic = source.quadratic;
+    light.cutoff = source.cutoff;
+    light.outerCutoff = source.outerCutoff;
+    return light;
+}
+
+void WorldStreamer::initialise(const WorldDatabase& world, Scene& scene)
+{
+    this->world = &world;
+    this->scene = &scene;
+    models.resize(world.header->modelCount);
+    for (uint32_t i = 0; i < world.header->globalLightCount; ++i) {
+        Entity entity = scene.create();
+        scene.addLight(entity, toLight(world.globalLights[i]));
+        globals.push_back(entity);
+        created.push_back(entity);
+    }
+    changes++;
+}
+
+void WorldStreamer::tileLoaded(int x, int z)
+{
+    const WorldTile* tile = world ? world->findTile(x, z) : nullptr;
+    if (!tile) return;
+
+    std::vector<Entity>& entities = loaded[{x, z}];
+    const WorldInstance* instances = world->instances(*tile);
+    for (uint32_t i = 0; i < tile->instanceCount; ++i) {
+        const WorldInstance& instance = instances[i];
+        if (instance.model >= models.size() || !models[instance.model].model) continue;
+
+        Entity entity = scene->create();
+        glm::quat rotation(instance.rotation[3], instance.rotation[0], instance.rotation[1], instance.rotation[2]);
+        scene->addTransform(entity, glm::vec3(instance.position[0], instance.position[1], instance.position[2]), rotation, glm::vec3(instance.scale));
+        scene->addModel(entity, *models[instance.model].model);
+        scene->meshes.get(entity.index)->occluder = models[instance.model].occluder;
+        entities.push_back(entity);
+        created.push_back(entity);
+        instancesLoaded++;
+    }
+
+    // lights have a transform too, so they follow the same placement rules
+    const WorldLight* lights = world->lights(*tile);
+    for (uint32_t i = 0; i < tile->lightCount; ++i) {
+        Entity entity = scene->create();
+        Light light = toLight(lights[i]);
+        scene->addTransform(entity, light.position);
+        scene->addLight(entity, light);
+        entities.push_back(entity);
+        created.push_back(entity);
+        lightsLoaded++;
+    }
+    changes++;
+}
+
+void WorldStreamer::tileUnloaded(int x, int z)
+{
+    auto it = loaded.find({x, z});
+    if (it == loaded.end()) return;
+    for (Entity entity : it->second) {
+        if (scene->meshes.has(entity.index)) instancesLoaded--;
+        if (scene->lights.has(entity.index)) lightsLoaded--;
+        scene->destroy(entity);
+        destroyed.push_back(entity);
+    }
+    loaded.erase(it);
+    changes++;
+}
+
+void WorldStreamer::cleanup()
+{
+    if (!scene) return;
+    for (auto& [key, entities] : loaded)
+        for (Entity entity : entities) {
+            scene->destroy(entity);
+            destroyed.push_back(entity);
+        }
+    for (Entity entity : globals) {
+        scene->destroy(entity);
+        destroyed.push_back(entity);
+    }
+    loaded.clear();
+    globals.clear();
+    instancesLoaded = lightsLoaded = 0;
+    changes++;
+}
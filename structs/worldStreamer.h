@@ -0,0 +1,51 @@
+#ifndef _WORLD_STREAMER_H_
+#define _WORLD_STREAMER_H_
+
+#include <map>
+#include <vector>
+#include "scene.h"
+
+struct WorldDatabase;
+struct GLTFModel;
+
+// Turns the placements of a world database into scene entities as terrain
+// tiles load, and destroys them again as the tiles unload, so the scene only
+// ever holds what is within the terrain's load distance. Global lights are
+// added once, up front.
+struct WorldStreamer
+{
+    struct ModelSlot {
+        GLTFModel* model = nullptr; // instances of models left null are skipped
+        int occluder = -1;          // OcclusionCuller mesh placed at each instance
+    };
+
+    std::vector<ModelSlot> models;  // by world model index
+
+    int changes = 0;                // bumped whenever entities come or go
+
+    // Entities made and destroyed since the caller last cleared these, so
+    // what depends on them can be updated piece by piece. Destroyed ones are
+    // gone from the scene already, and their indices may be in use again by
+    // entities made since.
+    std::vector<Entity> created;
+    std::vector<Entity> destroyed;
+    int instancesLoaded = 0;
+    int lightsLoaded = 0;
+
+    // models must be sized to the world's model table and filled in first
+    void initialise(const WorldDatabase& world, Scene& scene);
+
+    void tileLoaded(int x, int z);
+    void tileUnloaded(int x, int z);
+
+    // Destroys every entity it made
+    void cleanup();
+
+private:
+    const WorldDatabase* world = nullptr;
+    Scene* scene = nullptr;
+    std::vector<Entity> globals;
+    std::map<std::pair<int, int>, std::vector<Entity>> loaded;
+};
+
+#endif
@@ -0,0 +1,71 @@
+// Offline texture baker: decodes source images once and writes GPU-ready
+// .ltex containers next to them with the full mip chain, optionally BC1/BC3
+// (S3TC) compressed. LoadTextureTileBox and the glTF loader use a baked file
+// automatically when it exists.
+//
+//   texbake [--bc] <image> [<image>...]
+
+#include "textureBake.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static bool bakeFile(const char* sourcePath, bool compress)
+{
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(sourcePath, &width, &height, &channels, 0);
+    if (!pixels) {
+        std::cerr << "Failed to load texture " << sourcePath << std::endl;
+        return false;
+    }
+
+    // grey and grey+alpha images are expanded to RGB/RGBA
+    int outChannels = (channels == 2 || channels == 4) ? 4 : 3;
+    if (outChannels != channels) {
+        stbi_image_free(pixels);
+        pixels = stbi_load(sourcePath, &width, &height, &channels, outChannels);
+    }
+
+    std::vector<unsigned char> container;
+    bakeTexture(pixels, width, height, outChannels, compress, container);
+    stbi_image_free(pixels);
+
+    std::string outputPath = bakedTexturePath(sourcePath);
+    FILE* file = fopen(outputPath.c_str(), "wb");
+    if (!file || fwrite(container.data(), 1, container.size(), file) != container.size()) {
+        std::cerr << "Failed to write " << outputPath << std::endl;
+        if (file) fclose(file);
+        return false;
+    }
+    fclose(file);
+
+    std::cout << sourcePath << " -> " << outputPath << " (" << width << "x" << height
+              << ", " << container.size() / 1024 << " KB)" << std::endl;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    bool compress = false;
+    int failures = 0, inputs = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--bc") == 0) {
+            compress = true;
+            continue;
+        }
+        inputs++;
+        if (!bakeFile(argv[i], compress)) failures++;
+    }
+
+    if (inputs == 0) {
+        std::cerr << "usage: texbake [--bc] <image> [<image>...]" << std::endl;
+        return -1;
+    }
+    return failures == 0 ? 0 : -1;
+}
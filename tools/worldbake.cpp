@@ -0,0 +1,44 @@
+// Offline world baker: parses a text world (see assets/world.txt) and writes
+// the .lwld that WorldDatabase memory-maps next to it, so start-up neither
+// parses text nor buckets placements.
+//
+//   worldbake <world.txt> [<world.txt>...]
+
+#include "worldDatabase.h"
+
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+static bool bakeFile(const char* sourcePath)
+{
+    std::vector<unsigned char> baked;
+    if (!bakeWorld(sourcePath, baked)) return false;
+
+    std::string outputPath = bakedWorldPath(sourcePath);
+    FILE* file = fopen(outputPath.c_str(), "wb");
+    if (!file || fwrite(baked.data(), 1, baked.size(), file) != baked.size()) {
+        std::cerr << "Failed to write " << outputPath << std::endl;
+        if (file) fclose(file);
+        return false;
+    }
+    fclose(file);
+
+    const WorldHeader* header = reinterpret_cast<const WorldHeader*>(baked.data());
+    std::cout << sourcePath << " -> " << outputPath << " (" << header->tileCount << " tiles, "
+              << header->instanceCount << " instances, " << header->lightCount + header->globalLightCount << " lights)" << std::endl;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: worldbake <world.txt> [<world.txt>...]" << std::endl;
+        return -1;
+    }
+
+    int failures = 0;
+    for (int i = 1; i < argc; ++i)
+        if (!bakeFile(argv[i])) failures++;
+    return failures == 0 ? 0 : -1;
+}